@@ -87,11 +87,24 @@ FOUNDATION_EXPORT const unsigned char CocoaLumberjackVersionString[];
 #import <CocoaLumberjack/TMPASLLogger.h>
 #import <CocoaLumberjack/TMPFileLogger.h>
 #import <CocoaLumberjack/TMPOSLogger.h>
+#import <CocoaLumberjack/TMPLogRecordFraming.h>
+#import <CocoaLumberjack/TMPLogTimestampRenderer.h>
+#import <CocoaLumberjack/TMPLogFields.h>
+#import <CocoaLumberjack/TMPLogDiagnosticContext.h>
+#import <CocoaLumberjack/TMPLogRateLimiter.h>
+#import <CocoaLumberjack/TMPFlightRecorderLogger.h>
+#import <CocoaLumberjack/TMPMappedRingLogger.h>
+#import <CocoaLumberjack/TMPLogEmergency.h>
+#import <CocoaLumberjack/TMPLogMetrics.h>
+#import <CocoaLumberjack/TMPLogLatencyTracer.h>
+#import <CocoaLumberjack/TMPLogCallSiteProfiler.h>
 
 // Extensions
 #import <CocoaLumberjack/TMPContextFilterLogFormatter.h>
 #import <CocoaLumberjack/TMPDispatchQueueLogFormatter.h>
 #import <CocoaLumberjack/TMPMultiFormatter.h>
+#import <CocoaLumberjack/TMPPatternLogFormatter.h>
+#import <CocoaLumberjack/TMPJSONLogFormatter.h>
 #import <CocoaLumberjack/TMPFileLogger+Buffering.h>
 
 // CLI
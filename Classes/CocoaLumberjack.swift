@@ -72,6 +72,10 @@ public func resetDefaultDebugLevel() {
 /// If `true`, all logs (except errors) are logged asynchronously by default.
 public var asyncLoggingEnabled = true
 
+/// If `true`, threads running a debug sampled scope (see `TMPLogDiagnosticContext.sampled`) log every level.
+/// Off by default, as it adds a check of the sampled level to every message below the log level.
+public var sampledLoggingEnabled = false
+
 @inlinable
 public func _TMPLogMessage(_ message: @autoclosure () -> String,
                           level: TMPLogLevel,
@@ -82,10 +86,13 @@ public func _TMPLogMessage(_ message: @autoclosure () -> String,
                           line: UInt,
                           tag: Any?,
                           asynchronous: Bool,
-                          tmplog: TMPLog) {
+                          tmplog: TMPLog,
+                          fields: @autoclosure () -> TMPLogFields? = nil) {
     // The `dynamicLogLevel` will always be checked here (instead of being passed in).
     // We cannot "mix" it with the `TMPDefaultLogLevel`, because otherwise the compiler won't strip strings that are not logged.
-    if level.rawValue & flag.rawValue != 0 && dynamicLogLevel.rawValue & flag.rawValue != 0 {
+    // Threads running a debug sampled scope (see `TMPLogDiagnosticContext.sampled`) log every level, if enabled.
+    if (level.rawValue & flag.rawValue != 0 && dynamicLogLevel.rawValue & flag.rawValue != 0)
+        || (sampledLoggingEnabled && TMPLogDiagnosticContext.sampledLevel.rawValue & flag.rawValue != 0) {
         // Tell the TMPLogMessage constructor to copy the C strings that get passed to it.
         let logMessage = TMPLogMessage(message: message(),
                                       level: level,
@@ -96,8 +103,19 @@ public func _TMPLogMessage(_ message: @autoclosure () -> String,
                                       line: line,
                                       tag: tag,
                                       options: [.copyFile, .copyFunction],
-                                      timestamp: nil)
-        tmplog.log(asynchronous: asynchronous, message: logMessage)
+                                      timestamp: nil,
+                                      fields: fields())
+        // The literals' pointers tell the call site apart for the rate limiter and the call site profiler,
+        // like `__FILE__` in Objective-C.
+        // They are null terminated, like all the string literals.
+        if file.hasPointerRepresentation && function.hasPointerRepresentation {
+            tmplog.log(asynchronous: asynchronous,
+                       message: logMessage,
+                       file: UnsafeRawPointer(file.utf8Start).assumingMemoryBound(to: CChar.self),
+                       function: UnsafeRawPointer(function.utf8Start).assumingMemoryBound(to: CChar.self))
+        } else {
+            tmplog.log(asynchronous: asynchronous, message: logMessage)
+        }
     }
 }
 
@@ -109,9 +127,10 @@ public func TMPLogDebug(_ message: @autoclosure () -> String,
                        function: StaticString = #function,
                        line: UInt = #line,
                        tag: Any? = nil,
+                       fields: @autoclosure () -> TMPLogFields? = nil,
                        asynchronous async: Bool = asyncLoggingEnabled,
                        tmplog: TMPLog = .sharedInstance) {
-    _TMPLogMessage(message(), level: level, flag: .debug, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog)
+    _TMPLogMessage(message(), level: level, flag: .debug, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog, fields: fields())
 }
 
 @inlinable
@@ -122,9 +141,10 @@ public func TMPLogInfo(_ message: @autoclosure () -> String,
                       function: StaticString = #function,
                       line: UInt = #line,
                       tag: Any? = nil,
+                      fields: @autoclosure () -> TMPLogFields? = nil,
                       asynchronous async: Bool = asyncLoggingEnabled,
                       tmplog: TMPLog = .sharedInstance) {
-    _TMPLogMessage(message(), level: level, flag: .info, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog)
+    _TMPLogMessage(message(), level: level, flag: .info, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog, fields: fields())
 }
 
 @inlinable
@@ -135,9 +155,10 @@ public func TMPLogWarn(_ message: @autoclosure () -> String,
                       function: StaticString = #function,
                       line: UInt = #line,
                       tag: Any? = nil,
+                      fields: @autoclosure () -> TMPLogFields? = nil,
                       asynchronous async: Bool = asyncLoggingEnabled,
                       tmplog: TMPLog = .sharedInstance) {
-    _TMPLogMessage(message(), level: level, flag: .warning, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog)
+    _TMPLogMessage(message(), level: level, flag: .warning, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog, fields: fields())
 }
 
 @inlinable
@@ -148,9 +169,10 @@ public func TMPLogVerbose(_ message: @autoclosure () -> String,
                          function: StaticString = #function,
                          line: UInt = #line,
                          tag: Any? = nil,
+                         fields: @autoclosure () -> TMPLogFields? = nil,
                          asynchronous async: Bool = asyncLoggingEnabled,
                          tmplog: TMPLog = .sharedInstance) {
-    _TMPLogMessage(message(), level: level, flag: .verbose, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog)
+    _TMPLogMessage(message(), level: level, flag: .verbose, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog, fields: fields())
 }
 
 @inlinable
@@ -161,9 +183,10 @@ public func TMPLogError(_ message: @autoclosure () -> String,
                        function: StaticString = #function,
                        line: UInt = #line,
                        tag: Any? = nil,
+                       fields: @autoclosure () -> TMPLogFields? = nil,
                        asynchronous async: Bool = false,
                        tmplog: TMPLog = .sharedInstance) {
-    _TMPLogMessage(message(), level: level, flag: .error, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog)
+    _TMPLogMessage(message(), level: level, flag: .error, context: context, file: file, function: function, line: line, tag: tag, asynchronous: async, tmplog: tmplog, fields: fields())
 }
 
 /// Returns a String of the current filename, without full path or extension.
@@ -40,8 +40,14 @@
  * You can define multiple logging context's for use in your application.
  * For example, logically separate parts of your app each have a different logging context.
  * Also 3rd party frameworks that make use of Lumberjack generally use their own dedicated logging context.
+ *
+ * The formatter is also a `TMPLogFilter`. Prefer adding it to a logger as a filter
+ * (`[TMPLog addLogger:logger withLevel:TMPLogLevelAll filter:whitelist]`): filtered messages are then
+ * dropped before they are dispatched to the logger, instead of on the logger's queue.
+ *
+ * Looking up a context doesn't take a lock, so the whitelist can be changed while messages are being logged.
  **/
-@interface TMPContextWhitelistFilterLogFormatter : NSObject <TMPLogFormatter>
+@interface TMPContextWhitelistFilterLogFormatter : NSObject <TMPLogFormatter, TMPLogFilter>
 
 /**
  *  Designated default initializer
@@ -82,8 +88,10 @@
 
 /**
  * This class provides a log formatter that filters log statements from a logging context on the blacklist.
+ *
+ * Like the whitelist formatter, it can also be added to a logger as a `TMPLogFilter`.
  **/
-@interface TMPContextBlacklistFilterLogFormatter : NSObject <TMPLogFormatter>
+@interface TMPContextBlacklistFilterLogFormatter : NSObject <TMPLogFormatter, TMPLogFilter>
 
 - (instancetype)init NS_DESIGNATED_INITIALIZER;
 
@@ -15,6 +15,7 @@
 
 #import "TMPContextFilterLogFormatter.h"
 #import <pthread/pthread.h>
+#import <stdatomic.h>
 
 #if !__has_feature(objc_arc)
 #error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
@@ -76,6 +77,10 @@
     }
 }
 
+- (BOOL)shouldLogMessage:(TMPLogMessage *)logMessage {
+    return [_contextSet isInSet:logMessage->_context];
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -123,6 +128,10 @@
     }
 }
 
+- (BOOL)shouldLogMessage:(TMPLogMessage *)logMessage {
+    return ![_contextSet isInSet:logMessage->_context];
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -130,9 +139,30 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
+// Contexts in [0, kTMPSmallContextCount) are kept in a bitmap, all others in a hash table.
+#define kTMPSmallContextCount 256
+
+// Open addressing hash table of the contexts outside of the bitmap.
+// A table is never modified once published; 0 marks an empty slot (0 is always in the bitmap).
+typedef struct {
+    NSUInteger mask;
+    NSInteger slots[];
+} TMPLoggingContextTable;
+
+static inline NSUInteger TMPLoggingContextHash(NSInteger loggingContext) {
+    return (NSUInteger)(((uint64_t)loggingContext * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
 @interface TMPLoggingContextSet () {
     pthread_mutex_t _mutex;
-    NSMutableSet *_set;
+    NSMutableSet *_set; // Only access from within the mutex
+
+    // Copies of `_set` used by isInSet:, the bitmap without locking.
+    // The table of the large contexts is retained under `_largeContextsMutex`, held just long enough to replace
+    // or retain it, so that a replaced table is released by the last lookup using it.
+    _Atomic(uint64_t) _smallContexts[kTMPSmallContextCount / 64];
+    NSData *_largeContexts;
+    pthread_mutex_t _largeContextsMutex;
 }
 
 @end
@@ -144,6 +174,11 @@
     if ((self = [super init])) {
         _set = [[NSMutableSet alloc] init];
         pthread_mutex_init(&_mutex, NULL);
+        pthread_mutex_init(&_largeContextsMutex, NULL);
+
+        for (NSUInteger i = 0; i < kTMPSmallContextCount / 64; i++) {
+            atomic_init(&_smallContexts[i], 0);
+        }
     }
 
     return self;
@@ -151,12 +186,76 @@
 
 - (void)dealloc {
     pthread_mutex_destroy(&_mutex);
+    pthread_mutex_destroy(&_largeContextsMutex);
+}
+
+static inline BOOL TMPIsSmallLoggingContext(NSInteger loggingContext) {
+    return loggingContext >= 0 && loggingContext < kTMPSmallContextCount;
+}
+
+/**
+ * Must be called from within the mutex.
+ * Publishes a new table with the large contexts of `_set`.
+ **/
+- (void)publishLargeContexts {
+    NSUInteger count = 0;
+
+    for (NSNumber *context in _set) {
+        if (!TMPIsSmallLoggingContext(context.integerValue)) {
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        [self publishLargeContextsTable:nil];
+        return;
+    }
+
+    // At most half full, so that lookups always find an empty slot.
+    NSUInteger capacity = 8;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    NSMutableData *data = [NSMutableData dataWithLength:sizeof(TMPLoggingContextTable) + capacity * sizeof(NSInteger)];
+    TMPLoggingContextTable *table = data.mutableBytes;
+    table->mask = capacity - 1;
+
+    for (NSNumber *context in _set) {
+        NSInteger loggingContext = context.integerValue;
+
+        if (TMPIsSmallLoggingContext(loggingContext)) {
+            continue;
+        }
+
+        NSUInteger index = TMPLoggingContextHash(loggingContext) & table->mask;
+        while (table->slots[index] != 0) {
+            index = (index + 1) & table->mask;
+        }
+        table->slots[index] = loggingContext;
+    }
+
+    [self publishLargeContextsTable:data];
+}
+
+- (void)publishLargeContextsTable:(NSData *)data {
+    pthread_mutex_lock(&_largeContextsMutex);
+    {
+        _largeContexts = data;
+    }
+    pthread_mutex_unlock(&_largeContextsMutex);
 }
 
 - (void)addToSet:(NSInteger)loggingContext {
     pthread_mutex_lock(&_mutex);
     {
         [_set addObject:@(loggingContext)];
+
+        if (TMPIsSmallLoggingContext(loggingContext)) {
+            atomic_fetch_or_explicit(&_smallContexts[loggingContext / 64], 1ULL << (loggingContext % 64), memory_order_relaxed);
+        } else {
+            [self publishLargeContexts];
+        }
     }
     pthread_mutex_unlock(&_mutex);
 }
@@ -165,6 +264,12 @@
     pthread_mutex_lock(&_mutex);
     {
         [_set removeObject:@(loggingContext)];
+
+        if (TMPIsSmallLoggingContext(loggingContext)) {
+            atomic_fetch_and_explicit(&_smallContexts[loggingContext / 64], ~(1ULL << (loggingContext % 64)), memory_order_relaxed);
+        } else {
+            [self publishLargeContexts];
+        }
     }
     pthread_mutex_unlock(&_mutex);
 }
@@ -182,15 +287,36 @@
 }
 
 - (BOOL)isInSet:(NSInteger)loggingContext {
-    BOOL result = NO;
+    if (TMPIsSmallLoggingContext(loggingContext)) {
+        uint64_t bits = atomic_load_explicit(&_smallContexts[loggingContext / 64], memory_order_relaxed);
+        return (bits >> (loggingContext % 64)) & 1;
+    }
 
-    pthread_mutex_lock(&_mutex);
+    NSData *data;
+
+    pthread_mutex_lock(&_largeContextsMutex);
     {
-        result = [_set containsObject:@(loggingContext)];
+        data = _largeContexts;
     }
-    pthread_mutex_unlock(&_mutex);
+    pthread_mutex_unlock(&_largeContextsMutex);
 
-    return result;
+    if (data == nil) {
+        return NO;
+    }
+
+    const TMPLoggingContextTable *table = data.bytes;
+
+    for (NSUInteger index = TMPLoggingContextHash(loggingContext) & table->mask;; index = (index + 1) & table->mask) {
+        NSInteger slot = table->slots[index];
+
+        if (slot == loggingContext) {
+            return YES;
+        }
+
+        if (slot == 0) {
+            return NO;
+        }
+    }
 }
 
 @end
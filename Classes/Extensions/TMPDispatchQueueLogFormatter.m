@@ -14,8 +14,10 @@
 //   prior written permission of Deusty, LLC.
 
 #import "TMPDispatchQueueLogFormatter.h"
+#import <CocoaLumberjack/TMPLogTimestampRenderer.h>
 #import <pthread/pthread.h>
 #import <objc/runtime.h>
+#import <stdatomic.h>
 
 #if !__has_feature(objc_arc)
 #error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
@@ -23,17 +25,30 @@
 
 #pragma mark - TMPDispatchQueueLogFormatter
 
+// Maximum number of distinct labels kept in the label cache; a further label evicts one of them.
+static NSUInteger const kTMPLabelCacheCapacity = 128;
+
 @interface TMPDispatchQueueLogFormatter () {
     TMPDispatchQueueLogFormatterMode _mode;
     NSString *_dateFormatterKey;
     TMPAtomicCounter *_atomicLoggerCounter;
     NSDateFormatter *_threadUnsafeDateFormatter; // Use [self stringFromDate]
+    TMPLogTimestampRenderer *_timestampRenderer;  // nil if a subclass configures its own date formatter
     
     pthread_mutex_t _mutex;
     
-    NSUInteger _minQueueLength;           // _prefix == Only access via atomic property
-    NSUInteger _maxQueueLength;           // _prefix == Only access via atomic property
+    _Atomic(NSUInteger) _minQueueLength;  // _prefix == Only set from within spinlock, read without it
+    _Atomic(NSUInteger) _maxQueueLength;  // _prefix == Only set from within spinlock, read without it
     NSMutableDictionary *_replacements;   // _prefix == Only access from within spinlock
+
+    // Maps queue labels and thread names to the final (padded or truncated) label, or to NSNull for the root queues.
+    // Only access from within _labelCacheMutex, held just for a lookup or an update.
+    NSMutableDictionary *_labelCache;
+    pthread_mutex_t _labelCacheMutex;
+
+    BOOL _formatsToBuffer;                // NO if a subclass overrides formatLogMessage:
+    BOOL _padsThreadIDsToBuffer;          // NO if a subclass overrides queueThreadLabelForLogMessage:
+    BOOL _rendersTimestampToBuffer;       // NO if a subclass overrides stringFromDate:
 }
 
 @end
@@ -58,17 +73,36 @@
         // now `cls` is the class that provides implementation for `configureDateFormatter:`
         _dateFormatterKey = [NSString stringWithFormat:@"%s_NSDateFormatter", class_getName(cls)];
 
+        // The default date format doesn't need a NSDateFormatter per thread at all.
+        if (cls == [TMPDispatchQueueLogFormatter class]) {
+            _timestampRenderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:@"yyyy-MM-dd HH:mm:ss:SSS"];
+        }
+
         _atomicLoggerCounter = [[TMPAtomicCounter alloc] initWithDefaultValue:0];
         _threadUnsafeDateFormatter = nil;
 
-        _minQueueLength = 0;
-        _maxQueueLength = 0;
+        atomic_init(&_minQueueLength, 0);
+        atomic_init(&_maxQueueLength, 0);
         pthread_mutex_init(&_mutex, NULL);
         _replacements = [[NSMutableDictionary alloc] init];
 
         // Set default replacements:
 
         _replacements[@"com.apple.main-thread"] = @"main";
+
+        _labelCache = [[NSMutableDictionary alloc] init];
+        pthread_mutex_init(&_labelCacheMutex, NULL);
+
+        // Subclasses overriding formatLogMessage: expect to be in charge of the output.
+        SEL formatMethodName = @selector(formatLogMessage:);
+        _formatsToBuffer = [self methodForSelector:formatMethodName] == [TMPDispatchQueueLogFormatter instanceMethodForSelector:formatMethodName];
+
+        SEL labelMethodName = @selector(queueThreadLabelForLogMessage:);
+        _padsThreadIDsToBuffer = [self methodForSelector:labelMethodName] == [TMPDispatchQueueLogFormatter instanceMethodForSelector:labelMethodName];
+
+        SEL dateMethodName = @selector(stringFromDate:);
+        _rendersTimestampToBuffer = _timestampRenderer != nil &&
+            [self methodForSelector:dateMethodName] == [TMPDispatchQueueLogFormatter instanceMethodForSelector:dateMethodName];
     }
 
     return self;
@@ -83,14 +117,38 @@
 
 - (void)dealloc {
     pthread_mutex_destroy(&_mutex);
+    pthread_mutex_destroy(&_labelCacheMutex);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark Configuration
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-@synthesize minQueueLength = _minQueueLength;
-@synthesize maxQueueLength = _maxQueueLength;
+- (NSUInteger)minQueueLength {
+    return atomic_load_explicit(&_minQueueLength, memory_order_relaxed);
+}
+
+- (void)setMinQueueLength:(NSUInteger)minQueueLength {
+    pthread_mutex_lock(&_mutex);
+    {
+        atomic_store_explicit(&_minQueueLength, minQueueLength, memory_order_relaxed);
+        [self resetLabelCache];
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (NSUInteger)maxQueueLength {
+    return atomic_load_explicit(&_maxQueueLength, memory_order_relaxed);
+}
+
+- (void)setMaxQueueLength:(NSUInteger)maxQueueLength {
+    pthread_mutex_lock(&_mutex);
+    {
+        atomic_store_explicit(&_maxQueueLength, maxQueueLength, memory_order_relaxed);
+        [self resetLabelCache];
+    }
+    pthread_mutex_unlock(&_mutex);
+}
 
 - (NSString *)replacementStringForQueueLabel:(NSString *)longLabel {
     NSString *result = nil;
@@ -112,10 +170,132 @@
         } else {
             [_replacements removeObjectForKey:longLabel];
         }
+        [self resetLabelCache];
     }
     pthread_mutex_unlock(&_mutex);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Label Cache
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL TMPIsRootQueueLabel(NSString *label) {
+    // If you manually create a thread, it's dispatch_queue will have one of the thread names below.
+    // Since all such threads have the same name, we'd prefer to use the threadName or the machThreadID.
+    static NSSet *rootQueueLabels;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        rootQueueLabels = [NSSet setWithObjects:
+                           @"com.apple.root.low-priority",
+                           @"com.apple.root.default-priority",
+                           @"com.apple.root.high-priority",
+                           @"com.apple.root.low-overcommit-priority",
+                           @"com.apple.root.default-overcommit-priority",
+                           @"com.apple.root.high-overcommit-priority",
+                           @"com.apple.root.default-qos.overcommit",
+                           nil];
+    });
+
+    return [rootQueueLabels containsObject:label];
+}
+
+/**
+ * Must be called from within spinlock.
+ **/
+- (void)resetLabelCache {
+    pthread_mutex_lock(&_labelCacheMutex);
+    {
+        [_labelCache removeAllObjects];
+    }
+    pthread_mutex_unlock(&_labelCacheMutex);
+}
+
+/**
+ * Doesn't need the spinlock, the lengths are read atomically.
+ **/
+- (NSString *)labelByApplyingLengthLimits:(NSString *)label {
+    NSUInteger labelLength = [label length];
+    NSUInteger minQueueLength = atomic_load_explicit(&_minQueueLength, memory_order_relaxed);
+    NSUInteger maxQueueLength = atomic_load_explicit(&_maxQueueLength, memory_order_relaxed);
+
+    // labelLength > maxQueueLength : truncate
+    // labelLength < minQueueLength : padding
+    //                              : exact
+
+    if ((maxQueueLength > 0) && (labelLength > maxQueueLength)) {
+        return [label substringToIndex:maxQueueLength];
+    } else if (labelLength < minQueueLength) {
+        return [label stringByPaddingToLength:minQueueLength withString:@" " startingAtIndex:0];
+    } else {
+        return label;
+    }
+}
+
+/**
+ * Same as labelByApplyingLengthLimits:, straight into `buffer`, for the ASCII thread IDs.
+ **/
+- (void)appendThreadID:(NSString *)threadID toBuffer:(NSMutableData *)buffer {
+    NSUInteger start = buffer.length;
+    NSUInteger minQueueLength = atomic_load_explicit(&_minQueueLength, memory_order_relaxed);
+    NSUInteger maxQueueLength = atomic_load_explicit(&_maxQueueLength, memory_order_relaxed);
+
+    TMPLogBufferAppendString(buffer, threadID);
+
+    NSUInteger length = buffer.length - start;
+
+    if ((maxQueueLength > 0) && (length > maxQueueLength)) {
+        buffer.length = start + maxQueueLength;
+    } else if (length < minQueueLength) {
+        static const char spaces[32] = "                                ";
+
+        for (NSUInteger padding = minQueueLength - length; padding > 0;) {
+            NSUInteger chunk = MIN(padding, sizeof(spaces));
+            [buffer appendBytes:spaces length:chunk];
+            padding -= chunk;
+        }
+    }
+}
+
+/**
+ * Returns the final label for a queue label or thread name, or NSNull if `key` is the label of a root queue.
+ * Each distinct label is resolved once; afterwards this is a single lookup under the label cache mutex.
+ **/
+- (id)cachedLabelForKey:(NSString *)key {
+    id label;
+
+    pthread_mutex_lock(&_labelCacheMutex);
+    {
+        label = _labelCache[key];
+    }
+    pthread_mutex_unlock(&_labelCacheMutex);
+
+    if (label) {
+        return label;
+    }
+
+    // Resolved within spinlock, so that a concurrent configuration change can't leave a stale label in the cache
+    pthread_mutex_lock(&_mutex);
+    {
+        if (TMPIsRootQueueLabel(key)) {
+            label = [NSNull null];
+        } else {
+            label = [self labelByApplyingLengthLimits:(_replacements[key] ?: key)];
+        }
+
+        pthread_mutex_lock(&_labelCacheMutex);
+        {
+            if (_labelCache.count >= kTMPLabelCacheCapacity) {
+                [_labelCache removeObjectForKey:[_labelCache keyEnumerator].nextObject];
+            }
+            _labelCache[key] = label;
+        }
+        pthread_mutex_unlock(&_labelCacheMutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return label;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark TMPLogFormatter
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -137,6 +317,9 @@
 }
 
 - (NSString *)stringFromDate:(NSDate *)date {
+    if (_timestampRenderer) {
+        return [_timestampRenderer stringFromDate:date];
+    }
 
     NSDateFormatter *dateFormatter = nil;
     if (_mode == TMPDispatchQueueLogFormatterModeNonShareble) {
@@ -165,104 +348,77 @@
     return [dateFormatter stringFromDate:date];
 }
 
-- (NSString *)queueThreadLabelForLogMessage:(TMPLogMessage *)logMessage {
-    // As per the TMPLogFormatter contract, this method is always invoked on the same thread/dispatch_queue
-
-    NSUInteger minQueueLength = self.minQueueLength;
-    NSUInteger maxQueueLength = self.maxQueueLength;
-
-    // Get the name of the queue, thread, or machID (whichever we are to use).
-
-    NSString *queueThreadLabel = nil;
-
-    BOOL useQueueLabel = YES;
-    BOOL useThreadName = NO;
-
+/**
+ * The cached label of the queue or thread of `logMessage`, or nil if it's only known by its thread ID.
+ **/
+- (NSString *)cachedQueueThreadLabelForLogMessage:(TMPLogMessage *)logMessage {
     if (logMessage->_queueLabel) {
-        // If you manually create a thread, it's dispatch_queue will have one of the thread names below.
-        // Since all such threads have the same name, we'd prefer to use the threadName or the machThreadID.
-
-        NSArray *names = @[
-            @"com.apple.root.low-priority",
-            @"com.apple.root.default-priority",
-            @"com.apple.root.high-priority",
-            @"com.apple.root.low-overcommit-priority",
-            @"com.apple.root.default-overcommit-priority",
-            @"com.apple.root.high-overcommit-priority",
-            @"com.apple.root.default-qos.overcommit"
-        ];
-
-        for (NSString * name in names) {
-            if ([logMessage->_queueLabel isEqualToString:name]) {
-                useQueueLabel = NO;
-                useThreadName = [logMessage->_threadName length] > 0;
-                break;
-            }
+        id label = [self cachedLabelForKey:logMessage->_queueLabel];
+
+        if (label != [NSNull null]) {
+            return label;
         }
-    } else {
-        useQueueLabel = NO;
-        useThreadName = [logMessage->_threadName length] > 0;
     }
 
-    if (useQueueLabel || useThreadName) {
-        NSString *fullLabel;
-        NSString *abrvLabel;
+    if ([logMessage->_threadName length] > 0) {
+        id label = [self cachedLabelForKey:logMessage->_threadName];
 
-        if (useQueueLabel) {
-            fullLabel = logMessage->_queueLabel;
-        } else {
-            fullLabel = logMessage->_threadName;
+        if (label != [NSNull null]) {
+            return label;
         }
-
-        pthread_mutex_lock(&_mutex);
-        {
-            abrvLabel = _replacements[fullLabel];
-        }
-        pthread_mutex_unlock(&_mutex);
-
-        if (abrvLabel) {
-            queueThreadLabel = abrvLabel;
-        } else {
-            queueThreadLabel = fullLabel;
-        }
-    } else {
-        queueThreadLabel = logMessage->_threadID;
     }
 
-    // Now use the thread label in the output
-
-    NSUInteger labelLength = [queueThreadLabel length];
+    return nil;
+}
 
-    // labelLength > maxQueueLength : truncate
-    // labelLength < minQueueLength : padding
-    //                              : exact
+- (NSString *)queueThreadLabelForLogMessage:(TMPLogMessage *)logMessage {
+    // As per the TMPLogFormatter contract, this method is always invoked on the same thread/dispatch_queue
 
-    if ((maxQueueLength > 0) && (labelLength > maxQueueLength)) {
-        // Truncate
+    // Get the name of the queue, thread, or machID (whichever we are to use).
+    // Thread IDs are not cached, there is no bound to their number.
+    return [self cachedQueueThreadLabelForLogMessage:logMessage] ?: [self labelByApplyingLengthLimits:logMessage->_threadID];
+}
 
-        return [queueThreadLabel substringToIndex:maxQueueLength];
-    } else if (labelLength < minQueueLength) {
-        // Padding
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    NSString *timestamp = [self stringFromDate:(logMessage->_timestamp)];
+    NSString *queueThreadLabel = [self queueThreadLabelForLogMessage:logMessage];
 
-        NSUInteger numSpaces = minQueueLength - labelLength;
+    return [NSString stringWithFormat:@"%@ [%@] %@", timestamp, queueThreadLabel, logMessage->_message];
+}
 
-        char spaces[numSpaces + 1];
-        memset(spaces, ' ', numSpaces);
-        spaces[numSpaces] = '\0';
+- (BOOL)formatLogMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer {
+    if (!_formatsToBuffer) {
+        NSString *message = [self formatLogMessage:logMessage];
+        TMPLogBufferAppendString(buffer, message);
+        return message != nil;
+    }
 
-        return [NSString stringWithFormat:@"%@%s", queueThreadLabel, spaces];
+    if (_rendersTimestampToBuffer) {
+        [_timestampRenderer appendDate:(logMessage->_timestamp) toBuffer:buffer];
     } else {
-        // Exact
+        TMPLogBufferAppendString(buffer, [self stringFromDate:(logMessage->_timestamp)]);
+    }
+    [buffer appendBytes:" [" length:2];
+    if (_padsThreadIDsToBuffer) {
+        NSString *queueThreadLabel = [self cachedQueueThreadLabelForLogMessage:logMessage];
 
-        return queueThreadLabel;
+        if (queueThreadLabel) {
+            TMPLogBufferAppendString(buffer, queueThreadLabel);
+        } else {
+            [self appendThreadID:logMessage->_threadID toBuffer:buffer];
+        }
+    } else {
+        TMPLogBufferAppendString(buffer, [self queueThreadLabelForLogMessage:logMessage]);
     }
-}
+    [buffer appendBytes:"] " length:2];
+    TMPLogBufferAppendString(buffer, logMessage->_message);
 
-- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
-    NSString *timestamp = [self stringFromDate:(logMessage->_timestamp)];
-    NSString *queueThreadLabel = [self queueThreadLabelForLogMessage:logMessage];
+    return YES;
+}
 
-    return [NSString stringWithFormat:@"%@ [%@] %@", timestamp, queueThreadLabel, logMessage->_message];
+- (BOOL)isShareable {
+    // Subclasses overriding formatLogMessage: may depend on the logger's queue.
+    return _mode == TMPDispatchQueueLogFormatterModeShareble && _formatsToBuffer;
 }
 
 - (void)didAddToLogger:(id <TMPLogger>  __attribute__((unused)))logger {
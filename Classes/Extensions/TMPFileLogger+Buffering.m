@@ -15,7 +15,11 @@
 
 #import <CocoaLumberjack/TMPFileLogger+Internal.h>
 #import <CocoaLumberjack/TMPFileLogger+Buffering.h>
+#import <CocoaLumberjack/TMPLogEmergency.h>
+#import <CocoaLumberjack/TMPLogLatencyTracer.h>
+#import <CocoaLumberjack/TMPLogMessage+Internal.h>
 
+#import <stdatomic.h>
 #import <sys/mount.h>
 
 static const NSUInteger kTMPDefaultBufferSize = 4096; // 4 kB, block f_bsize on iphone7
@@ -59,28 +63,54 @@ static NSUInteger TMPGetDefaultBufferSizeBytes() {
     return defaultBufferSize;
 }
 
-@interface TMPBufferedProxy : NSProxy
+@interface TMPBufferedProxy : NSProxy <TMPFileLoggerFormattedDataWriter> {
+    // The pending bytes. Allocated once and never grown, so that the emergency drain
+    // can read them at any time: only their length is published, after every change.
+    uint8_t *_bytes;
+    NSUInteger _capacity;
+    _Atomic(size_t) _emergencyLength;
+
+    // The message being buffered, reused
+    NSMutableData *_formattingBuffer;
+}
 
 @property (nonatomic) TMPFileLogger *fileLogger;
-@property (nonatomic) NSOutputStream *buffer;
 
 @property (nonatomic) NSUInteger maxBufferSizeBytes;
 @property (nonatomic) NSUInteger currentBufferSizeBytes;
 
+// The traced messages in the buffer (see TMPLogLatencyTracer), written when it's sent
+@property (nonatomic) NSMutableArray<TMPLogMessage *> *tracedMessages;
+
 @end
 
+static void TMPBufferedProxyEmergencyDrain(void *context);
+
 @implementation TMPBufferedProxy
 
 - (instancetype)initWithFileLogger:(TMPFileLogger *)fileLogger {
     _fileLogger = fileLogger;
     _maxBufferSizeBytes = TMPGetDefaultBufferSizeBytes();
+
+    // Room for the largest maxBufferSizeBytes. The pages beyond the default size are only touched if it's raised.
+    _capacity = TMPGetMaxBufferSizeBytes();
+    _bytes = malloc(_capacity);
+    _formattingBuffer = [[NSMutableData alloc] initWithCapacity:1024];
+
+    _tracedMessages = [NSMutableArray array];
     [self flushBuffer];
 
+    TMPLogEmergencyAddDrain(TMPBufferedProxyEmergencyDrain, (__bridge void *)self);
+
     return self;
 }
 
 - (void)dealloc {
+    TMPLogEmergencyRemoveDrain(TMPBufferedProxyEmergencyDrain, (__bridge void *)self);
+
     dispatch_block_t block = ^{
+        // The traces are keyed by the proxy, which is going away
+        [self->_tracedMessages removeAllObjects];
         [self lt_sendBufferedDataToFileLogger];
         self.fileLogger = nil;
     };
@@ -90,39 +120,93 @@ static NSUInteger TMPGetDefaultBufferSizeBytes() {
     } else {
         dispatch_sync(self->_fileLogger.loggerQueue, block);
     }
+
+    free(_bytes);
 }
 
 #pragma mark - Buffering
 
 - (void)flushBuffer {
-    [_buffer close];
-    _buffer = [NSOutputStream outputStreamToMemory];
-    [_buffer open];
+    // The buffer is reused.
     _currentBufferSizeBytes = 0;
+    atomic_store_explicit(&_emergencyLength, 0, memory_order_release);
+}
+
+// Writes the pending bytes to the current log file at crash time, see TMPLogEmergency.h
+static void TMPBufferedProxyEmergencyDrain(void *context) {
+    __unsafe_unretained TMPBufferedProxy *proxy = (__bridge TMPBufferedProxy *)context;
+    __unsafe_unretained TMPFileLogger *fileLogger = proxy->_fileLogger;
+
+    size_t length = atomic_load_explicit(&proxy->_emergencyLength, memory_order_acquire);
+    int fd = fileLogger ? TMPFileLoggerEmergencyFileDescriptor(fileLogger) : -1;
+
+    if (length > 0 && fd >= 0) {
+        TMPLogEmergencyWriteBytes(fd, proxy->_bytes, length);
+    }
 }
 
 - (void)lt_sendBufferedDataToFileLogger {
-    NSData *data = [_buffer propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
-    [_fileLogger lt_logData:data];
+    if (_currentBufferSizeBytes > 0) {
+        [_fileLogger lt_logData:[NSData dataWithBytesNoCopy:_bytes length:_currentBufferSizeBytes freeWhenDone:NO]];
+    }
     [self flushBuffer];
+
+    for (TMPLogMessage *message in _tracedMessages) {
+        TMPLogLatencyTraceWritten(message, (id <TMPLogger>)self);
+    }
+    [_tracedMessages removeAllObjects];
 }
 
 #pragma mark - Logging
 
 - (void)logMessage:(TMPLogMessage *)logMessage {
-    NSData *data = [_fileLogger lt_dataForMessage:logMessage];
-    NSUInteger length = data.length;
-    if (length == 0) {
+    // The formatting workers append the message to the buffer later, see lt_writeFormattedData:tracedMessages:
+    if ([_fileLogger lt_submitMessageForFormatting:logMessage writer:self]) {
+        return;
+    }
+
+    _formattingBuffer.length = 0;
+
+    if (![_fileLogger lt_appendDataForMessage:logMessage toBuffer:_formattingBuffer]) {
+        return;
+    }
+
+    NSArray<TMPLogMessage *> *tracedMessages = nil;
+    if (logMessage->_latencyTrace) {
+        TMPLogLatencyTraceDeferred(logMessage, (id <TMPLogger>)self);
+        tracedMessages = @[ logMessage ];
+    }
+
+    [self lt_writeFormattedData:_formattingBuffer tracedMessages:tracedMessages];
+}
+
+- (void)lt_writeFormattedData:(NSData *)data tracedMessages:(NSArray<TMPLogMessage *> *)tracedMessages {
+    if (_currentBufferSizeBytes + data.length > _capacity) {
+        [self lt_sendBufferedDataToFileLogger];
+    }
+
+    if (data.length > _capacity) {
+        // Too large to be buffered
+        [_fileLogger lt_logData:data];
+
+        for (TMPLogMessage *message in tracedMessages) {
+            TMPLogLatencyTraceWritten(message, (id <TMPLogger>)self);
+        }
         return;
     }
 
-#ifndef DEBUG
-    __unused
-#endif
-    NSInteger written = [_buffer write:[data bytes] maxLength:length];
-    NSAssert(written == (NSInteger)length, @"Failed to write to memory buffer.");
+    memcpy(_bytes + _currentBufferSizeBytes, data.bytes, data.length);
+    _currentBufferSizeBytes += data.length;
+    atomic_store_explicit(&_emergencyLength, _currentBufferSizeBytes, memory_order_release);
+
+    if (tracedMessages) {
+        [_tracedMessages addObjectsFromArray:tracedMessages];
+    }
 
-    _currentBufferSizeBytes += length;
+    // The emergency drain writes to the current log file, make sure there is one
+    if (TMPFileLoggerEmergencyFileDescriptor(_fileLogger) < 0) {
+        [_fileLogger lt_currentLogFileHandle];
+    }
 
     if (_currentBufferSizeBytes >= _maxBufferSizeBytes) {
         [self lt_sendBufferedDataToFileLogger];
@@ -135,6 +219,7 @@ static NSUInteger TMPGetDefaultBufferSizeBytes() {
 
     dispatch_block_t block = ^{
         @autoreleasepool {
+            [self.fileLogger lt_finishFormatting];
             [self lt_sendBufferedDataToFileLogger];
             [self.fileLogger flush];
         }
@@ -146,7 +231,7 @@ static NSUInteger TMPGetDefaultBufferSizeBytes() {
     if ([self.fileLogger isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.fileLogger.globalLoggingQueue;
         NSAssert(![self.fileLogger isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_sync(globalLoggingQueue, ^{
@@ -0,0 +1,151 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * The fields written by `TMPJSONLogFormatter`, in the order they appear in the output.
+ **/
+typedef NS_OPTIONS(NSUInteger, TMPJSONLogField) {
+    /**
+     *  `"timestamp"`: local time with offset, `yyyy-MM-ddTHH:mm:ss.SSS+hh:mm`
+     */
+    TMPJSONLogFieldTimestamp  = (1 << 0),
+
+    /**
+     *  `"level"`: `ERROR`, `WARN`, `INFO`, `DEBUG` or `VERBOSE`
+     */
+    TMPJSONLogFieldLevel      = (1 << 1),
+
+    /**
+     *  `"context"`: number
+     */
+    TMPJSONLogFieldContext    = (1 << 2),
+
+    /**
+     *  `"file"`: file name (without extension)
+     */
+    TMPJSONLogFieldFile       = (1 << 3),
+
+    /**
+     *  `"function"`
+     */
+    TMPJSONLogFieldFunction   = (1 << 4),
+
+    /**
+     *  `"line"`: number
+     */
+    TMPJSONLogFieldLine       = (1 << 5),
+
+    /**
+     *  `"thread"`: thread ID, and `"threadName"` if the thread has a name
+     */
+    TMPJSONLogFieldThread     = (1 << 6),
+
+    /**
+     *  `"queue"`: dispatch queue label
+     */
+    TMPJSONLogFieldQueueLabel = (1 << 7),
+
+    /**
+     *  `"tag"`: description of the tag, if any
+     */
+    TMPJSONLogFieldTag        = (1 << 8),
+
+    /**
+     *  `"message"`
+     */
+    TMPJSONLogFieldMessage    = (1 << 9),
+
+    /**
+     *  `"fields"`: object holding the structured fields of the message (see `TMPLogFields`), if any.
+     *  Bytes are written as hexadecimal strings, and infinite or NaN doubles as `null`.
+     */
+    TMPJSONLogFieldFields     = (1 << 10),
+
+    /**
+     *  `"mdc"`: object holding the fields of the message's diagnostic context (see `TMPLogDiagnosticContext`), if any.
+     */
+    TMPJSONLogFieldDiagnosticContext = (1 << 11),
+
+    /**
+     *  All of the above
+     */
+    TMPJSONLogFieldAll        = 0xFFF
+};
+
+/**
+ * A log formatter writing each message as a single line JSON object (JSON lines / NDJSON), for example:
+ *
+ * `{"timestamp":"2019-05-01T10:15:30.250+02:00","level":"INFO","context":0,"file":"AppDelegate","line":42,"message":"Started"}`
+ *
+ * The object is written straight into the logger's byte buffer (see `formatLogMessage:toBuffer:`),
+ * without creating dictionaries or going through `NSJSONSerialization`.
+ * Strings are scanned 16 bytes at a time (SSE2 or NEON, 8 bytes at a time elsewhere) for the characters that need escaping,
+ * and are copied as they are unless one is found.
+ *
+ * The output never contains a newline, so every message is a single line; the loggers append the line terminator.
+ * Fields without a value (e.g. a message without tag) are left out.
+ *
+ * The formatter is immutable, so a single instance can safely be shared between any number of loggers.
+ **/
+@interface TMPJSONLogFormatter : NSObject <TMPLogFormatter>
+
+/**
+ *  Writes all fields, leaving non-ASCII characters unescaped.
+ */
+- (instancetype)init;
+
+/**
+ *  Writes the given fields, leaving non-ASCII characters unescaped.
+ */
+- (instancetype)initWithFields:(TMPJSONLogField)fields;
+
+/**
+ *  Designated initializer.
+ *
+ *  If `escapesNonASCII` is YES, all characters outside of ASCII are written as `\uXXXX` escapes
+ *  (surrogate pairs outside of the BMP), for consumers that can't handle UTF-8.
+ */
+- (instancetype)initWithFields:(TMPJSONLogField)fields escapingNonASCII:(BOOL)escapesNonASCII NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The fields written for each message.
+ **/
+@property (nonatomic, readonly) TMPJSONLogField fields;
+
+/**
+ * Whether characters outside of ASCII are escaped.
+ **/
+@property (nonatomic, readonly) BOOL escapesNonASCII;
+
+@end
+
+/**
+ * Appends `length` bytes of UTF-8 as a quoted JSON string, escaping quotes, backslashes and control characters
+ * (and all non-ASCII characters if `escapeNonASCII` is YES). Invalid UTF-8 is replaced by U+FFFD when escaping non-ASCII.
+ **/
+FOUNDATION_EXTERN void TMPJSONAppendQuotedString(NSMutableData *buffer, const char *bytes, NSUInteger length, BOOL escapeNonASCII);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,470 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPJSONLogFormatter.h"
+#import <CocoaLumberjack/TMPLogTimestampRenderer.h>
+#import <CocoaLumberjack/TMPLogFields.h>
+#import <CocoaLumberjack/TMPLogDiagnosticContext.h>
+
+#if defined(__SSE2__)
+    #import <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #import <arm_neon.h>
+#endif
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+static NSString * const kTMPJSONTimestampFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx";
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Escaping
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline BOOL TMPJSONNeedsEscaping(uint8_t c, BOOL escapeNonASCII) {
+    return c < 0x20 || c == '"' || c == '\\' || (escapeNonASCII && c >= 0x80);
+}
+
+// Returns the number of leading bytes that can be copied as they are.
+static NSUInteger TMPJSONSafePrefixLength(const uint8_t *bytes, NSUInteger length, BOOL escapeNonASCII) {
+    NSUInteger index = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i lastControl = _mm_set1_epi8(0x1F);
+
+    for (; index + 16 <= length; index += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(const void *)(bytes + index));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+
+        if (escapeNonASCII) {
+            // Signed comparison: bytes >= 0x80 are negative, so they are caught along with the control characters.
+            special = _mm_or_si128(special, _mm_cmplt_epi8(chunk, space));
+        } else {
+            // Unsigned `chunk <= 0x1F`
+            special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, lastControl), chunk));
+        }
+
+        int mask = _mm_movemask_epi8(special);
+
+        if (mask != 0) {
+            return index + (NSUInteger)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t space = vdupq_n_u8(' ');
+    const uint8x16_t nonASCII = vdupq_n_u8(0x80);
+
+    for (; index + 16 <= length; index += 16) {
+        uint8x16_t chunk = vld1q_u8(bytes + index);
+        uint8x16_t special = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        special = vorrq_u8(special, vcltq_u8(chunk, space));
+
+        if (escapeNonASCII) {
+            special = vorrq_u8(special, vcgeq_u8(chunk, nonASCII));
+        }
+
+        // Narrow every byte of the mask to a nibble, the lowest set nibble is the first special byte.
+        uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)), 0);
+
+        if (nibbles != 0) {
+            return index + (NSUInteger)(__builtin_ctzll(nibbles) >> 2);
+        }
+    }
+#else
+    // Eight bytes at a time, using the classic "has a byte less than n" bit tricks.
+    // They may flag bytes following a special byte, so the exact position is found by the loop below.
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highBits = 0x8080808080808080ULL;
+
+    for (; index + 8 <= length; index += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + index, sizeof(word));
+
+        uint64_t quotes = word ^ (ones * '"');
+        uint64_t backslashes = word ^ (ones * '\\');
+        uint64_t special = ((word - ones * 0x20) & ~word)
+                         | ((quotes - ones) & ~quotes)
+                         | ((backslashes - ones) & ~backslashes);
+
+        if (escapeNonASCII) {
+            special |= word;
+        }
+
+        if (special & highBits) {
+            break;
+        }
+    }
+#endif
+
+    for (; index < length; index++) {
+        if (TMPJSONNeedsEscaping(bytes[index], escapeNonASCII)) {
+            break;
+        }
+    }
+
+    return index;
+}
+
+static void TMPJSONAppendUnicodeEscape(NSMutableData *buffer, uint32_t unit) {
+    static const char hexDigits[] = "0123456789abcdef";
+    const char escape[6] = {
+        '\\', 'u',
+        hexDigits[(unit >> 12) & 0xF], hexDigits[(unit >> 8) & 0xF],
+        hexDigits[(unit >> 4) & 0xF], hexDigits[unit & 0xF]
+    };
+
+    [buffer appendBytes:escape length:sizeof(escape)];
+}
+
+// Decodes the UTF-8 sequence at `bytes`, returning the number of bytes consumed.
+// Invalid sequences decode to U+FFFD, consuming a single byte.
+static NSUInteger TMPJSONDecodeUTF8(const uint8_t *bytes, NSUInteger length, uint32_t *codePoint) {
+    uint8_t lead = bytes[0];
+    NSUInteger continuations;
+    uint32_t value;
+    uint32_t minimum;
+
+    if (lead >= 0xC0 && lead < 0xE0) {
+        continuations = 1;
+        value = lead & 0x1F;
+        minimum = 0x80;
+    } else if (lead >= 0xE0 && lead < 0xF0) {
+        continuations = 2;
+        value = lead & 0x0F;
+        minimum = 0x800;
+    } else if (lead >= 0xF0 && lead < 0xF8) {
+        continuations = 3;
+        value = lead & 0x07;
+        minimum = 0x10000;
+    } else {
+        goto invalid;
+    }
+
+    if (continuations >= length) {
+        goto invalid;
+    }
+
+    for (NSUInteger i = 1; i <= continuations; i++) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            goto invalid;
+        }
+
+        value = (value << 6) | (bytes[i] & 0x3F);
+    }
+
+    if (value < minimum || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+        goto invalid;
+    }
+
+    *codePoint = value;
+    return continuations + 1;
+
+invalid:
+    *codePoint = 0xFFFD;
+    return 1;
+}
+
+static void TMPJSONAppendEscapedBytes(NSMutableData *buffer, const uint8_t *bytes, NSUInteger length, BOOL escapeNonASCII) {
+    NSUInteger index = 0;
+
+    while (index < length) {
+        NSUInteger safeLength = TMPJSONSafePrefixLength(bytes + index, length - index, escapeNonASCII);
+
+        if (safeLength > 0) {
+            [buffer appendBytes:bytes + index length:safeLength];
+            index += safeLength;
+
+            if (index == length) {
+                break;
+            }
+        }
+
+        uint8_t c = bytes[index];
+
+        switch (c) {
+            case '"'  : [buffer appendBytes:"\\\"" length:2]; index++; break;
+            case '\\' : [buffer appendBytes:"\\\\" length:2]; index++; break;
+            case '\n' : [buffer appendBytes:"\\n" length:2]; index++; break;
+            case '\r' : [buffer appendBytes:"\\r" length:2]; index++; break;
+            case '\t' : [buffer appendBytes:"\\t" length:2]; index++; break;
+            case '\b' : [buffer appendBytes:"\\b" length:2]; index++; break;
+            case '\f' : [buffer appendBytes:"\\f" length:2]; index++; break;
+            default:
+                if (c < 0x20) {
+                    TMPJSONAppendUnicodeEscape(buffer, c);
+                    index++;
+                } else {
+                    uint32_t codePoint;
+                    index += TMPJSONDecodeUTF8(bytes + index, length - index, &codePoint);
+
+                    if (codePoint >= 0x10000) {
+                        codePoint -= 0x10000;
+                        TMPJSONAppendUnicodeEscape(buffer, 0xD800 + (codePoint >> 10));
+                        TMPJSONAppendUnicodeEscape(buffer, 0xDC00 + (codePoint & 0x3FF));
+                    } else {
+                        TMPJSONAppendUnicodeEscape(buffer, codePoint);
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void TMPJSONAppendQuotedString(NSMutableData *buffer, const char *bytes, NSUInteger length, BOOL escapeNonASCII) {
+    [buffer appendBytes:"\"" length:1];
+    TMPJSONAppendEscapedBytes(buffer, (const uint8_t *)bytes, length, escapeNonASCII);
+    [buffer appendBytes:"\"" length:1];
+}
+
+static void TMPJSONAppendString(NSMutableData *buffer, NSString *string, BOOL escapeNonASCII) {
+    [buffer appendBytes:"\"" length:1];
+
+    // The string is transcoded straight into the buffer and scanned there,
+    // so strings that need no escaping (almost all of them) are never copied.
+    NSUInteger start = buffer.length;
+    TMPLogBufferAppendString(buffer, string);
+
+    const uint8_t *bytes = (const uint8_t *)buffer.bytes + start;
+    NSUInteger length = buffer.length - start;
+    NSUInteger safeLength = TMPJSONSafePrefixLength(bytes, length, escapeNonASCII);
+
+    if (safeLength < length) {
+        // Move the rest out of the buffer, and write it back escaped.
+        NSData *rest = [[NSData alloc] initWithBytes:bytes + safeLength length:length - safeLength];
+        buffer.length = start + safeLength;
+        TMPJSONAppendEscapedBytes(buffer, rest.bytes, rest.length, escapeNonASCII);
+    }
+
+    [buffer appendBytes:"\"" length:1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Writing
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void TMPJSONAppendInteger(NSMutableData *buffer, long long value) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    [buffer appendBytes:p length:(NSUInteger)(end - p)];
+}
+
+static void TMPJSONAppendLevel(NSMutableData *buffer, TMPLogFlag flag) {
+    switch (flag) {
+        case TMPLogFlagError   : [buffer appendBytes:"\"ERROR\"" length:7]; break;
+        case TMPLogFlagWarning : [buffer appendBytes:"\"WARN\"" length:6]; break;
+        case TMPLogFlagInfo    : [buffer appendBytes:"\"INFO\"" length:6]; break;
+        case TMPLogFlagDebug   : [buffer appendBytes:"\"DEBUG\"" length:7]; break;
+        case TMPLogFlagVerbose : [buffer appendBytes:"\"VERBOSE\"" length:9]; break;
+        default                : TMPJSONAppendInteger(buffer, (long long)flag); break;
+    }
+}
+
+// Writes `"key":`, preceded by a comma unless it is the first member of the object.
+static inline void TMPJSONAppendKey(NSMutableData *buffer, const char *key, BOOL *first) {
+    if (!*first) {
+        [buffer appendBytes:"," length:1];
+    }
+
+    *first = NO;
+    [buffer appendBytes:key length:strlen(key)];
+}
+
+static void TMPJSONAppendFields(NSMutableData *buffer, TMPLogFields *fields, BOOL escapeNonASCII) {
+    NSUInteger count = fields.count;
+
+    [buffer appendBytes:"{" length:1];
+
+    for (NSUInteger i = 0; i < count; i++) {
+        TMPLogField field = [fields fieldAtIndex:i];
+
+        if (i > 0) {
+            [buffer appendBytes:"," length:1];
+        }
+
+        TMPJSONAppendQuotedString(buffer, field.key, strlen(field.key), escapeNonASCII);
+        [buffer appendBytes:":" length:1];
+
+        switch (field.type) {
+            case TMPLogFieldTypeString:
+                TMPJSONAppendQuotedString(buffer, field.value.data.bytes, field.value.data.length, escapeNonASCII);
+                break;
+            case TMPLogFieldTypeBytes:
+                [buffer appendBytes:"\"" length:1];
+                TMPLogFieldAppendHex(buffer, field.value.data.bytes, field.value.data.length);
+                [buffer appendBytes:"\"" length:1];
+                break;
+            case TMPLogFieldTypeDouble:
+                if (!isfinite(field.value.doubleValue)) {
+                    [buffer appendBytes:"null" length:4];
+                    break;
+                }
+                TMPLogFieldAppendScalar(buffer, &field);
+                break;
+            default:
+                TMPLogFieldAppendScalar(buffer, &field);
+                break;
+        }
+    }
+
+    [buffer appendBytes:"}" length:1];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPJSONLogFormatter () {
+    TMPLogTimestampRenderer *_timestampRenderer;
+}
+
+@end
+
+@implementation TMPJSONLogFormatter
+
+- (instancetype)init {
+    return [self initWithFields:TMPJSONLogFieldAll escapingNonASCII:NO];
+}
+
+- (instancetype)initWithFields:(TMPJSONLogField)fields {
+    return [self initWithFields:fields escapingNonASCII:NO];
+}
+
+- (instancetype)initWithFields:(TMPJSONLogField)fields escapingNonASCII:(BOOL)escapesNonASCII {
+    if ((self = [super init])) {
+        _fields = fields;
+        _escapesNonASCII = escapesNonASCII;
+        _timestampRenderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:kTMPJSONTimestampFormat];
+    }
+
+    return self;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogFormatter
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    NSMutableData *buffer = [[NSMutableData alloc] initWithCapacity:256];
+    [self formatLogMessage:logMessage toBuffer:buffer];
+
+    return [[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding];
+}
+
+- (BOOL)formatLogMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer {
+    TMPJSONLogField fields = _fields;
+    BOOL escapeNonASCII = _escapesNonASCII;
+    BOOL first = YES;
+
+    [buffer appendBytes:"{" length:1];
+
+    if (fields & TMPJSONLogFieldTimestamp) {
+        // The renderer only writes digits and separators, nothing to escape.
+        TMPJSONAppendKey(buffer, "\"timestamp\":\"", &first);
+        [_timestampRenderer appendDate:logMessage->_timestamp toBuffer:buffer];
+        [buffer appendBytes:"\"" length:1];
+    }
+
+    if (fields & TMPJSONLogFieldLevel) {
+        TMPJSONAppendKey(buffer, "\"level\":", &first);
+        TMPJSONAppendLevel(buffer, logMessage->_flag);
+    }
+
+    if (fields & TMPJSONLogFieldContext) {
+        TMPJSONAppendKey(buffer, "\"context\":", &first);
+        TMPJSONAppendInteger(buffer, (long long)logMessage->_context);
+    }
+
+    if ((fields & TMPJSONLogFieldFile) && logMessage->_fileName) {
+        TMPJSONAppendKey(buffer, "\"file\":", &first);
+        TMPJSONAppendString(buffer, logMessage->_fileName, escapeNonASCII);
+    }
+
+    if ((fields & TMPJSONLogFieldFunction) && logMessage->_function) {
+        TMPJSONAppendKey(buffer, "\"function\":", &first);
+        TMPJSONAppendString(buffer, logMessage->_function, escapeNonASCII);
+    }
+
+    if (fields & TMPJSONLogFieldLine) {
+        TMPJSONAppendKey(buffer, "\"line\":", &first);
+        TMPJSONAppendInteger(buffer, (long long)logMessage->_line);
+    }
+
+    if (fields & TMPJSONLogFieldThread) {
+        TMPJSONAppendKey(buffer, "\"thread\":", &first);
+        TMPJSONAppendString(buffer, logMessage->_threadID, escapeNonASCII);
+
+        if (logMessage->_threadName.length > 0) {
+            TMPJSONAppendKey(buffer, "\"threadName\":", &first);
+            TMPJSONAppendString(buffer, logMessage->_threadName, escapeNonASCII);
+        }
+    }
+
+    if ((fields & TMPJSONLogFieldQueueLabel) && logMessage->_queueLabel) {
+        TMPJSONAppendKey(buffer, "\"queue\":", &first);
+        TMPJSONAppendString(buffer, logMessage->_queueLabel, escapeNonASCII);
+    }
+
+    if ((fields & TMPJSONLogFieldTag) && logMessage->_tag) {
+        TMPJSONAppendKey(buffer, "\"tag\":", &first);
+        TMPJSONAppendString(buffer, [logMessage->_tag description], escapeNonASCII);
+    }
+
+    if (fields & TMPJSONLogFieldMessage) {
+        TMPJSONAppendKey(buffer, "\"message\":", &first);
+        TMPJSONAppendString(buffer, logMessage->_message, escapeNonASCII);
+    }
+
+    if ((fields & TMPJSONLogFieldFields) && logMessage->_fields.count > 0) {
+        TMPJSONAppendKey(buffer, "\"fields\":", &first);
+        TMPJSONAppendFields(buffer, logMessage->_fields, escapeNonASCII);
+    }
+
+    if (fields & TMPJSONLogFieldDiagnosticContext) {
+        TMPLogFields *contextFields = logMessage->_diagnosticContext.fields;
+
+        if (contextFields.count > 0) {
+            TMPJSONAppendKey(buffer, "\"mdc\":", &first);
+            TMPJSONAppendFields(buffer, contextFields, escapeNonASCII);
+        }
+    }
+
+    [buffer appendBytes:"}" length:1];
+
+    return YES;
+}
+
+- (BOOL)isShareable {
+    return YES;
+}
+
+@end
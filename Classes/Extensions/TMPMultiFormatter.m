@@ -15,18 +15,20 @@
 
 #import "TMPMultiFormatter.h"
 
+#import <pthread/pthread.h>
+
 #if !__has_feature(objc_arc)
 #error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
 #endif
 
 
 @interface TMPMultiFormatter () {
-    dispatch_queue_t _queue;
-    NSMutableArray *_formatters;
+    // Immutable NSArray of the chained formatters, replaced from within the mutex.
+    // Formatting only holds the mutex to retain it: a replaced array is released by the last message using it.
+    NSArray *_formatters;
+    pthread_mutex_t _mutex;
 }
 
-- (TMPLogMessage *)logMessageForLine:(NSString *)line originalMessage:(TMPLogMessage *)message;
-
 @end
 
 
@@ -36,77 +38,86 @@
     self = [super init];
 
     if (self) {
-        _queue = dispatch_queue_create("cocoa.lumberjack.multiformatter", DISPATCH_QUEUE_CONCURRENT);
-        _formatters = [NSMutableArray new];
+        _formatters = [NSArray array];
+        pthread_mutex_init(&_mutex, NULL);
     }
 
     return self;
 }
 
+- (void)dealloc {
+    pthread_mutex_destroy(&_mutex);
+}
+
 #pragma mark Processing
 
 - (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
-    __block NSString *line = logMessage->_message;
-
-    dispatch_sync(_queue, ^{
-        for (id<TMPLogFormatter> formatter in self->_formatters) {
-            TMPLogMessage *message = [self logMessageForLine:line originalMessage:logMessage];
-            line = [formatter formatLogMessage:message];
-
-            if (!line) {
-                break;
+    NSArray *formatters = self.formatters;
+    NSString *line = logMessage->_message;
+    TMPLogMessage *message = logMessage;
+
+    for (id<TMPLogFormatter> formatter in formatters) {
+        if (message->_message != line) {
+            // All stages after the first one see the output of the previous stage as message.
+            // A single copy is shared by the whole chain; only its message changes from stage to stage.
+            if (message == logMessage) {
+                message = [logMessage copy];
             }
+            message->_message = line;
         }
-    });
 
-    return line;
-}
+        line = [formatter formatLogMessage:message];
 
-- (TMPLogMessage *)logMessageForLine:(NSString *)line originalMessage:(TMPLogMessage *)message {
-    TMPLogMessage *newMessage = [message copy];
+        if (!line) {
+            break;
+        }
+    }
 
-    newMessage->_message = line;
-    return newMessage;
+    return line;
 }
 
 #pragma mark Formatters
 
 - (NSArray *)formatters {
-    __block NSArray *formatters;
+    NSArray *formatters;
 
-    dispatch_sync(_queue, ^{
-        formatters = [self->_formatters copy];
-    });
+    pthread_mutex_lock(&_mutex);
+    {
+        formatters = _formatters;
+    }
+    pthread_mutex_unlock(&_mutex);
 
     return formatters;
 }
 
 - (void)addFormatter:(id<TMPLogFormatter>)formatter {
-    dispatch_barrier_async(_queue, ^{
-        [self->_formatters addObject:formatter];
-    });
+    pthread_mutex_lock(&_mutex);
+    {
+        _formatters = [_formatters arrayByAddingObject:formatter];
+    }
+    pthread_mutex_unlock(&_mutex);
 }
 
 - (void)removeFormatter:(id<TMPLogFormatter>)formatter {
-    dispatch_barrier_async(_queue, ^{
-        [self->_formatters removeObject:formatter];
-    });
+    pthread_mutex_lock(&_mutex);
+    {
+        NSMutableArray *formatters = [_formatters mutableCopy];
+        [formatters removeObject:formatter];
+        _formatters = [formatters copy];
+    }
+    pthread_mutex_unlock(&_mutex);
 }
 
 - (void)removeAllFormatters {
-    dispatch_barrier_async(_queue, ^{
-        [self->_formatters removeAllObjects];
-    });
+    pthread_mutex_lock(&_mutex);
+    {
+        _formatters = [NSArray array];
+    }
+    pthread_mutex_unlock(&_mutex);
 }
 
 - (BOOL)isFormattingWithFormatter:(id<TMPLogFormatter>)formatter {
-    __block BOOL hasFormatter;
-
-    dispatch_sync(_queue, ^{
-        hasFormatter = [self->_formatters containsObject:formatter];
-    });
-
-    return hasFormatter;
+    return [self.formatters containsObject:formatter];
 }
 
 @end
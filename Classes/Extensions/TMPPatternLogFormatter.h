@@ -0,0 +1,86 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A log formatter driven by a log4j style layout pattern, for example:
+ *
+ * `%d{ISO8601} [%t] %-5p %F:%L %m`
+ *
+ * The pattern is compiled once, when the formatter is created, into a list of operations
+ * that write straight into the logger's byte buffer (see `formatLogMessage:toBuffer:`).
+ * No strings are created while formatting, and the formatter is immutable, so a single
+ * instance can safely be shared between any number of loggers.
+ *
+ * Conversions:
+ *
+ * | Conversion           | Output                                                           |
+ * |----------------------|------------------------------------------------------------------|
+ * | `%d`, `%d{DEFAULT}`  | local time, `yyyy-MM-dd HH:mm:ss.SSS`                            |
+ * | `%d{ISO8601}`        | local time with offset, `yyyy-MM-ddTHH:mm:ss.SSS+hh:mm`          |
+ * | `%d{ABSOLUTE}`       | local time of day, `HH:mm:ss.SSS`                                |
+ * | `%d{UNIX_MILLIS}`    | milliseconds since 1970                                          |
+ * | `%d{HH:mm:ss}`       | local time in a date format supported by `TMPLogTimestampRenderer` |
+ * | `%p`                 | level of the message (`ERROR`, `WARN`, `INFO`, `DEBUG`, `VERBOSE`) |
+ * | `%c`                 | context                                                          |
+ * | `%t`                 | thread name, or the thread ID if the thread has no name         |
+ * | `%T`                 | thread ID                                                        |
+ * | `%Q`                 | dispatch queue label                                             |
+ * | `%F`                 | file name (without extension)                                    |
+ * | `%M`                 | function                                                         |
+ * | `%L`                 | line number                                                      |
+ * | `%g`                 | description of the tag                                           |
+ * | `%m`                 | message                                                          |
+ * | `%X`                 | diagnostic context and fields of the message, as logfmt          |
+ * | `%X{key}`            | value of a single field, or of the diagnostic context            |
+ * | `%n`                 | newline                                                          |
+ * | `%%`                 | a single `%`                                                     |
+ *
+ * Every conversion may carry a format modifier between the `%` and the conversion character:
+ * `%5p` pads to a minimum of 5 characters (right aligned), `%-5p` pads on the right (left aligned),
+ * and `%.10Q` truncates to at most 10 characters. Both can be combined (`%-10.10Q`).
+ *
+ * Unknown conversions are written as they appear in the pattern.
+ **/
+@interface TMPPatternLogFormatter : NSObject <TMPLogFormatter>
+
+/**
+ * Unavailable, use `initWithPattern:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  Designated initializer, compiles the given layout pattern.
+ */
+- (instancetype)initWithPattern:(NSString *)pattern NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The layout pattern the formatter was created with.
+ **/
+@property (nonatomic, readonly, copy) NSString *pattern;
+
+@end
+
+NS_ASSUME_NONNULL_END
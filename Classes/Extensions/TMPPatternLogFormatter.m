@@ -0,0 +1,440 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPPatternLogFormatter.h"
+#import <CocoaLumberjack/TMPLogTimestampRenderer.h>
+#import <CocoaLumberjack/TMPLogFields.h>
+#import <CocoaLumberjack/TMPLogDiagnosticContext.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+typedef NS_ENUM(uint8_t, TMPPatternOperation) {
+    TMPPatternOperationLiteral,
+    TMPPatternOperationDate,
+    TMPPatternOperationLevel,
+    TMPPatternOperationContext,
+    TMPPatternOperationThreadName,
+    TMPPatternOperationThreadID,
+    TMPPatternOperationQueueLabel,
+    TMPPatternOperationFile,
+    TMPPatternOperationFunction,
+    TMPPatternOperationLine,
+    TMPPatternOperationTag,
+    TMPPatternOperationMessage,
+    TMPPatternOperationFields
+};
+
+typedef NS_ENUM(uint8_t, TMPPatternDateStyle) {
+    TMPPatternDateStyleRendered,  // Written by the timestamp renderer at rendererIndex
+    TMPPatternDateStyleUnixMillis
+};
+
+static NSString * const kTMPPatternDefaultDateFormat  = @"yyyy-MM-dd HH:mm:ss.SSS";
+static NSString * const kTMPPatternISO8601DateFormat  = @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx";
+static NSString * const kTMPPatternAbsoluteDateFormat = @"HH:mm:ss.SSS";
+
+typedef struct {
+    TMPPatternOperation operation;
+    TMPPatternDateStyle dateStyle;
+    BOOL leftAligned;
+    NSUInteger minWidth;
+    NSUInteger maxWidth;      // 0 == unlimited
+    NSUInteger literalOffset; // Used by TMPPatternOperationLiteral, and TMPPatternOperationFields for the NUL terminated key
+    NSUInteger literalLength; // 0 for TMPPatternOperationFields without key
+    NSUInteger rendererIndex; // Only used by TMPPatternOperationDate
+} TMPPatternOp;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Writing
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void TMPPatternAppendInteger(NSMutableData *buffer, long long value) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    [buffer appendBytes:p length:(NSUInteger)(end - p)];
+}
+
+static void TMPPatternAppendLevel(NSMutableData *buffer, TMPLogFlag flag) {
+    switch (flag) {
+        case TMPLogFlagError   : [buffer appendBytes:"ERROR" length:5]; break;
+        case TMPLogFlagWarning : [buffer appendBytes:"WARN" length:4]; break;
+        case TMPLogFlagInfo    : [buffer appendBytes:"INFO" length:4]; break;
+        case TMPLogFlagDebug   : [buffer appendBytes:"DEBUG" length:5]; break;
+        case TMPLogFlagVerbose : [buffer appendBytes:"VERBOSE" length:7]; break;
+        default                : TMPPatternAppendInteger(buffer, (long long)flag); break;
+    }
+}
+
+static void TMPPatternAppendSpaces(NSMutableData *buffer, NSUInteger count) {
+    static const char spaces[] = "                                ";
+
+    while (count > 0) {
+        NSUInteger chunk = MIN(count, sizeof(spaces) - 1);
+        [buffer appendBytes:spaces length:chunk];
+        count -= chunk;
+    }
+}
+
+// Truncates and pads the output of a single operation, which starts at `start`.
+// Widths are measured in characters, so multi-byte UTF-8 sequences are never split.
+static void TMPPatternApplyWidth(NSMutableData *buffer, NSUInteger start, const TMPPatternOp *op) {
+    const uint8_t *bytes = (const uint8_t *)buffer.bytes + start;
+    NSUInteger length = buffer.length - start;
+    NSUInteger characters = 0;
+    NSUInteger index = 0;
+
+    for (; index < length; index++) {
+        if ((bytes[index] & 0xC0) != 0x80) {
+            if (op->maxWidth > 0 && characters == op->maxWidth) {
+                break;
+            }
+
+            characters++;
+        }
+    }
+
+    if (index < length) {
+        buffer.length = start + index;
+    }
+
+    if (characters >= op->minWidth) {
+        return;
+    }
+
+    NSUInteger padding = op->minWidth - characters;
+
+    if (op->leftAligned) {
+        TMPPatternAppendSpaces(buffer, padding);
+    } else {
+        [buffer increaseLengthBy:padding];
+        uint8_t *mutableBytes = (uint8_t *)buffer.mutableBytes + start;
+        memmove(mutableBytes + padding, mutableBytes, index);
+        memset(mutableBytes, ' ', padding);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPPatternLogFormatter () {
+    NSMutableData *_operations;
+    NSMutableData *_literals;
+    NSMutableArray<TMPLogTimestampRenderer *> *_timestampRenderers;
+
+    // Raw pointers into the data objects above, which are never mutated after the pattern was compiled.
+    const TMPPatternOp *_ops;
+    NSUInteger _opCount;
+    const char *_literalBytes;
+}
+
+@end
+
+@implementation TMPPatternLogFormatter
+
+- (instancetype)initWithPattern:(NSString *)pattern {
+    NSParameterAssert(pattern);
+
+    if ((self = [super init])) {
+        _pattern = [pattern copy];
+        _operations = [NSMutableData data];
+        _literals = [NSMutableData data];
+        _timestampRenderers = [NSMutableArray array];
+
+        [self compilePattern];
+
+        _ops = _operations.bytes;
+        _opCount = _operations.length / sizeof(TMPPatternOp);
+        _literalBytes = _literals.bytes;
+    }
+
+    return self;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Compilation
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)addLiteral:(const char *)bytes length:(NSUInteger)length {
+    if (length == 0) {
+        return;
+    }
+
+    // Consecutive literals are merged into a single operation.
+    TMPPatternOp *last = _operations.length > 0 ? (TMPPatternOp *)_operations.mutableBytes + (_operations.length / sizeof(TMPPatternOp) - 1) : NULL;
+
+    if (last && last->operation == TMPPatternOperationLiteral && last->literalOffset + last->literalLength == _literals.length) {
+        last->literalLength += length;
+    } else {
+        TMPPatternOp op = {
+            .operation = TMPPatternOperationLiteral,
+            .literalOffset = _literals.length,
+            .literalLength = length
+        };
+        [_operations appendBytes:&op length:sizeof(op)];
+    }
+
+    [_literals appendBytes:bytes length:length];
+}
+
+- (TMPLogTimestampRenderer *)timestampRendererForDateFormat:(NSString *)dateFormat {
+    // Conversions using the same date format share the renderer (and its cache).
+    for (TMPLogTimestampRenderer *renderer in _timestampRenderers) {
+        if ([renderer.dateFormat isEqualToString:dateFormat]) {
+            return renderer;
+        }
+    }
+
+    TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:dateFormat];
+    if (renderer) {
+        [_timestampRenderers addObject:renderer];
+    }
+
+    return renderer;
+}
+
+- (void)compilePattern {
+    const char *pattern = _pattern.UTF8String ?: "";
+    size_t length = strlen(pattern);
+    size_t index = 0;
+
+    while (index < length) {
+        const char *percent = memchr(pattern + index, '%', length - index);
+
+        if (percent == NULL) {
+            [self addLiteral:pattern + index length:length - index];
+            break;
+        }
+
+        size_t conversionStart = (size_t)(percent - pattern);
+        [self addLiteral:pattern + index length:conversionStart - index];
+        index = conversionStart + 1;
+
+        if (index < length && pattern[index] == '%') {
+            [self addLiteral:"%" length:1];
+            index++;
+            continue;
+        }
+
+        TMPPatternOp op = { 0 };
+
+        // Format modifier: [-][minWidth][.maxWidth]
+        if (index < length && pattern[index] == '-') {
+            op.leftAligned = YES;
+            index++;
+        }
+
+        while (index < length && pattern[index] >= '0' && pattern[index] <= '9') {
+            op.minWidth = op.minWidth * 10 + (NSUInteger)(pattern[index++] - '0');
+        }
+
+        if (index < length && pattern[index] == '.') {
+            index++;
+
+            while (index < length && pattern[index] >= '0' && pattern[index] <= '9') {
+                op.maxWidth = op.maxWidth * 10 + (NSUInteger)(pattern[index++] - '0');
+            }
+        }
+
+        BOOL known = index < length;
+
+        if (known) {
+            switch (pattern[index++]) {
+                case 'd': op.operation = TMPPatternOperationDate;        break;
+                case 'p': op.operation = TMPPatternOperationLevel;       break;
+                case 'c': op.operation = TMPPatternOperationContext;     break;
+                case 't': op.operation = TMPPatternOperationThreadName;  break;
+                case 'T': op.operation = TMPPatternOperationThreadID;    break;
+                case 'Q': op.operation = TMPPatternOperationQueueLabel;  break;
+                case 'F': op.operation = TMPPatternOperationFile;        break;
+                case 'M': op.operation = TMPPatternOperationFunction;    break;
+                case 'L': op.operation = TMPPatternOperationLine;        break;
+                case 'g': op.operation = TMPPatternOperationTag;         break;
+                case 'm': op.operation = TMPPatternOperationMessage;     break;
+                case 'X': op.operation = TMPPatternOperationFields;      break;
+                case 'n':
+                    [self addLiteral:"\n" length:1];
+                    continue;
+                default:
+                    known = NO;
+                    break;
+            }
+        }
+
+        if (known && op.operation == TMPPatternOperationDate) {
+            NSString *dateFormat = kTMPPatternDefaultDateFormat;
+
+            if (index < length && pattern[index] == '{') {
+                const char *closing = memchr(pattern + index, '}', length - index);
+
+                if (closing) {
+                    NSString *style = [[NSString alloc] initWithBytes:pattern + index + 1
+                                                               length:(NSUInteger)(closing - pattern) - index - 1
+                                                             encoding:NSUTF8StringEncoding];
+
+                    if ([style isEqualToString:@"ISO8601"]) {
+                        dateFormat = kTMPPatternISO8601DateFormat;
+                    } else if ([style isEqualToString:@"ABSOLUTE"]) {
+                        dateFormat = kTMPPatternAbsoluteDateFormat;
+                    } else if ([style isEqualToString:@"UNIX_MILLIS"]) {
+                        dateFormat = nil;
+                        op.dateStyle = TMPPatternDateStyleUnixMillis;
+                    } else if (![style isEqualToString:@"DEFAULT"]) {
+                        dateFormat = style;
+                    }
+
+                    index = (size_t)(closing - pattern) + 1;
+                }
+            }
+
+            if (dateFormat) {
+                TMPLogTimestampRenderer *renderer = [self timestampRendererForDateFormat:dateFormat];
+                if (renderer) {
+                    op.dateStyle = TMPPatternDateStyleRendered;
+                    op.rendererIndex = [_timestampRenderers indexOfObjectIdenticalTo:renderer];
+                } else {
+                    known = NO;
+                }
+            }
+        }
+
+        if (known && op.operation == TMPPatternOperationFields && index < length && pattern[index] == '{') {
+            const char *closing = memchr(pattern + index, '}', length - index);
+
+            if (closing && closing > pattern + index + 1) {
+                // The key is stored with the literals, but isn't merged with them.
+                op.literalOffset = _literals.length;
+                op.literalLength = (NSUInteger)(closing - pattern) - index - 1;
+                [_literals appendBytes:pattern + index + 1 length:op.literalLength];
+                [_literals appendBytes:"" length:1];
+
+                index = (size_t)(closing - pattern) + 1;
+            }
+        }
+
+        if (known) {
+            [_operations appendBytes:&op length:sizeof(op)];
+        } else {
+            // Not something we understand, write it out as it is.
+            [self addLiteral:pattern + conversionStart length:index - conversionStart];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogFormatter
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    NSMutableData *buffer = [[NSMutableData alloc] initWithCapacity:256];
+    [self formatLogMessage:logMessage toBuffer:buffer];
+
+    return [[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding];
+}
+
+- (BOOL)formatLogMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer {
+    for (NSUInteger i = 0; i < _opCount; i++) {
+        const TMPPatternOp *op = &_ops[i];
+        NSUInteger start = buffer.length;
+
+        switch (op->operation) {
+            case TMPPatternOperationLiteral:
+                [buffer appendBytes:_literalBytes + op->literalOffset length:op->literalLength];
+                break;
+            case TMPPatternOperationDate:
+                if (op->dateStyle == TMPPatternDateStyleUnixMillis) {
+                    TMPPatternAppendInteger(buffer, (long long)floor([logMessage->_timestamp timeIntervalSince1970] * 1000.0));
+                } else {
+                    [_timestampRenderers[op->rendererIndex] appendDate:logMessage->_timestamp toBuffer:buffer];
+                }
+                break;
+            case TMPPatternOperationLevel:
+                TMPPatternAppendLevel(buffer, logMessage->_flag);
+                break;
+            case TMPPatternOperationContext:
+                TMPPatternAppendInteger(buffer, (long long)logMessage->_context);
+                break;
+            case TMPPatternOperationThreadName:
+                TMPLogBufferAppendString(buffer, logMessage->_threadName.length > 0 ? logMessage->_threadName : logMessage->_threadID);
+                break;
+            case TMPPatternOperationThreadID:
+                TMPLogBufferAppendString(buffer, logMessage->_threadID);
+                break;
+            case TMPPatternOperationQueueLabel:
+                TMPLogBufferAppendString(buffer, logMessage->_queueLabel);
+                break;
+            case TMPPatternOperationFile:
+                TMPLogBufferAppendString(buffer, logMessage->_fileName);
+                break;
+            case TMPPatternOperationFunction:
+                TMPLogBufferAppendString(buffer, logMessage->_function);
+                break;
+            case TMPPatternOperationLine:
+                TMPPatternAppendInteger(buffer, (long long)logMessage->_line);
+                break;
+            case TMPPatternOperationTag:
+                if (logMessage->_tag) {
+                    TMPLogBufferAppendString(buffer, [logMessage->_tag description]);
+                }
+                break;
+            case TMPPatternOperationMessage:
+                TMPLogBufferAppendString(buffer, logMessage->_message);
+                break;
+            case TMPPatternOperationFields:
+                if (op->literalLength == 0) {
+                    TMPLogMessageAppendFieldsLogfmt(buffer, logMessage);
+                } else {
+                    TMPLogField field;
+
+                    if (TMPLogMessageGetField(logMessage, &field, _literalBytes + op->literalOffset)) {
+                        if (field.type == TMPLogFieldTypeString) {
+                            [buffer appendBytes:field.value.data.bytes length:field.value.data.length];
+                        } else if (field.type == TMPLogFieldTypeBytes) {
+                            TMPLogFieldAppendHex(buffer, field.value.data.bytes, field.value.data.length);
+                        } else {
+                            TMPLogFieldAppendScalar(buffer, &field);
+                        }
+                    }
+                }
+                break;
+        }
+
+        if (op->minWidth > 0 || op->maxWidth > 0) {
+            TMPPatternApplyWidth(buffer, start, op);
+        }
+    }
+
+    return YES;
+}
+
+- (BOOL)isShareable {
+    return YES;
+}
+
+@end
@@ -210,7 +210,7 @@
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block NSUInteger result;
 
@@ -247,7 +247,7 @@
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -270,7 +270,7 @@
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block NSTimeInterval result;
 
@@ -338,7 +338,7 @@
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -361,7 +361,7 @@
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block NSTimeInterval result;
 
@@ -435,7 +435,7 @@
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -458,7 +458,7 @@
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block NSTimeInterval result;
 
@@ -525,7 +525,7 @@
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -548,7 +548,7 @@
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block BOOL result;
 
@@ -572,7 +572,7 @@
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -17,7 +17,16 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
-@interface TMPFileLogger (Internal)
+// Receives the bytes formatted by the formatting workers, see formattingWorkerCount
+@protocol TMPFileLoggerFormattedDataWriter <NSObject>
+
+// Called on the logger queue with the bytes of consecutive messages, in order.
+// `tracedMessages` are the messages among them traced by TMPLog.latencyTracer, nil if none.
+- (void)lt_writeFormattedData:(NSData *)data tracedMessages:(nullable NSArray<TMPLogMessage *> *)tracedMessages;
+
+@end
+
+@interface TMPFileLogger (Internal) <TMPFileLoggerFormattedDataWriter>
 
 - (void)logData:(NSData *)data;
 
@@ -26,6 +35,24 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (NSData *)lt_dataForMessage:(TMPLogMessage *)message;
 
+// Appends the bytes that would be written for the message to `buffer`.
+// Returns NO (and leaves the buffer untouched) if nothing should be written.
+- (BOOL)lt_appendDataForMessage:(TMPLogMessage *)message toBuffer:(NSMutableData *)buffer;
+
+// Opens the current log file if needed.
+- (NSFileHandle *)lt_currentLogFileHandle;
+
+// Hands the message to the formatting workers, which then pass its bytes to `writer`, if formattingWorkerCount
+// is above 1 and the formatter can be called from any thread. Otherwise returns NO, after writing the messages
+// the workers already have, and the caller formats the message itself.
+- (BOOL)lt_submitMessageForFormatting:(TMPLogMessage *)message writer:(id <TMPFileLoggerFormattedDataWriter>)writer;
+
+// Waits for the messages handed to the formatting workers, and writes them.
+- (void)lt_finishFormatting;
+
 @end
 
+// The descriptor of the current log file, -1 if none. Async-signal-safe.
+FOUNDATION_EXTERN int TMPFileLoggerEmergencyFileDescriptor(TMPFileLogger *fileLogger);
+
 NS_ASSUME_NONNULL_END
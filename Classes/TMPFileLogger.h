@@ -295,6 +295,9 @@ extern unsigned long long const kTMPDefaultLogFilesDiskQuota;
  *
  * In addition to the convenience of having a logical default formatter,
  * it will also provide a template that makes it easy for developers to copy and change.
+ *
+ * The diagnostic context (see `TMPLogDiagnosticContext`) and structured fields of the message (see `TMPLogFields`)
+ * are appended as logfmt after the message.
  **/
 @interface TMPLogFileFormatterDefault : NSObject <TMPLogFormatter>
 
@@ -418,6 +421,18 @@ extern unsigned long long const kTMPDefaultLogFilesDiskQuota;
  */
 @property (readwrite, assign, atomic) BOOL doNotReuseLogFiles;
 
+/**
+ * When set, log statements are written as length-prefixed, checksummed binary records
+ * (see `TMPLogRecordFraming.h`) instead of newline separated text.
+ * Use `TMPLogRecordReader` to read such log files.
+ *
+ * A record that was only partially written when the process went away is removed
+ * when logging resumes with the same log file.
+ *
+ * Set this property before the first message is logged. Default value is NO.
+ **/
+@property (readwrite, assign, atomic) BOOL usesRecordFraming;
+
 /**
  * The TMPLogFileManager instance can be used to retrieve the list of log files,
  * and configure the maximum number of archived log files to keep.
@@ -433,6 +448,19 @@ extern unsigned long long const kTMPDefaultLogFilesDiskQuota;
  **/
 @property (nonatomic, readwrite, assign) BOOL automaticallyAppendNewlineForCustomFormatters;
 
+/**
+ * Number of threads formatting messages in parallel. Default value is 0: messages are formatted on the logger queue.
+ *
+ * Above 1, `logMessage:` gives the message the next sequence number and hands it to one of the formatting workers.
+ * The formatted bytes go through a reorder buffer, and are written on the logger queue strictly in sequence order,
+ * so a CPU-heavy formatter no longer caps the throughput at one core. Up to 256 messages are in flight,
+ * `logMessage:` waits for the workers beyond that. `flush` waits for the messages in flight to be written.
+ *
+ * Only used with a shareable formatter (see `-[TMPLogFormatter isShareable]`), or without a formatter,
+ * as other formatters may not be called from several threads. Also applies through `wrapWithBuffer`.
+ **/
+@property (nonatomic, readwrite, assign) NSUInteger formattingWorkerCount;
+
 /**
  *  You can optionally force the current log file to be rolled with this method.
  *  CompletionBlock will be called on main queue.
@@ -16,7 +16,16 @@
 #import "TMPFileLogger.h"
 
 #import "TMPFileLogger+Internal.h"
-
+#import "TMPLogRecordFraming.h"
+#import "TMPLogTimestampRenderer.h"
+#import "TMPLogFields.h"
+#import "TMPLogDiagnosticContext.h"
+#import "TMPLogEmergency.h"
+#import "TMPLogLatencyTracer.h"
+#import "TMPLogMetrics.h"
+#import "TMPLogMessage+Internal.h"
+
+#import <stdatomic.h>
 #import <sys/xattr.h>
 
 #if !__has_feature(objc_arc)
@@ -561,6 +570,8 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
 
 @interface TMPLogFileFormatterDefault () {
     NSDateFormatter *_dateFormatter;
+    TMPLogTimestampRenderer *_timestampRenderer; // nil if a custom date formatter is used
+    BOOL _formatsToBuffer; // NO if a subclass overrides formatLogMessage:
 }
 
 @end
@@ -576,33 +587,78 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
         if (aDateFormatter) {
             _dateFormatter = aDateFormatter;
         } else {
-            _dateFormatter = [[NSDateFormatter alloc] init];
-            [_dateFormatter setFormatterBehavior:NSDateFormatterBehavior10_4]; // 10.4+ style
-            [_dateFormatter setDateFormat:@"yyyy/MM/dd HH:mm:ss:SSS"];
+            _timestampRenderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:@"yyyy/MM/dd HH:mm:ss:SSS"];
         }
+
+        SEL formatMethodName = @selector(formatLogMessage:);
+        _formatsToBuffer = [self methodForSelector:formatMethodName] == [TMPLogFileFormatterDefault instanceMethodForSelector:formatMethodName];
     }
 
     return self;
 }
 
 - (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
-    NSString *dateAndTime = [_dateFormatter stringFromDate:(logMessage->_timestamp)];
+    NSString *dateAndTime;
+    if (_timestampRenderer) {
+        dateAndTime = [_timestampRenderer stringFromDate:(logMessage->_timestamp)];
+    } else {
+        dateAndTime = [_dateFormatter stringFromDate:(logMessage->_timestamp)];
+    }
+
+    NSMutableData *fields = [NSMutableData data];
+    if (TMPLogMessageAppendFieldsLogfmt(fields, logMessage)) {
+        NSString *fieldsString = [[NSString alloc] initWithData:fields encoding:NSUTF8StringEncoding];
+        return [NSString stringWithFormat:@"%@  %@ %@", dateAndTime, logMessage->_message, fieldsString];
+    }
 
     return [NSString stringWithFormat:@"%@  %@", dateAndTime, logMessage->_message];
 }
 
+- (BOOL)formatLogMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer {
+    if (!_formatsToBuffer) {
+        NSString *message = [self formatLogMessage:logMessage];
+        TMPLogBufferAppendString(buffer, message);
+        return message != nil;
+    }
+
+    if (_timestampRenderer) {
+        [_timestampRenderer appendDate:(logMessage->_timestamp) toBuffer:buffer];
+    } else {
+        TMPLogBufferAppendString(buffer, [_dateFormatter stringFromDate:(logMessage->_timestamp)]);
+    }
+    [buffer appendBytes:"  " length:2];
+    TMPLogBufferAppendString(buffer, logMessage->_message);
+
+    if (logMessage->_fields.count > 0 || logMessage->_diagnosticContext.fields.count > 0) {
+        [buffer appendBytes:" " length:1];
+        TMPLogMessageAppendFieldsLogfmt(buffer, logMessage);
+    }
+
+    return YES;
+}
+
+- (BOOL)isShareable {
+    // NSDateFormatter is thread safe, but subclasses may not be.
+    return _formatsToBuffer;
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark -
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+@class TMPFileLoggerPipeline;
+
 @interface TMPFileLogger () {
     id <TMPLogFileManager> _logFileManager;
 
     TMPLogFileInfo *_currentLogFileInfo;
     NSFileHandle *_currentLogFileHandle;
 
+    // The descriptor of the current log file, registered for emergency logging, -1 if none
+    _Atomic(int) _emergencyFileDescriptor;
+
     dispatch_source_t _currentLogFileVnode;
 
     NSTimeInterval _rollingFrequency;
@@ -611,6 +667,270 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     unsigned long long _maximumFileSize;
 
     dispatch_queue_t _completionQueue;
+
+    NSMutableData *_formattingBuffer;
+
+    // Set when formattingWorkerCount is above 1
+    NSUInteger _formattingWorkerCount;
+    TMPFileLoggerPipeline *_formattingPipeline;
+}
+
+@end
+
+// Appends the bytes written for the message to `buffer`, returns NO (leaving the buffer untouched) if there are none.
+// Takes the logger's settings as arguments rather than reading them, as the formatting workers call it too.
+static BOOL TMPFileLoggerAppendData(TMPLogMessage *logMessage,
+                                    id <TMPLogFormatter> formatter,
+                                    BOOL usesRecordFraming,
+                                    BOOL automaticallyAppendsNewline,
+                                    NSMutableData *buffer) {
+    NSUInteger recordOffset = buffer.length;
+
+    if (usesRecordFraming) {
+        // Reserve room for the header, it's filled in once the payload length is known.
+        [buffer increaseLengthBy:kTMPLogRecordHeaderSize];
+    }
+
+    NSUInteger messageOffset = buffer.length;
+    BOOL isFormatted = NO;
+
+    if (!TMPLogFormatMessageToBuffer(formatter, logMessage, buffer, &isFormatted) || buffer.length == messageOffset) {
+        buffer.length = recordOffset;
+        return NO;
+    }
+
+    if (usesRecordFraming) {
+        // Records are delimited by their header, so there's no need for a trailing newline.
+        NSUInteger length = buffer.length - messageOffset;
+        NSAssert(length <= UINT32_MAX, @"Log message is too long to be framed.");
+
+        TMPLogRecordHeader header;
+        TMPLogRecordHeaderInit(&header, logMessage, (const uint8_t *)buffer.bytes + messageOffset, (uint32_t)length);
+        [buffer replaceBytesInRange:NSMakeRange(recordOffset, sizeof(header)) withBytes:&header];
+
+        return YES;
+    }
+
+    BOOL shouldFormat = !isFormatted || automaticallyAppendsNewline;
+    if (shouldFormat && ((const char *)buffer.bytes)[buffer.length - 1] != '\n') {
+        [buffer appendBytes:"\n" length:1];
+    }
+
+    return YES;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Formatting Pipeline
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Messages in flight in a pipeline, a power of 2
+static const NSUInteger kTMPFileLoggerPipelineCapacity = 256;
+
+// States of a pipeline slot
+static const NSUInteger kTMPFileLoggerPipelineSlotFree = 0;
+static const NSUInteger kTMPFileLoggerPipelineSlotFormatting = 1;
+static const NSUInteger kTMPFileLoggerPipelineSlotFormatted = 2;
+static const NSUInteger kTMPFileLoggerPipelineSlotSkipped = 3; // The formatter filtered the message
+
+// An entry of the reorder buffer.
+// Filled on the logger queue, formatted on a worker, then written and cleared on the logger queue:
+// the state is what hands it over from one to the other.
+@interface TMPFileLoggerPipelineSlot : NSObject {
+    @public
+    _Atomic(NSUInteger) _state;
+    __unsafe_unretained TMPFileLoggerPipeline *_pipeline;
+
+    // What the message is formatted with, copied from the logger: the workers don't read its ivars
+    TMPLogMessage *_message;
+    id <TMPLogFormatter> _formatter;
+    BOOL _usesRecordFraming;
+    BOOL _automaticallyAppendsNewline;
+
+    id <TMPFileLoggerFormattedDataWriter> _writer;
+    NSMutableData *_data; // Reused
+}
+
+@end
+
+@implementation TMPFileLoggerPipelineSlot
+
+@end
+
+// Formats messages on a set of serial worker queues, taken in turn, and writes them back in order on the logger queue.
+@interface TMPFileLoggerPipeline : NSObject {
+    @public
+    dispatch_queue_t _loggerQueue;
+    NSArray<dispatch_queue_t> *_workerQueues;
+    dispatch_group_t _formattingGroup;
+
+    // The reorder buffer, indexed by sequence number. Sequence numbers are only accessed on the logger queue.
+    NSArray<TMPFileLoggerPipelineSlot *> *_slots;
+    uint64_t _nextSequence;
+    uint64_t _nextSequenceToWrite;
+
+    _Atomic(BOOL) _writeScheduled;
+    NSMutableData *_writeBuffer;
+}
+
+- (instancetype)initWithLoggerQueue:(dispatch_queue_t)loggerQueue workerCount:(NSUInteger)workerCount;
+
+- (void)lt_submitMessage:(TMPLogMessage *)message
+               formatter:(nullable id <TMPLogFormatter>)formatter
+       usesRecordFraming:(BOOL)usesRecordFraming
+automaticallyAppendsNewline:(BOOL)automaticallyAppendsNewline
+                  writer:(id <TMPFileLoggerFormattedDataWriter>)writer;
+- (void)lt_writeFormattedMessages;
+- (void)lt_finish;
+
+@end
+
+static void TMPFileLoggerPipelineWrite(void *context) {
+    TMPFileLoggerPipeline *pipeline = CFBridgingRelease(context);
+
+    @autoreleasepool {
+        for (;;) {
+            [pipeline lt_writeFormattedMessages];
+            atomic_store(&pipeline->_writeScheduled, NO);
+
+            // A worker that finished the next message while we were writing may have seen the flag still set
+            TMPFileLoggerPipelineSlot *next = pipeline->_slots[pipeline->_nextSequenceToWrite & (kTMPFileLoggerPipelineCapacity - 1)];
+            BOOL nextIsFormatted = pipeline->_nextSequenceToWrite < pipeline->_nextSequence
+                                   && atomic_load(&next->_state) != kTMPFileLoggerPipelineSlotFormatting;
+
+            if (!nextIsFormatted || atomic_exchange(&pipeline->_writeScheduled, YES)) {
+                break;
+            }
+        }
+    }
+}
+
+static void TMPFileLoggerPipelineFormat(void *context) {
+    __unsafe_unretained TMPFileLoggerPipelineSlot *slot = (__bridge TMPFileLoggerPipelineSlot *)context;
+    __unsafe_unretained TMPFileLoggerPipeline *pipeline = slot->_pipeline;
+
+    @autoreleasepool {
+        slot->_data.length = 0;
+
+        BOOL formatted = TMPFileLoggerAppendData(slot->_message, slot->_formatter, slot->_usesRecordFraming, slot->_automaticallyAppendsNewline, slot->_data);
+        atomic_store(&slot->_state, formatted ? kTMPFileLoggerPipelineSlotFormatted : kTMPFileLoggerPipelineSlotSkipped);
+    }
+
+    // The pipeline can't go away before the formatting group is left, after we return
+    if (!atomic_exchange(&pipeline->_writeScheduled, YES)) {
+        dispatch_async_f(pipeline->_loggerQueue, (void *)CFBridgingRetain(pipeline), TMPFileLoggerPipelineWrite);
+    }
+}
+
+@implementation TMPFileLoggerPipeline
+
+- (instancetype)initWithLoggerQueue:(dispatch_queue_t)loggerQueue workerCount:(NSUInteger)workerCount {
+    if ((self = [super init])) {
+        _loggerQueue = loggerQueue;
+        _formattingGroup = dispatch_group_create();
+        _writeBuffer = [[NSMutableData alloc] initWithCapacity:4096];
+
+        NSMutableArray<dispatch_queue_t> *workerQueues = [NSMutableArray arrayWithCapacity:workerCount];
+        for (NSUInteger i = 0; i < workerCount; i++) {
+            [workerQueues addObject:dispatch_queue_create("cocoa.lumberjack.fileLogger.formatting", DISPATCH_QUEUE_SERIAL)];
+        }
+        _workerQueues = workerQueues;
+
+        NSMutableArray<TMPFileLoggerPipelineSlot *> *slots = [NSMutableArray arrayWithCapacity:kTMPFileLoggerPipelineCapacity];
+        for (NSUInteger i = 0; i < kTMPFileLoggerPipelineCapacity; i++) {
+            TMPFileLoggerPipelineSlot *slot = [TMPFileLoggerPipelineSlot new];
+            slot->_pipeline = self;
+            slot->_data = [[NSMutableData alloc] initWithCapacity:256];
+            [slots addObject:slot];
+        }
+        _slots = slots;
+    }
+    return self;
+}
+
+- (void)lt_submitMessage:(TMPLogMessage *)message
+               formatter:(nullable id <TMPLogFormatter>)formatter
+       usesRecordFraming:(BOOL)usesRecordFraming
+automaticallyAppendsNewline:(BOOL)automaticallyAppendsNewline
+                  writer:(id <TMPFileLoggerFormattedDataWriter>)writer {
+    if (_nextSequence - _nextSequenceToWrite == kTMPFileLoggerPipelineCapacity) {
+        // Full: the oldest messages may already be formatted, otherwise wait for the workers
+        [self lt_writeFormattedMessages];
+
+        if (_nextSequence - _nextSequenceToWrite == kTMPFileLoggerPipelineCapacity) {
+            [self lt_finish];
+        }
+    }
+
+    TMPFileLoggerPipelineSlot *slot = _slots[_nextSequence & (kTMPFileLoggerPipelineCapacity - 1)];
+    slot->_message = message;
+    slot->_formatter = formatter;
+    slot->_usesRecordFraming = usesRecordFraming;
+    slot->_automaticallyAppendsNewline = automaticallyAppendsNewline;
+    slot->_writer = writer;
+    atomic_store_explicit(&slot->_state, kTMPFileLoggerPipelineSlotFormatting, memory_order_relaxed);
+
+    if (message->_latencyTrace) {
+        TMPLogLatencyTraceDeferred(message, (id <TMPLogger>)writer);
+    }
+
+    // Submitting publishes the slot to the worker
+    dispatch_queue_t workerQueue = _workerQueues[_nextSequence % _workerQueues.count];
+    dispatch_group_async_f(_formattingGroup, workerQueue, (__bridge void *)slot, TMPFileLoggerPipelineFormat);
+
+    _nextSequence++;
+}
+
+- (void)lt_writeFormattedMessages {
+    // Consecutive messages of the same writer are written at once
+    id <TMPFileLoggerFormattedDataWriter> writer = nil;
+    NSMutableArray<TMPLogMessage *> *tracedMessages = nil;
+
+    while (_nextSequenceToWrite < _nextSequence) {
+        TMPFileLoggerPipelineSlot *slot = _slots[_nextSequenceToWrite & (kTMPFileLoggerPipelineCapacity - 1)];
+        NSUInteger state = atomic_load_explicit(&slot->_state, memory_order_acquire);
+
+        if (state == kTMPFileLoggerPipelineSlotFormatting) {
+            break;
+        }
+
+        if (slot->_writer != writer) {
+            if (writer && (_writeBuffer.length > 0 || tracedMessages)) {
+                [writer lt_writeFormattedData:_writeBuffer tracedMessages:tracedMessages];
+                _writeBuffer.length = 0;
+                tracedMessages = nil;
+            }
+            writer = slot->_writer;
+        }
+
+        if (state == kTMPFileLoggerPipelineSlotFormatted) {
+            [_writeBuffer appendData:slot->_data];
+        }
+
+        if (slot->_message->_latencyTrace) {
+            if (!tracedMessages) {
+                tracedMessages = [NSMutableArray array];
+            }
+            [tracedMessages addObject:slot->_message];
+        }
+
+        slot->_message = nil;
+        slot->_formatter = nil;
+        slot->_writer = nil;
+        atomic_store_explicit(&slot->_state, kTMPFileLoggerPipelineSlotFree, memory_order_relaxed);
+
+        _nextSequenceToWrite++;
+    }
+
+    if (writer && (_writeBuffer.length > 0 || tracedMessages)) {
+        [writer lt_writeFormattedData:_writeBuffer tracedMessages:tracedMessages];
+        _writeBuffer.length = 0;
+    }
+}
+
+- (void)lt_finish {
+    // The workers never wait for the logger queue
+    dispatch_group_wait(_formattingGroup, DISPATCH_TIME_FOREVER);
+    [self lt_writeFormattedMessages];
 }
 
 @end
@@ -640,6 +960,10 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
 
         _logFileManager = aLogFileManager;
         _logFormatter = [TMPLogFileFormatterDefault new];
+
+        _formattingBuffer = [[NSMutableData alloc] initWithCapacity:1024];
+
+        atomic_init(&_emergencyFileDescriptor, -1);
     }
 
     return self;
@@ -648,6 +972,8 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
 - (void)lt_cleanup {
     NSAssert([self isOnInternalLoggerQueue], @"lt_ methods should be on logger queue.");
 
+    [self lt_finishFormatting];
+    [self lt_unregisterEmergencyFileDescriptor];
     [_currentLogFileHandle synchronizeFile];
     [_currentLogFileHandle closeFile];
 
@@ -696,7 +1022,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_sync(globalLoggingQueue, ^{
         dispatch_sync(self.loggerQueue, block);
@@ -726,7 +1052,55 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
+
+    dispatch_async(globalLoggingQueue, ^{
+        dispatch_async(self.loggerQueue, block);
+    });
+}
+
+- (NSUInteger)formattingWorkerCount {
+    __block NSUInteger result;
+
+    dispatch_block_t block = ^{
+        result = self->_formattingWorkerCount;
+    };
+
+    // The design of this method is taken from the TMPAbstractLogger implementation.
+    // For extensive documentation please refer to the TMPAbstractLogger implementation.
+
+    NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
+    NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
+
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
+
+    dispatch_sync(globalLoggingQueue, ^{
+        dispatch_sync(self.loggerQueue, block);
+    });
+
+    return result;
+}
+
+- (void)setFormattingWorkerCount:(NSUInteger)formattingWorkerCount {
+    dispatch_block_t block = ^{
+        @autoreleasepool {
+            // The messages in flight are written by the pipeline that formatted them
+            [self lt_finishFormatting];
+
+            self->_formattingWorkerCount = formattingWorkerCount;
+            self->_formattingPipeline = formattingWorkerCount > 1
+                ? [[TMPFileLoggerPipeline alloc] initWithLoggerQueue:self.loggerQueue workerCount:formattingWorkerCount]
+                : nil;
+        }
+    };
+
+    // The design of this method is taken from the TMPAbstractLogger implementation.
+    // For extensive documentation please refer to the TMPAbstractLogger implementation.
+
+    NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
+    NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
+
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_async(globalLoggingQueue, ^{
         dispatch_async(self.loggerQueue, block);
@@ -753,7 +1127,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_sync(globalLoggingQueue, ^{
         dispatch_sync(self.loggerQueue, block);
@@ -783,7 +1157,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_async(globalLoggingQueue, ^{
         dispatch_async(self.loggerQueue, block);
@@ -847,6 +1221,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
 
     dispatch_block_t block = ^{
         @autoreleasepool {
+            [self lt_finishFormatting];
             [self lt_rollLogFileNow];
 
             if (completionBlock) {
@@ -863,7 +1238,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -880,6 +1255,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
         return;
     }
 
+    [self lt_unregisterEmergencyFileDescriptor];
     [_currentLogFileHandle synchronizeFile];
     [_currentLogFileHandle closeFile];
     _currentLogFileHandle = nil;
@@ -998,7 +1374,7 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
         info = [self lt_currentLogFileInfo];
     };
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_sync(globalLoggingQueue, ^{
         dispatch_sync(self->_loggerQueue, block);
@@ -1057,6 +1433,20 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
         return NO;
     }
 
+    // A record may have been torn when the app was terminated while writing it.
+    // Drop it, otherwise every record appended after it would be unreadable.
+    if (isResuming && _usesRecordFraming) {
+        NSError *error = nil;
+        unsigned long long removed = [TMPLogRecordReader truncateCorruptTailOfFileAtPath:logFileInfo.filePath error:&error];
+
+        if (error) {
+            NSLogError(@"TMPFileLogger: Failed to recover log file %@: %@", logFileInfo.fileName, error);
+        } else if (removed > 0) {
+            NSLogInfo(@"TMPFileLogger: Removed %llu bytes of a torn record from %@", removed, logFileInfo.fileName);
+            [logFileInfo reset];
+        }
+    }
+
     // All checks have passed. It's valid.
     return YES;
 }
@@ -1098,12 +1488,29 @@ unsigned long long const kTMPDefaultLogFilesDiskQuota   = 20 * 1024 * 1024; // 2
         if (_currentLogFileHandle) {
             [self lt_scheduleTimerToRollLogFileDueToAge];
             [self lt_monitorCurrentLogFileForExternalChanges];
+            [self lt_registerEmergencyFileDescriptor];
         }
     }
 
     return _currentLogFileHandle;
 }
 
+- (void)lt_registerEmergencyFileDescriptor {
+    int fd = _currentLogFileHandle.fileDescriptor;
+
+    if (TMPLogEmergencyAddFileDescriptor(fd, _usesRecordFraming)) {
+        atomic_store_explicit(&_emergencyFileDescriptor, fd, memory_order_release);
+    }
+}
+
+- (void)lt_unregisterEmergencyFileDescriptor {
+    int fd = atomic_exchange_explicit(&_emergencyFileDescriptor, -1, memory_order_acq_rel);
+
+    if (fd >= 0) {
+        TMPLogEmergencyRemoveFileDescriptor(fd);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark TMPLogger Protocol
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1113,24 +1520,17 @@ static int exception_count = 0;
 - (void)logMessage:(TMPLogMessage *)logMessage {
     NSAssert([self isOnInternalLoggerQueue], @"logMessage should only be executed on internal queue.");
 
-    NSString *message = logMessage->_message;
-    BOOL isFormatted = NO;
-
-    if (_logFormatter != nil) {
-        message = [_logFormatter formatLogMessage:logMessage];
-        isFormatted = message != logMessage->_message;
-    }
-
-    if (message.length == 0) {
+    if ([self lt_submitMessageForFormatting:logMessage writer:self]) {
         return;
     }
 
-    BOOL shouldFormat = !isFormatted || _automaticallyAppendNewlineForCustomFormatters;
-    if (shouldFormat && ![message hasSuffix:@"\n"]) {
-        message = [message stringByAppendingString:@"\n"];
-    }
+    // The buffer is reused for every message, it's written to the file before we return.
+    _formattingBuffer.length = 0;
 
-    [self lt_logData:[message dataUsingEncoding:NSUTF8StringEncoding]];
+    if ([self lt_appendDataForMessage:logMessage toBuffer:_formattingBuffer]) {
+        [self lt_logData:_formattingBuffer];
+        TMPLogLatencyTraceWritten(logMessage, self);
+    }
 }
 
 - (void)willLogMessage:(TMPLogFileInfo *)logFileInfo {
@@ -1146,6 +1546,7 @@ static int exception_count = 0;
 }
 
 - (void)willRemoveLogger {
+    [self lt_finishFormatting];
     [self lt_rollLogFileNow];
 }
 
@@ -1165,7 +1566,7 @@ static int exception_count = 0;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_sync(globalLoggingQueue, ^{
@@ -1176,6 +1577,7 @@ static int exception_count = 0;
 
 - (void)lt_flush {
     NSAssert([self isOnInternalLoggerQueue], @"flush should only be executed on internal queue.");
+    [self lt_finishFormatting];
     [_currentLogFileHandle synchronizeFile];
 }
 
@@ -1183,6 +1585,14 @@ static int exception_count = 0;
     return TMPLoggerNameFile;
 }
 
+int TMPFileLoggerEmergencyFileDescriptor(TMPFileLogger *fileLogger) {
+    return atomic_load_explicit(&fileLogger->_emergencyFileDescriptor, memory_order_acquire);
+}
+
+- (BOOL)reusesSharedFormattedOutput {
+    return YES;
+}
+
 @end
 
 @implementation TMPFileLogger (Internal)
@@ -1203,7 +1613,7 @@ static int exception_count = 0;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_sync(globalLoggingQueue, ^{
@@ -1258,6 +1668,7 @@ static int exception_count = 0;
         NSFileHandle *handle = [self lt_currentLogFileHandle];
         [handle seekToEndOfFile];
         [handle writeData:data];
+        TMPLogMetricsAddBytesWritten(data.length);
 
         if (implementsDeprecatedDidLog) {
 #pragma clang diagnostic push
@@ -1284,26 +1695,56 @@ static int exception_count = 0;
 - (NSData *)lt_dataForMessage:(TMPLogMessage *)logMessage {
     NSAssert([self isOnInternalLoggerQueue], @"logMessage should only be executed on internal queue.");
 
-    NSString *message = logMessage->_message;
-    BOOL isFormatted = NO;
+    NSMutableData *data = [NSMutableData data];
+    [self lt_appendDataForMessage:logMessage toBuffer:data];
 
-    if (_logFormatter != nil) {
-        message = [_logFormatter formatLogMessage:logMessage];
-        isFormatted = message != logMessage->_message;
-    }
+    return data;
+}
 
-    if (message.length == 0) {
-        return [NSData new];
+- (BOOL)lt_appendDataForMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer {
+    NSAssert([self isOnInternalLoggerQueue], @"logMessage should only be executed on internal queue.");
+
+    return TMPFileLoggerAppendData(logMessage, _logFormatter, _usesRecordFraming, _automaticallyAppendNewlineForCustomFormatters, buffer);
+}
+
+- (BOOL)lt_submitMessageForFormatting:(TMPLogMessage *)logMessage writer:(id <TMPFileLoggerFormattedDataWriter>)writer {
+    NSAssert([self isOnInternalLoggerQueue], @"logMessage should only be executed on internal queue.");
+
+    if (!_formattingPipeline) {
+        return NO;
     }
 
-    BOOL shouldFormat = !isFormatted || _automaticallyAppendNewlineForCustomFormatters;
-    if (shouldFormat && ![message hasSuffix:@"\n"]) {
-        message = [message stringByAppendingString:@"\n"];
+    id <TMPLogFormatter> formatter = _logFormatter;
+    if (formatter && !([formatter respondsToSelector:@selector(isShareable)] && [formatter isShareable])) {
+        // Formatted here, after the messages in flight
+        [_formattingPipeline lt_finish];
+        return NO;
     }
 
-    return [message dataUsingEncoding:NSUTF8StringEncoding];
+    [_formattingPipeline lt_submitMessage:logMessage
+                                formatter:formatter
+                        usesRecordFraming:_usesRecordFraming
+              automaticallyAppendsNewline:_automaticallyAppendNewlineForCustomFormatters
+                                   writer:writer];
+    return YES;
+}
+
+- (void)lt_finishFormatting {
+    NSAssert([self isOnInternalLoggerQueue], @"lt_ methods should be on logger queue.");
+    [_formattingPipeline lt_finish];
+}
+
+- (void)lt_writeFormattedData:(NSData *)data tracedMessages:(nullable NSArray<TMPLogMessage *> *)tracedMessages {
+    NSAssert([self isOnInternalLoggerQueue], @"lt_ methods should be on logger queue.");
+
+    [self lt_logData:data];
+
+    for (TMPLogMessage *message in tracedMessages) {
+        TMPLogLatencyTraceWritten(message, self);
+    }
 }
 
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
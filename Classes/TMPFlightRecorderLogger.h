@@ -0,0 +1,94 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A logger that keeps the most recent messages in memory, and writes nothing until something goes wrong.
+ *
+ * Add it with `TMPLogLevelAll` (or whatever level should be kept as history), and give it a `downstreamLogger`,
+ * typically a `TMPFileLogger` that is NOT added to `TMPLog` itself. Every message is recorded into a fixed size ring;
+ * when a message matching `triggerLevel` arrives (errors by default), or when `dump` is called,
+ * the recorded window, including the triggering message, is handed to the downstream logger, oldest first, and the ring is cleared.
+ *
+ * Messages are stored as framed records, the in-memory counterpart of `TMPLogRecordHeader`:
+ * a fixed size header (timestamp, context, flag) followed by the UTF-8 text and the metadata the downstream formatter
+ * may need (level, file, function, line, thread ID and name, queue label). Recording is a single copy into
+ * memory that was allocated once, on the logger queue (the only writer), so it doesn't take any lock.
+ * When the ring is full, the oldest records are dropped; a message larger than the whole ring is truncated.
+ *
+ * The downstream logger receives messages re-created from the records, with everything above but the tag,
+ * the fields and the diagnostic context. If the recorder has a formatter, its output is recorded as the text,
+ * and a downstream `TMPAbstractLogger` formatting with `TMPLogFormatMessageToBuffer` writes it as is instead of
+ * formatting it again; it's usually simpler to leave it unset and let the downstream logger format the messages.
+ *
+ * If the process crashes while `TMPLogInstallCrashHandler` is installed, the window is written out by the crash handler.
+ **/
+@interface TMPFlightRecorderLogger : TMPAbstractLogger <TMPLogger>
+
+/**
+ * Records into a ring of 256 KB.
+ */
+- (instancetype)init;
+
+/**
+ * Records into a ring of `capacity` bytes, allocated once. This is all the memory the recorder ever uses for messages.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Size of the ring in bytes.
+ **/
+@property (nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * The most messages kept at once, on top of the `capacity` limit. 0 (the default) means as many as fit.
+ **/
+@property (nonatomic, readwrite, assign) NSUInteger maximumNumberOfMessages;
+
+/**
+ * The messages that dump the recorded window when they arrive: a message is a trigger if its flag is part of this level.
+ * Defaults to `TMPLogLevelError`. `TMPLogLevelOff` only dumps when `dump` is called.
+ **/
+@property (nonatomic, readwrite, assign) TMPLogLevel triggerLevel;
+
+/**
+ * The logger the recorded window is dumped to. Its `logMessage:` and `flush` are invoked on its `loggerQueue`.
+ * Nothing is dumped (and the window is kept) while it's nil.
+ **/
+@property (nonatomic, readwrite, strong, nullable) id <TMPLogger> downstreamLogger;
+
+/**
+ * The number of messages currently recorded.
+ **/
+@property (nonatomic, readonly) NSUInteger numberOfRecordedMessages;
+
+/**
+ * Dumps the recorded window to the downstream logger, after the messages already logged were recorded.
+ **/
+- (void)dump;
+
+@end
+
+NS_ASSUME_NONNULL_END
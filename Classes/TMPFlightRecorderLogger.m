@@ -0,0 +1,553 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPFlightRecorderLogger.h"
+#import "TMPLogRecordFraming.h"
+#import "TMPLogEmergency.h"
+#import "TMPLogMessage+Internal.h"
+
+#import <objc/runtime.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+static const NSUInteger kTMPFlightRecorderDefaultCapacity = 256 * 1024;
+static const NSUInteger kTMPFlightRecorderMinimumCapacity = 1024;
+
+// Records start on 8 byte boundaries, so their headers can be accessed in place
+static const NSUInteger kTMPFlightRecorderAlignment = 8;
+
+// Magic of the record filling the end of the ring when the next record doesn't fit there.
+// If even its header doesn't fit, the end of the ring is skipped without one.
+static const uint32_t kTMPFlightRecorderPaddingMagic = 0;
+
+static inline NSUInteger TMPFlightRecorderAlign(NSUInteger length) {
+    return (length + kTMPFlightRecorderAlignment - 1) & ~(kTMPFlightRecorderAlignment - 1);
+}
+
+// The strings of a message kept after its text, for the formatter of the downstream logger
+typedef NS_ENUM(NSUInteger, TMPFlightRecorderString) {
+    TMPFlightRecorderStringFile,
+    TMPFlightRecorderStringFunction,
+    TMPFlightRecorderStringThreadID,
+    TMPFlightRecorderStringThreadName,
+    TMPFlightRecorderStringQueueLabel,
+    TMPFlightRecorderStringCount
+};
+
+// Follows the text of a record, unaligned, then the UTF-8 strings it has the lengths of.
+// In memory, the checksum field of the header holds the length of all this.
+typedef struct {
+    uint64_t line;
+    uint64_t level;
+    uint32_t isFormatted; // Whether the text is the output of the recorder's formatter
+    uint32_t stringLengths[TMPFlightRecorderStringCount];
+} TMPFlightRecorderMetadata;
+
+static inline NSUInteger TMPFlightRecorderRecordSize(const TMPLogRecordHeader *header) {
+    return TMPFlightRecorderAlign(kTMPLogRecordHeaderSize + header->length + header->checksum);
+}
+
+static void TMPFlightRecorderAppendMetadata(NSMutableData *buffer, TMPLogMessage *logMessage, BOOL isFormatted) {
+    NSString *strings[TMPFlightRecorderStringCount] = {
+        logMessage->_file,
+        logMessage->_function,
+        logMessage->_threadID,
+        logMessage->_threadName,
+        logMessage->_queueLabel
+    };
+    TMPFlightRecorderMetadata metadata = {
+        .line = logMessage->_line,
+        .level = logMessage->_level,
+        .isFormatted = isFormatted
+    };
+    NSUInteger offset = buffer.length;
+
+    [buffer increaseLengthBy:sizeof(metadata)];
+
+    for (NSUInteger i = 0; i < TMPFlightRecorderStringCount; i++) {
+        NSUInteger length = buffer.length;
+        TMPLogBufferAppendString(buffer, strings[i]);
+        metadata.stringLengths[i] = (uint32_t)(buffer.length - length);
+    }
+
+    memcpy((uint8_t *)buffer.mutableBytes + offset, &metadata, sizeof(metadata));
+}
+
+@interface TMPFlightRecorderLogger () {
+    uint8_t *_ring;
+    NSUInteger _capacity;
+
+    // Offset of the oldest record, offset the next record is written at,
+    // bytes in use (records, padding and skipped ends), and number of records
+    NSUInteger _head;
+    NSUInteger _tail;
+    NSUInteger _used;
+    NSUInteger _count;
+
+    NSUInteger _maximumNumberOfMessages;
+    TMPLogLevel _triggerLevel;
+    id <TMPLogger> _downstreamLogger;
+
+    NSMutableData *_formattingBuffer;
+}
+
+@end
+
+static void TMPFlightRecorderEmergencyDrain(void *context);
+
+@implementation TMPFlightRecorderLogger
+
+- (instancetype)init {
+    return [self initWithCapacity:kTMPFlightRecorderDefaultCapacity];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    if ((self = [super init])) {
+        _capacity = TMPFlightRecorderAlign(MAX(capacity, kTMPFlightRecorderMinimumCapacity));
+        _ring = malloc(_capacity);
+        _triggerLevel = TMPLogLevelError;
+        _formattingBuffer = [[NSMutableData alloc] initWithCapacity:1024];
+
+        TMPLogEmergencyAddDrain(TMPFlightRecorderEmergencyDrain, (__bridge void *)self);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    TMPLogEmergencyRemoveDrain(TMPFlightRecorderEmergencyDrain, (__bridge void *)self);
+    free(_ring);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Properties
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The design of these accessors is taken from the TMPAbstractLogger implementation.
+// For extensive documentation please refer to the TMPAbstractLogger implementation.
+// The internal implementation MUST access the variables directly.
+
+- (NSUInteger)capacity {
+    return _capacity;
+}
+
+- (NSUInteger)maximumNumberOfMessages {
+    __block NSUInteger result;
+
+    [self lt_performSync:^{
+        result = self->_maximumNumberOfMessages;
+    }];
+
+    return result;
+}
+
+- (void)setMaximumNumberOfMessages:(NSUInteger)maximumNumberOfMessages {
+    [self lt_performAsync:^{
+        self->_maximumNumberOfMessages = maximumNumberOfMessages;
+
+        while (maximumNumberOfMessages > 0 && self->_count > maximumNumberOfMessages) {
+            [self lt_removeOldestRecord];
+        }
+    }];
+}
+
+- (TMPLogLevel)triggerLevel {
+    __block TMPLogLevel result;
+
+    [self lt_performSync:^{
+        result = self->_triggerLevel;
+    }];
+
+    return result;
+}
+
+- (void)setTriggerLevel:(TMPLogLevel)triggerLevel {
+    [self lt_performAsync:^{
+        self->_triggerLevel = triggerLevel;
+    }];
+}
+
+- (id <TMPLogger>)downstreamLogger {
+    __block id <TMPLogger> result;
+
+    [self lt_performSync:^{
+        result = self->_downstreamLogger;
+    }];
+
+    return result;
+}
+
+- (void)setDownstreamLogger:(id <TMPLogger>)downstreamLogger {
+    [self lt_performAsync:^{
+        self->_downstreamLogger = downstreamLogger;
+    }];
+}
+
+- (NSUInteger)numberOfRecordedMessages {
+    __block NSUInteger result;
+
+    [self lt_performSync:^{
+        result = self->_count;
+    }];
+
+    return result;
+}
+
+- (void)dump {
+    [self lt_performAsync:^{
+        [self lt_dump];
+    }];
+}
+
+- (void)lt_performSync:(dispatch_block_t)block {
+    NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
+    NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
+
+    dispatch_sync(self.globalLoggingQueue, ^{
+        dispatch_sync(self.loggerQueue, block);
+    });
+}
+
+- (void)lt_performAsync:(dispatch_block_t)block {
+    NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
+    NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
+
+    // Going through the global logging queue orders the block after the messages logged so far
+    dispatch_async(self.globalLoggingQueue, ^{
+        dispatch_async(self.loggerQueue, ^{ @autoreleasepool {
+            block();
+        } });
+    });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Ring
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)lt_removeOldestRecord {
+    // Skip the padding and unused end of the ring, if any, up to the oldest record
+    while (_used > 0) {
+        NSUInteger remaining = _capacity - _head;
+
+        if (remaining < kTMPLogRecordHeaderSize) {
+            _used -= remaining;
+            _head = 0;
+            continue;
+        }
+
+        TMPLogRecordHeader *header = (TMPLogRecordHeader *)(_ring + _head);
+        NSUInteger size = TMPFlightRecorderRecordSize(header);
+
+        _used -= size;
+        _head = (_head + size == _capacity) ? 0 : _head + size;
+
+        if (header->magic != kTMPFlightRecorderPaddingMagic) {
+            _count--;
+            break;
+        }
+    }
+
+    if (_used == 0) {
+        _head = 0;
+        _tail = 0;
+    }
+}
+
+// `bytes` holds the text of the message, `textLength` bytes, followed by its metadata
+- (void)lt_recordMessage:(TMPLogMessage *)logMessage bytes:(const void *)bytes textLength:(NSUInteger)textLength length:(NSUInteger)length {
+    // Drop the metadata of what doesn't fit in the whole ring, and truncate the text on a character boundary
+    NSUInteger maximumLength = _capacity - kTMPLogRecordHeaderSize;
+
+    if (length > maximumLength) {
+        if (textLength > maximumLength) {
+            textLength = maximumLength;
+
+            while (textLength > 0 && (((const uint8_t *)bytes)[textLength] & 0xC0) == 0x80) {
+                textLength--;
+            }
+        }
+
+        length = textLength;
+    }
+
+    NSUInteger size = TMPFlightRecorderAlign(kTMPLogRecordHeaderSize + length);
+
+    while (_maximumNumberOfMessages > 0 && _count >= _maximumNumberOfMessages) {
+        [self lt_removeOldestRecord];
+    }
+
+    // Records are never split: if the record doesn't fit before the end of the ring, the end is padded
+    BOOL wraps = (_capacity - _tail < size);
+    NSUInteger needed = wraps ? (_capacity - _tail) + size : size;
+
+    while (_capacity - _used < needed) {
+        [self lt_removeOldestRecord];
+
+        if (_used == 0) {
+            wraps = NO;
+            needed = size;
+        }
+    }
+
+    if (wraps) {
+        NSUInteger remaining = _capacity - _tail;
+
+        if (remaining >= kTMPLogRecordHeaderSize) {
+            TMPLogRecordHeader *padding = (TMPLogRecordHeader *)(_ring + _tail);
+            padding->magic = kTMPFlightRecorderPaddingMagic;
+            padding->length = (uint32_t)(remaining - kTMPLogRecordHeaderSize);
+            padding->checksum = 0;
+        }
+
+        _used += remaining;
+        _tail = 0;
+    }
+
+    // The checksum isn't needed in memory, its field holds the length of the metadata instead.
+    // The header is only filled in the host byte order.
+    TMPLogRecordHeader *header = (TMPLogRecordHeader *)(_ring + _tail);
+    header->magic = kTMPLogRecordMagic;
+    header->length = (uint32_t)textLength;
+    header->timestamp = (int64_t)(logMessage->_timestamp.timeIntervalSince1970 * 1000000.0);
+    header->context = logMessage->_context;
+    header->flag = (uint32_t)logMessage->_flag;
+    header->checksum = (uint32_t)(length - textLength);
+    memcpy(_ring + _tail + kTMPLogRecordHeaderSize, bytes, length);
+
+    _used += size;
+    _tail = (_tail + size == _capacity) ? 0 : _tail + size;
+    _count++;
+}
+
+static NSString *TMPFlightRecorderStringFromBytes(const uint8_t *bytes, uint32_t length) {
+    if (length == 0) {
+        return nil;
+    }
+
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+// A message re-created from the record of `header`. If the text is formatted, it's also the message's shared output,
+// for the downstream logger to write it as is (see lt_dump).
+static TMPLogMessage *TMPFlightRecorderRecordedMessage(const TMPLogRecordHeader *header) {
+    const uint8_t *text = (const uint8_t *)header + kTMPLogRecordHeaderSize;
+    NSString *message = [[NSString alloc] initWithBytes:text length:header->length encoding:NSUTF8StringEncoding] ?: @"";
+    NSDate *timestamp = [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)header->timestamp / 1000000.0];
+
+    TMPFlightRecorderMetadata metadata = { .level = TMPLogLevelAll };
+    NSString *strings[TMPFlightRecorderStringCount] = { nil };
+
+    if (header->checksum >= sizeof(metadata)) {
+        const uint8_t *bytes = text + header->length;
+        memcpy(&metadata, bytes, sizeof(metadata));
+        bytes += sizeof(metadata);
+
+        for (NSUInteger i = 0; i < TMPFlightRecorderStringCount; i++) {
+            strings[i] = TMPFlightRecorderStringFromBytes(bytes, metadata.stringLengths[i]);
+            bytes += metadata.stringLengths[i];
+        }
+    }
+
+    TMPLogMessage *logMessage = [[TMPLogMessage alloc] initWithMessage:message
+                                                                 level:(TMPLogLevel)metadata.level
+                                                                  flag:(TMPLogFlag)header->flag
+                                                               context:(NSInteger)header->context
+                                                                  file:strings[TMPFlightRecorderStringFile] ?: @""
+                                                              function:strings[TMPFlightRecorderStringFunction]
+                                                                  line:(NSUInteger)metadata.line
+                                                                   tag:nil
+                                                               options:(TMPLogMessageOptions)0
+                                                             timestamp:timestamp];
+
+    // Of the thread that logged the message, not of the one dumping it
+    logMessage->_threadID = strings[TMPFlightRecorderStringThreadID] ?: @"";
+    logMessage->_threadName = strings[TMPFlightRecorderStringThreadName];
+    logMessage->_queueLabel = strings[TMPFlightRecorderStringQueueLabel];
+
+    if (metadata.isFormatted) {
+        logMessage->_sharedOutput = [NSData dataWithBytes:text length:header->length];
+        logMessage->_sharedOutputIsFormatted = YES;
+    }
+
+    return logMessage;
+}
+
+- (NSArray<TMPLogMessage *> *)lt_recordedMessages {
+    NSMutableArray<TMPLogMessage *> *messages = [NSMutableArray arrayWithCapacity:_count];
+    NSUInteger offset = _head;
+    NSUInteger used = _used;
+
+    while (used > 0) {
+        NSUInteger remaining = _capacity - offset;
+
+        if (remaining < kTMPLogRecordHeaderSize) {
+            used -= remaining;
+            offset = 0;
+            continue;
+        }
+
+        const TMPLogRecordHeader *header = (const TMPLogRecordHeader *)(_ring + offset);
+        NSUInteger size = TMPFlightRecorderRecordSize(header);
+
+        if (header->magic != kTMPFlightRecorderPaddingMagic) {
+            [messages addObject:TMPFlightRecorderRecordedMessage(header)];
+        }
+
+        used -= size;
+        offset = (offset + size == _capacity) ? 0 : offset + size;
+    }
+
+    return messages;
+}
+
+// Writes the recorded window at crash time, see TMPLogEmergency.h.
+// The ring may be in the middle of an update, so every offset is checked before it's used.
+static void TMPFlightRecorderEmergencyDrain(void *context) {
+    __unsafe_unretained TMPFlightRecorderLogger *logger = (__bridge TMPFlightRecorderLogger *)context;
+    NSUInteger capacity = logger->_capacity;
+    NSUInteger offset = logger->_head;
+    NSUInteger used = MIN(logger->_used, capacity);
+
+    while (used > 0 && offset < capacity) {
+        NSUInteger remaining = capacity - offset;
+
+        if (remaining < kTMPLogRecordHeaderSize) {
+            used -= MIN(used, remaining);
+            offset = 0;
+            continue;
+        }
+
+        const TMPLogRecordHeader *header = (const TMPLogRecordHeader *)(logger->_ring + offset);
+        NSUInteger size = TMPFlightRecorderRecordSize(header);
+
+        if (size > remaining || size > used) {
+            break;
+        }
+
+        if (header->magic == kTMPLogRecordMagic) {
+            TMPLogEmergencyWriteRecord(header->timestamp,
+                                       (NSInteger)header->context,
+                                       (TMPLogFlag)header->flag,
+                                       (const char *)header + kTMPLogRecordHeaderSize,
+                                       header->length);
+        }
+
+        used -= size;
+        offset = (offset + size == capacity) ? 0 : offset + size;
+    }
+}
+
+- (void)lt_dump {
+    id <TMPLogger> downstreamLogger = _downstreamLogger;
+
+    if (downstreamLogger == nil || _count == 0) {
+        return;
+    }
+
+    NSArray<TMPLogMessage *> *messages = [self lt_recordedMessages];
+
+    _head = 0;
+    _tail = 0;
+    _used = 0;
+    _count = 0;
+
+    dispatch_block_t block = ^{ @autoreleasepool {
+        // The text formatted by the recorder is written as is by the formatter of the downstream logger,
+        // instead of being formatted twice. Proxies are skipped, as they don't have a formatter of their own.
+        id <TMPLogFormatter> formatter = nil;
+
+        for (Class cls = object_getClass(downstreamLogger); cls; cls = class_getSuperclass(cls)) {
+            if (cls == [TMPAbstractLogger class]) {
+                formatter = ((TMPAbstractLogger *)downstreamLogger)->_logFormatter;
+                break;
+            }
+        }
+
+        for (TMPLogMessage *logMessage in messages) {
+            if (logMessage->_sharedOutput) {
+                logMessage->_sharedFormatter = formatter;
+            }
+            [downstreamLogger logMessage:logMessage];
+        }
+    } };
+
+    dispatch_queue_t queue = [downstreamLogger respondsToSelector:@selector(loggerQueue)] ? downstreamLogger.loggerQueue : NULL;
+
+    if (queue) {
+        dispatch_async(queue, block);
+    } else {
+        block();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogger
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (BOOL)reusesSharedFormattedOutput {
+    return YES;
+}
+
+- (BOOL)logsInline {
+    // Copying into the ring costs less than handing the message to another thread
+    return YES;
+}
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    // Without a formatter this is the UTF-8 text of the message, with one the formatted output,
+    // followed by the metadata of the message.
+    // The buffer is reused for every message since we're always running on our logger queue.
+    _formattingBuffer.length = 0;
+    BOOL isFormatted = NO;
+
+    if (!TMPLogFormatMessageToBuffer(_logFormatter, logMessage, _formattingBuffer, &isFormatted)) {
+        return;
+    }
+
+    NSUInteger textLength = _formattingBuffer.length;
+    TMPFlightRecorderAppendMetadata(_formattingBuffer, logMessage, isFormatted);
+
+    [self lt_recordMessage:logMessage bytes:_formattingBuffer.bytes textLength:textLength length:_formattingBuffer.length];
+
+    if (logMessage->_flag & _triggerLevel) {
+        [self lt_dump];
+    }
+}
+
+- (void)flush {
+    id <TMPLogger> downstreamLogger = _downstreamLogger;
+    dispatch_queue_t queue = [downstreamLogger respondsToSelector:@selector(loggerQueue)] ? downstreamLogger.loggerQueue : NULL;
+
+    // Waits for the dumps sent to the downstream logger
+    dispatch_block_t block = ^{ @autoreleasepool {
+        if ([downstreamLogger respondsToSelector:@selector(flush)]) {
+            [downstreamLogger flush];
+        }
+    } };
+
+    if (queue) {
+        dispatch_sync(queue, block);
+    } else {
+        block();
+    }
+}
+
+- (TMPLoggerName)loggerName {
+    return TMPLoggerNameFlightRecorder;
+}
+
+@end
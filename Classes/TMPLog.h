@@ -32,9 +32,17 @@
 #endif
 
 @class TMPLogMessage;
+@class TMPLogFields;
+@class TMPLogDiagnosticContext;
+@class TMPLogRateLimiter;
+@class TMPMappedRingLogger;
+@class TMPLogMetrics;
+@class TMPLogLatencyTracer;
+@class TMPLogCallSiteProfiler;
 @class TMPLoggerInformation;
 @protocol TMPLogger;
 @protocol TMPLogFormatter;
+@protocol TMPLogFilter;
 
 /**
  * Define the standard options.
@@ -218,11 +226,42 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
 @property (class, nonatomic, strong, readonly) TMPLog *sharedInstance;
 
 /**
- * Provides access to the underlying logging queue.
+ * Provides access to the underlying logging queue of the shared instance.
  * This may be helpful to Logger classes for things like thread synchronization.
  **/
 @property (class, nonatomic, DISPATCH_QUEUE_REFERENCE_TYPE, readonly) dispatch_queue_t loggingQueue;
 
+/**
+ * Same as `initWithMaximumQueueSize:qualityOfService:`, with `TMPLOG_MAX_QUEUE_SIZE` and no quality of service.
+ **/
+- (instancetype)init;
+
+/**
+ * Every `TMPLog` is an isolated pipeline: it has its own logging queue, dispatch group and backlog semaphore,
+ * so that the messages of an instance (used through `LOG_MACRO_TO_TMPLOG`) never wait behind those of another,
+ * and a slow logger only blocks the threads logging to its instance.
+ *
+ * @param maximumQueueSize  Number of messages queued before logging threads block, at least 1
+ *                          (see `TMPLOG_MAX_QUEUE_SIZE`, the size of the shared instance).
+ * @param qualityOfService  Quality of service of the logging queue, `QOS_CLASS_UNSPECIFIED` to inherit it from the logging threads.
+ *                          The workers of the logger pool (see `loggerPoolWidth`) run at this quality of service,
+ *                          or at `QOS_CLASS_DEFAULT` if unspecified.
+ *
+ * Logger properties are still set through the shared instance's queue (`TMPLog.loggingQueue`).
+ **/
+- (instancetype)initWithMaximumQueueSize:(NSUInteger)maximumQueueSize
+                        qualityOfService:(dispatch_qos_class_t)qualityOfService NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The queue all the messages of this instance go through.
+ **/
+@property (nonatomic, DISPATCH_QUEUE_REFERENCE_TYPE, readonly) dispatch_queue_t loggingQueue;
+
+/**
+ * Number of messages queued before logging threads block.
+ **/
+@property (nonatomic, readonly) NSUInteger maximumQueueSize;
+
 /**
  * Logging Primitive.
  *
@@ -275,6 +314,62 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
         tag:(id __nullable)tag
      format:(NSString *)format, ... NS_FORMAT_FUNCTION(9,10);
 
+/**
+ * Logging Primitive, attaching structured fields to the message.
+ *
+ * This method is used by the `...WithFields` macros.
+ * Similar to `log:level:flag:context:file:function:line:tag:format:...`
+ *
+ *  @param asynchronous YES if the logging is done async, NO if you want to force sync
+ *  @param level        the log level
+ *  @param flag         the log flag
+ *  @param context      the context (if any is defined)
+ *  @param file         the current file
+ *  @param function     the current function
+ *  @param line         the current code line
+ *  @param tag          potential tag
+ *  @param fields       the fields of the message (see `TMPLogFields`)
+ *  @param format       the log format
+ */
++ (void)log:(BOOL)asynchronous
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id __nullable)tag
+     fields:(TMPLogFields * __nullable)fields
+     format:(NSString *)format, ... NS_FORMAT_FUNCTION(10,11);
+
+/**
+ * Logging Primitive, attaching structured fields to the message.
+ *
+ * This method is used by the `...WithFields` macros.
+ * Similar to `log:level:flag:context:file:function:line:tag:format:...`
+ *
+ *  @param asynchronous YES if the logging is done async, NO if you want to force sync
+ *  @param level        the log level
+ *  @param flag         the log flag
+ *  @param context      the context (if any is defined)
+ *  @param file         the current file
+ *  @param function     the current function
+ *  @param line         the current code line
+ *  @param tag          potential tag
+ *  @param fields       the fields of the message (see `TMPLogFields`)
+ *  @param format       the log format
+ */
+- (void)log:(BOOL)asynchronous
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id __nullable)tag
+     fields:(TMPLogFields * __nullable)fields
+     format:(NSString *)format, ... NS_FORMAT_FUNCTION(10,11);
+
 /**
  * Logging Primitive.
  *
@@ -353,6 +448,40 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
 - (void)log:(BOOL)asynchronous
     message:(TMPLogMessage *)logMessage NS_SWIFT_NAME(log(asynchronous:message:));
 
+/**
+ * Logging Primitive.
+ *
+ * Same as `log:message:`, for callers that still have the `__FILE__` and `__FUNCTION__` pointers of the message's
+ * call site (or the Swift `#file` and `#function` literals): they tell the call site apart for the rate limiter
+ * and the call site profiler, without looking up the message's file name.
+ *
+ *  @param asynchronous YES if the logging is done async, NO if you want to force sync
+ *  @param logMessage   the log message stored in a `TMPLogMessage` model object
+ *  @param file         the file of the call site, a string literal that lives as long as the process
+ *  @param function     the function of the call site, a string literal as well
+ */
++ (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage
+       file:(const char *)file
+   function:(const char * __nullable)function NS_SWIFT_NAME(log(asynchronous:message:file:function:));
+
+/**
+ * Logging Primitive.
+ *
+ * Same as `log:message:`, for callers that still have the `__FILE__` and `__FUNCTION__` pointers of the message's
+ * call site (or the Swift `#file` and `#function` literals): they tell the call site apart for the rate limiter
+ * and the call site profiler, without looking up the message's file name.
+ *
+ *  @param asynchronous YES if the logging is done async, NO if you want to force sync
+ *  @param logMessage   the log message stored in a `TMPLogMessage` model object
+ *  @param file         the file of the call site, a string literal that lives as long as the process
+ *  @param function     the function of the call site, a string literal as well
+ */
+- (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage
+       file:(const char *)file
+   function:(const char * __nullable)function NS_SWIFT_NAME(log(asynchronous:message:file:function:));
+
 /**
  * Since logging can be asynchronous, there may be times when you want to flush the logs.
  * The framework invokes this automatically when the application quits.
@@ -465,6 +594,30 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
  **/
 - (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level;
 
+/**
+ * Adds the logger to the system, with a filter that decides which messages reach it.
+ *
+ * Like the level, the filter is a preemptive filter: it is evaluated on the global logging queue,
+ * before the message is dispatched to the logger's queue. Rejected messages never reach the logger
+ * (or its formatter), so they don't cost a dispatch to the logger queue.
+ *
+ * For example, to only send the messages of a single context to a logger:
+ *
+ * `TMPContextWhitelistFilterLogFormatter *filter = [TMPContextWhitelistFilterLogFormatter new];`
+ * `[filter addToWhitelist:MY_CONTEXT];`
+ * `[TMPLog addLogger:fileLogger withLevel:TMPLogLevelAll filter:filter];`
+ *
+ * Passing nil is equivalent to `addLogger:withLevel:`.
+ **/
++ (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level filter:(id <TMPLogFilter> __nullable)filter;
+
+/**
+ * Adds the logger to the system, with a filter that decides which messages reach it.
+ *
+ * See `+addLogger:withLevel:filter:`.
+ **/
+- (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level filter:(id <TMPLogFilter> __nullable)filter;
+
 /**
  *  Remove the logger from the system
  */
@@ -505,6 +658,102 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
  */
 @property (nonatomic, copy, readonly) NSArray<TMPLoggerInformation *> *allLoggersWithLevel;
 
+/**
+ * The rate limiter of the shared instance
+ **/
+@property (class, nonatomic, strong, nullable) TMPLogRateLimiter *rateLimiter;
+
+/**
+ * Limits how many messages each call site can log (see `TMPLogRateLimiter`), nil (the default) for no limit.
+ *
+ * Applies to all the messages logged to this `TMPLog`. The format primitives, and so the log macros, check it
+ * before the message is formatted. Messages passed as `TMPLogMessage` objects are told apart by their file name
+ * and line, unless their call site's pointers are passed as well (see `log:message:file:function:`).
+ * A limiter can only be installed on a single `TMPLog` at a time.
+ **/
+@property (nonatomic, strong, nullable) TMPLogRateLimiter *rateLimiter;
+
+/**
+ * The crash-persistent ring of the shared instance
+ **/
+@property (class, nonatomic, strong, nullable) TMPMappedRingLogger *mappedRingLogger;
+
+/**
+ * A ring that every message is written to on the thread logging it, before it's queued (see `TMPMappedRingLogger`),
+ * so it also holds the messages that were still queued when the process crashed. Nil by default.
+ *
+ * It receives all the messages reaching this `TMPLog`, after the rate limiter, regardless of the levels of the loggers.
+ **/
+@property (nonatomic, strong, nullable) TMPMappedRingLogger *mappedRingLogger;
+
+/**
+ * The metrics of the shared instance
+ **/
+@property (class, nonatomic, readonly) TMPLogMetrics *metrics;
+
+/**
+ * A snapshot of the logging pipeline (see `TMPLogMetrics`): messages enqueued, delivered and dropped,
+ * queue depth, time spent queued and blocked, and the time each logger spends in `logMessage:`.
+ * Waits for the logger list to be read on the logging queue, so don't call it from a logger.
+ **/
+@property (nonatomic, readonly) TMPLogMetrics *metrics;
+
+/**
+ * The latency tracer of the shared instance
+ **/
+@property (class, nonatomic, strong, nullable) TMPLogLatencyTracer *latencyTracer;
+
+/**
+ * Traces a sample of the messages from the moment they reach this `TMPLog` to the moment each logger wrote them
+ * (see `TMPLogLatencyTracer`). Nil (the default) traces nothing.
+ **/
+@property (nonatomic, strong, nullable) TMPLogLatencyTracer *latencyTracer;
+
+/**
+ * The call site profiler of the shared instance
+ **/
+@property (class, nonatomic, strong, nullable) TMPLogCallSiteProfiler *callSiteProfiler;
+
+/**
+ * Counts the messages and bytes logged by each call site (see `TMPLogCallSiteProfiler`), nil (the default) for none.
+ *
+ * Like the rate limiter, it applies to all the messages logged to this `TMPLog`, once they're allowed by the rate limiter.
+ * A profiler can only be installed on a single `TMPLog` at a time.
+ **/
+@property (nonatomic, strong, nullable) TMPLogCallSiteProfiler *callSiteProfiler;
+
+/**
+ * The logger pool width of the shared instance
+ **/
+@property (class, nonatomic, assign) NSUInteger loggerPoolWidth;
+
+/**
+ * Maximum number of threads delivering a message to the loggers, the logging thread included.
+ * Defaults to the number of processors, up to `TMPLOG_LOGGER_POOL_WIDTH`. 1 delivers on the logging thread only.
+ *
+ * The logging thread and up to `loggerPoolWidth - 1` workers take the loggers of a message in turn, until all of them
+ * got it, so the number of loggers no longer sets the number of threads woken up for every message.
+ * Each logger still receives the messages one at a time, in order, on its `loggerQueue`.
+ * Loggers returning YES from `-[TMPLogger logsInline]` are always run by the logging thread.
+ **/
+@property (nonatomic, assign) NSUInteger loggerPoolWidth;
+
+/**
+ * The inline logger threshold of the shared instance
+ **/
+@property (class, nonatomic, assign) NSTimeInterval inlineLoggerThreshold;
+
+/**
+ * Loggers spending less than this in `logMessage:`, in seconds, are run by the logging thread
+ * like the ones returning YES from `logsInline`, instead of paying for the hop to a worker of the logger pool.
+ * Defaults to `TMPLOG_INLINE_LOGGER_THRESHOLD` (5 µs), 0 disables it.
+ *
+ * The cost of each logger is a moving average of the durations of its `logMessage:` (weighing the last message 1/8),
+ * evaluated every 256 messages. A logger goes back to the pool above twice the threshold.
+ * `-[TMPLoggerMetrics averageCost]` and `runsInline` expose the averages and the decisions.
+ **/
+@property (nonatomic, assign) NSTimeInterval inlineLoggerThreshold;
+
 /**
  * Registered Dynamic Logging
  *
@@ -640,6 +889,13 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
  **/
 @property (copy, nonatomic, readonly) TMPLoggerName loggerName;
 
+/**
+ * Loggers whose `logMessage:` is cheap (an in-memory ring, a counter) can return YES, to always be run
+ * on the logging thread, still on their `loggerQueue`, instead of being handed to a worker of the logger pool
+ * (see `TMPLog.loggerPoolWidth`). Read when the logger is added.
+ **/
+@property (nonatomic, readonly) BOOL logsInline;
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -695,6 +951,76 @@ FOUNDATION_EXTERN NSString * __nullable TMPExtractFileNameWithoutExtension(const
  */
 - (void)willRemoveFromLogger:(id <TMPLogger>)logger;
 
+/**
+ * Byte oriented alternative to `formatLogMessage:`.
+ *
+ * Instead of returning a new string, the formatter appends the UTF-8 encoded output to `buffer`.
+ * The buffer is owned by the logger and reused for every message, so no intermediate strings
+ * or data objects need to be allocated. Loggers that write bytes (`TMPFileLogger`, `TMPTTYLogger`
+ * and the buffering extension) use this method when the formatter implements it.
+ *
+ * The buffer may already contain data. Only append to it, never modify existing bytes.
+ * Return NO to filter the message (anything appended is discarded by the caller),
+ * which is the equivalent of returning nil from `formatLogMessage:`.
+ *
+ * The output must be identical to the one of `formatLogMessage:`.
+ **/
+- (BOOL)formatLogMessage:(TMPLogMessage *)logMessage toBuffer:(NSMutableData *)buffer NS_SWIFT_NAME(format(message:to:));
+
+/**
+ * Return YES if the output of the formatter only depends on the log message (not on the logger it is added to),
+ * and the formatter may be invoked from any thread, including the global logging queue.
+ *
+ * When several loggers that support it (see `-[TMPAbstractLogger reusesSharedFormattedOutput]`) use the same
+ * shareable formatter, each message is formatted only once, on the global logging queue,
+ * and all of those loggers write the same bytes. Defaults to NO.
+ **/
+@property (nonatomic, readonly, getter=isShareable) BOOL shareable;
+
+@end
+
+/**
+ * Appends the UTF-8 representation of `string` to `buffer`, without creating an intermediate copy.
+ **/
+FOUNDATION_EXTERN void TMPLogBufferAppendString(NSMutableData *buffer, NSString * __nullable string);
+
+/**
+ * Formats `logMessage` with `formatter` and appends the UTF-8 encoded result to `buffer`.
+ *
+ * Uses `formatLogMessage:toBuffer:` if the formatter implements it and falls back to `formatLogMessage:` otherwise.
+ * If `formatter` is nil, the message itself is appended.
+ *
+ * Returns NO if the formatter filtered the message; `buffer` is left unchanged in that case.
+ * `isFormatted` is set to NO if the appended text is the unformatted message.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogFormatMessageToBuffer(id <TMPLogFormatter> __nullable formatter,
+                                                   TMPLogMessage *logMessage,
+                                                   NSMutableData *buffer,
+                                                   BOOL * __nullable isFormatted);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  This protocol describes a log filter
+ */
+@protocol TMPLogFilter <NSObject>
+@required
+
+/**
+ * Filters can be attached to a logger when it is added (see `+[TMPLog addLogger:withLevel:filter:]`).
+ * Unlike formatters, which run on the logger's queue, filters are evaluated on the global logging queue,
+ * before the message is dispatched to the logger.
+ *
+ * Return NO to keep the message from the logger.
+ *
+ * This method is invoked for every message that passes the logger's level, and it blocks the delivery
+ * to all loggers while it runs. Keep it fast, and don't block or log from it.
+ * A filter may be attached to several loggers, but it is always invoked on the global logging queue.
+ **/
+- (BOOL)shouldLogMessage:(TMPLogMessage *)logMessage NS_SWIFT_NAME(shouldLog(message:));
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -781,6 +1107,8 @@ typedef NS_OPTIONS(NSInteger, TMPLogMessageOptions){
     NSString *_threadID;
     NSString *_threadName;
     NSString *_queueLabel;
+    TMPLogFields *_fields;
+    TMPLogDiagnosticContext *_diagnosticContext;
 }
 
 /**
@@ -826,6 +1154,22 @@ typedef NS_OPTIONS(NSInteger, TMPLogMessageOptions){
                         options:(TMPLogMessageOptions)options
                       timestamp:(NSDate * __nullable)timestamp NS_DESIGNATED_INITIALIZER;
 
+/**
+ * Same as `initWithMessage:level:flag:context:file:function:line:tag:options:timestamp:`,
+ * attaching structured fields to the message.
+ */
+- (instancetype)initWithMessage:(NSString *)message
+                          level:(TMPLogLevel)level
+                           flag:(TMPLogFlag)flag
+                        context:(NSInteger)context
+                           file:(NSString *)file
+                       function:(NSString * __nullable)function
+                           line:(NSUInteger)line
+                            tag:(id __nullable)tag
+                        options:(TMPLogMessageOptions)options
+                      timestamp:(NSDate * __nullable)timestamp
+                         fields:(TMPLogFields * __nullable)fields;
+
 /**
  * Read-only properties
  **/
@@ -847,6 +1191,9 @@ typedef NS_OPTIONS(NSInteger, TMPLogMessageOptions){
 @property (readonly, nonatomic) NSString *threadID; // ID as it appears in NSLog calculated from the machThreadID
 @property (readonly, nonatomic) NSString *threadName;
 @property (readonly, nonatomic) NSString *queueLabel;
+@property (readonly, nonatomic) TMPLogFields * __nullable fields; // Structured key-value fields, if any
+@property (readonly, nonatomic) TMPLogDiagnosticContext * __nullable diagnosticContext; // Context of the creating thread, if any
+@property (readonly, nonatomic) NSUInteger sampleRate; // N if the message was logged 1 in N times (see `TMPLogFieldSampleRateKey`), 1 otherwise
 
 @end
 
@@ -881,10 +1228,24 @@ typedef NS_OPTIONS(NSInteger, TMPLogMessageOptions){
 @property (nonatomic, strong, nullable) id <TMPLogFormatter> logFormatter;
 @property (nonatomic, DISPATCH_QUEUE_REFERENCE_TYPE) dispatch_queue_t loggerQueue;
 
+/**
+ * Subclasses that format messages with `TMPLogFormatMessageToBuffer` can return YES, to reuse the output
+ * formatted once for all loggers sharing the same shareable formatter (see `-[TMPLogFormatter isShareable]`).
+ * Defaults to NO.
+ **/
+@property (nonatomic, readonly) BOOL reusesSharedFormattedOutput;
+
+/**
+ * The logging queue of the `TMPLog` instance the logger was last added to, or of the shared instance
+ * until it's added to one. Accessors of the logger's properties go through it, to be ordered with its messages.
+ **/
+@property (nonatomic, readonly) dispatch_queue_t globalLoggingQueue;
+
 // For thread-safety assertions
 
 /**
- *  Return YES if the current logger uses a global queue for logging
+ *  Return YES if the current logger uses a global queue for logging,
+ *  that is if it's running on the logging queue of the instance it was added to (see `globalLoggingQueue`).
  */
 @property (nonatomic, readonly, getter=isOnGlobalLoggingQueue)  BOOL onGlobalLoggingQueue;
 
@@ -19,8 +19,21 @@
 #endif
 
 #import "TMPLog.h"
-
+#import "TMPLogCallSite+Internal.h"
+#import "TMPLogCallSiteProfiler.h"
+#import "TMPLogDiagnosticContext.h"
+#import "TMPLogFields.h"
+#import "TMPLogLatencyTracer.h"
+#import "TMPLogMacros.h"
+#import "TMPLogMessage+Internal.h"
+#import "TMPLogMetrics.h"
+#import "TMPLogRateLimiter.h"
+#import "TMPMappedRingLogger.h"
+
+#import <mach/mach_time.h>
 #import <pthread.h>
+#import <sched.h>
+#import <stdatomic.h>
 #import <objc/runtime.h>
 
 #if TARGET_OS_IOS
@@ -48,7 +61,8 @@
 
 #define NSLogDebug(frmt, ...) do{ if(TMP_DEBUG) NSLog((frmt), ##__VA_ARGS__); } while(0)
 
-// Specifies the maximum queue size of the logging thread.
+// Specifies the maximum queue size of the logging thread of the shared instance,
+// and the default one of other instances (see initWithMaximumQueueSize:qualityOfService:).
 //
 // Since most logging is asynchronous, its possible for rogue threads to flood the logging queue.
 // That is, to issue an abundance of log statements faster than the logging thread can keep up.
@@ -63,13 +77,46 @@
     #define TMPLOG_MAX_QUEUE_SIZE 1000 // Should not exceed INT32_MAX
 #endif
 
-// The "global logging queue" refers to [TMPLog loggingQueue].
-// It is the queue that all log statements go through.
+// Specifies the default width of the logger pool (see loggerPoolWidth),
+// that is the maximum number of threads delivering a message to the loggers.
+// The default width is the number of processors, up to this value.
+
+#ifndef TMPLOG_LOGGER_POOL_WIDTH
+    #define TMPLOG_LOGGER_POOL_WIDTH 4
+#endif
+
+// Specifies the default cost, in seconds, under which a logger is run by the logging thread (see inlineLoggerThreshold).
+// Handing a message to another thread and waiting for it takes a few microseconds,
+// more than in-memory loggers spend in logMessage:.
+
+#ifndef TMPLOG_INLINE_LOGGER_THRESHOLD
+    #define TMPLOG_INLINE_LOGGER_THRESHOLD 0.000005
+#endif
+
+// Number of messages between two evaluations of the loggers' costs
+static const uint64_t kTMPLogInlineEvaluationInterval = 256;
+
+// Each TMPLog instance has its own logging queue, that all its log statements go through.
+// The "global logging queue" of a TMPAbstractLogger refers to the logging queue of the instance it was last added to,
+// or of the shared instance until it's added to one (see -[TMPAbstractLogger globalLoggingQueue]).
 //
-// The logging queue sets a flag via dispatch_queue_set_specific using this key.
-// We can check for this key via dispatch_get_specific() to see if we're on the "global logging queue".
+// The logging queue of an instance sets the instance via dispatch_queue_set_specific using this key.
+// We can check for this key via dispatch_get_specific() to see which instance's logging queue we're on, if any.
+
+static void *const LoggingQueueIdentityKey = (void *)&LoggingQueueIdentityKey;
+
+static double TMPLogSecondsPerTick(void) {
+    static double secondsPerTick;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
+    });
 
-static void *const GlobalLoggingQueueIdentityKey = (void *)&GlobalLoggingQueueIdentityKey;
+    return secondsPerTick;
+}
 
 @interface TMPLoggerNode : NSObject
 {
@@ -78,46 +125,304 @@ static void *const GlobalLoggingQueueIdentityKey = (void *)&GlobalLoggingQueueId
     id <TMPLogger> _logger;
     TMPLogLevel _level;
     dispatch_queue_t _loggerQueue;
+    id <TMPLogFilter> _filter;
+    TMPAbstractLogger *_sharingLogger; // The logger, if it reuses shared formatted output
+    id <TMPLogFormatter> _sharedFormatter; // Its formatter, if another node shares it, see lt_updateSharedFormatters
+    TMPLogFlag _sharedFlags; // The flags for which at least two of the nodes sharing _sharedFormatter get the message
+    BOOL _logsInline; // The logger asked to always be run by the logging thread, see logsInline
+    _Atomic(BOOL) _inline; // The logger is currently run by the logging thread, see lt_evaluateInlineLoggers
+    _Atomic(double) _cost; // Moving average of the time spent in logMessage:, in mach ticks, 0 until it first ran
+    TMPLogHistogram *_latency; // Time spent in the logger's logMessage:
+
+    // How to deliver to the logger, looked up once rather than for every message (see TMPLoggerNodeLookUpLogger).
+    // Looked up again if the class of the logger changes, as KVO does.
+    Class _loggerClass;
+    IMP _logMessageIMP;
+    BOOL _respondsToFlush;
 }
 
 @property (nonatomic, readonly) id <TMPLogger> logger;
 @property (nonatomic, readonly) TMPLogLevel level;
 @property (nonatomic, readonly) dispatch_queue_t loggerQueue;
+@property (nonatomic, readonly) id <TMPLogFilter> filter;
 
 + (TMPLoggerNode *)nodeWithLogger:(id <TMPLogger>)logger
                      loggerQueue:(dispatch_queue_t)loggerQueue
-                           level:(TMPLogLevel)level;
+                           level:(TMPLogLevel)level
+                          filter:(id <TMPLogFilter>)filter;
 
 @end
 
+static void TMPLoggerNodeLookUpLogger(TMPLoggerNode *loggerNode, Class loggerClass) {
+    // Proxies forwarding logMessage: get the forwarding IMP, which forwards like a message send would
+    loggerNode->_loggerClass = loggerClass;
+    loggerNode->_logMessageIMP = class_getMethodImplementation(loggerClass, @selector(logMessage:));
+    loggerNode->_respondsToFlush = [loggerNode->_logger respondsToSelector:@selector(flush)];
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark -
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-@interface TMPLog ()
+@interface TMPAbstractLogger () {
+    // The instance the logger was last added to, nil for the shared instance. Only access with self locked.
+    __weak TMPLog *_owningLog;
+}
+
+// The logger's formatter if it is shareable, nil otherwise.
+// Set on the global logging queue, read on the logging queues of the instances using the logger.
+@property (atomic, strong, nullable) id <TMPLogFormatter> shareableFormatter;
+
+// Record the instance whose logging queue is the global logging queue, see addLogger:withLevel:filter:.
+// Sent to the proxies of a logger as well, which forward them.
+- (void)wasAddedToLog:(TMPLog *)log;
+- (void)wasRemovedFromLog:(TMPLog *)log;
+
+@end
+
+// Incremented whenever the shareable formatter of a logger changes,
+// for the instances to find out that they must update their shared formatters (see lt_updateSharedFormatters).
+static _Atomic(uint64_t) TMPShareableFormatterGeneration;
+
+static inline void TMPAbstractLoggerSetShareableFormatter(TMPAbstractLogger *logger, id <TMPLogFormatter> formatter) {
+    logger.shareableFormatter = formatter;
+    atomic_fetch_add_explicit(&TMPShareableFormatterGeneration, 1, memory_order_release);
+}
+
+static inline id <TMPLogFormatter> TMPShareableFormatter(id <TMPLogFormatter> formatter) {
+    if ([formatter respondsToSelector:@selector(isShareable)] && [formatter isShareable]) {
+        return formatter;
+    }
+
+    return nil;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLog () {
+    // The rate limiter, retained, read without retaining it by every log statement between TMPLogBeginRead
+    // and TMPLogEndRead. A replaced limiter is released once those reads are over, see TMPLogReplace.
+    @public
+    _Atomic(void *) _rateLimiter;
+
+    // The mapped ring, managed the same way
+    _Atomic(void *) _mappedRingLogger;
+
+    // The latency tracer, managed the same way
+    _Atomic(void *) _latencyTracer;
+
+    // The call site profiler, managed the same way
+    _Atomic(void *) _callSiteProfiler;
+
+    // The reads of the objects above in progress, counted by the parity of the epoch they started in
+    _Atomic(NSUInteger) _readEpoch;
+    _Atomic(NSUInteger) _readers[2];
+
+    // Maximum number of threads delivering a message, see lt_log:tookQueueSlot:
+    _Atomic(NSUInteger) _loggerPoolWidth;
+
+    // Loggers cheaper than this, in mach ticks, are run by the logging thread, see lt_evaluateInlineLoggers
+    _Atomic(double) _inlineLoggerThreshold;
+
+    // Whether some loggers share their formatter, as of the TMPShareableFormatterGeneration value.
+    // Only accessed on the logging queue, see lt_updateSharedFormatters.
+    BOOL _sharesFormatters;
+    uint64_t _sharedFormattersGeneration;
+
+    // All logging statements are added to the same queue to ensure FIFO operation.
+    dispatch_queue_t _loggingQueue;
+
+    // Individual loggers are executed concurrently per log statement, by the logger pool (see lt_log:tookQueueSlot:).
+    // Each logger has it's own associated queue, and a dispatch group is used for synchronization.
+    dispatch_group_t _loggingGroup;
+
+    // The global queue of the logger pool's workers, at the quality of service of the logging queue.
+    dispatch_queue_t _loggerPoolQueue;
+
+    // In order to prevent to queue from growing infinitely large,
+    // a maximum size is enforced (maximumQueueSize).
+    dispatch_semaphore_t _queueSemaphore;
+    NSUInteger _maximumQueueSize;
+
+    // Minor optimization for uniprocessor machines, where the logger pool defaults to the logging thread only
+    NSUInteger _numProcessors;
+
+    // Pipeline metrics (see TMPLogMetrics). The queue depth is enqueued - delivered.
+    _Atomic(uint64_t) _messagesEnqueued;
+    _Atomic(uint64_t) _messagesDelivered;
+    _Atomic(uint64_t) _messagesDropped;
+    _Atomic(uint64_t) _maximumQueueDepth;
+    TMPLogHistogram *_queueLatency;
+    TMPLogHistogram *_blockedTime;
+}
 
 // An array used to manage all the individual loggers.
 // The array is only modified on the loggingQueue/loggingThread.
 @property (nonatomic, strong) NSMutableArray *_loggers;
 
+- (void)queueLogMessage:(TMPLogMessage *)logMessage asynchronously:(BOOL)asyncFlag;
+
 @end
 
-@implementation TMPLog
+@interface TMPLogRateLimiter (TMPLogInternal)
+
+- (void)setLog:(TMPLog * __nullable)log;
+
+@end
+
+@interface TMPLogCallSiteProfiler (TMPLogInternal)
+
+- (void)setLog:(TMPLog * __nullable)log;
+
+@end
+
+@interface TMPLoggerMetrics (TMPLogInternal)
 
-// All logging statements are added to the same queue to ensure FIFO operation.
-static dispatch_queue_t _loggingQueue;
+- (instancetype)initWithLogger:(id <TMPLogger>)logger latency:(TMPLogLatency *)latency averageCost:(NSTimeInterval)averageCost runsInline:(BOOL)runsInline;
 
-// Individual loggers are executed concurrently per log statement.
-// Each logger has it's own associated queue, and a dispatch group is used for synchronization.
-static dispatch_group_t _loggingGroup;
+@end
+
+@interface TMPLogMetrics (TMPLogInternal)
+
+- (instancetype)initWithMessagesEnqueued:(uint64_t)messagesEnqueued
+                       messagesDelivered:(uint64_t)messagesDelivered
+                         messagesDropped:(uint64_t)messagesDropped
+                       maximumQueueDepth:(uint64_t)maximumQueueDepth
+                            queueLatency:(TMPLogLatency *)queueLatency
+                             blockedTime:(TMPLogLatency *)blockedTime
+                                 loggers:(NSArray<TMPLoggerMetrics *> *)loggers
+                               callSites:(NSArray<TMPLogCallSite *> *)callSites;
+
+@end
+
+// Latency tracing, see TMPLogLatencyTracer.m
+FOUNDATION_EXTERN id TMPLogLatencyTracerSample(TMPLogLatencyTracer *tracer, TMPLogMessage *message, uint64_t created);
+FOUNDATION_EXTERN void TMPLogLatencyTraceDequeued(id trace, uint64_t dequeued);
+FOUNDATION_EXTERN void TMPLogLatencyTraceHanded(id trace, id <TMPLogger> logger, uint64_t handed);
+FOUNDATION_EXTERN void TMPLogLatencyTraceReturned(id trace, id <TMPLogger> logger, uint64_t returned);
 
-// In order to prevent to queue from growing infinitely large,
-// a maximum size is enforced (TMPLOG_MAX_QUEUE_SIZE).
-static dispatch_semaphore_t _queueSemaphore;
+// Starts a read of the objects replaced by TMPLogReplace, which keeps them alive until the matching TMPLogEndRead.
+// Returns the counter of the read. The epoch is checked again once counted, so that a read is never counted
+// in a parity that a replacement is already done waiting for.
+static inline NSUInteger TMPLogBeginRead(TMPLog *log) {
+    for (;;) {
+        NSUInteger epoch = atomic_load(&log->_readEpoch);
+        NSUInteger readers = epoch & 1;
+
+        atomic_fetch_add(&log->_readers[readers], 1);
+
+        if (atomic_load(&log->_readEpoch) == epoch) {
+            return readers;
+        }
+
+        atomic_fetch_sub(&log->_readers[readers], 1);
+    }
+}
+
+static inline void TMPLogEndRead(TMPLog *log, NSUInteger readers) {
+    atomic_fetch_sub_explicit(&log->_readers[readers], 1, memory_order_release);
+}
+
+// Stores `object`, retained, in `slot`, and returns the object it replaced once no read can still be using it.
+// Called with the instance locked, so that replacements wait for each other.
+static id TMPLogReplace(TMPLog *log, _Atomic(void *) *slot, id object) {
+    void *previous = atomic_exchange(slot, (void *)CFBridgingRetain(object));
+
+    if (previous == NULL || previous == (__bridge void *)object) {
+        return CFBridgingRelease(previous);
+    }
+
+    // The reads that may have loaded the previous object all started before the epoch moved on
+    NSUInteger epoch = atomic_fetch_add(&log->_readEpoch, 1);
+
+    while (atomic_load_explicit(&log->_readers[epoch & 1], memory_order_acquire) != 0) {
+        sched_yield();
+    }
+
+    return CFBridgingRelease(previous);
+}
+
+static inline BOOL TMPLogRateLimiterAllows(TMPLog *log, const char *file, NSUInteger line, NSInteger context) {
+    if (atomic_load_explicit(&log->_rateLimiter, memory_order_relaxed) == NULL) {
+        return YES;
+    }
+
+    NSUInteger readers = TMPLogBeginRead(log);
+    __unsafe_unretained TMPLogRateLimiter *limiter = (__bridge TMPLogRateLimiter *)atomic_load_explicit(&log->_rateLimiter, memory_order_acquire);
+    BOOL allowed = limiter == nil || TMPLogRateLimiterCheck(limiter, file, line, context);
+    TMPLogEndRead(log, readers);
+
+    if (allowed) {
+        return YES;
+    }
+
+    atomic_fetch_add_explicit(&log->_messagesDropped, 1, memory_order_relaxed);
+    return NO;
+}
+
+// Same as TMPLogRateLimiterAllows, once the message is formatted: also collapses repeated messages.
+// The format primitives already checked the limit of the call site, and don't check it again.
+static inline BOOL TMPLogRateLimiterAllowsMessage(TMPLog *log, const char *file, NSUInteger line, NSInteger context, NSString *message, BOOL checksSiteLimit) {
+    if (atomic_load_explicit(&log->_rateLimiter, memory_order_relaxed) == NULL) {
+        return YES;
+    }
 
-// Minor optimization for uniprocessor machines
-static NSUInteger _numProcessors;
+    NSUInteger readers = TMPLogBeginRead(log);
+    __unsafe_unretained TMPLogRateLimiter *limiter = (__bridge TMPLogRateLimiter *)atomic_load_explicit(&log->_rateLimiter, memory_order_acquire);
+    BOOL allowed = limiter == nil
+                   || ((!checksSiteLimit || TMPLogRateLimiterCheck(limiter, file, line, context))
+                       && TMPLogRateLimiterCheckRepeat(limiter, file, line, context, message));
+    TMPLogEndRead(log, readers);
+
+    if (allowed) {
+        return YES;
+    }
+
+    atomic_fetch_add_explicit(&log->_messagesDropped, 1, memory_order_relaxed);
+    return NO;
+}
+
+// A copy of the string that lives as long as the process, the same for equal strings, so that the file and function names
+// of the messages logged as objects can key the call site tables like __FILE__ pointers.
+// There are only so many files logging in a process.
+static const char * TMPLogInternedCString(NSString *string) {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    static NSMutableDictionary<NSString *, NSValue *> *interned;
+
+    if (string == nil) {
+        return "";
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    if (!interned) {
+        interned = [NSMutableDictionary dictionary];
+    }
+
+    const char *cString = [interned[string] pointerValue];
+
+    if (!cString) {
+        cString = strdup(string.UTF8String);
+        interned[[string copy]] = [NSValue valueWithPointer:cString];
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return cString;
+}
+
+void TMPLogQueueReport(TMPLog *log, TMPLogMessage *report) {
+    [log queueLogMessage:report asynchronously:YES];
+}
+
+static inline BOOL TMPLogIsOnLoggingQueue(TMPLog *log) {
+    return dispatch_get_specific(LoggingQueueIdentityKey) == (__bridge void *)log;
+}
+
+@implementation TMPLog
 
 /**
  *  Returns the singleton `TMPLog`.
@@ -137,47 +442,45 @@ static NSUInteger _numProcessors;
 }
 
 /**
- * The runtime sends initialize to each class in a program exactly one time just before the class,
- * or any class that inherits from it, is sent its first message from within the program. (Thus the
- * method may never be invoked if the class is not used.) The runtime sends the initialize message to
- * classes in a thread-safe manner. Superclasses receive this message before their subclasses.
+ *  The `TMPLog` initializer.
  *
- * This method may also be called directly, hence the safety mechanism.
- **/
-+ (void)initialize {
-    static dispatch_once_t TMPLogOnceToken;
+ *  @return An initialized `TMPLog` instance.
+ */
+- (instancetype)init {
+    return [self initWithMaximumQueueSize:TMPLOG_MAX_QUEUE_SIZE qualityOfService:QOS_CLASS_UNSPECIFIED];
+}
 
-    dispatch_once(&TMPLogOnceToken, ^{
-        NSLogDebug(@"TMPLog: Using grand central dispatch");
+- (instancetype)initWithMaximumQueueSize:(NSUInteger)maximumQueueSize qualityOfService:(dispatch_qos_class_t)qualityOfService {
+    self = [super init];
+
+    if (self) {
+        self._loggers = [[NSMutableArray alloc] initWithCapacity:4];
+
+        dispatch_queue_attr_t attributes = DISPATCH_QUEUE_SERIAL;
+        if (qualityOfService != QOS_CLASS_UNSPECIFIED) {
+            attributes = dispatch_queue_attr_make_with_qos_class(attributes, qualityOfService, 0);
+        }
 
-        _loggingQueue = dispatch_queue_create("cocoa.lumberjack", NULL);
+        _loggingQueue = dispatch_queue_create("cocoa.lumberjack", attributes);
         _loggingGroup = dispatch_group_create();
+        _loggerPoolQueue = dispatch_get_global_queue(qualityOfService != QOS_CLASS_UNSPECIFIED ? qualityOfService : QOS_CLASS_DEFAULT, 0);
 
-        void *nonNullValue = GlobalLoggingQueueIdentityKey; // Whatever, just not null
-        dispatch_queue_set_specific(_loggingQueue, GlobalLoggingQueueIdentityKey, nonNullValue, NULL);
+        // Not retained: the queue's blocks retain the instance
+        dispatch_queue_set_specific(_loggingQueue, LoggingQueueIdentityKey, (__bridge void *)self, NULL);
 
-        _queueSemaphore = dispatch_semaphore_create(TMPLOG_MAX_QUEUE_SIZE);
+        _maximumQueueSize = MAX(maximumQueueSize, (NSUInteger)1);
+        _queueSemaphore = dispatch_semaphore_create((long)_maximumQueueSize);
 
         // Figure out how many processors are available.
         // This may be used later for an optimization on uniprocessor machines.
 
         _numProcessors = MAX([NSProcessInfo processInfo].processorCount, (NSUInteger) 1);
 
-        NSLogDebug(@"TMPLog: numProcessors = %@", @(_numProcessors));
-    });
-}
+        _queueLatency = calloc(1, sizeof(TMPLogHistogram));
+        _blockedTime = calloc(1, sizeof(TMPLogHistogram));
 
-/**
- *  The `TMPLog` initializer.
- *  Static variables are set only once.
- *
- *  @return An initialized `TMPLog` instance.
- */
-- (id)init {
-    self = [super init];
-
-    if (self) {
-        self._loggers = [[NSMutableArray alloc] initWithCapacity:4];
+        atomic_init(&_loggerPoolWidth, MIN(_numProcessors, (NSUInteger)TMPLOG_LOGGER_POOL_WIDTH));
+        atomic_init(&_inlineLoggerThreshold, TMPLOG_INLINE_LOGGER_THRESHOLD / TMPLogSecondsPerTick());
 
 #if TARGET_OS_IOS
         NSString *notificationName = UIApplicationWillTerminateNotification;
@@ -213,13 +516,50 @@ static NSUInteger _numProcessors;
     return self;
 }
 
+- (void)dealloc {
+    void *rateLimiter = atomic_load_explicit(&_rateLimiter, memory_order_relaxed);
+
+    if (rateLimiter) {
+        CFRelease(rateLimiter);
+    }
+
+    void *mappedRingLogger = atomic_load_explicit(&_mappedRingLogger, memory_order_relaxed);
+
+    if (mappedRingLogger) {
+        CFRelease(mappedRingLogger);
+    }
+
+    void *latencyTracer = atomic_load_explicit(&_latencyTracer, memory_order_relaxed);
+
+    if (latencyTracer) {
+        CFRelease(latencyTracer);
+    }
+
+    void *callSiteProfiler = atomic_load_explicit(&_callSiteProfiler, memory_order_relaxed);
+
+    if (callSiteProfiler) {
+        CFRelease(callSiteProfiler);
+    }
+
+    free(_queueLatency);
+    free(_blockedTime);
+}
+
 /**
  * Provides access to the logging queue.
  **/
 + (dispatch_queue_t)loggingQueue {
+    return [self.sharedInstance loggingQueue];
+}
+
+- (dispatch_queue_t)loggingQueue {
     return _loggingQueue;
 }
 
+- (NSUInteger)maximumQueueSize {
+    return _maximumQueueSize;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #pragma mark Notifications
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -245,12 +585,25 @@ static NSUInteger _numProcessors;
 }
 
 - (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level {
+    [self addLogger:logger withLevel:level filter:nil];
+}
+
++ (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level filter:(id <TMPLogFilter>)filter {
+    [self.sharedInstance addLogger:logger withLevel:level filter:filter];
+}
+
+- (void)addLogger:(id <TMPLogger>)logger withLevel:(TMPLogLevel)level filter:(id <TMPLogFilter>)filter {
     if (!logger) {
         return;
     }
 
+    // Recorded right away, so that the accessors used after this call are ordered after the logger is added
+    if ([logger respondsToSelector:@selector(wasAddedToLog:)]) {
+        [(TMPAbstractLogger *)logger wasAddedToLog:self];
+    }
+
     dispatch_async(_loggingQueue, ^{ @autoreleasepool {
-        [self lt_addLogger:logger level:level];
+        [self lt_addLogger:logger level:level filter:filter];
     } });
 }
 
@@ -310,6 +663,20 @@ static NSUInteger _numProcessors;
 #pragma mark - Master Logging
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Where the messages allowed by the rate limiter enter the pipeline, with the pointers of their call site
+- (void)queueLogMessage:(TMPLogMessage *)logMessage asynchronously:(BOOL)asyncFlag file:(const char *)file function:(const char *)function {
+    if (atomic_load_explicit(&_callSiteProfiler, memory_order_relaxed)) {
+        NSUInteger readers = TMPLogBeginRead(self);
+        __unsafe_unretained TMPLogCallSiteProfiler *profiler = (__bridge TMPLogCallSiteProfiler *)atomic_load_explicit(&_callSiteProfiler, memory_order_acquire);
+        if (profiler) {
+            TMPLogCallSiteProfilerCount(profiler, file, function, logMessage->_line, logMessage->_message);
+        }
+        TMPLogEndRead(self, readers);
+    }
+
+    [self queueLogMessage:logMessage asynchronously:asyncFlag];
+}
+
 - (void)queueLogMessage:(TMPLogMessage *)logMessage asynchronously:(BOOL)asyncFlag {
     // We have a tricky situation here...
     //
@@ -340,7 +707,7 @@ static NSUInteger _numProcessors;
 
 
     // We are using a counting semaphore provided by GCD.
-    // The semaphore is initialized with our TMPLOG_MAX_QUEUE_SIZE value.
+    // The semaphore is initialized with our maximumQueueSize value.
     // Every time we want to queue a log message we decrement this value.
     // If the resulting value is less than zero,
     // the semaphore function waits in FIFO order for a signal to occur before returning.
@@ -348,19 +715,66 @@ static NSUInteger _numProcessors;
     // A dispatch semaphore is an efficient implementation of a traditional counting semaphore.
     // Dispatch semaphores call down to the kernel only when the calling thread needs to be blocked.
     // If the calling semaphore does not need to block, no kernel call is made.
+    //
+    // The wait happens on the calling thread, before the message is queued: waiting in the queued block
+    // would only hold up the queue, which releases a slot after each message, and never the thread.
+    // Messages logged from the logging queue itself don't take a slot, as waiting there would deadlock.
+
+    // Recorded before the message is queued, so the ring has it even if the process dies before it's dequeued
+    if (atomic_load_explicit(&_mappedRingLogger, memory_order_relaxed)) {
+        NSUInteger readers = TMPLogBeginRead(self);
+        __unsafe_unretained TMPMappedRingLogger *mappedRingLogger = (__bridge TMPMappedRingLogger *)atomic_load_explicit(&_mappedRingLogger, memory_order_acquire);
+        if (mappedRingLogger) {
+            [mappedRingLogger logMessage:logMessage];
+        }
+        TMPLogEndRead(self, readers);
+    }
 
-    dispatch_block_t logBlock = ^{
+    BOOL onLoggingQueue = TMPLogIsOnLoggingQueue(self);
+
+    if (!onLoggingQueue && dispatch_semaphore_wait(_queueSemaphore, DISPATCH_TIME_NOW) != 0) {
+        // Only the waits for a slot are timed, not the synchronous deliveries
+        uint64_t blockedTime = mach_absolute_time();
         dispatch_semaphore_wait(_queueSemaphore, DISPATCH_TIME_FOREVER);
-        // We're now sure we won't overflow the queue.
-        // It is time to queue our log message.
+        TMPLogHistogramRecord(_blockedTime, mach_absolute_time() - blockedTime);
+    }
+
+    uint64_t enqueueTime = mach_absolute_time();
+
+    // The trace retains its tracer
+    if (atomic_load_explicit(&_latencyTracer, memory_order_relaxed)) {
+        NSUInteger readers = TMPLogBeginRead(self);
+        __unsafe_unretained TMPLogLatencyTracer *latencyTracer = (__bridge TMPLogLatencyTracer *)atomic_load_explicit(&_latencyTracer, memory_order_acquire);
+        if (latencyTracer) {
+            logMessage->_latencyTrace = TMPLogLatencyTracerSample(latencyTracer, logMessage, enqueueTime);
+        }
+        TMPLogEndRead(self, readers);
+    }
+
+    uint64_t queueDepth = atomic_fetch_add_explicit(&_messagesEnqueued, 1, memory_order_relaxed) + 1
+                          - atomic_load_explicit(&_messagesDelivered, memory_order_relaxed);
+    uint64_t maximumQueueDepth = atomic_load_explicit(&_maximumQueueDepth, memory_order_relaxed);
+
+    while (queueDepth > maximumQueueDepth &&
+           !atomic_compare_exchange_weak_explicit(&_maximumQueueDepth, &maximumQueueDepth, queueDepth, memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    dispatch_block_t logBlock = ^{
+        uint64_t dequeueTime = mach_absolute_time();
+        TMPLogHistogramRecord(self->_queueLatency, dequeueTime - enqueueTime);
+
+        if (logMessage->_latencyTrace) {
+            TMPLogLatencyTraceDequeued(logMessage->_latencyTrace, dequeueTime);
+        }
+
         @autoreleasepool {
-            [self lt_log:logMessage];
+            [self lt_log:logMessage tookQueueSlot:!onLoggingQueue];
         }
     };
 
     if (asyncFlag) {
         dispatch_async(_loggingQueue, logBlock);
-    } else if (dispatch_get_specific(GlobalLoggingQueueIdentityKey)) {
+    } else if (onLoggingQueue) {
         // We've logged an error message while on the logging queue...
         logBlock();
     } else {
@@ -379,7 +793,43 @@ static NSUInteger _numProcessors;
      format:(NSString *)format, ... {
     va_list args;
 
-    if (format) {
+    if (format && TMPLogRateLimiterAllows(self.sharedInstance, file, line, context)) {
+        va_start(args, format);
+
+        NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
+
+        va_end(args);
+
+        va_start(args, format);
+
+        [self.sharedInstance log:asynchronous
+                         message:message
+                           level:level
+                            flag:flag
+                         context:context
+                            file:file
+                        function:function
+                            line:line
+                             tag:tag
+                          fields:nil
+                 checksSiteLimit:NO];
+
+        va_end(args);
+    }
+}
+
+- (void)log:(BOOL)asynchronous
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     format:(NSString *)format, ... {
+    va_list args;
+
+    if (format && TMPLogRateLimiterAllows(self, file, line, context)) {
         va_start(args, format);
 
         NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
@@ -396,13 +846,15 @@ static NSUInteger _numProcessors;
              file:file
          function:function
              line:line
-              tag:tag];
+              tag:tag
+           fields:nil
+  checksSiteLimit:NO];
 
         va_end(args);
     }
 }
 
-- (void)log:(BOOL)asynchronous
++ (void)log:(BOOL)asynchronous
       level:(TMPLogLevel)level
        flag:(TMPLogFlag)flag
     context:(NSInteger)context
@@ -410,18 +862,48 @@ static NSUInteger _numProcessors;
    function:(const char *)function
        line:(NSUInteger)line
         tag:(id)tag
+     fields:(TMPLogFields *)fields
      format:(NSString *)format, ... {
-    va_list args;
-
-    if (format) {
+    if (format && TMPLogRateLimiterAllows(self.sharedInstance, file, line, context)) {
+        va_list args;
         va_start(args, format);
 
         NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
 
         va_end(args);
 
+        [self.sharedInstance log:asynchronous
+                         message:message
+                           level:level
+                            flag:flag
+                         context:context
+                            file:file
+                        function:function
+                            line:line
+                             tag:tag
+                          fields:fields
+                 checksSiteLimit:NO];
+    }
+}
+
+- (void)log:(BOOL)asynchronous
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     fields:(TMPLogFields *)fields
+     format:(NSString *)format, ... {
+    if (format && TMPLogRateLimiterAllows(self, file, line, context)) {
+        va_list args;
         va_start(args, format);
 
+        NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
+
+        va_end(args);
+
         [self log:asynchronous
           message:message
             level:level
@@ -430,9 +912,9 @@ static NSUInteger _numProcessors;
              file:file
          function:function
              line:line
-              tag:tag];
-
-        va_end(args);
+              tag:tag
+           fields:fields
+  checksSiteLimit:NO];
     }
 }
 
@@ -449,73 +931,302 @@ static NSUInteger _numProcessors;
     [self.sharedInstance log:asynchronous level:level flag:flag context:context file:file function:function line:line tag:tag format:format args:args];
 }
 
-- (void)log:(BOOL)asynchronous
-      level:(TMPLogLevel)level
-       flag:(TMPLogFlag)flag
-    context:(NSInteger)context
-       file:(const char *)file
-   function:(const char *)function
-       line:(NSUInteger)line
-        tag:(id)tag
-     format:(NSString *)format
-       args:(va_list)args {
-    if (format) {
-        NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
-        [self log:asynchronous
-          message:message
-            level:level
-             flag:flag
-          context:context
-             file:file
-         function:function
-             line:line
-              tag:tag];
+- (void)log:(BOOL)asynchronous
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     format:(NSString *)format
+       args:(va_list)args {
+    if (format && TMPLogRateLimiterAllows(self, file, line, context)) {
+        NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
+        [self log:asynchronous
+          message:message
+            level:level
+             flag:flag
+          context:context
+             file:file
+         function:function
+             line:line
+              tag:tag
+           fields:nil
+  checksSiteLimit:NO];
+    }
+}
+
++ (void)log:(BOOL)asynchronous
+    message:(NSString *)message
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     fields:(TMPLogFields *)fields {
+    [self.sharedInstance log:asynchronous message:message level:level flag:flag context:context file:file function:function line:line tag:tag fields:fields];
+}
+
+- (void)log:(BOOL)asynchronous
+    message:(NSString *)message
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     fields:(TMPLogFields *)fields {
+    [self log:asynchronous
+      message:message
+        level:level
+         flag:flag
+      context:context
+         file:file
+     function:function
+         line:line
+          tag:tag
+       fields:fields
+checksSiteLimit:YES];
+}
+
+// The format primitives check the limit of the call site before formatting the message, and pass NO
+- (void)log:(BOOL)asynchronous
+    message:(NSString *)message
+      level:(TMPLogLevel)level
+       flag:(TMPLogFlag)flag
+    context:(NSInteger)context
+       file:(const char *)file
+   function:(const char *)function
+       line:(NSUInteger)line
+        tag:(id)tag
+     fields:(TMPLogFields *)fields
+checksSiteLimit:(BOOL)checksSiteLimit {
+    if (!TMPLogRateLimiterAllowsMessage(self, file, line, context, message, checksSiteLimit)) {
+        return;
+    }
+
+    TMPLogMessage *logMessage = [[TMPLogMessage alloc] initWithMessage:message
+                                                               level:level
+                                                                flag:flag
+                                                             context:context
+                                                                file:[NSString stringWithFormat:@"%s", file]
+                                                            function:[NSString stringWithFormat:@"%s", function]
+                                                                line:line
+                                                                 tag:tag
+                                                             options:(TMPLogMessageOptions)0
+                                                           timestamp:nil
+                                                              fields:fields];
+
+    [self queueLogMessage:logMessage asynchronously:asynchronous file:file function:function];
+}
+
++ (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage {
+    [self.sharedInstance log:asynchronous message:logMessage];
+}
+
+- (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage {
+    if (atomic_load_explicit(&_rateLimiter, memory_order_relaxed) == NULL && atomic_load_explicit(&_callSiteProfiler, memory_order_relaxed) == NULL) {
+        [self queueLogMessage:logMessage asynchronously:asynchronous];
+        return;
+    }
+
+    // The call site is told apart by the interned file name, as its __FILE__ pointer is gone
+    [self log:asynchronous
+      message:logMessage
+         file:TMPLogInternedCString(logMessage->_file)
+     function:logMessage->_function ? TMPLogInternedCString(logMessage->_function) : NULL];
+}
+
++ (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage
+       file:(const char *)file
+   function:(const char *)function {
+    [self.sharedInstance log:asynchronous message:logMessage file:file function:function];
+}
+
+- (void)log:(BOOL)asynchronous
+    message:(TMPLogMessage *)logMessage
+       file:(const char *)file
+   function:(const char *)function {
+    if (TMPLogRateLimiterAllowsMessage(self, file, logMessage->_line, logMessage->_context, logMessage->_message, YES)) {
+        [self queueLogMessage:logMessage asynchronously:asynchronous file:file function:function];
+    }
+}
+
++ (TMPLogRateLimiter *)rateLimiter {
+    return [self.sharedInstance rateLimiter];
+}
+
++ (void)setRateLimiter:(TMPLogRateLimiter *)rateLimiter {
+    [self.sharedInstance setRateLimiter:rateLimiter];
+}
+
+- (TMPLogRateLimiter *)rateLimiter {
+    NSUInteger readers = TMPLogBeginRead(self);
+    TMPLogRateLimiter *rateLimiter = (__bridge TMPLogRateLimiter *)atomic_load_explicit(&_rateLimiter, memory_order_acquire);
+    TMPLogEndRead(self, readers);
+
+    return rateLimiter;
+}
+
+- (void)setRateLimiter:(TMPLogRateLimiter *)rateLimiter {
+    @synchronized (self) {
+        [rateLimiter setLog:self];
+
+        TMPLogRateLimiter *previousLimiter = TMPLogReplace(self, &_rateLimiter, rateLimiter);
+
+        if (previousLimiter != rateLimiter) {
+            [previousLimiter setLog:nil];
+        }
+    }
+}
+
++ (TMPMappedRingLogger *)mappedRingLogger {
+    return [self.sharedInstance mappedRingLogger];
+}
+
++ (void)setMappedRingLogger:(TMPMappedRingLogger *)mappedRingLogger {
+    [self.sharedInstance setMappedRingLogger:mappedRingLogger];
+}
+
+- (TMPMappedRingLogger *)mappedRingLogger {
+    NSUInteger readers = TMPLogBeginRead(self);
+    TMPMappedRingLogger *mappedRingLogger = (__bridge TMPMappedRingLogger *)atomic_load_explicit(&_mappedRingLogger, memory_order_acquire);
+    TMPLogEndRead(self, readers);
+
+    return mappedRingLogger;
+}
+
+- (void)setMappedRingLogger:(TMPMappedRingLogger *)mappedRingLogger {
+    @synchronized (self) {
+        TMPLogReplace(self, &_mappedRingLogger, mappedRingLogger);
+    }
+}
+
++ (TMPLogMetrics *)metrics {
+    return [self.sharedInstance metrics];
+}
+
+- (TMPLogMetrics *)metrics {
+    __block NSArray<TMPLoggerNode *> *loggerNodes;
+
+    if (TMPLogIsOnLoggingQueue(self)) {
+        loggerNodes = [self._loggers copy];
+    } else {
+        dispatch_sync(_loggingQueue, ^{
+            loggerNodes = [self._loggers copy];
+        });
+    }
+
+    NSMutableArray<TMPLoggerMetrics *> *loggers = [NSMutableArray arrayWithCapacity:loggerNodes.count];
+
+    for (TMPLoggerNode *loggerNode in loggerNodes) {
+        TMPLogLatency *latency = [[TMPLogLatency alloc] initWithHistogram:loggerNode->_latency];
+        [loggers addObject:[[TMPLoggerMetrics alloc] initWithLogger:loggerNode->_logger
+                                                            latency:latency
+                                                        averageCost:atomic_load_explicit(&loggerNode->_cost, memory_order_relaxed) * TMPLogSecondsPerTick()
+                                                         runsInline:atomic_load_explicit(&loggerNode->_inline, memory_order_relaxed)]];
+    }
+
+    // Delivered first, so that it's never ahead of enqueued
+    uint64_t messagesDelivered = atomic_load_explicit(&_messagesDelivered, memory_order_relaxed);
+
+    return [[TMPLogMetrics alloc] initWithMessagesEnqueued:atomic_load_explicit(&_messagesEnqueued, memory_order_relaxed)
+                                        messagesDelivered:messagesDelivered
+                                          messagesDropped:atomic_load_explicit(&_messagesDropped, memory_order_relaxed)
+                                        maximumQueueDepth:atomic_load_explicit(&_maximumQueueDepth, memory_order_relaxed)
+                                             queueLatency:[[TMPLogLatency alloc] initWithHistogram:_queueLatency]
+                                              blockedTime:[[TMPLogLatency alloc] initWithHistogram:_blockedTime]
+                                                  loggers:loggers
+                                                callSites:[self.callSiteProfiler topCallSites:100] ?: @[]];
+}
+
++ (TMPLogLatencyTracer *)latencyTracer {
+    return [self.sharedInstance latencyTracer];
+}
+
++ (void)setLatencyTracer:(TMPLogLatencyTracer *)latencyTracer {
+    [self.sharedInstance setLatencyTracer:latencyTracer];
+}
+
+- (TMPLogLatencyTracer *)latencyTracer {
+    NSUInteger readers = TMPLogBeginRead(self);
+    TMPLogLatencyTracer *latencyTracer = (__bridge TMPLogLatencyTracer *)atomic_load_explicit(&_latencyTracer, memory_order_acquire);
+    TMPLogEndRead(self, readers);
+
+    return latencyTracer;
+}
+
+- (void)setLatencyTracer:(TMPLogLatencyTracer *)latencyTracer {
+    @synchronized (self) {
+        TMPLogReplace(self, &_latencyTracer, latencyTracer);
+    }
+}
+
++ (TMPLogCallSiteProfiler *)callSiteProfiler {
+    return [self.sharedInstance callSiteProfiler];
+}
+
++ (void)setCallSiteProfiler:(TMPLogCallSiteProfiler *)callSiteProfiler {
+    [self.sharedInstance setCallSiteProfiler:callSiteProfiler];
+}
+
+- (TMPLogCallSiteProfiler *)callSiteProfiler {
+    NSUInteger readers = TMPLogBeginRead(self);
+    TMPLogCallSiteProfiler *callSiteProfiler = (__bridge TMPLogCallSiteProfiler *)atomic_load_explicit(&_callSiteProfiler, memory_order_acquire);
+    TMPLogEndRead(self, readers);
+
+    return callSiteProfiler;
+}
+
+- (void)setCallSiteProfiler:(TMPLogCallSiteProfiler *)callSiteProfiler {
+    @synchronized (self) {
+        [callSiteProfiler setLog:self];
+
+        TMPLogCallSiteProfiler *previousProfiler = TMPLogReplace(self, &_callSiteProfiler, callSiteProfiler);
+
+        if (previousProfiler != callSiteProfiler) {
+            [previousProfiler setLog:nil];
+        }
     }
 }
 
-+ (void)log:(BOOL)asynchronous
-    message:(NSString *)message
-      level:(TMPLogLevel)level
-       flag:(TMPLogFlag)flag
-    context:(NSInteger)context
-       file:(const char *)file
-   function:(const char *)function
-       line:(NSUInteger)line
-        tag:(id)tag {
-    [self.sharedInstance log:asynchronous message:message level:level flag:flag context:context file:file function:function line:line tag:tag];
++ (NSUInteger)loggerPoolWidth {
+    return [self.sharedInstance loggerPoolWidth];
 }
 
-- (void)log:(BOOL)asynchronous
-    message:(NSString *)message
-      level:(TMPLogLevel)level
-       flag:(TMPLogFlag)flag
-    context:(NSInteger)context
-       file:(const char *)file
-   function:(const char *)function
-       line:(NSUInteger)line
-        tag:(id)tag {
-    TMPLogMessage *logMessage = [[TMPLogMessage alloc] initWithMessage:message
-                                                               level:level
-                                                                flag:flag
-                                                             context:context
-                                                                file:[NSString stringWithFormat:@"%s", file]
-                                                            function:[NSString stringWithFormat:@"%s", function]
-                                                                line:line
-                                                                 tag:tag
-                                                             options:(TMPLogMessageOptions)0
-                                                           timestamp:nil];
++ (void)setLoggerPoolWidth:(NSUInteger)loggerPoolWidth {
+    [self.sharedInstance setLoggerPoolWidth:loggerPoolWidth];
+}
 
-    [self queueLogMessage:logMessage asynchronously:asynchronous];
+- (NSUInteger)loggerPoolWidth {
+    return atomic_load_explicit(&_loggerPoolWidth, memory_order_relaxed);
 }
 
-+ (void)log:(BOOL)asynchronous
-    message:(TMPLogMessage *)logMessage {
-    [self.sharedInstance log:asynchronous message:logMessage];
+- (void)setLoggerPoolWidth:(NSUInteger)loggerPoolWidth {
+    atomic_store_explicit(&_loggerPoolWidth, MAX(loggerPoolWidth, (NSUInteger)1), memory_order_relaxed);
 }
 
-- (void)log:(BOOL)asynchronous
-    message:(TMPLogMessage *)logMessage {
-    [self queueLogMessage:logMessage asynchronously:asynchronous];
++ (NSTimeInterval)inlineLoggerThreshold {
+    return [self.sharedInstance inlineLoggerThreshold];
+}
+
++ (void)setInlineLoggerThreshold:(NSTimeInterval)inlineLoggerThreshold {
+    [self.sharedInstance setInlineLoggerThreshold:inlineLoggerThreshold];
+}
+
+- (NSTimeInterval)inlineLoggerThreshold {
+    return atomic_load_explicit(&_inlineLoggerThreshold, memory_order_relaxed) * TMPLogSecondsPerTick();
+}
+
+- (void)setInlineLoggerThreshold:(NSTimeInterval)inlineLoggerThreshold {
+    atomic_store_explicit(&_inlineLoggerThreshold, MAX(inlineLoggerThreshold, 0.0) / TMPLogSecondsPerTick(), memory_order_relaxed);
 }
 
 + (void)flushLog {
@@ -689,19 +1400,20 @@ static NSUInteger _numProcessors;
 #pragma mark Logging Thread
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-- (void)lt_addLogger:(id <TMPLogger>)logger level:(TMPLogLevel)level {
+- (void)lt_addLogger:(id <TMPLogger>)logger level:(TMPLogLevel)level filter:(id <TMPLogFilter>)filter {
     // Add to loggers array.
     // Need to create loggerQueue if loggerNode doesn't provide one.
 
     for (TMPLoggerNode* node in self._loggers) {
         if (node->_logger == logger
-            && node->_level == level) {
+            && node->_level == level
+            && node->_filter == filter) {
             // Exactly same logger already added, exit
             return;
         }
     }
 
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     dispatch_queue_t loggerQueue = NULL;
@@ -725,9 +1437,35 @@ static NSUInteger _numProcessors;
         loggerQueue = dispatch_queue_create(loggerQueueName, NULL);
     }
 
-    TMPLoggerNode *loggerNode = [TMPLoggerNode nodeWithLogger:logger loggerQueue:loggerQueue level:level];
+    TMPLoggerNode *loggerNode = [TMPLoggerNode nodeWithLogger:logger loggerQueue:loggerQueue level:level filter:filter];
+    TMPLoggerNodeLookUpLogger(loggerNode, object_getClass(logger));
     [self._loggers addObject:loggerNode];
 
+    if ([logger respondsToSelector:@selector(logsInline)] && [logger logsInline]) {
+        loggerNode->_logsInline = YES;
+        atomic_store_explicit(&loggerNode->_inline, YES, memory_order_relaxed);
+    }
+
+    // Proxies (like the buffering file logger proxy) are skipped, as their class isn't really a TMPAbstractLogger.
+    for (Class cls = object_getClass(logger); cls; cls = class_getSuperclass(cls)) {
+        if (cls == [TMPAbstractLogger class]) {
+            TMPAbstractLogger *abstractLogger = (TMPAbstractLogger *)logger;
+
+            if (abstractLogger.reusesSharedFormattedOutput) {
+                __block id <TMPLogFormatter> formatter;
+                dispatch_sync(loggerQueue, ^{
+                    formatter = abstractLogger->_logFormatter;
+                });
+
+                loggerNode->_sharingLogger = abstractLogger;
+                TMPAbstractLoggerSetShareableFormatter(abstractLogger, TMPShareableFormatter(formatter));
+            }
+            break;
+        }
+    }
+
+    [self lt_updateSharedFormatters];
+
     if ([logger respondsToSelector:@selector(didAddLoggerInQueue:)]) {
         dispatch_async(loggerNode->_loggerQueue, ^{ @autoreleasepool {
             [logger didAddLoggerInQueue:loggerNode->_loggerQueue];
@@ -742,7 +1480,7 @@ static NSUInteger _numProcessors;
 - (void)lt_removeLogger:(id <TMPLogger>)logger {
     // Find associated loggerNode in list of added loggers
 
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     TMPLoggerNode *loggerNode = nil;
@@ -766,12 +1504,18 @@ static NSUInteger _numProcessors;
         } });
     }
 
+    if ([logger respondsToSelector:@selector(wasRemovedFromLog:)]) {
+        [(TMPAbstractLogger *)logger wasRemovedFromLog:self];
+    }
+
     // Remove from loggers array
     [self._loggers removeObject:loggerNode];
+
+    [self lt_updateSharedFormatters];
 }
 
 - (void)lt_removeAllLoggers {
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     // Notify all loggers
@@ -781,15 +1525,21 @@ static NSUInteger _numProcessors;
                 [loggerNode->_logger willRemoveLogger];
             } });
         }
+
+        if ([loggerNode->_logger respondsToSelector:@selector(wasRemovedFromLog:)]) {
+            [(TMPAbstractLogger *)loggerNode->_logger wasRemovedFromLog:self];
+        }
     }
 
     // Remove all loggers from array
 
     [self._loggers removeAllObjects];
+
+    [self lt_updateSharedFormatters];
 }
 
 - (NSArray *)lt_allLoggers {
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     NSMutableArray *theLoggers = [NSMutableArray new];
@@ -802,7 +1552,7 @@ static NSUInteger _numProcessors;
 }
 
 - (NSArray *)lt_allLoggersWithLevel {
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     NSMutableArray *theLoggersWithLevel = [NSMutableArray new];
@@ -815,70 +1565,250 @@ static NSUInteger _numProcessors;
     return [theLoggersWithLevel copy];
 }
 
-- (void)lt_log:(TMPLogMessage *)logMessage {
-    // Execute the given log message on each of our loggers.
+- (void)lt_updateSharedFormatters {
+    // Groups the loggers by shareable formatter, once rather than for every message:
+    // each node of a group of two or more gets the formatter, and the flags that at least two of them log.
 
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
-    if (_numProcessors > 1) {
-        // Execute each logger concurrently, each within its own queue.
-        // All blocks are added to same group.
-        // After each block has been queued, wait on group.
-        //
-        // The waiting ensures that a slow logger doesn't end up with a large queue of pending log messages.
-        // This would defeat the purpose of the efforts we made earlier to restrict the max queue size.
+    // Read first, so that a change made while we're at it is picked up by the next message
+    _sharedFormattersGeneration = atomic_load_explicit(&TMPShareableFormatterGeneration, memory_order_acquire);
+    _sharesFormatters = NO;
 
-        for (TMPLoggerNode *loggerNode in self._loggers) {
-            // skip the loggers that shouldn't write this message based on the log level
+    NSArray<TMPLoggerNode *> *loggers = self._loggers;
+    NSUInteger count = loggers.count;
+    NSMutableArray *formatters = [NSMutableArray arrayWithCapacity:count];
 
-            if (!(logMessage->_flag & loggerNode->_level)) {
-                continue;
-            }
+    for (TMPLoggerNode *loggerNode in loggers) {
+        [formatters addObject:loggerNode->_sharingLogger.shareableFormatter ?: [NSNull null]];
+        loggerNode->_sharedFormatter = nil;
+        loggerNode->_sharedFlags = 0;
+    }
 
-            dispatch_group_async(_loggingGroup, loggerNode->_loggerQueue, ^{ @autoreleasepool {
-                [loggerNode->_logger logMessage:logMessage];
-            } });
+    for (NSUInteger i = 0; i < count; i++) {
+        if (formatters[i] == [NSNull null] || loggers[i]->_sharedFormatter != nil) {
+            continue;
         }
 
-        dispatch_group_wait(_loggingGroup, DISPATCH_TIME_FOREVER);
-    } else {
-        // Execute each logger serially, each within its own queue.
+        // The flags logged by at least one, then two, of the nodes of the group
+        TMPLogFlag onceFlags = 0;
+        TMPLogFlag twiceFlags = 0;
+        NSUInteger groupCount = 0;
+
+        for (NSUInteger j = i; j < count; j++) {
+            if (formatters[j] == formatters[i]) {
+                TMPLogFlag flags = (TMPLogFlag)loggers[j]->_level;
+                twiceFlags |= onceFlags & flags;
+                onceFlags |= flags;
+                groupCount++;
+            }
+        }
 
-        for (TMPLoggerNode *loggerNode in self._loggers) {
-            // skip the loggers that shouldn't write this message based on the log level
+        if (groupCount < 2 || twiceFlags == 0) {
+            continue;
+        }
 
-            if (!(logMessage->_flag & loggerNode->_level)) {
-                continue;
+        for (NSUInteger j = i; j < count; j++) {
+            if (formatters[j] == formatters[i]) {
+                loggers[j]->_sharedFormatter = formatters[i];
+                loggers[j]->_sharedFlags = twiceFlags;
             }
+        }
+        _sharesFormatters = YES;
+    }
+}
 
-#if TMP_DEBUG
-            // we must assure that we aren not on loggerNode->_loggerQueue.
-            if (loggerNode->_loggerQueue == NULL) {
-              // tell that we can't dispatch logger node on queue that is NULL.
-              NSLogDebug(@"TMPLog: current node has loggerQueue == NULL");
-            }
-            else {
-              dispatch_async(loggerNode->_loggerQueue, ^{
-                if (dispatch_get_specific(GlobalLoggingQueueIdentityKey)) {
-                  // tell that we somehow on logging queue?
-                  NSLogDebug(@"TMPLog: current node has loggerQueue == globalLoggingQueue");
-                }
-              });
+- (void)lt_formatSharedOutputOfMessage:(TMPLogMessage *)logMessage {
+    // If at least two of the loggers receiving the message use the same shareable formatter,
+    // the message is formatted here once, and every one of them reuses the output.
+    // Filters are not evaluated here; if they reject the message for one of the loggers,
+    // the output is still used by the others.
+
+    if (atomic_load_explicit(&TMPShareableFormatterGeneration, memory_order_relaxed) != _sharedFormattersGeneration) {
+        [self lt_updateSharedFormatters];
+    }
+
+    if (!_sharesFormatters) {
+        return;
+    }
+
+    for (TMPLoggerNode *loggerNode in self._loggers) {
+        if (loggerNode->_sharedFlags & logMessage->_flag) {
+            id <TMPLogFormatter> formatter = loggerNode->_sharedFormatter;
+            NSMutableData *output = [[NSMutableData alloc] initWithCapacity:256];
+            BOOL isFormatted = NO;
+
+            if (TMPLogFormatMessageToBuffer(formatter, logMessage, output, &isFormatted)) {
+                logMessage->_sharedOutput = output;
+                logMessage->_sharedOutputIsFormatted = isFormatted;
             }
-#endif
-            // next, we must check that node is OK.
-            dispatch_sync(loggerNode->_loggerQueue, ^{ @autoreleasepool {
-                [loggerNode->_logger logMessage:logMessage];
-            } });
+            logMessage->_sharedFormatter = formatter;
+
+            // A message holds the output of a single formatter.
+            return;
+        }
+    }
+}
+
+// Runs on the logger queue
+static inline void TMPLoggerNodeLogMessage(TMPLoggerNode *loggerNode, TMPLogMessage *logMessage) {
+    Class loggerClass = object_getClass(loggerNode->_logger);
+
+    if (loggerClass != loggerNode->_loggerClass) {
+        TMPLoggerNodeLookUpLogger(loggerNode, loggerClass);
+    }
+
+    uint64_t start = mach_absolute_time();
+
+    if (logMessage->_latencyTrace) {
+        TMPLogLatencyTraceHanded(logMessage->_latencyTrace, loggerNode->_logger, start);
+    }
+
+    ((void (*)(id, SEL, TMPLogMessage *))loggerNode->_logMessageIMP)(loggerNode->_logger, @selector(logMessage:), logMessage);
+
+    uint64_t end = mach_absolute_time();
+    TMPLogHistogramRecord(loggerNode->_latency, end - start);
+
+    // Only ever updated by the thread running the logger, the atomic is for the readers
+    double cost = atomic_load_explicit(&loggerNode->_cost, memory_order_relaxed);
+    cost = cost > 0 ? cost + ((double)(end - start) - cost) / 8 : (double)MAX(end - start, (uint64_t)1);
+    atomic_store_explicit(&loggerNode->_cost, cost, memory_order_relaxed);
+
+    if (logMessage->_latencyTrace) {
+        TMPLogLatencyTraceReturned(logMessage->_latencyTrace, loggerNode->_logger, end);
+    }
+}
+
+- (void)lt_evaluateInlineLoggers {
+    // Loggers whose average cost is under the threshold are run by the logging thread, as the hop to a worker
+    // would cost more than the work. They go back to the pool above twice the threshold, so that a logger
+    // around the threshold doesn't switch at every evaluation.
+
+    NSAssert(TMPLogIsOnLoggingQueue(self),
+             @"This method should only be run on the logging thread/queue");
+
+    double threshold = atomic_load_explicit(&_inlineLoggerThreshold, memory_order_relaxed);
+
+    for (TMPLoggerNode *loggerNode in self._loggers) {
+        if (loggerNode->_logsInline) {
+            continue;
+        }
+
+        double cost = atomic_load_explicit(&loggerNode->_cost, memory_order_relaxed);
+        BOOL wasInline = atomic_load_explicit(&loggerNode->_inline, memory_order_relaxed);
+        BOOL isInline = cost > 0 && (wasInline ? cost <= threshold * 2 : cost < threshold);
+
+        if (isInline != wasInline) {
+            NSLogDebug(@"TMPLog: %@ now runs %@ (%.0f ns)", loggerNode->_logger, isInline ? @"inline" : @"in the pool", cost * TMPLogSecondsPerTick() * NSEC_PER_SEC);
+            atomic_store_explicit(&loggerNode->_inline, isInline, memory_order_relaxed);
         }
     }
+}
+
+// A message being delivered by the logger pool.
+// The logging thread and the workers take the loggers in turn, so a busy logger doesn't hold up the others.
+typedef struct {
+    __unsafe_unretained TMPLogMessage *message;
+    TMPLoggerNode * __unsafe_unretained *nodes;
+    NSUInteger count;
+    _Atomic(NSUInteger) next;
+} TMPLoggerPoolBatch;
+
+// A logger and the message to deliver to it, the context of TMPLoggerDeliver
+typedef struct {
+    __unsafe_unretained TMPLoggerNode *node;
+    __unsafe_unretained TMPLogMessage *message;
+} TMPLoggerDelivery;
+
+static void TMPLoggerDeliver(void *context) {
+    TMPLoggerDelivery *delivery = context;
+    TMPLoggerNodeLogMessage(delivery->node, delivery->message);
+}
+
+static void TMPLoggerPoolWork(void *context) {
+    TMPLoggerPoolBatch *batch = context;
+    NSUInteger index;
+
+    // A single pool for all the loggers this thread takes for the message
+    @autoreleasepool {
+        while ((index = atomic_fetch_add_explicit(&batch->next, 1, memory_order_relaxed)) < batch->count) {
+            TMPLoggerDelivery delivery = { batch->nodes[index], batch->message };
+
+            // dispatch_sync runs the function on this thread, once the logger queue is done with any other work
+            dispatch_sync_f(delivery.node->_loggerQueue, &delivery, TMPLoggerDeliver);
+        }
+    }
+}
+
+- (void)lt_log:(TMPLogMessage *)logMessage tookQueueSlot:(BOOL)tookQueueSlot {
+    // Execute the given log message on each of our loggers.
+
+    NSAssert(TMPLogIsOnLoggingQueue(self),
+             @"This method should only be run on the logging thread/queue");
+
+    [self lt_formatSharedOutputOfMessage:logMessage];
+
+    if (atomic_load_explicit(&_messagesDelivered, memory_order_relaxed) % kTMPLogInlineEvaluationInterval == 0) {
+        [self lt_evaluateInlineLoggers];
+    }
+
+    // The loggers handed to the pool fill the array from the start, the inline ones from the end.
+    NSUInteger loggerCount = self._loggers.count;
+    TMPLoggerNode * __unsafe_unretained loggerNodes[MAX(loggerCount, (NSUInteger)1)];
+    NSUInteger pooledCount = 0;
+    NSUInteger inlineStart = loggerCount;
+
+    for (TMPLoggerNode *loggerNode in self._loggers) {
+        // skip the loggers that shouldn't write this message based on the log level
+
+        if (!(logMessage->_flag & loggerNode->_level)) {
+            continue;
+        }
+
+        // skip the loggers whose filter rejects the message, before paying for the dispatch
+
+        if (loggerNode->_filter && ![loggerNode->_filter shouldLogMessage:logMessage]) {
+            continue;
+        }
+
+        if (atomic_load_explicit(&loggerNode->_inline, memory_order_relaxed)) {
+            loggerNodes[--inlineStart] = loggerNode;
+        } else {
+            loggerNodes[pooledCount++] = loggerNode;
+        }
+    }
+
+    TMPLoggerPoolBatch batch = { logMessage, loggerNodes, pooledCount, 0 };
+
+    // The logging thread takes its share of the loggers, so it needs at most width - 1 workers.
+    //
+    // It then waits for the workers, which ensures that a slow logger doesn't end up with a large queue
+    // of pending log messages. This would defeat the purpose of the efforts we made earlier to restrict the max queue size.
+
+    NSUInteger width = atomic_load_explicit(&_loggerPoolWidth, memory_order_relaxed);
+    NSUInteger workerCount = pooledCount > 1 ? MIN(pooledCount, width) - 1 : 0;
+
+    for (NSUInteger i = 0; i < workerCount; i++) {
+        dispatch_group_async_f(_loggingGroup, _loggerPoolQueue, &batch, TMPLoggerPoolWork);
+    }
+
+    for (NSUInteger i = inlineStart; i < loggerCount; i++) {
+        TMPLoggerDelivery delivery = { loggerNodes[i], logMessage };
+        dispatch_sync_f(delivery.node->_loggerQueue, &delivery, TMPLoggerDeliver);
+    }
+
+    TMPLoggerPoolWork(&batch);
+
+    if (workerCount > 0) {
+        dispatch_group_wait(_loggingGroup, DISPATCH_TIME_FOREVER);
+    }
 
     // If our queue got too big, there may be blocked threads waiting to add log messages to the queue.
     // Since we've now dequeued an item from the log, we may need to unblock the next thread.
 
     // We are using a counting semaphore provided by GCD.
-    // The semaphore is initialized with our TMPLOG_MAX_QUEUE_SIZE value.
+    // The semaphore is initialized with our maximumQueueSize value.
     // When a log message is queued this value is decremented.
     // When a log message is dequeued this value is incremented.
     // If the value ever drops below zero,
@@ -888,7 +1818,11 @@ static NSUInteger _numProcessors;
     // Dispatch semaphores call down to the kernel only when the calling thread needs to be blocked.
     // If the calling semaphore does not need to block, no kernel call is made.
 
-    dispatch_semaphore_signal(_queueSemaphore);
+    atomic_fetch_add_explicit(&_messagesDelivered, 1, memory_order_relaxed);
+
+    if (tookQueueSlot) {
+        dispatch_semaphore_signal(_queueSemaphore);
+    }
 }
 
 - (void)lt_flush {
@@ -897,11 +1831,11 @@ static NSUInteger _numProcessors;
     // Now we need to propagate the flush request to any loggers that implement the flush method.
     // This is designed for loggers that buffer IO.
 
-    NSAssert(dispatch_get_specific(GlobalLoggingQueueIdentityKey),
+    NSAssert(TMPLogIsOnLoggingQueue(self),
              @"This method should only be run on the logging thread/queue");
 
     for (TMPLoggerNode *loggerNode in self._loggers) {
-        if ([loggerNode->_logger respondsToSelector:@selector(flush)]) {
+        if (loggerNode->_respondsToFlush) {
             dispatch_group_async(_loggingGroup, loggerNode->_loggerQueue, ^{ @autoreleasepool {
                 [loggerNode->_logger flush];
             } });
@@ -976,6 +1910,97 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
     }
 }
 
+void TMPLogBufferAppendString(NSMutableData *buffer, NSString * __nullable string) {
+    NSUInteger length = string.length;
+
+    if (length == 0) {
+        return;
+    }
+
+    // Fast path: ASCII strings (e.g. most literals) expose their storage directly.
+    // Their length comes from the string, not strlen, as they may contain NUL characters.
+    const char *cString = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+
+    if (cString) {
+        [buffer appendBytes:cString length:[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding]];
+        return;
+    }
+
+    // Otherwise transcode straight into the buffer.
+    NSUInteger offset = buffer.length;
+    NSUInteger maxLength = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger usedLength = 0;
+
+    [buffer increaseLengthBy:maxLength];
+    [string getBytes:(char *)buffer.mutableBytes + offset
+           maxLength:maxLength
+          usedLength:&usedLength
+            encoding:NSUTF8StringEncoding
+             options:0
+               range:NSMakeRange(0, length)
+      remainingRange:NULL];
+    buffer.length = offset + usedLength;
+}
+
+BOOL TMPLogFormatMessageToBuffer(id <TMPLogFormatter> __nullable formatter,
+                                 TMPLogMessage *logMessage,
+                                 NSMutableData *buffer,
+                                 BOOL * __nullable isFormatted) {
+    if (formatter != nil && logMessage->_sharedFormatter == formatter) {
+        // Already formatted on the global logging queue, for all the loggers sharing this formatter.
+        if (logMessage->_sharedOutput == nil) {
+            return NO;
+        }
+
+        [buffer appendData:logMessage->_sharedOutput];
+
+        if (isFormatted) {
+            *isFormatted = logMessage->_sharedOutputIsFormatted;
+        }
+
+        return YES;
+    }
+
+    if (formatter == nil) {
+        TMPLogBufferAppendString(buffer, logMessage->_message);
+
+        if (isFormatted) {
+            *isFormatted = NO;
+        }
+
+        return YES;
+    }
+
+    if ([formatter respondsToSelector:@selector(formatLogMessage:toBuffer:)]) {
+        NSUInteger length = buffer.length;
+
+        if (![formatter formatLogMessage:logMessage toBuffer:buffer]) {
+            buffer.length = length;
+            return NO;
+        }
+
+        if (isFormatted) {
+            *isFormatted = YES;
+        }
+
+        return YES;
+    }
+
+    NSString *message = [formatter formatLogMessage:logMessage];
+
+    if (message == nil) {
+        return NO;
+    }
+
+    TMPLogBufferAppendString(buffer, message);
+
+    if (isFormatted) {
+        *isFormatted = message != logMessage->_message;
+    }
+
+    return YES;
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -984,9 +2009,10 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
 
 @implementation TMPLoggerNode
 
-- (instancetype)initWithLogger:(id <TMPLogger>)logger loggerQueue:(dispatch_queue_t)loggerQueue level:(TMPLogLevel)level {
+- (instancetype)initWithLogger:(id <TMPLogger>)logger loggerQueue:(dispatch_queue_t)loggerQueue level:(TMPLogLevel)level filter:(id <TMPLogFilter>)filter {
     if ((self = [super init])) {
         _logger = logger;
+        _filter = filter;
 
         if (loggerQueue) {
             _loggerQueue = loggerQueue;
@@ -996,12 +2022,13 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
         }
 
         _level = level;
+        _latency = calloc(1, sizeof(TMPLogHistogram));
     }
     return self;
 }
 
-+ (TMPLoggerNode *)nodeWithLogger:(id <TMPLogger>)logger loggerQueue:(dispatch_queue_t)loggerQueue level:(TMPLogLevel)level {
-    return [[TMPLoggerNode alloc] initWithLogger:logger loggerQueue:loggerQueue level:level];
++ (TMPLoggerNode *)nodeWithLogger:(id <TMPLogger>)logger loggerQueue:(dispatch_queue_t)loggerQueue level:(TMPLogLevel)level filter:(id <TMPLogFilter>)filter {
+    return [[TMPLoggerNode alloc] initWithLogger:logger loggerQueue:loggerQueue level:level filter:filter];
 }
 
 - (void)dealloc {
@@ -1010,6 +2037,8 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
         dispatch_release(_loggerQueue);
     }
     #endif
+
+    free(_latency);
 }
 
 @end
@@ -1018,6 +2047,29 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
 #pragma mark -
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+__thread uint64_t tmpLogSampleState = 0;
+
+uint64_t TMPLogSampleSeed(void) {
+    static _Atomic(uint64_t) seedCounter = 0;
+
+    // Different for every thread, even when seeded at the same time
+    uint64_t seed = mach_absolute_time()
+                  ^ (uint64_t)(uintptr_t)pthread_self()
+                  ^ atomic_fetch_add_explicit(&seedCounter, 0x9e3779b97f4a7c15ULL, memory_order_relaxed);
+
+    // splitmix64 finalizer, and xorshift state must not be zero
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+    seed ^= seed >> 31;
+
+    tmpLogSampleState = seed ?: 1;
+    return tmpLogSampleState;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 @implementation TMPLogMessage
 
 - (instancetype)init {
@@ -1071,6 +2123,35 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
 
         // Try to get the current queue's label
         _queueLabel = [[NSString alloc] initWithFormat:@"%s", dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL)];
+
+        // Retain the immutable context of this thread, it's shared with every other message logged in the same scope
+        _diagnosticContext = TMPLogCurrentDiagnosticContext();
+    }
+    return self;
+}
+
+- (instancetype)initWithMessage:(NSString *)message
+                          level:(TMPLogLevel)level
+                           flag:(TMPLogFlag)flag
+                        context:(NSInteger)context
+                           file:(NSString *)file
+                       function:(NSString *)function
+                           line:(NSUInteger)line
+                            tag:(id)tag
+                        options:(TMPLogMessageOptions)options
+                      timestamp:(NSDate *)timestamp
+                         fields:(TMPLogFields *)fields {
+    if ((self = [self initWithMessage:message
+                                level:level
+                                 flag:flag
+                              context:context
+                                 file:file
+                             function:function
+                                 line:line
+                                  tag:tag
+                              options:options
+                            timestamp:timestamp])) {
+        _fields = fields;
     }
     return self;
 }
@@ -1092,10 +2173,23 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
     newMessage->_threadID = _threadID;
     newMessage->_threadName = _threadName;
     newMessage->_queueLabel = _queueLabel;
+    newMessage->_fields = _fields;
+    newMessage->_diagnosticContext = _diagnosticContext;
+    newMessage->_latencyTrace = _latencyTrace;
 
     return newMessage;
 }
 
+- (NSUInteger)sampleRate {
+    TMPLogField field;
+
+    if ([_fields getField:&field forKey:TMPLogFieldSampleRateKey] && field.type == TMPLogFieldTypeInt && field.value.intValue > 1) {
+        return (NSUInteger)field.value.intValue;
+    }
+
+    return 1;
+}
+
 @end
 
 
@@ -1205,7 +2299,7 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block id <TMPLogFormatter> result;
 
@@ -1242,9 +2336,12 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
         }
     };
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_async(globalLoggingQueue, ^{
+        // Messages dispatched from now on are formatted with the new formatter.
+        TMPAbstractLoggerSetShareableFormatter(self, TMPShareableFormatter(logFormatter));
+
         dispatch_async(self->_loggerQueue, block);
     });
 }
@@ -1253,12 +2350,41 @@ NSString * __nullable TMPExtractFileNameWithoutExtension(const char *filePath, B
     return _loggerQueue;
 }
 
+- (BOOL)reusesSharedFormattedOutput {
+    return NO;
+}
+
 - (NSString *)loggerName {
     return NSStringFromClass([self class]);
 }
 
+- (TMPLog *)owningLog {
+    @synchronized (self) {
+        return _owningLog ?: [TMPLog sharedInstance];
+    }
+}
+
+- (void)wasAddedToLog:(TMPLog *)log {
+    @synchronized (self) {
+        _owningLog = log;
+    }
+}
+
+- (void)wasRemovedFromLog:(TMPLog *)log {
+    @synchronized (self) {
+        // Unless it was added to another instance since
+        if (_owningLog == log) {
+            _owningLog = nil;
+        }
+    }
+}
+
+- (dispatch_queue_t)globalLoggingQueue {
+    return [self owningLog].loggingQueue;
+}
+
 - (BOOL)isOnGlobalLoggingQueue {
-    return (dispatch_get_specific(GlobalLoggingQueueIdentityKey) != NULL);
+    return (dispatch_get_specific(LoggingQueueIdentityKey) == (__bridge void *)[self owningLog]);
 }
 
 - (BOOL)isOnInternalLoggerQueue {
@@ -0,0 +1,137 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+#import <stdatomic.h>
+
+// The tables of call sites of TMPLogRateLimiter and TMPLogCallSiteProfiler.
+//
+// A table is a power of 2 array of sites, each starting with a TMPLogCallSiteKey, that the logging threads
+// claim without locking (open addressing with linear probing). A claimed site is never freed.
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class TMPLog, TMPLogMessage;
+
+/**
+ * Queues a report of the rate limiter or the call site profiler, which neither of them checks.
+ **/
+FOUNDATION_EXTERN void TMPLogQueueReport(TMPLog *log, TMPLogMessage *report);
+
+// Sites probed before giving up on a full table
+static const NSUInteger kTMPLogCallSiteMaxProbes = 16;
+
+// Values of TMPLogCallSiteKey.file for unused sites, and for a site being claimed
+static const uintptr_t kTMPLogCallSiteFree = 0;
+static const uintptr_t kTMPLogCallSiteClaiming = 1;
+
+typedef struct {
+    _Atomic(uintptr_t) file; // The __FILE__ pointer, published once the other members are set
+    NSUInteger line;
+    NSInteger context;
+    const char * _Nullable function;
+} TMPLogCallSiteKey;
+
+static inline NSUInteger TMPLogCallSiteHash(const char *file, NSUInteger line, NSInteger context) {
+    uint64_t hash = (uint64_t)(uintptr_t)file ^ ((uint64_t)line << 32) ^ (uint64_t)context;
+
+    hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+
+    return (NSUInteger)hash;
+}
+
+/**
+ * Finds the site of `file`:`line` in `context` among the `capacity` sites of `siteSize` bytes at `sites`,
+ * claiming a free one the first time. `function` is only recorded, sites are told apart by the other members.
+ *
+ * Returns NULL if the table is full around the site's hash, or if another thread is claiming a site on the way,
+ * maybe for this call site: the message then isn't accounted for.
+ **/
+static inline TMPLogCallSiteKey * _Nullable TMPLogCallSiteFind(void *sites, size_t siteSize, NSUInteger capacity,
+                                                               const char *file, const char * _Nullable function,
+                                                               NSUInteger line, NSInteger context) {
+    NSUInteger index = TMPLogCallSiteHash(file, line, context);
+
+    for (NSUInteger probe = 0; probe < kTMPLogCallSiteMaxProbes; probe++, index++) {
+        TMPLogCallSiteKey *site = (TMPLogCallSiteKey *)((uint8_t *)sites + (index & (capacity - 1)) * siteSize);
+        uintptr_t siteFile = atomic_load_explicit(&site->file, memory_order_acquire);
+
+        if (siteFile == (uintptr_t)file) {
+            if (site->line == line && site->context == context) {
+                return site;
+            }
+            continue;
+        }
+
+        if (siteFile == kTMPLogCallSiteFree) {
+            uintptr_t expected = kTMPLogCallSiteFree;
+
+            if (atomic_compare_exchange_strong_explicit(&site->file, &expected, kTMPLogCallSiteClaiming,
+                                                        memory_order_acquire, memory_order_acquire)) {
+                site->line = line;
+                site->context = context;
+                site->function = function;
+                atomic_store_explicit(&site->file, (uintptr_t)file, memory_order_release);
+                return site;
+            }
+
+            siteFile = expected;
+
+            if (siteFile == (uintptr_t)file && site->line == line && site->context == context) {
+                return site;
+            }
+        }
+
+        if (siteFile == kTMPLogCallSiteClaiming) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * The file of a claimed site, which also publishes its other members, or NULL if the site isn't claimed yet.
+ **/
+static inline const char * _Nullable TMPLogCallSiteFile(TMPLogCallSiteKey *site) {
+    uintptr_t file = atomic_load_explicit(&site->file, memory_order_acquire);
+    return file > kTMPLogCallSiteClaiming ? (const char *)file : NULL;
+}
+
+/**
+ * A timer running `handler` every `interval` seconds on a utility queue, for the periodic reports logged
+ * by the rate limiter and the call site profiler. Already resumed, or nil if `interval` isn't positive.
+ **/
+static inline dispatch_source_t _Nullable TMPLogCallSiteReportTimer(NSTimeInterval interval, dispatch_block_t handler) {
+    if (!(interval > 0)) {
+        return nil;
+    }
+
+    dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+    uint64_t nanoseconds = (uint64_t)(interval * NSEC_PER_SEC);
+
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)nanoseconds), nanoseconds, nanoseconds / 10);
+    dispatch_source_set_event_handler(timer, ^{ @autoreleasepool {
+        handler();
+    } });
+    dispatch_resume(timer);
+
+    return timer;
+}
+
+NS_ASSUME_NONNULL_END
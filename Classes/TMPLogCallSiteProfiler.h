@@ -0,0 +1,111 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+/**
+ * Number of call sites a profiler keeps track of. Messages from further call sites are not counted.
+ * Must be a power of 2.
+ **/
+#ifndef TMP_LOG_CALL_SITE_PROFILER_SITES
+    #define TMP_LOG_CALL_SITE_PROFILER_SITES 1024
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * What a call site logged over the window of a `TMPLogCallSiteProfiler`.
+ **/
+@interface TMPLogCallSite : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@property (nonatomic, readonly, copy) NSString *file;
+@property (nonatomic, readonly, copy) NSString *fileName;
+@property (nonatomic, readonly, copy, nullable) NSString *function;
+@property (nonatomic, readonly) NSUInteger line;
+
+/**
+ * Number of messages logged.
+ **/
+@property (nonatomic, readonly) uint64_t messages;
+
+/**
+ * Size of the formatted messages, in UTF-8 bytes.
+ **/
+@property (nonatomic, readonly) uint64_t bytes;
+
+@end
+
+/**
+ * Counts the messages and bytes each call site (file and line) logs, to find the statements responsible for the log volume.
+ * Install it with `TMPLog.callSiteProfiler`.
+ *
+ * Counting finds the site in a fixed size open addressing table, the one `TMPLogRateLimiter` uses,
+ * and adds to two relaxed atomic counters, without locking. Messages passed as `TMPLogMessage` objects are counted
+ * by file name and line, or by the call site pointers passed with them (see `-[TMPLog log:message:file:function:]`).
+ *
+ * The counters are copied every sixth of `window`, so the reports cover the last `window` (give or take a sixth).
+ **/
+@interface TMPLogCallSiteProfiler : NSObject
+
+/**
+ * Reports over the last minute.
+ **/
+- (instancetype)init;
+
+/**
+ * Reports over the last `window` seconds.
+ **/
+- (instancetype)initWithWindow:(NSTimeInterval)window NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSTimeInterval window;
+
+/**
+ * How often the report is logged, as an info message, while the profiler is installed. 0 (the default) never logs it.
+ * Read when the profiler is installed.
+ **/
+@property (nonatomic, assign) NSTimeInterval reportInterval;
+
+/**
+ * Number of call sites in the logged report. Defaults to 10.
+ **/
+@property (nonatomic, assign) NSUInteger reportCount;
+
+/**
+ * The `count` call sites that logged the most bytes over the window, the most first.
+ **/
+- (NSArray<TMPLogCallSite *> *)topCallSites:(NSUInteger)count;
+
+/**
+ * The `topCallSites:` as a table: bytes, messages and call site, one site per line.
+ **/
+- (NSString *)reportWithCount:(NSUInteger)count;
+
+@end
+
+/**
+ * Used by `TMPLog`: counts a formatted message of the given call site.
+ **/
+FOUNDATION_EXTERN void TMPLogCallSiteProfilerCount(TMPLogCallSiteProfiler *profiler, const char *file, const char * __nullable function, NSUInteger line, NSString *message);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,266 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogCallSiteProfiler.h"
+#import "TMPLogCallSite+Internal.h"
+
+#import <stdatomic.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+#if (TMP_LOG_CALL_SITE_PROFILER_SITES & (TMP_LOG_CALL_SITE_PROFILER_SITES - 1)) != 0
+    #error TMP_LOG_CALL_SITE_PROFILER_SITES must be a power of 2
+#endif
+
+// Copies of the counters kept for the sliding window, taken every window / kTMPCallSiteProfilerSnapshots
+static const NSUInteger kTMPCallSiteProfilerSnapshots = 6;
+
+typedef struct {
+    TMPLogCallSiteKey key; // The context is always 0
+
+    _Atomic(uint64_t) messages;
+    _Atomic(uint64_t) bytes;
+} TMPLogCallSiteProfilerSite;
+
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+} TMPLogCallSiteProfilerCounts;
+
+@interface TMPLogCallSite ()
+
+- (instancetype)initWithFile:(const char *)file function:(const char *)function line:(NSUInteger)line messages:(uint64_t)messages bytes:(uint64_t)bytes;
+
+@end
+
+@implementation TMPLogCallSite
+
+- (instancetype)initWithFile:(const char *)file function:(const char *)function line:(NSUInteger)line messages:(uint64_t)messages bytes:(uint64_t)bytes {
+    if ((self = [super init])) {
+        _file = @(file);
+        _fileName = _file.lastPathComponent;
+        _function = function ? @(function) : nil;
+        _line = line;
+        _messages = messages;
+        _bytes = bytes;
+    }
+    return self;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"%@:%lu %@", _fileName, (unsigned long)_line, _function ?: @""];
+}
+
+@end
+
+@interface TMPLogCallSiteProfiler () {
+    TMPLogCallSiteProfilerSite *_sites;
+
+    // Ring of copies of the counters, only accessed on _queue
+    dispatch_queue_t _queue;
+    dispatch_source_t _snapshotTimer;
+    TMPLogCallSiteProfilerCounts *_snapshots;
+    NSUInteger _nextSnapshot;
+    NSUInteger _snapshotCount;
+
+    // Set by -[TMPLog setCallSiteProfiler:]
+    __weak TMPLog *_log;
+    dispatch_source_t _reportTimer;
+}
+
+@end
+
+@implementation TMPLogCallSiteProfiler
+
+- (instancetype)init {
+    return [self initWithWindow:60];
+}
+
+- (instancetype)initWithWindow:(NSTimeInterval)window {
+    if ((self = [super init])) {
+        _window = window;
+        _reportCount = 10;
+
+        _sites = calloc(TMP_LOG_CALL_SITE_PROFILER_SITES, sizeof(TMPLogCallSiteProfilerSite));
+        _snapshots = calloc(kTMPCallSiteProfilerSnapshots * TMP_LOG_CALL_SITE_PROFILER_SITES, sizeof(TMPLogCallSiteProfilerCounts));
+
+        _queue = dispatch_queue_create("cocoa.lumberjack.callSiteProfiler", DISPATCH_QUEUE_SERIAL);
+        _snapshotTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+
+        uint64_t interval = (uint64_t)(window / kTMPCallSiteProfilerSnapshots * NSEC_PER_SEC);
+        dispatch_source_set_timer(_snapshotTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10);
+
+        __unsafe_unretained TMPLogCallSiteProfiler *unretainedSelf = self;
+        dispatch_source_set_event_handler(_snapshotTimer, ^{
+            // The timer is cancelled by dealloc, before self goes away
+            [unretainedSelf lt_takeSnapshot];
+        });
+
+        dispatch_resume(_snapshotTimer);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_reportTimer) {
+        dispatch_source_cancel(_reportTimer);
+    }
+
+    dispatch_source_cancel(_snapshotTimer);
+
+    // Waits for a snapshot being taken
+    dispatch_sync(_queue, ^{});
+
+    free(_sites);
+    free(_snapshots);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Window
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)lt_takeSnapshot {
+    TMPLogCallSiteProfilerCounts *snapshot = &_snapshots[_nextSnapshot * TMP_LOG_CALL_SITE_PROFILER_SITES];
+
+    for (NSUInteger i = 0; i < TMP_LOG_CALL_SITE_PROFILER_SITES; i++) {
+        snapshot[i].messages = atomic_load_explicit(&_sites[i].messages, memory_order_relaxed);
+        snapshot[i].bytes = atomic_load_explicit(&_sites[i].bytes, memory_order_relaxed);
+    }
+
+    _nextSnapshot = (_nextSnapshot + 1) % kTMPCallSiteProfilerSnapshots;
+    _snapshotCount = MIN(_snapshotCount + 1, kTMPCallSiteProfilerSnapshots);
+}
+
+- (NSArray<TMPLogCallSite *> *)topCallSites:(NSUInteger)count {
+    NSMutableArray<TMPLogCallSite *> *callSites = [NSMutableArray array];
+
+    dispatch_sync(_queue, ^{
+        // The oldest copy is a window old, nothing was counted before the first one
+        const TMPLogCallSiteProfilerCounts *baseline = NULL;
+
+        if (_snapshotCount == kTMPCallSiteProfilerSnapshots) {
+            baseline = &_snapshots[_nextSnapshot * TMP_LOG_CALL_SITE_PROFILER_SITES];
+        }
+
+        for (NSUInteger i = 0; i < TMP_LOG_CALL_SITE_PROFILER_SITES; i++) {
+            TMPLogCallSiteProfilerSite *site = &_sites[i];
+            const char *file = TMPLogCallSiteFile(&site->key);
+
+            if (!file) {
+                continue;
+            }
+
+            uint64_t messages = atomic_load_explicit(&site->messages, memory_order_relaxed) - (baseline ? baseline[i].messages : 0);
+            uint64_t bytes = atomic_load_explicit(&site->bytes, memory_order_relaxed) - (baseline ? baseline[i].bytes : 0);
+
+            if (messages > 0) {
+                [callSites addObject:[[TMPLogCallSite alloc] initWithFile:file
+                                                                 function:site->key.function
+                                                                     line:site->key.line
+                                                                 messages:messages
+                                                                    bytes:bytes]];
+            }
+        }
+    });
+
+    [callSites sortUsingComparator:^NSComparisonResult(TMPLogCallSite *site1, TMPLogCallSite *site2) {
+        if (site1.bytes != site2.bytes) {
+            return site1.bytes > site2.bytes ? NSOrderedAscending : NSOrderedDescending;
+        }
+
+        if (site1.messages != site2.messages) {
+            return site1.messages > site2.messages ? NSOrderedAscending : NSOrderedDescending;
+        }
+
+        return NSOrderedSame;
+    }];
+
+    if (callSites.count > count) {
+        [callSites removeObjectsInRange:NSMakeRange(count, callSites.count - count)];
+    }
+
+    return callSites;
+}
+
+- (NSString *)reportWithCount:(NSUInteger)count {
+    NSMutableString *report = [NSMutableString stringWithFormat:@"Top log call sites over the last %g s:\n%12s %10s  %s",
+                               _window, "bytes", "messages", "site"];
+
+    for (TMPLogCallSite *site in [self topCallSites:count]) {
+        [report appendFormat:@"\n%12llu %10llu  %@", site.bytes, site.messages, site];
+    }
+
+    return report;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Reporting
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)setLog:(TMPLog *)log {
+    if (_reportTimer) {
+        dispatch_source_cancel(_reportTimer);
+    }
+
+    _log = log;
+
+    __weak __auto_type weakSelf = self;
+    _reportTimer = log ? TMPLogCallSiteReportTimer(_reportInterval, ^{
+        [weakSelf logReport];
+    }) : nil;
+}
+
+- (void)logReport {
+    TMPLog *log = _log;
+
+    if (!log) {
+        return;
+    }
+
+    // Not counted, see TMPLogQueueReport
+    TMPLogMessage *report = [[TMPLogMessage alloc] initWithMessage:[self reportWithCount:_reportCount]
+                                                             level:TMPLogLevelAll
+                                                              flag:TMPLogFlagInfo
+                                                           context:0
+                                                              file:@(__FILE__)
+                                                          function:nil
+                                                              line:__LINE__
+                                                               tag:nil
+                                                           options:TMPLogMessageDontCopyMessage
+                                                         timestamp:nil];
+
+    TMPLogQueueReport(log, report);
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Counting
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TMPLogCallSiteProfilerCount(TMPLogCallSiteProfiler *profiler, const char *file, const char *function, NSUInteger line, NSString *message) {
+    TMPLogCallSiteProfilerSite *site = (TMPLogCallSiteProfilerSite *)TMPLogCallSiteFind(profiler->_sites, sizeof(TMPLogCallSiteProfilerSite), TMP_LOG_CALL_SITE_PROFILER_SITES,
+                                                                                        file, function, line, 0);
+
+    if (!site) {
+        return;
+    }
+
+    atomic_fetch_add_explicit(&site->messages, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->bytes, [message lengthOfBytesUsingEncoding:NSUTF8StringEncoding], memory_order_relaxed);
+}
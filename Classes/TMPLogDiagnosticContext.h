@@ -0,0 +1,200 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+#import <CocoaLumberjack/TMPLogFields.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A mapped diagnostic context (MDC): fields, like a request or trace id, that apply to every message
+ * logged by a thread while a scope is active.
+ *
+ * Each thread has its own stack of scopes. Pushing a scope creates an immutable context node pointing to its parent,
+ * and every `TMPLogMessage` created on the thread retains the current node. Nothing is copied per message,
+ * so the context travels with the message to the loggers' queues, and is shared by all messages
+ * logged until the next push or pop.
+ *
+ * ```
+ * TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldString("request", requestID)));
+ * TMPLogInfo(@"Started");   // Both messages carry request=...
+ * TMPLogInfo(@"Finished");
+ * ```
+ *
+ * Formatters render the context along with the message fields (`%X` in `TMPPatternLogFormatter`,
+ * `TMPJSONLogFieldDiagnosticContext`, `TMPLogFileFormatterDefault`), and `TMPLogFieldFilter` matches on it.
+ **/
+@interface TMPLogDiagnosticContext : NSObject
+
+/**
+ * Unavailable, push scopes with `+[TMPLog pushContextFields:]` or `TMPLogContextScoped`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * The innermost context of the current thread, nil if no scope is active.
+ **/
+@property (class, nonatomic, readonly, nullable) TMPLogDiagnosticContext *currentContext;
+
+/**
+ * The enclosing context, nil for the outermost scope.
+ **/
+@property (nonatomic, readonly, nullable) TMPLogDiagnosticContext *parent;
+
+/**
+ * Number of scopes, including this one.
+ **/
+@property (nonatomic, readonly) NSUInteger depth;
+
+/**
+ * The fields pushed by this scope.
+ **/
+@property (nonatomic, readonly) TMPLogFields *scopeFields;
+
+/**
+ * The fields of this scope and all enclosing ones, outermost first.
+ * If several scopes use the same key, only the innermost value is kept.
+ * Computed once per context, the first time it is needed.
+ **/
+@property (nonatomic, readonly) TMPLogFields *fields;
+
+/**
+ * Whether the scope is debug sampled: while it is the innermost context of a thread, the level checks of the log macros
+ * let every message through up to verbose on that thread only, if enabled with `TMP_LOG_SAMPLING_ENABLED`
+ * (or `sampledLoggingEnabled` in Swift).
+ * Loggers added with a lower level still drop the extra messages.
+ * Scopes nested in a sampled scope are sampled too.
+ **/
+@property (nonatomic, readonly, getter=isSampled) BOOL sampled;
+
+/**
+ * The level added to the log level checks on the current thread: `TMPLogLevelVerbose` if the current context is sampled,
+ * `TMPLogLevelOff` otherwise.
+ **/
+@property (class, nonatomic, readonly) TMPLogLevel sampledLevel;
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLog (TMPLogDiagnosticContext)
+
+/**
+ * Pushes a scope with the given fields on the current thread's context stack.
+ * Every push must be balanced by a `popContext` on the same thread.
+ **/
++ (void)pushContextFields:(TMPLogFields *)fields NS_SWIFT_NAME(pushContext(fields:));
+
+/**
+ * Pushes a scope, debug sampled if `sampled` is YES or if the current scope is sampled (see `TMPLogDiagnosticContext.sampled`).
+ **/
++ (void)pushContextFields:(TMPLogFields *)fields sampled:(BOOL)sampled NS_SWIFT_NAME(pushContext(fields:sampled:));
+
+/**
+ * Pushes a scope for a request, debug sampled if its trace id falls within `sampleRate` (see `TMPLogTraceIsSampled`)
+ * or if the current scope is sampled.
+ **/
++ (void)pushContextFields:(TMPLogFields *)fields
+                  traceID:(NSString *)traceID
+               sampleRate:(double)sampleRate NS_SWIFT_NAME(pushContext(fields:traceID:sampleRate:));
+
+/**
+ * Pops the innermost scope of the current thread. Does nothing if no scope is active.
+ **/
++ (void)popContext;
+
+/**
+ * Runs `block` with a scope holding the given fields.
+ **/
++ (void)performWithContextFields:(TMPLogFields *)fields block:(NS_NOESCAPE void (^)(void))block NS_SWIFT_NAME(withContext(fields:_:));
+
+@end
+
+/**
+ * Returns the innermost context of the current thread, nil if no scope is active.
+ * A single thread-local read, used by `TMPLogMessage` to capture the context.
+ **/
+FOUNDATION_EXTERN TMPLogDiagnosticContext * __nullable TMPLogCurrentDiagnosticContext(void) NS_SWIFT_UNAVAILABLE("Use TMPLogDiagnosticContext.current");
+
+/**
+ * The sampled level of the current thread (see `TMPLogDiagnosticContext.sampledLevel`).
+ * A plain thread-local variable, so the log macros check it with a single load. Don't modify it.
+ **/
+FOUNDATION_EXTERN __thread TMPLogLevel tmpLogSampledLevel;
+
+/**
+ * Whether a trace id falls within the sample rate, between 0 and 1.
+ * The trace id is hashed, so a given trace is sampled the same way by every thread, process and service.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogTraceIsSampled(const char *traceID, NSUInteger length, double sampleRate);
+
+/**
+ * Token returned by `TMPLogContextScopePush`: the depth of the context stack after the push.
+ **/
+typedef NSUInteger TMPLogContextScope;
+
+/**
+ * Pushes a scope, returning a token for `TMPLogContextScopePop`.
+ **/
+FOUNDATION_EXTERN TMPLogContextScope TMPLogContextScopePush(TMPLogFields *fields) NS_SWIFT_UNAVAILABLE("Use TMPLog.withContext(fields:_:)");
+
+/**
+ * Pushes a scope, debug sampled if `sampled` is YES or if the current scope is sampled.
+ **/
+FOUNDATION_EXTERN TMPLogContextScope TMPLogContextScopePushSampled(TMPLogFields *fields, BOOL sampled) NS_SWIFT_UNAVAILABLE("Use TMPLog.pushContext(fields:sampled:)");
+
+/**
+ * Pops the scope pushed by `TMPLogContextScopePush`. Takes a pointer, so it can be used as a cleanup function.
+ **/
+FOUNDATION_EXTERN void TMPLogContextScopePop(TMPLogContextScope *scope) NS_SWIFT_UNAVAILABLE("Use TMPLog.withContext(fields:_:)");
+
+#define TMP_CONTEXT_SCOPE_CONCAT_(a, b) a ## b
+#define TMP_CONTEXT_SCOPE_CONCAT(a, b) TMP_CONTEXT_SCOPE_CONCAT_(a, b)
+
+/**
+ * Pushes a scope with the given fields, which is popped automatically when the enclosing C scope ends.
+ **/
+#define TMPLogContextScoped(flds)                                                                       \
+        __attribute__((cleanup(TMPLogContextScopePop), unused))                                         \
+        TMPLogContextScope TMP_CONTEXT_SCOPE_CONCAT(tmpLogContextScope, __LINE__) = TMPLogContextScopePush(flds)
+
+/**
+ * Same as `TMPLogContextScoped`, debug sampling the scope if `smpld` is YES.
+ **/
+#define TMPLogContextScopedSampled(flds, smpld)                                                         \
+        __attribute__((cleanup(TMPLogContextScopePop), unused))                                         \
+        TMPLogContextScope TMP_CONTEXT_SCOPE_CONCAT(tmpLogContextScope, __LINE__) = TMPLogContextScopePushSampled(flds, smpld)
+
+/**
+ * Looks up a field of the message: its own fields first, then its diagnostic context (innermost first).
+ **/
+FOUNDATION_EXTERN BOOL TMPLogMessageGetField(TMPLogMessage *logMessage, TMPLogField *field, const char *key);
+
+/**
+ * Appends the diagnostic context and the fields of the message as logfmt (see `TMPLogFieldsAppendLogfmt`).
+ * Returns NO, without appending anything, if there are none.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogMessageAppendFieldsLogfmt(NSMutableData *buffer, TMPLogMessage *logMessage);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,291 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogDiagnosticContext.h"
+
+#import <pthread.h>
+#import <stdatomic.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+// The thread-local slot holds a retained reference to the innermost context of the thread.
+// Each context retains its parent, so the whole stack is kept alive by that single reference
+// (and by the messages that captured one of its contexts).
+__thread TMPLogLevel tmpLogSampledLevel = TMPLogLevelOff;
+
+static void TMPLogDiagnosticContextRelease(void *context) {
+    CFRelease(context);
+}
+
+static pthread_key_t TMPLogDiagnosticContextKey(void) {
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, TMPLogDiagnosticContextRelease);
+    });
+
+    return key;
+}
+
+@interface TMPLogDiagnosticContext () {
+    // Read by the push and pop functions below
+    TMPLogDiagnosticContext *_parent;
+    NSUInteger _depth;
+    BOOL _sampled;
+
+    // Merged fields of the whole stack, computed lazily and then shared by every message with this context
+    _Atomic(void *) _mergedFields;
+}
+
+@end
+
+@implementation TMPLogDiagnosticContext
+
+- (instancetype)initWithParent:(TMPLogDiagnosticContext *)parent scopeFields:(TMPLogFields *)scopeFields sampled:(BOOL)sampled {
+    if ((self = [super init])) {
+        _parent = parent;
+        _depth = parent.depth + 1;
+        _scopeFields = scopeFields;
+        _sampled = sampled || parent.sampled;
+
+        // The outermost scope has nothing to merge
+        atomic_init(&_mergedFields, parent ? NULL : (void *)CFBridgingRetain(scopeFields));
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    void *mergedFields = atomic_load_explicit(&_mergedFields, memory_order_relaxed);
+
+    if (mergedFields) {
+        CFRelease(mergedFields);
+    }
+}
+
++ (TMPLogDiagnosticContext *)currentContext {
+    return TMPLogCurrentDiagnosticContext();
+}
+
++ (TMPLogLevel)sampledLevel {
+    return tmpLogSampledLevel;
+}
+
+- (TMPLogFields *)mergeFields {
+    TMPLogFields *parentFields = _parent.fields;
+    NSUInteger parentCount = parentFields.count;
+    NSUInteger scopeCount = _scopeFields.count;
+
+    if (scopeCount == 0) {
+        return parentFields;
+    }
+
+    TMPLogField *fields = malloc((parentCount + scopeCount) * sizeof(TMPLogField));
+    NSUInteger count = 0;
+
+    // The parent's fields have unique keys already
+    for (NSUInteger i = 0; i < parentCount; i++) {
+        fields[count++] = [parentFields fieldAtIndex:i];
+    }
+
+    for (NSUInteger i = 0; i < scopeCount; i++) {
+        TMPLogField field = [_scopeFields fieldAtIndex:i];
+        NSUInteger index = 0;
+
+        while (index < count && strcmp(fields[index].key, field.key) != 0) {
+            index++;
+        }
+
+        if (index == count) {
+            fields[count++] = field;
+        } else if (index < parentCount) {
+            // Shadows an enclosing scope, keeping the position of the outer field
+            fields[index] = field;
+        }
+        // Otherwise the key appears twice in this scope, and the first one wins like in -[TMPLogFields getField:forKey:]
+    }
+
+    // The fields point into parentFields and _scopeFields, which are copied here
+    TMPLogFields *mergedFields = [TMPLogFields fieldsWithFields:fields count:count];
+    free(fields);
+
+    return mergedFields;
+}
+
+- (TMPLogFields *)fields {
+    void *mergedFields = atomic_load_explicit(&_mergedFields, memory_order_acquire);
+
+    if (mergedFields) {
+        return (__bridge TMPLogFields *)mergedFields;
+    }
+
+    // Several threads may get here at the same time for a context shared by their messages:
+    // they all merge, and the first one to publish its result wins.
+    TMPLogFields *fields = [self mergeFields];
+    void *retainedFields = (void *)CFBridgingRetain(fields);
+    void *expected = NULL;
+
+    if (!atomic_compare_exchange_strong_explicit(&_mergedFields, &expected, retainedFields, memory_order_acq_rel, memory_order_acquire)) {
+        CFRelease(retainedFields);
+        return (__bridge TMPLogFields *)expected;
+    }
+
+    return fields;
+}
+
+- (NSString *)description {
+    return [self.fields description];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TMPLogDiagnosticContext * TMPLogCurrentDiagnosticContext(void) {
+    return (__bridge TMPLogDiagnosticContext *)pthread_getspecific(TMPLogDiagnosticContextKey());
+}
+
+BOOL TMPLogTraceIsSampled(const char *traceID, NSUInteger length, double sampleRate) {
+    if (sampleRate >= 1.0) {
+        return YES;
+    }
+
+    if (!(sampleRate > 0.0)) {
+        return NO;
+    }
+
+    // FNV-1a, then the splitmix64 finalizer so that similar ids (e.g. sequential ones) spread over the whole range.
+    // Both are fixed, so every process agrees on which traces are sampled.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (NSUInteger i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)traceID[i]) * 0x100000001b3ULL;
+    }
+
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+
+    // The top 53 bits as a uniform double in [0, 1)
+    return (double)(hash >> 11) * 0x1.0p-53 < sampleRate;
+}
+
+static inline void TMPLogSetCurrentContext(pthread_key_t key, TMPLogDiagnosticContext *context) {
+    pthread_setspecific(key, context ? CFBridgingRetain(context) : NULL);
+    tmpLogSampledLevel = (context && context->_sampled) ? TMPLogLevelVerbose : TMPLogLevelOff;
+}
+
+TMPLogContextScope TMPLogContextScopePushSampled(TMPLogFields *fields, BOOL sampled) {
+    NSCParameterAssert(fields);
+
+    pthread_key_t key = TMPLogDiagnosticContextKey();
+    TMPLogDiagnosticContext *parent = (__bridge TMPLogDiagnosticContext *)pthread_getspecific(key);
+
+    // A single allocation: the context points to its parent instead of copying its fields
+    TMPLogDiagnosticContext *context = [[TMPLogDiagnosticContext alloc] initWithParent:parent scopeFields:fields sampled:sampled];
+
+    // The thread's reference to the parent is handed over to the new context
+    TMPLogSetCurrentContext(key, context);
+
+    if (parent) {
+        CFRelease((__bridge CFTypeRef)parent);
+    }
+
+    return context->_depth;
+}
+
+TMPLogContextScope TMPLogContextScopePush(TMPLogFields *fields) {
+    return TMPLogContextScopePushSampled(fields, NO);
+}
+
+static void TMPLogContextPop(pthread_key_t key, void *current) {
+    TMPLogDiagnosticContext *context = CFBridgingRelease(current);
+    TMPLogSetCurrentContext(key, context->_parent);
+}
+
+void TMPLogContextScopePop(TMPLogContextScope *scope) {
+    pthread_key_t key = TMPLogDiagnosticContextKey();
+    void *current = pthread_getspecific(key);
+
+    NSCAssert(current && ((__bridge TMPLogDiagnosticContext *)current)->_depth == *scope,
+              @"Unbalanced diagnostic context scopes");
+
+    if (current) {
+        TMPLogContextPop(key, current);
+    }
+}
+
+BOOL TMPLogMessageGetField(TMPLogMessage *logMessage, TMPLogField *field, const char *key) {
+    return [logMessage->_fields getField:field forKey:key]
+        || [logMessage->_diagnosticContext.fields getField:field forKey:key];
+}
+
+BOOL TMPLogMessageAppendFieldsLogfmt(NSMutableData *buffer, TMPLogMessage *logMessage) {
+    TMPLogFields *contextFields = logMessage->_diagnosticContext.fields;
+    TMPLogFields *fields = logMessage->_fields;
+
+    if (contextFields.count == 0 && fields.count == 0) {
+        return NO;
+    }
+
+    TMPLogFieldsAppendLogfmt(buffer, contextFields);
+
+    if (contextFields.count > 0 && fields.count > 0) {
+        [buffer appendBytes:" " length:1];
+    }
+
+    TMPLogFieldsAppendLogfmt(buffer, fields);
+    return YES;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@implementation TMPLog (TMPLogDiagnosticContext)
+
++ (void)pushContextFields:(TMPLogFields *)fields {
+    TMPLogContextScopePushSampled(fields, NO);
+}
+
++ (void)pushContextFields:(TMPLogFields *)fields sampled:(BOOL)sampled {
+    TMPLogContextScopePushSampled(fields, sampled);
+}
+
++ (void)pushContextFields:(TMPLogFields *)fields traceID:(NSString *)traceID sampleRate:(double)sampleRate {
+    const char *bytes = traceID.UTF8String ?: "";
+    TMPLogContextScopePushSampled(fields, TMPLogTraceIsSampled(bytes, strlen(bytes), sampleRate));
+}
+
++ (void)popContext {
+    pthread_key_t key = TMPLogDiagnosticContextKey();
+    void *current = pthread_getspecific(key);
+
+    if (current) {
+        TMPLogContextPop(key, current);
+    }
+}
+
++ (void)performWithContextFields:(TMPLogFields *)fields block:(NS_NOESCAPE void (^)(void))block {
+    TMPLogContextScoped(fields);
+    block();
+}
+
+@end
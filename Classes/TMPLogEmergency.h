@@ -0,0 +1,108 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+/**
+ * Number of file descriptors, and of drains, the emergency path can hold.
+ **/
+#ifndef TMP_LOG_EMERGENCY_SLOTS
+    #define TMP_LOG_EMERGENCY_SLOTS 8
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Emergency logging
+ *
+ * `TMPLog` can't be used once the process received a fatal signal: it allocates, dispatches and takes locks,
+ * and the crash may well have happened while one of them was held. The functions below are async-signal-safe:
+ * they only read fixed size tables, and write preformatted bytes with write(2).
+ *
+ * Messages go to stderr, and to the file descriptors registered with `TMPLogEmergencyAddFileDescriptor`,
+ * which `TMPFileLogger` does for its current log file. Drains registered with `TMPLogEmergencyAddDrain`
+ * write what loggers still hold in memory: the buffer of a `TMPFileLogger` wrapped with `wrapWithBuffer`,
+ * and the window of a `TMPFlightRecorderLogger`.
+ **/
+
+/**
+ * Writes `message` followed by a newline to stderr and to the registered file descriptors.
+ * Framed file descriptors get a record (see `TMPLogRecordHeader`) stamped with the current time instead.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyWrite(TMPLogFlag flag, const char *message, size_t length);
+
+/**
+ * Same as `TMPLogEmergencyWrite`, for a message logged earlier: `timestamp` is in microseconds since 1970.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyWriteRecord(int64_t timestamp, NSInteger context, TMPLogFlag flag, const char *message, size_t length);
+
+/**
+ * Writes `length` bytes to `fd` as they are, retrying on interrupted and partial writes.
+ * Regular files are written at their end.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyWriteBytes(int fd, const void *bytes, size_t length);
+
+/**
+ * Registers a file descriptor the emergency messages are written to, as framed records if `framed` is YES.
+ * Returns NO if all the slots are taken.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogEmergencyAddFileDescriptor(int fd, BOOL framed);
+
+/**
+ * Unregisters the file descriptor. Must be called before it's closed.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyRemoveFileDescriptor(int fd);
+
+/**
+ * A function writing what a logger holds in memory, called from the crash handler.
+ * It must be async-signal-safe: no allocation, no lock, no Objective-C message.
+ **/
+typedef void (*TMPLogEmergencyDrainFunction)(void * __nullable context);
+
+/**
+ * Registers a drain. `context` must stay valid until the drain is removed.
+ * Returns NO if all the slots are taken.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogEmergencyAddDrain(TMPLogEmergencyDrainFunction function, void * __nullable context);
+
+/**
+ * Unregisters a drain.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyRemoveDrain(TMPLogEmergencyDrainFunction function, void * __nullable context);
+
+/**
+ * Calls the registered drains, one after the other.
+ **/
+FOUNDATION_EXTERN void TMPLogEmergencyDrain(void);
+
+/**
+ * Installs handlers for SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT and SIGTRAP.
+ * They write the name of the signal and run the drains, then hand the signal to the handlers installed before.
+ * On the thread calling this function (usually the main thread), they run on a stack of their own,
+ * so that a stack overflow can be reported too.
+ *
+ * The handlers never wait on a lock: a crash in a drain gives up on draining, and a crash on another thread
+ * waits a second at most for the drains to finish. Returns NO if the handlers couldn't be installed.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogInstallCrashHandler(void);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,320 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogEmergency.h"
+#import "TMPLogRecordFraming.h"
+
+#import <errno.h>
+#import <pthread.h>
+#import <signal.h>
+#import <stdatomic.h>
+#import <sys/stat.h>
+#import <time.h>
+#import <unistd.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+// Slots are claimed and released with the same protocol as the call sites of TMPLogRateLimiter:
+// the state goes from free to claiming with a compare-and-swap, and is published as ready once the slot is filled.
+static const int kTMPEmergencySlotFree = 0;
+static const int kTMPEmergencySlotClaiming = 1;
+static const int kTMPEmergencySlotReady = 2;
+
+typedef struct {
+    _Atomic(int) state;
+    int fd;
+    BOOL framed;
+} TMPLogEmergencyFileSlot;
+
+typedef struct {
+    _Atomic(int) state;
+    TMPLogEmergencyDrainFunction function;
+    void *context;
+} TMPLogEmergencyDrainSlot;
+
+static TMPLogEmergencyFileSlot tmpLogEmergencyFiles[TMP_LOG_EMERGENCY_SLOTS];
+static TMPLogEmergencyDrainSlot tmpLogEmergencyDrains[TMP_LOG_EMERGENCY_SLOTS];
+
+static inline BOOL TMPLogEmergencyClaimSlot(_Atomic(int) *state) {
+    int expected = kTMPEmergencySlotFree;
+    return atomic_compare_exchange_strong_explicit(state, &expected, kTMPEmergencySlotClaiming,
+                                                   memory_order_acquire, memory_order_relaxed);
+}
+
+static inline BOOL TMPLogEmergencyReleaseSlot(_Atomic(int) *state) {
+    int expected = kTMPEmergencySlotReady;
+    return atomic_compare_exchange_strong_explicit(state, &expected, kTMPEmergencySlotClaiming,
+                                                   memory_order_acquire, memory_order_relaxed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Writing
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline void TMPLogEmergencyWriteAll(int fd, const void *bytes, size_t length) {
+    const uint8_t *cursor = bytes;
+
+    while (length > 0) {
+        ssize_t written = write(fd, cursor, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        cursor += written;
+        length -= (size_t)written;
+    }
+}
+
+void TMPLogEmergencyWriteBytes(int fd, const void *bytes, size_t length) {
+    // The file loggers seek to the end before every write, do the same
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        lseek(fd, 0, SEEK_END);
+    }
+
+    TMPLogEmergencyWriteAll(fd, bytes, length);
+}
+
+static inline void TMPLogEmergencyWriteLine(int fd, const char *message, size_t length) {
+    TMPLogEmergencyWriteBytes(fd, message, length);
+
+    if (length == 0 || message[length - 1] != '\n') {
+        TMPLogEmergencyWriteAll(fd, "\n", 1);
+    }
+}
+
+void TMPLogEmergencyWriteRecord(int64_t timestamp, NSInteger context, TMPLogFlag flag, const char *message, size_t length) {
+    length = MIN(length, (size_t)UINT32_MAX);
+
+    TMPLogEmergencyWriteLine(STDERR_FILENO, message, length);
+
+    BOOL hasHeader = NO;
+    TMPLogRecordHeader header;
+
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyFileSlot *slot = &tmpLogEmergencyFiles[i];
+
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) != kTMPEmergencySlotReady || slot->fd == STDERR_FILENO) {
+            continue;
+        }
+
+        if (!slot->framed) {
+            TMPLogEmergencyWriteLine(slot->fd, message, length);
+            continue;
+        }
+
+        if (!hasHeader) {
+            TMPLogRecordHeaderInitWithValues(&header, timestamp, context, flag, message, (uint32_t)length);
+            hasHeader = YES;
+        }
+
+        TMPLogEmergencyWriteBytes(slot->fd, &header, sizeof(header));
+        TMPLogEmergencyWriteAll(slot->fd, message, length);
+    }
+}
+
+void TMPLogEmergencyWrite(TMPLogFlag flag, const char *message, size_t length) {
+    struct timespec now = { 0, 0 };
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    TMPLogEmergencyWriteRecord((int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000, 0, flag, message, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Registration
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL TMPLogEmergencyAddFileDescriptor(int fd, BOOL framed) {
+    if (framed) {
+        // Makes sure the CRC implementation is chosen now, rather than from a signal handler
+        TMPLogCRC32C(0, NULL, 0);
+    }
+
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyFileSlot *slot = &tmpLogEmergencyFiles[i];
+
+        if (TMPLogEmergencyClaimSlot(&slot->state)) {
+            slot->fd = fd;
+            slot->framed = framed;
+            atomic_store_explicit(&slot->state, kTMPEmergencySlotReady, memory_order_release);
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+void TMPLogEmergencyRemoveFileDescriptor(int fd) {
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyFileSlot *slot = &tmpLogEmergencyFiles[i];
+
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) == kTMPEmergencySlotReady &&
+            slot->fd == fd &&
+            TMPLogEmergencyReleaseSlot(&slot->state)) {
+            slot->fd = -1;
+            atomic_store_explicit(&slot->state, kTMPEmergencySlotFree, memory_order_release);
+            return;
+        }
+    }
+}
+
+BOOL TMPLogEmergencyAddDrain(TMPLogEmergencyDrainFunction function, void *context) {
+    NSCParameterAssert(function);
+
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyDrainSlot *slot = &tmpLogEmergencyDrains[i];
+
+        if (TMPLogEmergencyClaimSlot(&slot->state)) {
+            slot->function = function;
+            slot->context = context;
+            atomic_store_explicit(&slot->state, kTMPEmergencySlotReady, memory_order_release);
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+void TMPLogEmergencyRemoveDrain(TMPLogEmergencyDrainFunction function, void *context) {
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyDrainSlot *slot = &tmpLogEmergencyDrains[i];
+
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) == kTMPEmergencySlotReady &&
+            slot->function == function &&
+            slot->context == context &&
+            TMPLogEmergencyReleaseSlot(&slot->state)) {
+            slot->function = NULL;
+            slot->context = NULL;
+            atomic_store_explicit(&slot->state, kTMPEmergencySlotFree, memory_order_release);
+            return;
+        }
+    }
+}
+
+void TMPLogEmergencyDrain(void) {
+    for (NSUInteger i = 0; i < TMP_LOG_EMERGENCY_SLOTS; i++) {
+        TMPLogEmergencyDrainSlot *slot = &tmpLogEmergencyDrains[i];
+
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) == kTMPEmergencySlotReady) {
+            slot->function(slot->context);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Crash Handler
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static const int kTMPLogCrashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP };
+static const NSUInteger kTMPLogCrashSignalCount = sizeof(kTMPLogCrashSignals) / sizeof(kTMPLogCrashSignals[0]);
+
+static struct sigaction tmpLogPreviousActions[kTMPLogCrashSignalCount];
+
+// The thread handling a crash, 0 if none, kTMPLogCrashDrained once it's done
+static _Atomic(uintptr_t) tmpLogCrashingThread;
+static const uintptr_t kTMPLogCrashDrained = UINTPTR_MAX;
+
+static const char * TMPLogCrashSignalMessage(int signal) {
+    switch (signal) {
+        case SIGSEGV: return "Fatal signal SIGSEGV, draining pending log messages";
+        case SIGBUS:  return "Fatal signal SIGBUS, draining pending log messages";
+        case SIGILL:  return "Fatal signal SIGILL, draining pending log messages";
+        case SIGFPE:  return "Fatal signal SIGFPE, draining pending log messages";
+        case SIGABRT: return "Fatal signal SIGABRT, draining pending log messages";
+        case SIGTRAP: return "Fatal signal SIGTRAP, draining pending log messages";
+        default:      return "Fatal signal, draining pending log messages";
+    }
+}
+
+static void TMPLogRestorePreviousAction(int signal) {
+    for (NSUInteger i = 0; i < kTMPLogCrashSignalCount; i++) {
+        if (kTMPLogCrashSignals[i] == signal) {
+            sigaction(signal, &tmpLogPreviousActions[i], NULL);
+            return;
+        }
+    }
+}
+
+static void TMPLogCrashHandler(int signal, siginfo_t * __attribute__((unused)) info, void * __attribute__((unused)) context) {
+    uintptr_t thread = (uintptr_t)pthread_self();
+    uintptr_t expected = 0;
+
+    if (!atomic_compare_exchange_strong(&tmpLogCrashingThread, &expected, thread)) {
+        if (expected != thread) {
+            // Another thread is draining: give it a second before this signal takes the process down
+            struct timespec delay = { 0, 10 * NSEC_PER_MSEC };
+            for (NSUInteger i = 0; i < 100 && atomic_load(&tmpLogCrashingThread) != kTMPLogCrashDrained; i++) {
+                nanosleep(&delay, NULL);
+            }
+        }
+
+        // Otherwise it's a crash while draining on this thread: give up on draining
+        TMPLogRestorePreviousAction(signal);
+        raise(signal);
+        return;
+    }
+
+    const char *message = TMPLogCrashSignalMessage(signal);
+    TMPLogEmergencyWrite(TMPLogFlagError, message, strlen(message));
+    TMPLogEmergencyDrain();
+    atomic_store(&tmpLogCrashingThread, kTMPLogCrashDrained);
+
+    // Hand the signal to the previous handler, or the default action, once we return
+    TMPLogRestorePreviousAction(signal);
+    raise(signal);
+}
+
+BOOL TMPLogInstallCrashHandler(void) {
+    static BOOL installed = NO;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        // A stack overflow leaves no stack to handle SIGSEGV on.
+        // The alternate stack is per thread, this one is for the thread installing the handlers.
+        stack_t stack;
+        stack.ss_size = MAX((size_t)SIGSTKSZ, (size_t)64 * 1024);
+        stack.ss_sp = malloc(stack.ss_size);
+        stack.ss_flags = 0;
+
+        if (stack.ss_sp == NULL || sigaltstack(&stack, NULL) != 0) {
+            return;
+        }
+
+        // Chosen lazily otherwise
+        TMPLogCRC32C(0, NULL, 0);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = TMPLogCrashHandler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+
+        installed = YES;
+
+        for (NSUInteger i = 0; i < kTMPLogCrashSignalCount; i++) {
+            if (sigaction(kTMPLogCrashSignals[i], &action, &tmpLogPreviousActions[i]) != 0) {
+                installed = NO;
+            }
+        }
+    });
+
+    return installed;
+}
@@ -0,0 +1,239 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * The type of a field value
+ **/
+typedef NS_ENUM(uint8_t, TMPLogFieldType) {
+    /**
+     *  Signed 64 bit integer
+     */
+    TMPLogFieldTypeInt,
+
+    /**
+     *  Double precision floating point number
+     */
+    TMPLogFieldTypeDouble,
+
+    /**
+     *  Boolean
+     */
+    TMPLogFieldTypeBool,
+
+    /**
+     *  UTF-8 string
+     */
+    TMPLogFieldTypeString,
+
+    /**
+     *  Raw bytes, rendered as hexadecimal
+     */
+    TMPLogFieldTypeBytes
+};
+
+/**
+ * A single field.
+ *
+ * Fields returned by `TMPLogFields` point into its storage, and are valid as long as that object is.
+ * Their keys and string values are NUL terminated.
+ **/
+typedef struct TMPLogField {
+    const char *key;
+    TMPLogFieldType type;
+    union {
+        int64_t intValue;
+        double doubleValue;
+        BOOL boolValue;
+        struct {
+            const void * __nullable bytes;
+            NSUInteger length;
+        } data; // TMPLogFieldTypeString and TMPLogFieldTypeBytes
+    } value;
+} TMPLogField;
+
+static inline TMPLogField TMPLogFieldInt(const char *key, int64_t value) {
+    TMPLogField field = { .key = key, .type = TMPLogFieldTypeInt };
+    field.value.intValue = value;
+    return field;
+}
+
+static inline TMPLogField TMPLogFieldDouble(const char *key, double value) {
+    TMPLogField field = { .key = key, .type = TMPLogFieldTypeDouble };
+    field.value.doubleValue = value;
+    return field;
+}
+
+static inline TMPLogField TMPLogFieldBool(const char *key, BOOL value) {
+    TMPLogField field = { .key = key, .type = TMPLogFieldTypeBool };
+    field.value.boolValue = value;
+    return field;
+}
+
+static inline TMPLogField TMPLogFieldCString(const char *key, const char * __nullable value) {
+    TMPLogField field = { .key = key, .type = TMPLogFieldTypeString };
+    field.value.data.bytes = value;
+    field.value.data.length = value ? strlen(value) : 0;
+    return field;
+}
+
+static inline TMPLogField TMPLogFieldString(const char *key, NSString * __nullable value) {
+    return TMPLogFieldCString(key, value.UTF8String);
+}
+
+static inline TMPLogField TMPLogFieldBytes(const char *key, const void * __nullable bytes, NSUInteger length) {
+    TMPLogField field = { .key = key, .type = TMPLogFieldTypeBytes };
+    field.value.data.bytes = bytes;
+    field.value.data.length = bytes ? length : 0;
+    return field;
+}
+
+/**
+ * Key of the field holding the N of a message logged 1 in N times by the sampled log macros (see `TMPLogDebugSampled`).
+ * Counts of sampled messages can be reweighted by this value.
+ **/
+#define TMPLogFieldSampleRateKey "sample_rate"
+
+/**
+ * Creates a `TMPLogFields` object from one or more `TMPLogField` values, for use with the `...WithFields` log macros:
+ *
+ * `TMPLogFieldsMake(TMPLogFieldInt("attempt", 3), TMPLogFieldBool("cached", NO))`
+ **/
+#define TMPLogFieldsMake(...)                                                   \
+        [TMPLogFields fieldsWithFields:(const TMPLogField[]){ __VA_ARGS__ }    \
+                                 count:sizeof((const TMPLogField[]){ __VA_ARGS__ }) / sizeof(TMPLogField)]
+
+/**
+ * An immutable, ordered list of structured key-value fields, attached to a log message.
+ *
+ * Fields carry typed values next to the message text, so request ids, status codes and the like
+ * don't have to be formatted into the message, and loggers can index them without parsing any text:
+ *
+ * `TMPLogInfoWithFields(TMPLogFieldsMake(TMPLogFieldString("request", requestID), TMPLogFieldInt("status", 200)), @"Request finished");`
+ *
+ * The fields expression is only evaluated if the message is logged.
+ * All keys and values are copied into a single allocation when the `TMPLogFields` object is created,
+ * so the original strings and buffers only have to stay valid for the duration of the log statement.
+ *
+ * Formatters render fields as logfmt (`%X` in `TMPPatternLogFormatter`, and `TMPLogFileFormatterDefault`)
+ * or JSON (`TMPJSONLogFieldFields`), and `TMPLogFieldFilter` matches on them.
+ **/
+@interface TMPLogFields : NSObject <NSCopying>
+
+/**
+ * Unavailable, use `fieldsWithFields:count:` or `fieldsWithDictionary:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Copies `count` fields, including their keys and values.
+ **/
++ (instancetype)fieldsWithFields:(const TMPLogField *)fields count:(NSUInteger)count NS_SWIFT_UNAVAILABLE("Use init(dictionary:)");
+
+/**
+ * Converts a dictionary, ordered by key. Booleans, integers and floating point numbers keep their type,
+ * `NSData` values become bytes, and every other object is stored as its description.
+ **/
++ (instancetype)fieldsWithDictionary:(NSDictionary<NSString *, id> *)dictionary;
+
+/**
+ * Number of fields
+ **/
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * The field at `index`, which must be less than `count`.
+ **/
+- (TMPLogField)fieldAtIndex:(NSUInteger)index NS_SWIFT_UNAVAILABLE("Use object(forKey:)");
+
+/**
+ * Looks up the first field with the given key, without allocating.
+ * Returns NO if there is no such field.
+ **/
+- (BOOL)getField:(TMPLogField *)field forKey:(const char *)key NS_SWIFT_UNAVAILABLE("Use object(forKey:)");
+
+/**
+ * The value of the first field with the given key, as a `NSNumber`, `NSString` or `NSData`.
+ **/
+- (id __nullable)objectForKey:(NSString *)key;
+- (id __nullable)objectForKeyedSubscript:(NSString *)key;
+
+/**
+ * All fields as a dictionary (see `objectForKey:`).
+ **/
+@property (nonatomic, readonly) NSDictionary<NSString *, id> *dictionaryRepresentation;
+
+@end
+
+/**
+ * Appends the fields as logfmt, e.g. `request=abc123 status=200 note="two words"`.
+ * String values are quoted when they are empty or contain spaces, `=`, quotes or control characters.
+ **/
+FOUNDATION_EXTERN void TMPLogFieldsAppendLogfmt(NSMutableData *buffer, TMPLogFields * __nullable fields);
+
+/**
+ * Appends the value of an integer, double or boolean field as text (`42`, `0.5`, `true`).
+ * Doubles are written with the shortest precision that reads back as the same value.
+ * Returns NO, without appending anything, for other types.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogFieldAppendScalar(NSMutableData *buffer, const TMPLogField *field);
+
+/**
+ * Appends bytes as lowercase hexadecimal digits.
+ **/
+FOUNDATION_EXTERN void TMPLogFieldAppendHex(NSMutableData *buffer, const void * __nullable bytes, NSUInteger length);
+
+/**
+ * A filter (see `-[TMPLog addLogger:withLevel:filter:]`) only letting through messages with a matching field,
+ * in their own fields or in their diagnostic context (see `TMPLogDiagnosticContext`).
+ *
+ * Integers and doubles are compared numerically, strings and bytes byte for byte.
+ **/
+@interface TMPLogFieldFilter : NSObject <TMPLogFilter>
+
+/**
+ * Unavailable, use `initWithKey:value:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Matches messages having a field `key` equal to `value` (see `fieldsWithDictionary:` for the supported values),
+ * or, if `value` is nil, having a field `key` at all.
+ **/
+- (instancetype)initWithKey:(NSString *)key value:(id __nullable)value NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The key the filter matches on
+ **/
+@property (nonatomic, readonly, copy) NSString *key;
+
+/**
+ * The value the filter matches, nil if any value matches
+ **/
+@property (nonatomic, readonly, nullable) id value;
+
+@end
+
+NS_ASSUME_NONNULL_END
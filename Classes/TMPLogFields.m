@@ -0,0 +1,395 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogFields.h"
+#import "TMPLogDiagnosticContext.h"
+
+#import <math.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+static inline BOOL TMPLogFieldHasData(const TMPLogField *field) {
+    return field->type == TMPLogFieldTypeString || field->type == TMPLogFieldTypeBytes;
+}
+
+static BOOL TMPLogFieldEqualValues(const TMPLogField *a, const TMPLogField *b) {
+    switch (a->type) {
+        case TMPLogFieldTypeInt:
+            if (b->type == TMPLogFieldTypeDouble) {
+                return (double)a->value.intValue == b->value.doubleValue;
+            }
+            return b->type == TMPLogFieldTypeInt && a->value.intValue == b->value.intValue;
+        case TMPLogFieldTypeDouble:
+            if (b->type == TMPLogFieldTypeInt) {
+                return a->value.doubleValue == (double)b->value.intValue;
+            }
+            return b->type == TMPLogFieldTypeDouble && a->value.doubleValue == b->value.doubleValue;
+        case TMPLogFieldTypeBool:
+            return b->type == TMPLogFieldTypeBool && !a->value.boolValue == !b->value.boolValue;
+        case TMPLogFieldTypeString:
+        case TMPLogFieldTypeBytes:
+            return b->type == a->type
+                && a->value.data.length == b->value.data.length
+                && memcmp(a->value.data.bytes, b->value.data.bytes, a->value.data.length) == 0;
+    }
+
+    return NO;
+}
+
+@interface TMPLogFields () {
+    // A single allocation: the fields, followed by their keys and values.
+    // The pointers in the fields point into the same allocation.
+    TMPLogField *_storage;
+}
+
+@end
+
+@implementation TMPLogFields
+
+- (instancetype)initWithFields:(const TMPLogField *)fields count:(NSUInteger)count {
+    if ((self = [super init])) {
+        size_t size = count * sizeof(TMPLogField);
+
+        for (NSUInteger i = 0; i < count; i++) {
+            NSParameterAssert(fields[i].key);
+            size += strlen(fields[i].key) + 1;
+
+            if (TMPLogFieldHasData(&fields[i])) {
+                size += fields[i].value.data.length + 1;
+            }
+        }
+
+        _storage = malloc(MAX(size, 1));
+        _count = count;
+
+        char *cursor = (char *)(_storage + count);
+
+        for (NSUInteger i = 0; i < count; i++) {
+            TMPLogField *field = &_storage[i];
+            *field = fields[i];
+
+            size_t keyLength = strlen(fields[i].key) + 1;
+            memcpy(cursor, fields[i].key, keyLength);
+            field->key = cursor;
+            cursor += keyLength;
+
+            if (TMPLogFieldHasData(field)) {
+                NSUInteger length = fields[i].value.data.length;
+
+                if (length > 0) {
+                    memcpy(cursor, fields[i].value.data.bytes, length);
+                }
+
+                cursor[length] = '\0';
+                field->value.data.bytes = cursor;
+                cursor += length + 1;
+            }
+        }
+    }
+
+    return self;
+}
+
++ (instancetype)fieldsWithFields:(const TMPLogField *)fields count:(NSUInteger)count {
+    return [[self alloc] initWithFields:fields count:count];
+}
+
++ (instancetype)fieldsWithDictionary:(NSDictionary<NSString *, id> *)dictionary {
+    NSArray<NSString *> *keys = [dictionary.allKeys sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger count = keys.count;
+    TMPLogField *fields = calloc(MAX(count, 1), sizeof(TMPLogField));
+
+    for (NSUInteger i = 0; i < count; i++) {
+        // The UTF-8 buffers are autoreleased, and outlive the copy below.
+        const char *key = keys[i].UTF8String ?: "";
+        id value = dictionary[keys[i]];
+
+        if ([value isKindOfClass:[NSNumber class]]) {
+            NSNumber *number = value;
+
+            if (CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID()) {
+                fields[i] = TMPLogFieldBool(key, number.boolValue);
+            } else if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+                fields[i] = TMPLogFieldDouble(key, number.doubleValue);
+            } else {
+                fields[i] = TMPLogFieldInt(key, number.longLongValue);
+            }
+        } else if ([value isKindOfClass:[NSData class]]) {
+            NSData *data = value;
+            fields[i] = TMPLogFieldBytes(key, data.bytes, data.length);
+        } else {
+            fields[i] = TMPLogFieldString(key, [value description]);
+        }
+    }
+
+    TMPLogFields *result = [self fieldsWithFields:fields count:count];
+    free(fields);
+
+    return result;
+}
+
+- (void)dealloc {
+    free(_storage);
+}
+
+- (id)copyWithZone:(NSZone * __attribute__((unused)))zone {
+    // Immutable
+    return self;
+}
+
+- (TMPLogField)fieldAtIndex:(NSUInteger)index {
+    NSParameterAssert(index < _count);
+    return _storage[index];
+}
+
+- (BOOL)getField:(TMPLogField *)field forKey:(const char *)key {
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (strcmp(_storage[i].key, key) == 0) {
+            if (field) {
+                *field = _storage[i];
+            }
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+static id TMPLogFieldObjectValue(const TMPLogField *field) {
+    switch (field->type) {
+        case TMPLogFieldTypeInt    : return @(field->value.intValue);
+        case TMPLogFieldTypeDouble : return @(field->value.doubleValue);
+        case TMPLogFieldTypeBool   : return field->value.boolValue ? @YES : @NO;
+        case TMPLogFieldTypeString : return @((const char *)field->value.data.bytes) ?: @"";
+        case TMPLogFieldTypeBytes  : return [NSData dataWithBytes:field->value.data.bytes length:field->value.data.length];
+    }
+
+    return nil;
+}
+
+- (id)objectForKey:(NSString *)key {
+    TMPLogField field;
+
+    if (![self getField:&field forKey:key.UTF8String ?: ""]) {
+        return nil;
+    }
+
+    return TMPLogFieldObjectValue(&field);
+}
+
+- (id)objectForKeyedSubscript:(NSString *)key {
+    return [self objectForKey:key];
+}
+
+- (NSDictionary<NSString *, id> *)dictionaryRepresentation {
+    NSMutableDictionary<NSString *, id> *dictionary = [NSMutableDictionary dictionaryWithCapacity:_count];
+
+    // Iterate backwards, so the first field with a key wins.
+    for (NSUInteger i = _count; i > 0; i--) {
+        const TMPLogField *field = &_storage[i - 1];
+        NSString *key = @(field->key);
+        id value = TMPLogFieldObjectValue(field);
+
+        if (key && value) {
+            dictionary[key] = value;
+        }
+    }
+
+    return [dictionary copy];
+}
+
+- (NSString *)description {
+    NSMutableData *buffer = [NSMutableData data];
+    TMPLogFieldsAppendLogfmt(buffer, self);
+
+    return [[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Rendering
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TMPLogFieldAppendHex(NSMutableData *buffer, const void *bytes, NSUInteger length) {
+    static const char hexDigits[] = "0123456789abcdef";
+    const uint8_t *input = bytes;
+    NSUInteger offset = buffer.length;
+
+    [buffer increaseLengthBy:length * 2];
+    char *output = (char *)buffer.mutableBytes + offset;
+
+    for (NSUInteger i = 0; i < length; i++) {
+        output[2 * i]     = hexDigits[input[i] >> 4];
+        output[2 * i + 1] = hexDigits[input[i] & 0xF];
+    }
+}
+
+BOOL TMPLogFieldAppendScalar(NSMutableData *buffer, const TMPLogField *field) {
+    char text[32];
+    int length;
+
+    switch (field->type) {
+        case TMPLogFieldTypeInt:
+            length = snprintf(text, sizeof(text), "%lld", (long long)field->value.intValue);
+            break;
+        case TMPLogFieldTypeDouble:
+            // 15 significant digits are enough for most values, 17 always read back as the same double.
+            length = snprintf(text, sizeof(text), "%.15g", field->value.doubleValue);
+            if (isfinite(field->value.doubleValue) && strtod(text, NULL) != field->value.doubleValue) {
+                length = snprintf(text, sizeof(text), "%.17g", field->value.doubleValue);
+            }
+            break;
+        case TMPLogFieldTypeBool:
+            if (field->value.boolValue) {
+                [buffer appendBytes:"true" length:4];
+            } else {
+                [buffer appendBytes:"false" length:5];
+            }
+            return YES;
+        default:
+            return NO;
+    }
+
+    [buffer appendBytes:text length:(NSUInteger)length];
+    return YES;
+}
+
+static BOOL TMPLogfmtNeedsQuoting(const uint8_t *bytes, NSUInteger length) {
+    if (length == 0) {
+        return YES;
+    }
+
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+
+        if (c <= ' ' || c == '=' || c == '"' || c == '\\' || c == 0x7F) {
+            return YES;
+        }
+    }
+
+    return NO;
+}
+
+static void TMPLogfmtAppendQuoted(NSMutableData *buffer, const uint8_t *bytes, NSUInteger length) {
+    static const char hexDigits[] = "0123456789abcdef";
+    NSUInteger start = 0;
+
+    [buffer appendBytes:"\"" length:1];
+
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+
+        if (c >= ' ' && c != '"' && c != '\\' && c != 0x7F) {
+            continue;
+        }
+
+        [buffer appendBytes:bytes + start length:i - start];
+        start = i + 1;
+
+        switch (c) {
+            case '"'  : [buffer appendBytes:"\\\"" length:2]; break;
+            case '\\' : [buffer appendBytes:"\\\\" length:2]; break;
+            case '\n' : [buffer appendBytes:"\\n" length:2]; break;
+            case '\r' : [buffer appendBytes:"\\r" length:2]; break;
+            case '\t' : [buffer appendBytes:"\\t" length:2]; break;
+            default: {
+                const char escape[4] = { '\\', 'x', hexDigits[c >> 4], hexDigits[c & 0xF] };
+                [buffer appendBytes:escape length:sizeof(escape)];
+                break;
+            }
+        }
+    }
+
+    [buffer appendBytes:bytes + start length:length - start];
+    [buffer appendBytes:"\"" length:1];
+}
+
+void TMPLogFieldsAppendLogfmt(NSMutableData *buffer, TMPLogFields *fields) {
+    NSUInteger count = fields.count;
+
+    for (NSUInteger i = 0; i < count; i++) {
+        TMPLogField field = [fields fieldAtIndex:i];
+
+        if (i > 0) {
+            [buffer appendBytes:" " length:1];
+        }
+
+        [buffer appendBytes:field.key length:strlen(field.key)];
+        [buffer appendBytes:"=" length:1];
+
+        if (field.type == TMPLogFieldTypeString) {
+            const uint8_t *bytes = field.value.data.bytes;
+            NSUInteger length = field.value.data.length;
+
+            if (TMPLogfmtNeedsQuoting(bytes, length)) {
+                TMPLogfmtAppendQuoted(buffer, bytes, length);
+            } else {
+                [buffer appendBytes:bytes length:length];
+            }
+        } else if (field.type == TMPLogFieldTypeBytes) {
+            TMPLogFieldAppendHex(buffer, field.value.data.bytes, field.value.data.length);
+        } else {
+            TMPLogFieldAppendScalar(buffer, &field);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLogFieldFilter () {
+    const char *_keyBytes;
+    TMPLogFields *_expected; // A single field holding the value
+}
+
+@end
+
+@implementation TMPLogFieldFilter
+
+- (instancetype)initWithKey:(NSString *)key value:(id)value {
+    NSParameterAssert(key);
+
+    if ((self = [super init])) {
+        _key = [key copy];
+        _value = value;
+
+        // The expected value is stored like any other field. If any value matches, only its key is used.
+        _expected = [TMPLogFields fieldsWithDictionary:@{ _key: value ?: @YES }];
+        _keyBytes = [_expected fieldAtIndex:0].key; // Lives as long as _expected
+    }
+
+    return self;
+}
+
+- (BOOL)shouldLogMessage:(TMPLogMessage *)logMessage {
+    TMPLogField field;
+
+    if (!TMPLogMessageGetField(logMessage, &field, _keyBytes)) {
+        return NO;
+    }
+
+    if (_value == nil) {
+        return YES;
+    }
+
+    TMPLogField expected = [_expected fieldAtIndex:0];
+    return TMPLogFieldEqualValues(&expected, &field);
+}
+
+@end
@@ -0,0 +1,143 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+#import <CocoaLumberjack/TMPLogMetrics.h>
+
+/**
+ * Number of loggers a single traced message keeps stamps for.
+ **/
+#ifndef TMP_LOG_LATENCY_TRACE_LOGGERS
+    #define TMP_LOG_LATENCY_TRACE_LOGGERS 8
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Records that `logger` wrote `message` to its destination now. Does nothing if the message isn't traced.
+ *
+ * Loggers that write from `logMessage:` don't need to call it: the message then counts as written when
+ * `logMessage:` returns. `TMPFileLogger` calls it once the bytes are handed to the file.
+ **/
+FOUNDATION_EXTERN void TMPLogLatencyTraceWritten(TMPLogMessage *message, id <TMPLogger> logger);
+
+/**
+ * Records that `logger` keeps `message` to write it later, and will call `TMPLogLatencyTraceWritten` then.
+ * Called from `logMessage:`, as the `TMPFileLogger` buffer does. Does nothing if the message isn't traced.
+ **/
+FOUNDATION_EXTERN void TMPLogLatencyTraceDeferred(TMPLogMessage *message, id <TMPLogger> logger);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLoggerLatencyTrace
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * How long the traced messages took to reach one logger, stage by stage.
+ **/
+@interface TMPLoggerLatencyTrace : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * The `loggerName` of the logger, or its class name if it has none.
+ **/
+@property (nonatomic, readonly, copy) NSString *name;
+
+/**
+ * From `created` to `dequeued`: waiting in the logging queue.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *queueing;
+
+/**
+ * From `dequeued` to `handed`: formatting the shared output, and waiting for the logger's queue.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *dispatching;
+
+/**
+ * From `handed` to `written`: formatting, buffering and writing in the logger.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *writing;
+
+/**
+ * From `created` to `written`: how stale the log is.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *total;
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogLatencyTracer
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Traces messages from the moment they reach `TMPLog` to the moment loggers write them, see `TMPLog.latencyTracer`.
+ *
+ * A traced message is stamped with `mach_absolute_time()` when it's handed to `TMPLog`, when it's dequeued,
+ * when it's passed to each logger, and when each logger wrote it. Once a logger wrote it, the stages feed
+ * the histograms of that logger, and the stamps are kept as a sample for `samplesCSV`.
+ *
+ * Only sampled messages are traced, the others pay for a thread-local random number only.
+ **/
+@interface TMPLogLatencyTracer : NSObject
+
+/**
+ * Traces 1 message in 100.
+ **/
+- (instancetype)init;
+
+/**
+ * Traces 1 message in `sampleRate`, chosen at random. 1 traces every message.
+ **/
+- (instancetype)initWithSampleRate:(NSUInteger)sampleRate NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) NSUInteger sampleRate;
+
+/**
+ * Number of samples kept for `samplesCSV`, the oldest being dropped. Defaults to 10000.
+ **/
+@property (nonatomic, readwrite, assign) NSUInteger maximumNumberOfSamples;
+
+/**
+ * One entry per logger that received a traced message, in the order they first did.
+ **/
+@property (nonatomic, readonly) NSArray<TMPLoggerLatencyTrace *> *loggers;
+
+/**
+ * The kept samples, oldest first, one line per message and logger:
+ * `logger,timestamp,created,dequeued,handed,written`. `timestamp` is the message's, in seconds since 1970;
+ * the stamps are `mach_absolute_time()` converted to seconds.
+ **/
+@property (nonatomic, readonly) NSString *samplesCSV;
+
+/**
+ * Writes `samplesCSV` to `path`.
+ **/
+- (BOOL)writeSamplesToFile:(NSString *)path error:(NSError * __autoreleasing *)error;
+
+/**
+ * Clears the histograms and the samples.
+ **/
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,410 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogLatencyTracer.h"
+#import "TMPLogMacros.h"
+#import "TMPLogMessage+Internal.h"
+
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+static const NSUInteger kTMPLogLatencyTracerDefaultSampleRate = 100;
+static const NSUInteger kTMPLogLatencyTracerDefaultMaximumNumberOfSamples = 10000;
+
+static double TMPLogLatencyTracerSecondsPerTick(void) {
+    static double secondsPerTick;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
+    });
+
+    return secondsPerTick;
+}
+
+// The stamps of a traced message for one logger
+typedef struct {
+    const void *logger; // Only compared
+    uint64_t handed;
+    BOOL deferred;
+    BOOL completed;
+} TMPLogLatencyTraceLogger;
+
+// A completed trace, as kept for samplesCSV
+typedef struct {
+    NSUInteger logger; // Index in _tracedLoggers
+    NSTimeInterval timestamp;
+    uint64_t created;
+    uint64_t dequeued;
+    uint64_t handed;
+    uint64_t written;
+} TMPLogLatencySample;
+
+// The value of -[TMPLogMessage _latencyTrace] for the traced messages.
+// _dequeued is set on the logging queue before the message is dispatched to the loggers,
+// everything else is only accessed with the mutex of the tracer held.
+@interface TMPLogLatencyTrace : NSObject {
+    @package
+    TMPLogLatencyTracer *_tracer;
+    NSTimeInterval _timestamp;
+    uint64_t _created;
+    uint64_t _dequeued;
+    NSUInteger _numberOfLoggers;
+    TMPLogLatencyTraceLogger _loggers[TMP_LOG_LATENCY_TRACE_LOGGERS];
+}
+
+@end
+
+@implementation TMPLogLatencyTrace
+
+@end
+
+// The histograms of a logger
+@interface TMPLogLatencyTracerLogger : NSObject {
+    @package
+    NSString *_name;
+    NSUInteger _index;
+    TMPLogHistogram *_queueing;
+    TMPLogHistogram *_dispatching;
+    TMPLogHistogram *_writing;
+    TMPLogHistogram *_total;
+}
+
+- (instancetype)initWithLogger:(id <TMPLogger>)logger index:(NSUInteger)index;
+
+@end
+
+@implementation TMPLogLatencyTracerLogger
+
+- (instancetype)initWithLogger:(id <TMPLogger>)logger index:(NSUInteger)index {
+    if ((self = [super init])) {
+        if ([logger respondsToSelector:@selector(loggerName)]) {
+            _name = [[logger loggerName] copy];
+        }
+
+        if (_name.length == 0) {
+            _name = NSStringFromClass([logger class]);
+        }
+
+        _index = index;
+        _queueing = calloc(1, sizeof(TMPLogHistogram));
+        _dispatching = calloc(1, sizeof(TMPLogHistogram));
+        _writing = calloc(1, sizeof(TMPLogHistogram));
+        _total = calloc(1, sizeof(TMPLogHistogram));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_queueing);
+    free(_dispatching);
+    free(_writing);
+    free(_total);
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLoggerLatencyTrace
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLoggerLatencyTrace ()
+
+- (instancetype)initWithTracerLogger:(TMPLogLatencyTracerLogger *)tracerLogger;
+
+@end
+
+@implementation TMPLoggerLatencyTrace
+
+- (instancetype)initWithTracerLogger:(TMPLogLatencyTracerLogger *)tracerLogger {
+    if ((self = [super init])) {
+        _name = tracerLogger->_name;
+        _queueing = [[TMPLogLatency alloc] initWithHistogram:tracerLogger->_queueing];
+        _dispatching = [[TMPLogLatency alloc] initWithHistogram:tracerLogger->_dispatching];
+        _writing = [[TMPLogLatency alloc] initWithHistogram:tracerLogger->_writing];
+        _total = [[TMPLogLatency alloc] initWithHistogram:tracerLogger->_total];
+    }
+    return self;
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogLatencyTracer
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLogLatencyTracer () {
+    @package
+    NSUInteger _sampleRate;
+    NSUInteger _maximumNumberOfSamples;
+    pthread_mutex_t _mutex;
+
+    // The loggers that received traced messages, in order, and by logger
+    NSMutableArray<TMPLogLatencyTracerLogger *> *_tracedLoggers;
+    NSMapTable<id, TMPLogLatencyTracerLogger *> *_tracedLoggersByLogger;
+
+    // Ring of the kept samples
+    TMPLogLatencySample *_samples;
+    NSUInteger _samplesStart;
+    NSUInteger _samplesCount;
+}
+
+@end
+
+@implementation TMPLogLatencyTracer
+
+- (instancetype)init {
+    return [self initWithSampleRate:kTMPLogLatencyTracerDefaultSampleRate];
+}
+
+- (instancetype)initWithSampleRate:(NSUInteger)sampleRate {
+    if ((self = [super init])) {
+        _sampleRate = MAX(sampleRate, (NSUInteger)1);
+        _maximumNumberOfSamples = kTMPLogLatencyTracerDefaultMaximumNumberOfSamples;
+        _tracedLoggers = [NSMutableArray array];
+        _tracedLoggersByLogger = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                                            valueOptions:NSPointerFunctionsStrongMemory
+                                                                capacity:0];
+        pthread_mutex_init(&_mutex, NULL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_samples);
+    pthread_mutex_destroy(&_mutex);
+}
+
+- (NSUInteger)maximumNumberOfSamples {
+    pthread_mutex_lock(&_mutex);
+    NSUInteger maximumNumberOfSamples = _maximumNumberOfSamples;
+    pthread_mutex_unlock(&_mutex);
+
+    return maximumNumberOfSamples;
+}
+
+- (void)setMaximumNumberOfSamples:(NSUInteger)maximumNumberOfSamples {
+    pthread_mutex_lock(&_mutex);
+    _maximumNumberOfSamples = maximumNumberOfSamples;
+    free(_samples);
+    _samples = NULL;
+    _samplesStart = 0;
+    _samplesCount = 0;
+    pthread_mutex_unlock(&_mutex);
+}
+
+- (NSArray<TMPLoggerLatencyTrace *> *)loggers {
+    NSMutableArray<TMPLoggerLatencyTrace *> *loggers = [NSMutableArray array];
+
+    pthread_mutex_lock(&_mutex);
+    for (TMPLogLatencyTracerLogger *tracerLogger in _tracedLoggers) {
+        [loggers addObject:[[TMPLoggerLatencyTrace alloc] initWithTracerLogger:tracerLogger]];
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return loggers;
+}
+
+- (NSString *)samplesCSV {
+    NSMutableString *csv = [NSMutableString stringWithString:@"logger,timestamp,created,dequeued,handed,written\n"];
+    double secondsPerTick = TMPLogLatencyTracerSecondsPerTick();
+
+    pthread_mutex_lock(&_mutex);
+    for (NSUInteger i = 0; i < _samplesCount; i++) {
+        TMPLogLatencySample *sample = &_samples[(_samplesStart + i) % _maximumNumberOfSamples];
+        NSString *name = _tracedLoggers[sample->logger]->_name;
+
+        if ([name rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@",\"\n"]].location != NSNotFound) {
+            name = [NSString stringWithFormat:@"\"%@\"", [name stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""]];
+        }
+
+        [csv appendFormat:@"%@,%.6f,%.9f,%.9f,%.9f,%.9f\n", name, sample->timestamp,
+         sample->created * secondsPerTick, sample->dequeued * secondsPerTick,
+         sample->handed * secondsPerTick, sample->written * secondsPerTick];
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    return csv;
+}
+
+- (BOOL)writeSamplesToFile:(NSString *)path error:(NSError * __autoreleasing *)error {
+    return [self.samplesCSV writeToFile:path atomically:YES encoding:NSUTF8StringEncoding error:error];
+}
+
+- (void)reset {
+    pthread_mutex_lock(&_mutex);
+    [_tracedLoggers removeAllObjects];
+    [_tracedLoggersByLogger removeAllObjects];
+    _samplesStart = 0;
+    _samplesCount = 0;
+    pthread_mutex_unlock(&_mutex);
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Tracing
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Must be called with the mutex of the tracer held. NULL once the trace is full.
+static TMPLogLatencyTraceLogger * TMPLogLatencyTraceLoggerFor(TMPLogLatencyTrace *trace, id <TMPLogger> logger) {
+    const void *key = (__bridge const void *)logger;
+
+    for (NSUInteger i = 0; i < trace->_numberOfLoggers; i++) {
+        if (trace->_loggers[i].logger == key) {
+            return &trace->_loggers[i];
+        }
+    }
+
+    if (trace->_numberOfLoggers == TMP_LOG_LATENCY_TRACE_LOGGERS) {
+        return NULL;
+    }
+
+    TMPLogLatencyTraceLogger *traceLogger = &trace->_loggers[trace->_numberOfLoggers++];
+    *traceLogger = (TMPLogLatencyTraceLogger) { .logger = key };
+
+    return traceLogger;
+}
+
+// Must be called with the mutex of the tracer held
+static void TMPLogLatencyTraceComplete(TMPLogLatencyTrace *trace, TMPLogLatencyTraceLogger *traceLogger, id <TMPLogger> logger, uint64_t written) {
+    __unsafe_unretained TMPLogLatencyTracer *tracer = trace->_tracer;
+    traceLogger->completed = YES;
+
+    TMPLogLatencyTracerLogger *tracerLogger = [tracer->_tracedLoggersByLogger objectForKey:logger];
+
+    if (!tracerLogger) {
+        tracerLogger = [[TMPLogLatencyTracerLogger alloc] initWithLogger:logger index:tracer->_tracedLoggers.count];
+        [tracer->_tracedLoggers addObject:tracerLogger];
+        [tracer->_tracedLoggersByLogger setObject:tracerLogger forKey:logger];
+    }
+
+    // Stages that weren't stamped (e.g. a message logged to a logger directly) are empty
+    uint64_t created = trace->_created;
+    uint64_t dequeued = MAX(trace->_dequeued, created);
+    uint64_t handed = MAX(traceLogger->handed, dequeued);
+    written = MAX(written, handed);
+
+    TMPLogHistogramRecord(tracerLogger->_queueing, dequeued - created);
+    TMPLogHistogramRecord(tracerLogger->_dispatching, handed - dequeued);
+    TMPLogHistogramRecord(tracerLogger->_writing, written - handed);
+    TMPLogHistogramRecord(tracerLogger->_total, written - created);
+
+    if (tracer->_maximumNumberOfSamples == 0) {
+        return;
+    }
+
+    if (!tracer->_samples) {
+        tracer->_samples = calloc(tracer->_maximumNumberOfSamples, sizeof(TMPLogLatencySample));
+    }
+
+    NSUInteger index;
+
+    if (tracer->_samplesCount < tracer->_maximumNumberOfSamples) {
+        index = (tracer->_samplesStart + tracer->_samplesCount++) % tracer->_maximumNumberOfSamples;
+    } else {
+        index = tracer->_samplesStart;
+        tracer->_samplesStart = (tracer->_samplesStart + 1) % tracer->_maximumNumberOfSamples;
+    }
+
+    tracer->_samples[index] = (TMPLogLatencySample) {
+        .logger = tracerLogger->_index,
+        .timestamp = trace->_timestamp,
+        .created = created,
+        .dequeued = dequeued,
+        .handed = handed,
+        .written = written
+    };
+}
+
+id TMPLogLatencyTracerSample(TMPLogLatencyTracer *tracer, TMPLogMessage *message, uint64_t created) {
+    if (!TMPLogSampleOneIn(tracer->_sampleRate)) {
+        return nil;
+    }
+
+    TMPLogLatencyTrace *trace = [TMPLogLatencyTrace new];
+    trace->_tracer = tracer;
+    trace->_timestamp = message->_timestamp.timeIntervalSince1970;
+    trace->_created = created;
+
+    return trace;
+}
+
+void TMPLogLatencyTraceDequeued(id trace, uint64_t dequeued) {
+    ((TMPLogLatencyTrace *)trace)->_dequeued = dequeued;
+}
+
+void TMPLogLatencyTraceHanded(id trace, id <TMPLogger> logger, uint64_t handed) {
+    __unsafe_unretained TMPLogLatencyTracer *tracer = ((TMPLogLatencyTrace *)trace)->_tracer;
+
+    pthread_mutex_lock(&tracer->_mutex);
+    TMPLogLatencyTraceLogger *traceLogger = TMPLogLatencyTraceLoggerFor(trace, logger);
+    if (traceLogger) {
+        traceLogger->handed = handed;
+    }
+    pthread_mutex_unlock(&tracer->_mutex);
+}
+
+void TMPLogLatencyTraceReturned(id trace, id <TMPLogger> logger, uint64_t returned) {
+    __unsafe_unretained TMPLogLatencyTracer *tracer = ((TMPLogLatencyTrace *)trace)->_tracer;
+
+    pthread_mutex_lock(&tracer->_mutex);
+    TMPLogLatencyTraceLogger *traceLogger = TMPLogLatencyTraceLoggerFor(trace, logger);
+    if (traceLogger && !traceLogger->deferred && !traceLogger->completed) {
+        TMPLogLatencyTraceComplete(trace, traceLogger, logger, returned);
+    }
+    pthread_mutex_unlock(&tracer->_mutex);
+}
+
+void TMPLogLatencyTraceWritten(TMPLogMessage *message, id <TMPLogger> logger) {
+    __unsafe_unretained TMPLogLatencyTrace *trace = message->_latencyTrace;
+
+    if (!trace) {
+        return;
+    }
+
+    uint64_t written = mach_absolute_time();
+    __unsafe_unretained TMPLogLatencyTracer *tracer = trace->_tracer;
+
+    pthread_mutex_lock(&tracer->_mutex);
+    TMPLogLatencyTraceLogger *traceLogger = TMPLogLatencyTraceLoggerFor(trace, logger);
+    if (traceLogger && !traceLogger->completed) {
+        TMPLogLatencyTraceComplete(trace, traceLogger, logger, written);
+    }
+    pthread_mutex_unlock(&tracer->_mutex);
+}
+
+void TMPLogLatencyTraceDeferred(TMPLogMessage *message, id <TMPLogger> logger) {
+    __unsafe_unretained TMPLogLatencyTrace *trace = message->_latencyTrace;
+
+    if (!trace) {
+        return;
+    }
+
+    __unsafe_unretained TMPLogLatencyTracer *tracer = trace->_tracer;
+
+    pthread_mutex_lock(&tracer->_mutex);
+    TMPLogLatencyTraceLogger *traceLogger = TMPLogLatencyTraceLoggerFor(trace, logger);
+    if (traceLogger) {
+        traceLogger->deferred = YES;
+    }
+    pthread_mutex_unlock(&tracer->_mutex);
+}
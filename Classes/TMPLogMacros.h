@@ -19,6 +19,8 @@
 #endif
 
 #import <CocoaLumberjack/TMPLog.h>
+#import <CocoaLumberjack/TMPLogFields.h>
+#import <CocoaLumberjack/TMPLogDiagnosticContext.h>
 
 /**
  * The constant/variable/method responsible for controlling the current log level.
@@ -34,6 +36,23 @@
     #define LOG_ASYNC_ENABLED YES
 #endif
 
+/**
+ * Whether the level checks below let through every message, up to verbose, on threads running a debug sampled scope
+ * (see `TMPLogDiagnosticContext.sampled`). For other threads this costs a single thread-local load per check.
+ *
+ * Off by default: define as 1 (before importing CocoaLumberjack) to opt in. The messages above a constant LOG_LEVEL_DEF
+ * are then no longer stripped by the compiler, as the sampled level is only known at run time.
+ **/
+#ifndef TMP_LOG_SAMPLING_ENABLED
+    #define TMP_LOG_SAMPLING_ENABLED 0
+#endif
+
+#if TMP_LOG_SAMPLING_ENABLED
+    #define TMP_LOG_EFFECTIVE_LEVEL(lvl) ((lvl) | tmpLogSampledLevel)
+#else
+    #define TMP_LOG_EFFECTIVE_LEVEL(lvl) (lvl)
+#endif
+
 /**
  * These are the two macros that all other macros below compile into.
  * These big multiline macros makes all the other macros easier to read.
@@ -75,15 +94,16 @@
  * the log messages above your logging threshold will automatically be compiled out.
  *
  * (If the compiler sees LOG_LEVEL_DEF/tmpLogLevel declared as a constant, the compiler simply checks to see
- *  if the 'if' statement would execute, and if not it strips it from the binary.)
+ *  if the 'if' statement would execute, and if not it strips it from the binary.
+ *  This requires TMP_LOG_SAMPLING_ENABLED to be 0, the default, as the sampled level is only known at run time.)
  *
  * We also define shorthand versions for asynchronous and synchronous logging.
  **/
 #define LOG_MAYBE(async, lvl, flg, ctx, tag, fnct, frmt, ...) \
-        do { if(lvl & flg) LOG_MACRO(async, lvl, flg, ctx, tag, fnct, frmt, ##__VA_ARGS__); } while(0)
+        do { if(TMP_LOG_EFFECTIVE_LEVEL(lvl) & flg) LOG_MACRO(async, lvl, flg, ctx, tag, fnct, frmt, ##__VA_ARGS__); } while(0)
 
 #define LOG_MAYBE_TO_TMPLOG(tmplog, async, lvl, flg, ctx, tag, fnct, frmt, ...) \
-        do { if(lvl & flg) LOG_MACRO_TO_TMPLOG(tmplog, async, lvl, flg, ctx, tag, fnct, frmt, ##__VA_ARGS__); } while(0)
+        do { if(TMP_LOG_EFFECTIVE_LEVEL(lvl) & flg) LOG_MACRO_TO_TMPLOG(tmplog, async, lvl, flg, ctx, tag, fnct, frmt, ##__VA_ARGS__); } while(0)
 
 /**
  * Ready to use log macros with no context or tag.
@@ -99,3 +119,94 @@
 #define TMPLogInfoToTMPLog(tmplog, frmt, ...)    LOG_MAYBE_TO_TMPLOG(tmplog, LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagInfo,    0, nil, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
 #define TMPLogDebugToTMPLog(tmplog, frmt, ...)   LOG_MAYBE_TO_TMPLOG(tmplog, LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagDebug,   0, nil, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
 #define TMPLogVerboseToTMPLog(tmplog, frmt, ...) LOG_MAYBE_TO_TMPLOG(tmplog, LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagVerbose, 0, nil, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+
+/**
+ * Variants of the macros above attaching structured fields (see `TMPLogFields` and `TMPLogFieldsMake`) to the message.
+ * Like the message arguments, the fields are only evaluated if the message is logged.
+ *
+ * The fields are wrapped in parentheses at every level, so the commas of `TMPLogFieldsMake` are never split into macro arguments.
+ **/
+#define LOG_MACRO_WITH_FIELDS(isAsynchronous, lvl, flg, ctx, atag, flds, fnct, frmt, ...) \
+        [TMPLog log : isAsynchronous                                     \
+             level : lvl                                                \
+              flag : flg                                                \
+           context : ctx                                                \
+              file : __FILE__                                           \
+          function : fnct                                               \
+              line : __LINE__                                           \
+               tag : atag                                               \
+            fields : (flds)                                             \
+            format : (frmt), ## __VA_ARGS__]
+
+#define LOG_MAYBE_WITH_FIELDS(async, lvl, flg, ctx, tag, flds, fnct, frmt, ...) \
+        do { if(TMP_LOG_EFFECTIVE_LEVEL(lvl) & flg) LOG_MACRO_WITH_FIELDS(async, lvl, flg, ctx, tag, (flds), fnct, frmt, ##__VA_ARGS__); } while(0)
+
+#define TMPLogErrorWithFields(flds, frmt, ...)   LOG_MAYBE_WITH_FIELDS(NO,                LOG_LEVEL_DEF, TMPLogFlagError,   0, nil, (flds), __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogWarnWithFields(flds, frmt, ...)    LOG_MAYBE_WITH_FIELDS(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagWarning, 0, nil, (flds), __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogInfoWithFields(flds, frmt, ...)    LOG_MAYBE_WITH_FIELDS(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagInfo,    0, nil, (flds), __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogDebugWithFields(flds, frmt, ...)   LOG_MAYBE_WITH_FIELDS(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagDebug,   0, nil, (flds), __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogVerboseWithFields(flds, frmt, ...) LOG_MAYBE_WITH_FIELDS(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagVerbose, 0, nil, (flds), __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+
+/**
+ * Per-thread state of the random number generator used by the sampled macros below. Don't modify it.
+ **/
+FOUNDATION_EXTERN __thread uint64_t tmpLogSampleState;
+
+/**
+ * Seeds `tmpLogSampleState` for the current thread, and returns it.
+ **/
+FOUNDATION_EXTERN uint64_t TMPLogSampleSeed(void);
+
+/**
+ * Returns YES 1 in `rate` times, at random. Always YES for a rate of 0 or 1.
+ *
+ * Uses a xorshift64* generator with thread-local state, so the cost stays a few instructions however many threads log.
+ **/
+static inline BOOL TMPLogSampleOneIn(NSUInteger rate) {
+    if (rate <= 1) {
+        return YES;
+    }
+
+    uint64_t x = tmpLogSampleState;
+    if (__builtin_expect(x == 0, 0)) {
+        x = TMPLogSampleSeed();
+    }
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    tmpLogSampleState = x;
+
+    uint64_t random = x * 0x2545F4914F6CDD1DULL;
+
+    if ((uint64_t)rate > UINT32_MAX) {
+        return random % rate == 0;
+    }
+
+    // Maps the high 32 bits onto [0, rate) with a multiplication instead of a division
+    return (((random >> 32) * (uint64_t)rate) >> 32) == 0;
+}
+
+/**
+ * Sampled variants of the macros above: each message that passes the level check is only logged 1 in `rate` times,
+ * decided before its arguments are evaluated. Logged messages carry the rate as the `sample_rate` field
+ * (see `TMPLogFieldSampleRateKey` and `TMPLogMessage.sampleRate`), so their counts can be reweighted downstream.
+ *
+ * `TMPLogDebugSampled(100, @"Received packet %u", sequence);`
+ **/
+#define LOG_MAYBE_SAMPLED(async, lvl, flg, ctx, tag, rate, fnct, frmt, ...)                    \
+        do {                                                                                    \
+            if(TMP_LOG_EFFECTIVE_LEVEL(lvl) & flg) {                                            \
+                NSUInteger tmpLogSampledMacroRate_ = MAX((NSUInteger)(rate), (NSUInteger)1);    \
+                if(TMPLogSampleOneIn(tmpLogSampledMacroRate_))                                  \
+                    LOG_MACRO_WITH_FIELDS(async, lvl, flg, ctx, tag,                            \
+                        (TMPLogFieldsMake(TMPLogFieldInt(TMPLogFieldSampleRateKey, (int64_t)tmpLogSampledMacroRate_))), \
+                        fnct, frmt, ##__VA_ARGS__);                                             \
+            }                                                                                   \
+        } while(0)
+
+#define TMPLogErrorSampled(rate, frmt, ...)   LOG_MAYBE_SAMPLED(NO,                LOG_LEVEL_DEF, TMPLogFlagError,   0, nil, rate, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogWarnSampled(rate, frmt, ...)    LOG_MAYBE_SAMPLED(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagWarning, 0, nil, rate, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogInfoSampled(rate, frmt, ...)    LOG_MAYBE_SAMPLED(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagInfo,    0, nil, rate, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogDebugSampled(rate, frmt, ...)   LOG_MAYBE_SAMPLED(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagDebug,   0, nil, rate, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
+#define TMPLogVerboseSampled(rate, frmt, ...) LOG_MAYBE_SAMPLED(LOG_ASYNC_ENABLED, LOG_LEVEL_DEF, TMPLogFlagVerbose, 0, nil, rate, __PRETTY_FUNCTION__, frmt, ##__VA_ARGS__)
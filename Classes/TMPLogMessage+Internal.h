@@ -0,0 +1,35 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface TMPLogMessage () {
+    // Internal state shared by the framework's loggers, not part of the public interface.
+    @public
+    id _Nullable _latencyTrace; // Set for the messages traced by `TMPLog.latencyTracer`, see `TMPLogLatencyTraceWritten`
+
+    // Output of a shareable formatter, formatted once on the global logging queue
+    // for all the loggers using that formatter (see `TMPLogFormatMessageToBuffer`).
+    // Set before the message is dispatched to the loggers, and not copied by copyWithZone:.
+    id <TMPLogFormatter> _Nullable _sharedFormatter;
+    NSData * _Nullable _sharedOutput; // nil if the formatter filtered the message
+    BOOL _sharedOutputIsFormatted;
+}
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,250 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+@class TMPLogCallSite;
+
+/**
+ * Number of buckets of a `TMPLogHistogram`: 16 linear sub-buckets for every power of two,
+ * so a recorded value is known within 1/16th (about 6%).
+ **/
+#define TMP_LOG_HISTOGRAM_SUB_BUCKETS 16
+#define TMP_LOG_HISTOGRAM_BUCKETS ((64 - 3) * TMP_LOG_HISTOGRAM_SUB_BUCKETS)
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A latency histogram of fixed size, made of relaxed atomic counters: recording never allocates nor locks,
+ * and any thread can record while another one reads it.
+ * Values are durations in `mach_absolute_time()` units. Zero it (e.g. with calloc) before use.
+ **/
+typedef struct TMPLogHistogram {
+    _Atomic(uint64_t) count;
+    _Atomic(uint64_t) total;
+    _Atomic(uint64_t) maximum;
+    _Atomic(uint64_t) buckets[TMP_LOG_HISTOGRAM_BUCKETS];
+} TMPLogHistogram;
+
+/**
+ * Records a duration, in `mach_absolute_time()` units.
+ **/
+FOUNDATION_EXTERN void TMPLogHistogramRecord(TMPLogHistogram *histogram, uint64_t duration);
+
+/**
+ * Counts bytes written to their destination by a logger, in a single process-wide counter: loggers don't know
+ * which `TMPLog` instances they're added to. `TMPFileLogger` and `TMPTTYLogger` report their writes;
+ * custom loggers writing bytes should too.
+ **/
+FOUNDATION_EXTERN void TMPLogMetricsAddBytesWritten(NSUInteger length);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogLatency
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A copy of a `TMPLogHistogram`, with durations in seconds.
+ **/
+@interface TMPLogLatency : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Copies `histogram`. Counters are read one by one, so a copy taken while recording can be off by the values being recorded.
+ **/
+- (instancetype)initWithHistogram:(const TMPLogHistogram *)histogram NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Number of recorded durations.
+ **/
+@property (nonatomic, readonly) uint64_t count;
+
+/**
+ * Sum of the recorded durations.
+ **/
+@property (nonatomic, readonly) NSTimeInterval total;
+
+/**
+ * Longest recorded duration (exact).
+ **/
+@property (nonatomic, readonly) NSTimeInterval maximum;
+
+/**
+ * Average duration, 0 if nothing was recorded.
+ **/
+@property (nonatomic, readonly) NSTimeInterval mean;
+
+/**
+ * The duration `percentile` percent of the recorded durations are shorter than or equal to (rounded up to its bucket),
+ * 0 if nothing was recorded. `percentile` is between 0 and 100.
+ **/
+- (NSTimeInterval)latencyAtPercentile:(double)percentile;
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLoggerMetrics
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * What a logger did since it was added.
+ **/
+@interface TMPLoggerMetrics : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * The logger.
+ **/
+@property (nonatomic, readonly) id <TMPLogger> logger;
+
+/**
+ * Its `loggerName`, or its class name if it has none.
+ **/
+@property (nonatomic, readonly, copy) NSString *name;
+
+/**
+ * Time spent in its `logMessage:`, one duration per message it received.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *latency;
+
+/**
+ * Moving average of the time spent in its `logMessage:`, see `TMPLog.inlineLoggerThreshold`.
+ **/
+@property (nonatomic, readonly) NSTimeInterval averageCost;
+
+/**
+ * YES if it's currently run by the logging thread rather than by the logger pool.
+ **/
+@property (nonatomic, readonly) BOOL runsInline;
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogMetrics
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A snapshot of the logging pipeline of a `TMPLog`, see `-[TMPLog metrics]`.
+ *
+ * The counters are maintained all the time, with relaxed atomics: a couple of additions and
+ * a `mach_absolute_time()` call per message, plus two calls per logger.
+ **/
+@interface TMPLogMetrics : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Messages handed to the logging queue.
+ **/
+@property (nonatomic, readonly) uint64_t messagesEnqueued;
+
+/**
+ * Messages taken off the logging queue and dispatched to the loggers.
+ **/
+@property (nonatomic, readonly) uint64_t messagesDelivered;
+
+/**
+ * Messages dropped before being queued, by the `rateLimiter`.
+ **/
+@property (nonatomic, readonly) uint64_t messagesDropped;
+
+/**
+ * Messages currently queued (enqueued and not delivered yet).
+ **/
+@property (nonatomic, readonly) uint64_t queueDepth;
+
+/**
+ * The highest `queueDepth` seen.
+ **/
+@property (nonatomic, readonly) uint64_t maximumQueueDepth;
+
+/**
+ * Time messages spent queued, from being enqueued to being delivered.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *queueLatency;
+
+/**
+ * Time the logging threads spent blocked waiting for the queue to drop below `TMPLog.maximumQueueSize`.
+ * Only the waits are recorded, and not the time synchronous messages take to be delivered.
+ **/
+@property (nonatomic, readonly) TMPLogLatency *blockedTime;
+
+/**
+ * Bytes written by all the loggers of the process, whatever `TMPLog` instances they're added to,
+ * see `TMPLogMetricsAddBytesWritten`. The same value in the metrics of every instance.
+ **/
+@property (nonatomic, readonly) uint64_t processBytesWritten;
+
+/**
+ * One entry per logger, in the order they were added.
+ **/
+@property (nonatomic, readonly) NSArray<TMPLoggerMetrics *> *loggers;
+
+/**
+ * The 100 call sites that logged the most bytes, if `TMPLog.callSiteProfiler` is set, see `topCallSites:`.
+ **/
+@property (nonatomic, readonly) NSArray<TMPLogCallSite *> *callSites;
+
+/**
+ * The snapshot in the Prometheus text format, durations in seconds.
+ **/
+@property (nonatomic, readonly) NSString *textExposition;
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogMetricsServer
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Serves the `textExposition` of a `TMPLog` on a local Unix domain socket: every connection
+ * gets a fresh snapshot, then is closed. Read it with e.g. `nc -U <path>`.
+ **/
+@interface TMPLogMetricsServer : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * A server for the metrics of `log`, listening at `socketPath` once started.
+ **/
+- (instancetype)initWithLog:(TMPLog *)log socketPath:(NSString *)socketPath NS_DESIGNATED_INITIALIZER;
+
+@property (nonatomic, readonly) TMPLog *log;
+
+@property (nonatomic, readonly, copy) NSString *socketPath;
+
+/**
+ * Starts listening. A socket left at `socketPath`, by a previous run for instance, is replaced, but any other file
+ * is left alone and makes it fail. Returns NO and sets `error` (POSIX domain) on failure.
+ **/
+- (BOOL)start:(NSError * __autoreleasing *)error;
+
+/**
+ * Stops listening and removes the socket file. Also done when the server is deallocated.
+ **/
+- (void)stop;
+
+@end
+
+NS_ASSUME_NONNULL_END
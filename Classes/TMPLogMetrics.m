@@ -0,0 +1,439 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogMetrics.h"
+#import "TMPLogCallSiteProfiler.h"
+
+#import <fcntl.h>
+#import <mach/mach_time.h>
+#import <sys/socket.h>
+#import <sys/stat.h>
+#import <sys/un.h>
+#import <unistd.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+// log2(TMP_LOG_HISTOGRAM_SUB_BUCKETS)
+static const unsigned kTMPLogHistogramSubBucketBits = 4;
+
+// The percentiles of the text exposition
+static const double kTMPLogMetricsQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static _Atomic(uint64_t) tmpLogProcessBytesWritten = 0;
+
+void TMPLogMetricsAddBytesWritten(NSUInteger length) {
+    atomic_fetch_add_explicit(&tmpLogProcessBytesWritten, length, memory_order_relaxed);
+}
+
+// Values below TMP_LOG_HISTOGRAM_SUB_BUCKETS have a bucket each. Above, every power of two
+// is split into TMP_LOG_HISTOGRAM_SUB_BUCKETS buckets, indexed by the bits following the highest one.
+static inline NSUInteger TMPLogHistogramIndex(uint64_t value) {
+    if (value < TMP_LOG_HISTOGRAM_SUB_BUCKETS) {
+        return (NSUInteger)value;
+    }
+
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = exponent - kTMPLogHistogramSubBucketBits;
+
+    return (shift + 1) * TMP_LOG_HISTOGRAM_SUB_BUCKETS + (NSUInteger)((value >> shift) & (TMP_LOG_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// The highest value recorded in the bucket
+static inline uint64_t TMPLogHistogramBucketUpperBound(NSUInteger index) {
+    if (index < TMP_LOG_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    unsigned shift = (unsigned)(index / TMP_LOG_HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t lowerBound = (uint64_t)(TMP_LOG_HISTOGRAM_SUB_BUCKETS + index % TMP_LOG_HISTOGRAM_SUB_BUCKETS) << shift;
+
+    return lowerBound + (((uint64_t)1 << shift) - 1);
+}
+
+void TMPLogHistogramRecord(TMPLogHistogram *histogram, uint64_t duration) {
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->total, duration, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->buckets[TMPLogHistogramIndex(duration)], 1, memory_order_relaxed);
+
+    uint64_t maximum = atomic_load_explicit(&histogram->maximum, memory_order_relaxed);
+    while (duration > maximum &&
+           !atomic_compare_exchange_weak_explicit(&histogram->maximum, &maximum, duration, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static double TMPLogMetricsSecondsPerTick(void) {
+    static double secondsPerTick;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        secondsPerTick = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
+    });
+
+    return secondsPerTick;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogLatency
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@implementation TMPLogLatency {
+    uint64_t _buckets[TMP_LOG_HISTOGRAM_BUCKETS];
+    uint64_t _maximumTicks;
+}
+
+- (instancetype)initWithHistogram:(const TMPLogHistogram *)histogram {
+    if ((self = [super init])) {
+        TMPLogHistogram *source = (TMPLogHistogram *)histogram;
+        uint64_t count = 0;
+
+        // The buckets are what percentiles are computed from, so they make the count
+        for (NSUInteger i = 0; i < TMP_LOG_HISTOGRAM_BUCKETS; i++) {
+            _buckets[i] = atomic_load_explicit(&source->buckets[i], memory_order_relaxed);
+            count += _buckets[i];
+        }
+
+        _count = count;
+        _maximumTicks = atomic_load_explicit(&source->maximum, memory_order_relaxed);
+        _total = atomic_load_explicit(&source->total, memory_order_relaxed) * TMPLogMetricsSecondsPerTick();
+        _maximum = _maximumTicks * TMPLogMetricsSecondsPerTick();
+    }
+    return self;
+}
+
+- (NSTimeInterval)mean {
+    return _count ? _total / _count : 0;
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile {
+    if (_count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(MIN(MAX(percentile, 0), 100) / 100 * _count);
+    uint64_t seen = 0;
+
+    for (NSUInteger i = 0; i < TMP_LOG_HISTOGRAM_BUCKETS; i++) {
+        seen += _buckets[i];
+
+        if (seen >= MAX(rank, (uint64_t)1)) {
+            return MIN(TMPLogHistogramBucketUpperBound(i), _maximumTicks) * TMPLogMetricsSecondsPerTick();
+        }
+    }
+
+    return _maximum;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ count: %llu, mean: %g, p99: %g, max: %g>",
+            NSStringFromClass([self class]), _count, self.mean, [self latencyAtPercentile:99], _maximum];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLoggerMetrics
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@implementation TMPLoggerMetrics
+
+- (instancetype)initWithLogger:(id <TMPLogger>)logger latency:(TMPLogLatency *)latency averageCost:(NSTimeInterval)averageCost runsInline:(BOOL)runsInline {
+    if ((self = [super init])) {
+        _logger = logger;
+        _latency = latency;
+        _averageCost = averageCost;
+        _runsInline = runsInline;
+
+        if ([logger respondsToSelector:@selector(loggerName)]) {
+            _name = [[logger loggerName] copy];
+        }
+
+        if (_name.length == 0) {
+            _name = NSStringFromClass([logger class]);
+        }
+    }
+    return self;
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogMetrics
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static NSString * TMPLogMetricsEscapedLabel(NSString *value) {
+    value = [value stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    value = [value stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+    return [value stringByReplacingOccurrencesOfString:@"\n" withString:@"\\n"];
+}
+
+static void TMPLogMetricsAppendSummary(NSMutableString *text, NSString *name, NSString *labels, TMPLogLatency *latency) {
+    NSString *separator = labels.length ? @"," : @"";
+
+    for (size_t i = 0; i < sizeof(kTMPLogMetricsQuantiles) / sizeof(kTMPLogMetricsQuantiles[0]); i++) {
+        [text appendFormat:@"%@{%@%@quantile=\"%g\"} %.9g\n",
+         name, labels, separator, kTMPLogMetricsQuantiles[i], [latency latencyAtPercentile:kTMPLogMetricsQuantiles[i] * 100]];
+    }
+
+    NSString *braces = labels.length ? [NSString stringWithFormat:@"{%@}", labels] : @"";
+    [text appendFormat:@"%@_sum%@ %.9g\n", name, braces, latency.total];
+    [text appendFormat:@"%@_count%@ %llu\n", name, braces, latency.count];
+}
+
+static NSString * TMPLogMetricsCallSiteLabels(TMPLogCallSite *site) {
+    return [NSString stringWithFormat:@"file=\"%@\",line=\"%lu\",function=\"%@\"",
+            TMPLogMetricsEscapedLabel(site.fileName), (unsigned long)site.line, TMPLogMetricsEscapedLabel(site.function ?: @"")];
+}
+
+@implementation TMPLogMetrics
+
+- (instancetype)initWithMessagesEnqueued:(uint64_t)messagesEnqueued
+                       messagesDelivered:(uint64_t)messagesDelivered
+                         messagesDropped:(uint64_t)messagesDropped
+                       maximumQueueDepth:(uint64_t)maximumQueueDepth
+                            queueLatency:(TMPLogLatency *)queueLatency
+                             blockedTime:(TMPLogLatency *)blockedTime
+                                 loggers:(NSArray<TMPLoggerMetrics *> *)loggers
+                               callSites:(NSArray<TMPLogCallSite *> *)callSites {
+    if ((self = [super init])) {
+        _messagesEnqueued = messagesEnqueued;
+        _messagesDelivered = MIN(messagesDelivered, messagesEnqueued);
+        _messagesDropped = messagesDropped;
+        _queueDepth = _messagesEnqueued - _messagesDelivered;
+        _maximumQueueDepth = MAX(maximumQueueDepth, _queueDepth);
+        _queueLatency = queueLatency;
+        _blockedTime = blockedTime;
+        _processBytesWritten = atomic_load_explicit(&tmpLogProcessBytesWritten, memory_order_relaxed);
+        _loggers = [loggers copy];
+        _callSites = [callSites copy];
+    }
+    return self;
+}
+
+- (NSString *)textExposition {
+    NSMutableString *text = [NSMutableString string];
+
+    [text appendFormat:@"# TYPE tmplog_messages_enqueued_total counter\ntmplog_messages_enqueued_total %llu\n", _messagesEnqueued];
+    [text appendFormat:@"# TYPE tmplog_messages_delivered_total counter\ntmplog_messages_delivered_total %llu\n", _messagesDelivered];
+    [text appendFormat:@"# TYPE tmplog_messages_dropped_total counter\ntmplog_messages_dropped_total %llu\n", _messagesDropped];
+    [text appendFormat:@"# TYPE tmplog_queue_depth gauge\ntmplog_queue_depth %llu\n", _queueDepth];
+    [text appendFormat:@"# TYPE tmplog_queue_depth_max gauge\ntmplog_queue_depth_max %llu\n", _maximumQueueDepth];
+    // Process-wide, not specific to the instance
+    [text appendFormat:@"# TYPE tmplog_process_bytes_written_total counter\ntmplog_process_bytes_written_total %llu\n", _processBytesWritten];
+
+    [text appendString:@"# TYPE tmplog_queue_latency_seconds summary\n"];
+    TMPLogMetricsAppendSummary(text, @"tmplog_queue_latency_seconds", @"", _queueLatency);
+
+    [text appendString:@"# TYPE tmplog_blocked_seconds summary\n"];
+    TMPLogMetricsAppendSummary(text, @"tmplog_blocked_seconds", @"", _blockedTime);
+
+    if (_loggers.count) {
+        [text appendString:@"# TYPE tmplog_logger_latency_seconds summary\n"];
+
+        // The position tells apart loggers with the same name
+        [_loggers enumerateObjectsUsingBlock:^(TMPLoggerMetrics *logger, NSUInteger idx, BOOL *stop) {
+            NSString *labels = [NSString stringWithFormat:@"logger=\"%@\",position=\"%lu\"", TMPLogMetricsEscapedLabel(logger.name), (unsigned long)idx];
+            TMPLogMetricsAppendSummary(text, @"tmplog_logger_latency_seconds", labels, logger.latency);
+        }];
+
+        [text appendString:@"# TYPE tmplog_logger_cost_seconds gauge\n"];
+
+        [_loggers enumerateObjectsUsingBlock:^(TMPLoggerMetrics *logger, NSUInteger idx, BOOL *stop) {
+            [text appendFormat:@"tmplog_logger_cost_seconds{logger=\"%@\",position=\"%lu\"} %.9g\n",
+             TMPLogMetricsEscapedLabel(logger.name), (unsigned long)idx, logger.averageCost];
+        }];
+
+        [text appendString:@"# TYPE tmplog_logger_inline gauge\n"];
+
+        [_loggers enumerateObjectsUsingBlock:^(TMPLoggerMetrics *logger, NSUInteger idx, BOOL *stop) {
+            [text appendFormat:@"tmplog_logger_inline{logger=\"%@\",position=\"%lu\"} %d\n",
+             TMPLogMetricsEscapedLabel(logger.name), (unsigned long)idx, logger.runsInline ? 1 : 0];
+        }];
+    }
+
+    if (_callSites.count) {
+        [text appendString:@"# TYPE tmplog_call_site_messages gauge\n"];
+
+        for (TMPLogCallSite *site in _callSites) {
+            [text appendFormat:@"tmplog_call_site_messages{%@} %llu\n", TMPLogMetricsCallSiteLabels(site), site.messages];
+        }
+
+        [text appendString:@"# TYPE tmplog_call_site_bytes gauge\n"];
+
+        for (TMPLogCallSite *site in _callSites) {
+            [text appendFormat:@"tmplog_call_site_bytes{%@} %llu\n", TMPLogMetricsCallSiteLabels(site), site.bytes];
+        }
+    }
+
+    return text;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@ enqueued: %llu, delivered: %llu, dropped: %llu, queue depth: %llu (max %llu)>",
+            NSStringFromClass([self class]), _messagesEnqueued, _messagesDelivered, _messagesDropped, _queueDepth, _maximumQueueDepth];
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogMetricsServer
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// How long a client that doesn't read is waited for
+static const struct timeval kTMPLogMetricsServerSendTimeout = { 1, 0 };
+
+// Writing to a client that went away must not raise SIGPIPE, which would kill the process:
+// SO_NOSIGPIPE is only available on Apple platforms, MSG_NOSIGNAL on Linux.
+#ifdef MSG_NOSIGNAL
+static const int kTMPLogMetricsServerSendFlags = MSG_NOSIGNAL;
+#else
+static const int kTMPLogMetricsServerSendFlags = 0;
+#endif
+
+static void TMPLogMetricsServerReply(int fd, NSData *data) {
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &kTMPLogMetricsServerSendTimeout, sizeof(kTMPLogMetricsServerSendTimeout));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    const uint8_t *bytes = data.bytes;
+    size_t remaining = data.length;
+
+    while (remaining > 0) {
+        ssize_t written = send(fd, bytes, remaining, kTMPLogMetricsServerSendFlags);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (written <= 0) {
+            break;
+        }
+
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+
+    close(fd);
+}
+
+// Removes the socket left at path, if any, but never another kind of file.
+static void TMPLogMetricsServerRemoveSocket(const char *path) {
+    struct stat status;
+
+    if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+        unlink(path);
+    }
+}
+
+@implementation TMPLogMetricsServer {
+    dispatch_queue_t _queue;
+    dispatch_source_t _source;
+}
+
+- (instancetype)initWithLog:(TMPLog *)log socketPath:(NSString *)socketPath {
+    if ((self = [super init])) {
+        _log = log;
+        _socketPath = [socketPath copy];
+        _queue = dispatch_queue_create("cocoa.lumberjack.metrics", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+}
+
+- (BOOL)start:(NSError * __autoreleasing *)error {
+    @synchronized (self) {
+        if (_source) {
+            return YES;
+        }
+
+        const char *path = _socketPath.fileSystemRepresentation;
+        struct sockaddr_un address = { 0 };
+        address.sun_family = AF_UNIX;
+
+        if (strlen(path) >= sizeof(address.sun_path)) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENAMETOOLONG userInfo:@{ NSFilePathErrorKey: _socketPath }];
+            }
+            return NO;
+        }
+
+        strlcpy(address.sun_path, path, sizeof(address.sun_path));
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (fd < 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: _socketPath }];
+            }
+            return NO;
+        }
+
+        TMPLogMetricsServerRemoveSocket(path);
+
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(fd, 8) != 0 ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+            if (error) {
+                *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: _socketPath }];
+            }
+            close(fd);
+            return NO;
+        }
+
+        _source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)fd, 0, _queue);
+
+        __weak __auto_type weakSelf = self;
+        dispatch_source_set_event_handler(_source, ^{ @autoreleasepool {
+            int client;
+
+            while ((client = accept(fd, NULL, NULL)) >= 0) {
+                // Accepted sockets inherit O_NONBLOCK on some systems
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL) & ~O_NONBLOCK);
+
+                NSString *text = weakSelf.log.metrics.textExposition ?: @"";
+                TMPLogMetricsServerReply(client, [text dataUsingEncoding:NSUTF8StringEncoding]);
+            }
+        } });
+
+        dispatch_source_set_cancel_handler(_source, ^{
+            close(fd);
+        });
+
+        dispatch_resume(_source);
+        return YES;
+    }
+}
+
+- (void)stop {
+    @synchronized (self) {
+        if (!_source) {
+            return;
+        }
+
+        dispatch_source_cancel(_source);
+        _source = nil;
+        TMPLogMetricsServerRemoveSocket(_socketPath.fileSystemRepresentation);
+    }
+}
+
+@end
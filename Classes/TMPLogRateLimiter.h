@@ -0,0 +1,111 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+/**
+ * Number of call sites a rate limiter keeps track of. Messages from further call sites are not limited.
+ * Must be a power of 2.
+ **/
+#ifndef TMP_LOG_RATE_LIMITER_SITES
+    #define TMP_LOG_RATE_LIMITER_SITES 1024
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Limits how many messages each call site (file and line) can log, to keep a statement spinning in an error loop
+ * from drowning the loggers. Install it with `TMPLog.rateLimiter`.
+ *
+ * Each call site gets a token bucket: it can log `burst` messages at once, and then `messagesPerSecond` messages per second.
+ * The check runs before the message is formatted, so suppressed messages cost next to nothing:
+ * it finds the site in a fixed size open addressing table, and updates its bucket with a single compare-and-swap, without locking.
+ *
+ * Suppressed messages are counted per call site, and reported as a single warning,
+ * `Suppressed N messages from File.m:42`, when the site logs again, or at the latest after `reportInterval`.
+ *
+ * Limits can be changed per logging context, e.g. to exempt a context, or to limit a chatty one harder.
+ **/
+@interface TMPLogRateLimiter : NSObject
+
+/**
+ * Unavailable, use `initWithMessagesPerSecond:burst:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Limits every call site to `messagesPerSecond` messages per second, allowing bursts of up to `burst` messages.
+ * A rate of 0 or less disables the limit, except for the contexts given to `setMessagesPerSecond:burst:forContext:`.
+ */
+- (instancetype)initWithMessagesPerSecond:(double)messagesPerSecond burst:(NSUInteger)burst NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The default limit
+ **/
+@property (nonatomic, readonly) double messagesPerSecond;
+@property (nonatomic, readonly) NSUInteger burst;
+
+/**
+ * Overrides the default limit for call sites logging with the given context.
+ * A rate of 0 or less disables the limit for the context.
+ **/
+- (void)setMessagesPerSecond:(double)messagesPerSecond burst:(NSUInteger)burst forContext:(NSInteger)context;
+
+/**
+ * Restores the default limit for the context.
+ **/
+- (void)removeLimitForContext:(NSInteger)context;
+
+/**
+ * How often suppressed messages that haven't been reported yet are reported. Defaults to 5 seconds.
+ * Read when the limiter is installed.
+ **/
+@property (nonatomic, assign) NSTimeInterval reportInterval;
+
+/**
+ * If YES, consecutive messages with the same call site and text are collapsed syslog-style:
+ * the repeats are dropped, and reported as `Last message repeated N times` when a different message is logged,
+ * or at the latest after `reportInterval`. Defaults to NO.
+ *
+ * Unlike the rate limit, this compares the formatted text, under a lock.
+ **/
+@property (nonatomic, assign) BOOL collapsesRepeatedMessages;
+
+/**
+ * Reports the suppressed and repeated messages that haven't been reported yet, right away.
+ **/
+- (void)reportSuppressedMessages;
+
+@end
+
+/**
+ * Used by `TMPLog`: whether a message from the given call site can be logged.
+ * Reports the suppressed messages of the site before letting one through.
+ **/
+FOUNDATION_EXTERN BOOL TMPLogRateLimiterCheck(TMPLogRateLimiter *limiter, const char *file, NSUInteger line, NSInteger context);
+
+/**
+ * Used by `TMPLog`: whether a formatted message isn't a repeat of the previous one (see `collapsesRepeatedMessages`).
+ **/
+FOUNDATION_EXTERN BOOL TMPLogRateLimiterCheckRepeat(TMPLogRateLimiter *limiter, const char *file, NSUInteger line, NSInteger context, NSString *message);
+
+NS_ASSUME_NONNULL_END
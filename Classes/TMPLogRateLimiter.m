@@ -0,0 +1,357 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogRateLimiter.h"
+#import "TMPLogCallSite+Internal.h"
+
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdatomic.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+#if (TMP_LOG_RATE_LIMITER_SITES & (TMP_LOG_RATE_LIMITER_SITES - 1)) != 0
+    #error TMP_LOG_RATE_LIMITER_SITES must be a power of 2
+#endif
+
+typedef struct {
+    TMPLogCallSiteKey key;
+
+    // The limits of the site, and the configuration generation they were read at
+    _Atomic(uint32_t) generation;
+    _Atomic(uint64_t) interval;  // Mach ticks per message, 0 if unlimited
+    _Atomic(uint64_t) tolerance; // burst * interval
+
+    // Token bucket, as a "theoretical arrival time" (GCRA): the bucket is full when it's in the past,
+    // and each message moves it one interval into the future. A message is suppressed if that would put it
+    // more than `tolerance` ahead of now.
+    _Atomic(uint64_t) arrival;
+
+    _Atomic(uint64_t) suppressed;
+} TMPLogRateLimiterSite;
+
+typedef struct {
+    NSInteger context;
+    uint64_t interval;
+    uint64_t tolerance;
+} TMPLogRateLimiterContextLimit;
+
+@interface TMPLogRateLimiter () {
+    TMPLogRateLimiterSite *_sites;
+
+    // Configuration, only read by sites whose generation is outdated
+    pthread_mutex_t _configMutex;
+    _Atomic(uint32_t) _generation;
+    uint64_t _interval;
+    uint64_t _tolerance;
+    TMPLogRateLimiterContextLimit *_contextLimits;
+    NSUInteger _contextLimitCount;
+
+    // Repeated messages
+    BOOL _collapsesRepeatedMessages;
+    pthread_mutex_t _repeatMutex;
+    const char *_lastFile;
+    NSUInteger _lastLine;
+    NSInteger _lastContext;
+    NSString *_lastMessage;
+    NSUInteger _repeats;
+
+    // Set by -[TMPLog setRateLimiter:]
+    __weak TMPLog *_log;
+    dispatch_source_t _reportTimer;
+}
+
+@end
+
+static void TMPLogRateLimiterConvert(double messagesPerSecond, NSUInteger burst, uint64_t *interval, uint64_t *tolerance) {
+    if (!(messagesPerSecond > 0.0)) {
+        *interval = 0;
+        *tolerance = 0;
+        return;
+    }
+
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+
+    double nanoseconds = (double)NSEC_PER_SEC / messagesPerSecond;
+    *interval = MAX((uint64_t)(nanoseconds * timebase.denom / timebase.numer), (uint64_t)1);
+    *tolerance = *interval * MAX(burst, (NSUInteger)1);
+}
+
+@implementation TMPLogRateLimiter
+
+- (instancetype)initWithMessagesPerSecond:(double)messagesPerSecond burst:(NSUInteger)burst {
+    if ((self = [super init])) {
+        _messagesPerSecond = messagesPerSecond;
+        _burst = burst;
+        _reportInterval = 5.0;
+
+        _sites = calloc(TMP_LOG_RATE_LIMITER_SITES, sizeof(TMPLogRateLimiterSite));
+
+        pthread_mutex_init(&_configMutex, NULL);
+        pthread_mutex_init(&_repeatMutex, NULL);
+
+        // Sites start at generation 0, so they all read their limits the first time
+        atomic_init(&_generation, 1);
+        TMPLogRateLimiterConvert(messagesPerSecond, burst, &_interval, &_tolerance);
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_reportTimer) {
+        dispatch_source_cancel(_reportTimer);
+    }
+
+    free(_sites);
+    free(_contextLimits);
+
+    pthread_mutex_destroy(&_configMutex);
+    pthread_mutex_destroy(&_repeatMutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Configuration
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)setMessagesPerSecond:(double)messagesPerSecond burst:(NSUInteger)burst forContext:(NSInteger)context {
+    pthread_mutex_lock(&_configMutex);
+
+    NSUInteger index = 0;
+    while (index < _contextLimitCount && _contextLimits[index].context != context) {
+        index++;
+    }
+
+    if (index == _contextLimitCount) {
+        _contextLimits = reallocf(_contextLimits, (_contextLimitCount + 1) * sizeof(TMPLogRateLimiterContextLimit));
+        _contextLimitCount++;
+    }
+
+    _contextLimits[index].context = context;
+    TMPLogRateLimiterConvert(messagesPerSecond, burst, &_contextLimits[index].interval, &_contextLimits[index].tolerance);
+
+    atomic_fetch_add_explicit(&_generation, 1, memory_order_release);
+    pthread_mutex_unlock(&_configMutex);
+}
+
+- (void)removeLimitForContext:(NSInteger)context {
+    pthread_mutex_lock(&_configMutex);
+
+    for (NSUInteger i = 0; i < _contextLimitCount; i++) {
+        if (_contextLimits[i].context == context) {
+            _contextLimits[i] = _contextLimits[--_contextLimitCount];
+            atomic_fetch_add_explicit(&_generation, 1, memory_order_release);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&_configMutex);
+}
+
+static void TMPLogRateLimiterRefreshSite(TMPLogRateLimiter *limiter, TMPLogRateLimiterSite *site) {
+    pthread_mutex_lock(&limiter->_configMutex);
+
+    uint32_t generation = atomic_load_explicit(&limiter->_generation, memory_order_relaxed);
+    uint64_t interval = limiter->_interval;
+    uint64_t tolerance = limiter->_tolerance;
+
+    for (NSUInteger i = 0; i < limiter->_contextLimitCount; i++) {
+        if (limiter->_contextLimits[i].context == site->key.context) {
+            interval = limiter->_contextLimits[i].interval;
+            tolerance = limiter->_contextLimits[i].tolerance;
+            break;
+        }
+    }
+
+    atomic_store_explicit(&site->interval, interval, memory_order_relaxed);
+    atomic_store_explicit(&site->tolerance, tolerance, memory_order_relaxed);
+    atomic_store_explicit(&site->generation, generation, memory_order_release);
+
+    pthread_mutex_unlock(&limiter->_configMutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Reporting
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)setLog:(TMPLog *)log {
+    if (_reportTimer) {
+        dispatch_source_cancel(_reportTimer);
+    }
+
+    _log = log;
+
+    __weak __auto_type weakSelf = self;
+    _reportTimer = log ? TMPLogCallSiteReportTimer(_reportInterval, ^{
+        [weakSelf reportSuppressedMessages];
+    }) : nil;
+}
+
+static void TMPLogRateLimiterLogReport(TMPLogRateLimiter *limiter, NSString *text, const char *file, NSUInteger line, NSInteger context) {
+    TMPLog *log = limiter->_log;
+
+    if (!log) {
+        return;
+    }
+
+    // Logged from the limited call site, but not limited, see TMPLogQueueReport
+    TMPLogMessage *report = [[TMPLogMessage alloc] initWithMessage:text
+                                                             level:TMPLogLevelAll
+                                                              flag:TMPLogFlagWarning
+                                                           context:context
+                                                              file:@(file)
+                                                          function:nil
+                                                              line:line
+                                                               tag:nil
+                                                           options:TMPLogMessageDontCopyMessage
+                                                         timestamp:nil];
+
+    TMPLogQueueReport(log, report);
+}
+
+static void TMPLogRateLimiterReportSite(TMPLogRateLimiter *limiter, TMPLogRateLimiterSite *site) {
+    uint64_t suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+
+    if (suppressed == 0) {
+        return;
+    }
+
+    // Published by the acquire load that found the site
+    const char *file = (const char *)atomic_load_explicit(&site->key.file, memory_order_relaxed);
+    NSString *text = [[NSString alloc] initWithFormat:@"Suppressed %llu messages from %s:%lu",
+                      (unsigned long long)suppressed, strrchr(file, '/') ? strrchr(file, '/') + 1 : file, (unsigned long)site->key.line];
+
+    TMPLogRateLimiterLogReport(limiter, text, file, site->key.line, site->key.context);
+}
+
+static void TMPLogRateLimiterReportRepeats(TMPLogRateLimiter *limiter, NSUInteger repeats, const char *file, NSUInteger line, NSInteger context) {
+    NSString *text = [[NSString alloc] initWithFormat:@"Last message repeated %lu times", (unsigned long)repeats];
+    TMPLogRateLimiterLogReport(limiter, text, file, line, context);
+}
+
+- (void)reportSuppressedMessages {
+    for (NSUInteger i = 0; i < TMP_LOG_RATE_LIMITER_SITES; i++) {
+        TMPLogRateLimiterSite *site = &_sites[i];
+
+        if (TMPLogCallSiteFile(&site->key)
+            && atomic_load_explicit(&site->suppressed, memory_order_relaxed) > 0) {
+            TMPLogRateLimiterReportSite(self, site);
+        }
+    }
+
+    pthread_mutex_lock(&_repeatMutex);
+
+    // Keeps the last message, so that further repeats are still collapsed
+    NSUInteger repeats = _repeats;
+    const char *file = _lastFile;
+    NSUInteger line = _lastLine;
+    NSInteger context = _lastContext;
+    _repeats = 0;
+
+    pthread_mutex_unlock(&_repeatMutex);
+
+    if (repeats > 0) {
+        TMPLogRateLimiterReportRepeats(self, repeats, file, line, context);
+    }
+}
+
+@end
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Checks
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+BOOL TMPLogRateLimiterCheck(TMPLogRateLimiter *limiter, const char *file, NSUInteger line, NSInteger context) {
+    TMPLogRateLimiterSite *site = (TMPLogRateLimiterSite *)TMPLogCallSiteFind(limiter->_sites, sizeof(TMPLogRateLimiterSite), TMP_LOG_RATE_LIMITER_SITES,
+                                                                              file, NULL, line, context);
+
+    if (!site) {
+        return YES;
+    }
+
+    if (atomic_load_explicit(&site->generation, memory_order_acquire) != atomic_load_explicit(&limiter->_generation, memory_order_relaxed)) {
+        TMPLogRateLimiterRefreshSite(limiter, site);
+    }
+
+    uint64_t interval = atomic_load_explicit(&site->interval, memory_order_relaxed);
+
+    if (interval == 0) {
+        return YES;
+    }
+
+    uint64_t tolerance = atomic_load_explicit(&site->tolerance, memory_order_relaxed);
+    uint64_t now = mach_absolute_time();
+    uint64_t arrival = atomic_load_explicit(&site->arrival, memory_order_relaxed);
+
+    for (;;) {
+        uint64_t nextArrival = MAX(arrival, now) + interval;
+
+        if (nextArrival - now > tolerance) {
+            atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+            return NO;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&site->arrival, &arrival, nextArrival, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    // The window closed: report what was suppressed before this message goes through
+    if (atomic_load_explicit(&site->suppressed, memory_order_relaxed) > 0) {
+        TMPLogRateLimiterReportSite(limiter, site);
+    }
+
+    return YES;
+}
+
+BOOL TMPLogRateLimiterCheckRepeat(TMPLogRateLimiter *limiter, const char *file, NSUInteger line, NSInteger context, NSString *message) {
+    if (!limiter->_collapsesRepeatedMessages) {
+        return YES;
+    }
+
+    pthread_mutex_lock(&limiter->_repeatMutex);
+
+    if (file == limiter->_lastFile && line == limiter->_lastLine && context == limiter->_lastContext
+        && [message isEqualToString:limiter->_lastMessage]) {
+        limiter->_repeats++;
+        pthread_mutex_unlock(&limiter->_repeatMutex);
+        return NO;
+    }
+
+    NSUInteger repeats = limiter->_repeats;
+    const char *lastFile = limiter->_lastFile;
+    NSUInteger lastLine = limiter->_lastLine;
+    NSInteger lastContext = limiter->_lastContext;
+
+    limiter->_lastFile = file;
+    limiter->_lastLine = line;
+    limiter->_lastContext = context;
+    limiter->_lastMessage = message;
+    limiter->_repeats = 0;
+
+    pthread_mutex_unlock(&limiter->_repeatMutex);
+
+    if (repeats > 0) {
+        TMPLogRateLimiterReportRepeats(limiter, repeats, lastFile, lastLine, lastContext);
+    }
+
+    return YES;
+}
@@ -0,0 +1,188 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Framed log records.
+ *
+ * When `TMPFileLogger.usesRecordFraming` is enabled, every log statement is written to disk as a binary record:
+ * a fixed size header followed by the UTF-8 payload produced by the log formatter.
+ *
+ * The header carries everything needed to verify and re-create the message without parsing any text:
+ *
+ * | Offset | Size | Field                                        |
+ * |--------|------|----------------------------------------------|
+ * | 0      | 4    | magic (`kTMPLogRecordMagic`)                 |
+ * | 4      | 4    | payload length in bytes                      |
+ * | 8      | 8    | timestamp, microseconds since 1970           |
+ * | 16     | 8    | context                                      |
+ * | 24     | 4    | flag                                         |
+ * | 28     | 4    | CRC32C of bytes 0..27 followed by the payload |
+ *
+ * All fields are stored little endian.
+ *
+ * Because every record is self-describing, a record that was only partially written
+ * (for example because the process was killed in the middle of a write) can be detected and dropped.
+ * `TMPFileLogger` does this automatically when it resumes logging into an existing file.
+ **/
+typedef struct TMPLogRecordHeader {
+    uint32_t magic;
+    uint32_t length;
+    int64_t  timestamp;
+    int64_t  context;
+    uint32_t flag;
+    uint32_t checksum;
+} TMPLogRecordHeader;
+
+/**
+ * The value every record header starts with (`LJR1`).
+ **/
+FOUNDATION_EXPORT uint32_t const kTMPLogRecordMagic;
+
+/**
+ * Size of `TMPLogRecordHeader` on disk.
+ **/
+FOUNDATION_EXPORT NSUInteger const kTMPLogRecordHeaderSize;
+
+/**
+ * Updates the running CRC32C (Castagnoli) `crc` with `length` bytes.
+ * Pass 0 as the initial value.
+ *
+ * Uses the CRC32 instructions of the CPU when they are available (ARMv8 CRC extension, SSE 4.2)
+ * and falls back to a table driven slicing-by-8 implementation otherwise.
+ **/
+FOUNDATION_EXPORT uint32_t TMPLogCRC32C(uint32_t crc, const void *bytes, size_t length);
+
+/**
+ * Fills `header` (including its checksum) for the given message and payload.
+ * The header is written in its on-disk representation, so it can be appended as is.
+ **/
+FOUNDATION_EXPORT void TMPLogRecordHeaderInit(TMPLogRecordHeader *header,
+                                              TMPLogMessage *logMessage,
+                                              const void * __nullable payload,
+                                              uint32_t length);
+
+/**
+ * Same as `TMPLogRecordHeaderInit`, from the values of the header (the timestamp is in microseconds since 1970).
+ * Neither allocates nor locks, so it can be used from a signal handler once `TMPLogCRC32C` has been called once.
+ **/
+FOUNDATION_EXPORT void TMPLogRecordHeaderInitWithValues(TMPLogRecordHeader *header,
+                                                        int64_t timestamp,
+                                                        NSInteger context,
+                                                        TMPLogFlag flag,
+                                                        const void * __nullable payload,
+                                                        uint32_t length);
+
+/**
+ * Appends a complete record (header and payload) to `data`.
+ **/
+FOUNDATION_EXPORT void TMPLogRecordAppend(NSMutableData *data,
+                                          TMPLogMessage *logMessage,
+                                          const void * __nullable payload,
+                                          NSUInteger length);
+
+/**
+ * Scans `length` bytes of framed records and returns the number of leading bytes that form valid records.
+ *
+ * Bytes that precede the first record (e.g. a `logFileHeader`) are skipped and reported through `preambleLength`.
+ * Everything after the returned length is either a torn or a corrupt record and can be discarded.
+ **/
+FOUNDATION_EXPORT NSUInteger TMPLogRecordValidLength(const void *bytes,
+                                                     NSUInteger length,
+                                                     NSUInteger * __nullable preambleLength,
+                                                     NSUInteger * __nullable recordCount);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Reads and validates files written by `TMPFileLogger` with `usesRecordFraming` enabled.
+ *
+ * The file is memory mapped, records are validated lazily while being enumerated,
+ * and payloads are handed out without copying.
+ **/
+@interface TMPLogRecordReader : NSObject
+
+/**
+ * Unavailable, use `initWithData:` or `initWithContentsOfFile:error:`.
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ *  Designated initializer, reads records from the given buffer.
+ */
+- (instancetype)initWithData:(NSData *)data NS_DESIGNATED_INITIALIZER;
+
+/**
+ *  Maps the file at `path` and reads records from it.
+ */
+- (nullable instancetype)initWithContentsOfFile:(NSString *)path error:(NSError * __autoreleasing *)error;
+
+/**
+ * Number of bytes preceding the first record.
+ **/
+@property (nonatomic, readonly) NSUInteger preambleLength;
+
+/**
+ * Number of leading bytes that form valid records (including the preamble).
+ **/
+@property (nonatomic, readonly) NSUInteger validLength;
+
+/**
+ * Number of valid records.
+ **/
+@property (nonatomic, readonly) NSUInteger recordCount;
+
+/**
+ * YES if the valid records are followed by other bytes: a torn or corrupt record, and whatever follows it.
+ **/
+@property (nonatomic, readonly) BOOL hasCorruptTail;
+
+/**
+ * Enumerates all valid records in order.
+ * The header is already converted to host byte order. The payload is only valid within the block.
+ **/
+- (void)enumerateRecordsUsingBlock:(void (NS_NOESCAPE ^)(const TMPLogRecordHeader *header,
+                                                         const void *payload,
+                                                         BOOL *stop))block;
+
+/**
+ * Re-creates the log messages stored in the records.
+ * Only the fields stored in the record header are restored; the message is the formatted payload.
+ **/
+@property (nonatomic, readonly) NSArray<TMPLogMessage *> *logMessages;
+
+/**
+ * Truncates the file at `path` from its first corrupt record, so that it ends with the last record of `validLength`.
+ * Records following a corrupt one are removed as well, even if they are valid: framed files are appended to,
+ * so corruption is expected at the end only (a torn write), and there is no resynchronization.
+ * Returns the number of bytes removed, which is 0 if the file was intact.
+ **/
++ (unsigned long long)truncateCorruptTailOfFileAtPath:(NSString *)path error:(NSError * __autoreleasing *)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
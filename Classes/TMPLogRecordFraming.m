@@ -0,0 +1,438 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogRecordFraming.h"
+
+#import <sys/sysctl.h>
+#import <unistd.h>
+
+#if defined(__x86_64__)
+    #import <nmmintrin.h>
+#elif defined(__aarch64__)
+    #import <arm_acle.h>
+#endif
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+uint32_t const kTMPLogRecordMagic = 0x31524A4C; // "LJR1" in little endian
+NSUInteger const kTMPLogRecordHeaderSize = sizeof(TMPLogRecordHeader);
+
+// The checksum covers everything in the header up to (but excluding) the checksum itself.
+#define TMP_RECORD_CHECKSUMMED_HEADER_SIZE offsetof(TMPLogRecordHeader, checksum)
+
+_Static_assert(sizeof(TMPLogRecordHeader) == 32, "TMPLogRecordHeader must not contain padding");
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark CRC32C
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef uint32_t (*TMPLogCRC32CFunction)(uint32_t crc, const uint8_t *bytes, size_t length);
+
+static uint32_t TMPLogCRC32CTable[8][256];
+
+static void TMPLogCRC32CInitTable(void) {
+    // Reflected Castagnoli polynomial
+    static const uint32_t polynomial = 0x82F63B78;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ polynomial : (crc >> 1);
+        }
+        TMPLogCRC32CTable[0][i] = crc;
+    }
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = TMPLogCRC32CTable[0][i];
+        for (int slice = 1; slice < 8; slice++) {
+            crc = TMPLogCRC32CTable[0][crc & 0xFF] ^ (crc >> 8);
+            TMPLogCRC32CTable[slice][i] = crc;
+        }
+    }
+}
+
+static uint32_t TMPLogCRC32CSoftware(uint32_t crc, const uint8_t *bytes, size_t length) {
+#if __LITTLE_ENDIAN__
+    // Slicing-by-8: consume 8 bytes per iteration with 8 independent table lookups.
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        word ^= crc;
+
+        crc = TMPLogCRC32CTable[7][ word        & 0xFF] ^
+              TMPLogCRC32CTable[6][(word >>  8) & 0xFF] ^
+              TMPLogCRC32CTable[5][(word >> 16) & 0xFF] ^
+              TMPLogCRC32CTable[4][(word >> 24) & 0xFF] ^
+              TMPLogCRC32CTable[3][(word >> 32) & 0xFF] ^
+              TMPLogCRC32CTable[2][(word >> 40) & 0xFF] ^
+              TMPLogCRC32CTable[1][(word >> 48) & 0xFF] ^
+              TMPLogCRC32CTable[0][ word >> 56        ];
+
+        bytes += 8;
+        length -= 8;
+    }
+#endif
+
+    while (length--) {
+        crc = TMPLogCRC32CTable[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+static uint32_t TMPLogCRC32CHardware(uint32_t crc, const uint8_t *bytes, size_t length) {
+    uint64_t crc64 = crc;
+
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        bytes += 8;
+        length -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *bytes++);
+    }
+
+    return crc;
+}
+
+static BOOL TMPLogCRC32CHardwareAvailable(void) {
+    int available = 0;
+    size_t size = sizeof(available);
+    return sysctlbyname("hw.optional.sse4_2", &available, &size, NULL, 0) == 0 && available;
+}
+
+#elif defined(__aarch64__)
+
+#if defined(__ARM_FEATURE_CRC32)
+static uint32_t TMPLogCRC32CHardware(uint32_t crc, const uint8_t *bytes, size_t length) {
+#else
+__attribute__((target("crc")))
+static uint32_t TMPLogCRC32CHardware(uint32_t crc, const uint8_t *bytes, size_t length) {
+#endif
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc = __builtin_arm_crc32cd(crc, word);
+        bytes += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = __builtin_arm_crc32cb(crc, *bytes++);
+    }
+
+    return crc;
+}
+
+static BOOL TMPLogCRC32CHardwareAvailable(void) {
+#if defined(__ARM_FEATURE_CRC32)
+    return YES;
+#else
+    int available = 0;
+    size_t size = sizeof(available);
+    return sysctlbyname("hw.optional.armv8_crc32", &available, &size, NULL, 0) == 0 && available;
+#endif
+}
+
+#endif
+
+static TMPLogCRC32CFunction TMPLogCRC32CImplementation(void) {
+    static TMPLogCRC32CFunction implementation = NULL;
+    static dispatch_once_t onceToken;
+
+    dispatch_once(&onceToken, ^{
+        implementation = TMPLogCRC32CSoftware;
+
+#if defined(__x86_64__) || defined(__aarch64__)
+        if (TMPLogCRC32CHardwareAvailable()) {
+            implementation = TMPLogCRC32CHardware;
+        }
+#endif
+
+        if (implementation == TMPLogCRC32CSoftware) {
+            TMPLogCRC32CInitTable();
+        }
+    });
+
+    return implementation;
+}
+
+uint32_t TMPLogCRC32C(uint32_t crc, const void *bytes, size_t length) {
+    return ~TMPLogCRC32CImplementation()(~crc, bytes, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Records
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void TMPLogRecordHeaderInit(TMPLogRecordHeader *header,
+                            TMPLogMessage *logMessage,
+                            const void *payload,
+                            uint32_t length) {
+    NSCParameterAssert(header);
+
+    int64_t timestamp = (int64_t)([logMessage->_timestamp timeIntervalSince1970] * 1000000.0);
+    TMPLogRecordHeaderInitWithValues(header, timestamp, logMessage->_context, logMessage->_flag, payload, length);
+}
+
+void TMPLogRecordHeaderInitWithValues(TMPLogRecordHeader *header,
+                                      int64_t timestamp,
+                                      NSInteger context,
+                                      TMPLogFlag flag,
+                                      const void *payload,
+                                      uint32_t length) {
+    header->magic = CFSwapInt32HostToLittle(kTMPLogRecordMagic);
+    header->length = CFSwapInt32HostToLittle(length);
+    header->timestamp = (int64_t)CFSwapInt64HostToLittle((uint64_t)timestamp);
+    header->context = (int64_t)CFSwapInt64HostToLittle((uint64_t)context);
+    header->flag = CFSwapInt32HostToLittle((uint32_t)flag);
+
+    uint32_t checksum = TMPLogCRC32C(0, header, TMP_RECORD_CHECKSUMMED_HEADER_SIZE);
+    if (length > 0) {
+        checksum = TMPLogCRC32C(checksum, payload, length);
+    }
+
+    header->checksum = CFSwapInt32HostToLittle(checksum);
+}
+
+void TMPLogRecordAppend(NSMutableData *data,
+                        TMPLogMessage *logMessage,
+                        const void *payload,
+                        NSUInteger length) {
+    NSCParameterAssert(length <= UINT32_MAX);
+
+    TMPLogRecordHeader header;
+    TMPLogRecordHeaderInit(&header, logMessage, payload, (uint32_t)length);
+
+    [data appendBytes:&header length:sizeof(header)];
+
+    if (length > 0) {
+        [data appendBytes:payload length:length];
+    }
+}
+
+typedef NS_ENUM(NSUInteger, TMPLogRecordStatus) {
+    TMPLogRecordStatusValid,
+    TMPLogRecordStatusTorn,
+    TMPLogRecordStatusCorrupt
+};
+
+static TMPLogRecordStatus TMPLogRecordCheck(const uint8_t *bytes, NSUInteger available, NSUInteger *recordLength) {
+    if (available < sizeof(TMPLogRecordHeader)) {
+        return TMPLogRecordStatusTorn;
+    }
+
+    TMPLogRecordHeader header;
+    memcpy(&header, bytes, sizeof(header));
+
+    if (CFSwapInt32LittleToHost(header.magic) != kTMPLogRecordMagic) {
+        return TMPLogRecordStatusCorrupt;
+    }
+
+    NSUInteger length = CFSwapInt32LittleToHost(header.length);
+    if (available - sizeof(header) < length) {
+        return TMPLogRecordStatusTorn;
+    }
+
+    uint32_t checksum = TMPLogCRC32C(0, bytes, TMP_RECORD_CHECKSUMMED_HEADER_SIZE);
+    checksum = TMPLogCRC32C(checksum, bytes + sizeof(header), length);
+
+    if (checksum != CFSwapInt32LittleToHost(header.checksum)) {
+        return TMPLogRecordStatusCorrupt;
+    }
+
+    *recordLength = sizeof(header) + length;
+    return TMPLogRecordStatusValid;
+}
+
+static NSUInteger TMPLogRecordFindFirst(const uint8_t *bytes, NSUInteger length) {
+    // Usually the file starts with a record. Otherwise anything written before it (a log file header)
+    // is skipped. A candidate that is complete but fails validation is just a coincidental match.
+    NSUInteger offset = 0;
+    const uint32_t magic = CFSwapInt32HostToLittle(kTMPLogRecordMagic);
+
+    while (offset + sizeof(magic) <= length) {
+        const uint8_t *candidate = memchr(bytes + offset, (int)(magic & 0xFF), length - offset - sizeof(magic) + 1);
+        if (candidate == NULL) {
+            break;
+        }
+
+        offset = (NSUInteger)(candidate - bytes);
+
+        if (memcmp(candidate, &magic, sizeof(magic)) == 0) {
+            NSUInteger recordLength = 0;
+            if (TMPLogRecordCheck(candidate, length - offset, &recordLength) != TMPLogRecordStatusCorrupt) {
+                return offset;
+            }
+        }
+
+        offset++;
+    }
+
+    return length;
+}
+
+NSUInteger TMPLogRecordValidLength(const void *bytes,
+                                   NSUInteger length,
+                                   NSUInteger *preambleLength,
+                                   NSUInteger *recordCount) {
+    const uint8_t *buffer = bytes;
+    NSUInteger offset = TMPLogRecordFindFirst(buffer, length);
+    NSUInteger count = 0;
+
+    if (preambleLength) {
+        *preambleLength = offset;
+    }
+
+    while (offset < length) {
+        NSUInteger recordLength = 0;
+        if (TMPLogRecordCheck(buffer + offset, length - offset, &recordLength) != TMPLogRecordStatusValid) {
+            break;
+        }
+
+        offset += recordLength;
+        count++;
+    }
+
+    if (recordCount) {
+        *recordCount = count;
+    }
+
+    return offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark -
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+@interface TMPLogRecordReader () {
+    NSData *_data;
+}
+
+@end
+
+@implementation TMPLogRecordReader
+
+- (instancetype)initWithData:(NSData *)data {
+    NSParameterAssert(data);
+
+    if ((self = [super init])) {
+        _data = data;
+        _validLength = TMPLogRecordValidLength(data.bytes, data.length, &_preambleLength, &_recordCount);
+    }
+
+    return self;
+}
+
+- (instancetype)initWithContentsOfFile:(NSString *)path error:(NSError * __autoreleasing *)error {
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+
+    if (data == nil) {
+        return nil;
+    }
+
+    return [self initWithData:data];
+}
+
+- (BOOL)hasCorruptTail {
+    return _validLength < _data.length;
+}
+
+- (void)enumerateRecordsUsingBlock:(void (NS_NOESCAPE ^)(const TMPLogRecordHeader *header,
+                                                         const void *payload,
+                                                         BOOL *stop))block {
+    NSParameterAssert(block);
+
+    const uint8_t *bytes = _data.bytes;
+    NSUInteger offset = _preambleLength;
+    BOOL stop = NO;
+
+    // Everything up to `_validLength` has been verified during initialization.
+    while (offset < _validLength && !stop) {
+        TMPLogRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+
+        header.magic = CFSwapInt32LittleToHost(header.magic);
+        header.length = CFSwapInt32LittleToHost(header.length);
+        header.timestamp = (int64_t)CFSwapInt64LittleToHost((uint64_t)header.timestamp);
+        header.context = (int64_t)CFSwapInt64LittleToHost((uint64_t)header.context);
+        header.flag = CFSwapInt32LittleToHost(header.flag);
+        header.checksum = CFSwapInt32LittleToHost(header.checksum);
+
+        block(&header, bytes + offset + sizeof(header), &stop);
+
+        offset += sizeof(header) + header.length;
+    }
+}
+
+- (NSArray<TMPLogMessage *> *)logMessages {
+    NSMutableArray<TMPLogMessage *> *messages = [NSMutableArray arrayWithCapacity:_recordCount];
+
+    [self enumerateRecordsUsingBlock:^(const TMPLogRecordHeader *header, const void *payload, BOOL *stop) {
+        NSString *message = [[NSString alloc] initWithBytes:payload length:header->length encoding:NSUTF8StringEncoding] ?: @"";
+        NSDate *timestamp = [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)header->timestamp / 1000000.0];
+
+        TMPLogMessage *logMessage = [[TMPLogMessage alloc] initWithMessage:message
+                                                                   level:TMPLogLevelAll
+                                                                    flag:(TMPLogFlag)header->flag
+                                                                 context:(NSInteger)header->context
+                                                                    file:@""
+                                                                function:nil
+                                                                    line:0
+                                                                     tag:nil
+                                                                 options:(TMPLogMessageOptions)0
+                                                               timestamp:timestamp];
+        [messages addObject:logMessage];
+    }];
+
+    return messages;
+}
+
++ (unsigned long long)truncateCorruptTailOfFileAtPath:(NSString *)path error:(NSError * __autoreleasing *)error {
+    unsigned long long removed = 0;
+
+    // Outside the pool, which would release it before the caller gets it
+    NSError *localError = nil;
+
+    @autoreleasepool {
+        TMPLogRecordReader *reader = [[self alloc] initWithContentsOfFile:path error:&localError];
+
+        if (reader != nil && reader.hasCorruptTail) {
+            if (truncate(path.fileSystemRepresentation, (off_t)reader->_validLength) == 0) {
+                removed = reader->_data.length - reader->_validLength;
+            } else {
+                localError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            }
+        }
+    }
+
+    if (error && localError) {
+        *error = localError;
+    }
+
+    return removed;
+}
+
+@end
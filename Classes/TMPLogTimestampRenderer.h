@@ -0,0 +1,79 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A fast replacement for `NSDateFormatter` on the logging hot path.
+ *
+ * Log timestamps are (almost) always increasing, and many messages are logged within the same second.
+ * The renderer therefore caches everything but the milliseconds for the current second,
+ * and only the three millisecond digits are written for each message.
+ * The cached text is recomputed when the second changes or the system time zone changes.
+ *
+ * The cache is published with a sequence lock: readers never block or take a lock,
+ * and a reader that races with an update simply renders the timestamp itself.
+ * A single renderer can therefore be shared by any number of loggers and threads.
+ *
+ * Only fixed width, numeric date formats are supported. The format may contain the fields
+ * `yyyy`, `yy`, `MM`, `dd`, `HH`, `mm`, `ss`, `SSS`, `xxx` (`+01:00`) and `Z` (`+0100`),
+ * separated by any literal characters; text can be quoted (`'T'`). The Gregorian calendar is always used.
+ * This covers the formats used by the formatters in this project, e.g. `yyyy/MM/dd HH:mm:ss:SSS`.
+ **/
+@interface TMPLogTimestampRenderer : NSObject
+
+/**
+ * Unavailable, use `initWithDateFormat:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Creates a renderer for the date format, using `[NSTimeZone defaultTimeZone]`.
+ * Returns nil if the format isn't supported; use a `NSDateFormatter` in that case.
+ **/
+- (nullable instancetype)initWithDateFormat:(NSString *)dateFormat;
+
+/**
+ * Creates a renderer for the date format in the given time zone (the default time zone if nil).
+ * Returns nil if the format isn't supported.
+ **/
+- (nullable instancetype)initWithDateFormat:(NSString *)dateFormat
+                                   timeZone:(NSTimeZone * __nullable)timeZone NS_DESIGNATED_INITIALIZER;
+
+/**
+ * The date format the renderer was created with.
+ **/
+@property (nonatomic, readonly, copy) NSString *dateFormat;
+
+/**
+ * Number of bytes every rendered timestamp occupies.
+ **/
+@property (nonatomic, readonly) NSUInteger length;
+
+/**
+ * Appends the UTF-8 representation of `date` to `buffer`.
+ **/
+- (void)appendDate:(NSDate *)date toBuffer:(NSMutableData *)buffer;
+
+/**
+ * Returns `date` as a string, like `-[NSDateFormatter stringFromDate:]`.
+ **/
+- (NSString *)stringFromDate:(NSDate *)date;
+
+@end
+
+NS_ASSUME_NONNULL_END
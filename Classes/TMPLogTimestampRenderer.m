@@ -0,0 +1,338 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPLogTimestampRenderer.h"
+
+#import <stdatomic.h>
+#import <time.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+// Longest timestamp the renderer supports, in bytes. Must be a multiple of 8.
+#define TMP_TIMESTAMP_MAX_LENGTH 64
+#define TMP_TIMESTAMP_CACHE_WORDS (TMP_TIMESTAMP_MAX_LENGTH / sizeof(uint64_t))
+
+typedef NS_ENUM(uint8_t, TMPTimestampField) {
+    TMPTimestampFieldLiteral,
+    TMPTimestampFieldYear4,
+    TMPTimestampFieldYear2,
+    TMPTimestampFieldMonth,
+    TMPTimestampFieldDay,
+    TMPTimestampFieldHour,
+    TMPTimestampFieldMinute,
+    TMPTimestampFieldSecond,
+    TMPTimestampFieldMillisecond,
+    TMPTimestampFieldOffsetColon,   // xxx: +01:00
+    TMPTimestampFieldOffsetCompact, // Z:   +0100
+};
+
+typedef struct {
+    TMPTimestampField field;
+    uint8_t offset; // position of the field in the rendered timestamp
+    uint8_t length; // number of bytes the field occupies
+} TMPTimestampToken;
+
+// Bumped whenever the system time zone changes, which invalidates the cache of every renderer.
+static _Atomic(uint64_t) TMPTimestampTimeZoneGeneration = 0;
+
+@interface TMPLogTimestampRenderer () {
+    NSTimeZone *_timeZone;
+
+    NSData *_tokenData;
+    const TMPTimestampToken *_tokens;
+    NSUInteger _tokenCount;
+
+    // Literal text of the format, with room for the fields that are filled in when rendering.
+    char _template[TMP_TIMESTAMP_MAX_LENGTH];
+    NSUInteger _length;
+    NSUInteger _millisecondOffset;
+    BOOL _hasMilliseconds;
+
+    // Sequence lock protecting the cache below: odd while an update is in progress.
+    _Atomic(uint64_t) _sequence;
+    _Atomic(int64_t) _cachedSecond;
+    _Atomic(uint64_t) _cachedGeneration;
+    _Atomic(uint64_t) _cachedText[TMP_TIMESTAMP_CACHE_WORDS];
+}
+
+@end
+
+@implementation TMPLogTimestampRenderer
+
++ (void)initialize {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        [[NSNotificationCenter defaultCenter] addObserverForName:NSSystemTimeZoneDidChangeNotification
+                                                          object:nil
+                                                           queue:nil
+                                                      usingBlock:^(NSNotification *note) {
+            atomic_fetch_add_explicit(&TMPTimestampTimeZoneGeneration, 1, memory_order_relaxed);
+        }];
+    });
+}
+
+- (instancetype)initWithDateFormat:(NSString *)dateFormat {
+    return [self initWithDateFormat:dateFormat timeZone:nil];
+}
+
+- (instancetype)initWithDateFormat:(NSString *)dateFormat timeZone:(NSTimeZone *)timeZone {
+    if ((self = [super init])) {
+        _dateFormat = [dateFormat copy];
+        _timeZone = timeZone;
+
+        if (![self compileDateFormat:_dateFormat]) {
+            return nil;
+        }
+
+        // No second can be cached yet: INT64_MIN is never a valid timestamp.
+        atomic_init(&_sequence, 0);
+        atomic_init(&_cachedSecond, INT64_MIN);
+        atomic_init(&_cachedGeneration, 0);
+        for (NSUInteger i = 0; i < TMP_TIMESTAMP_CACHE_WORDS; i++) {
+            atomic_init(&_cachedText[i], 0);
+        }
+    }
+
+    return self;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Compiling
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static BOOL TMPTimestampFieldForLetter(unichar letter, NSUInteger count, TMPTimestampField *field, uint8_t *length) {
+    switch (letter) {
+        case 'y':
+            if (count == 4) { *field = TMPTimestampFieldYear4; *length = 4; return YES; }
+            if (count == 2) { *field = TMPTimestampFieldYear2; *length = 2; return YES; }
+            return NO;
+        case 'M': *field = TMPTimestampFieldMonth;          *length = 2; return count == 2;
+        case 'd': *field = TMPTimestampFieldDay;            *length = 2; return count == 2;
+        case 'H': *field = TMPTimestampFieldHour;           *length = 2; return count == 2;
+        case 'm': *field = TMPTimestampFieldMinute;         *length = 2; return count == 2;
+        case 's': *field = TMPTimestampFieldSecond;         *length = 2; return count == 2;
+        case 'S': *field = TMPTimestampFieldMillisecond;    *length = 3; return count == 3;
+        case 'x': *field = TMPTimestampFieldOffsetColon;    *length = 6; return count == 3;
+        case 'Z': *field = TMPTimestampFieldOffsetCompact;  *length = 5; return count == 1;
+        default:
+            return NO;
+    }
+}
+
+- (BOOL)compileDateFormat:(NSString *)dateFormat {
+    NSMutableData *tokenData = [NSMutableData data];
+    NSMutableData *templateData = [NSMutableData data];
+
+    NSUInteger formatLength = dateFormat.length;
+    NSUInteger index = 0;
+    BOOL quoted = NO;
+
+    while (index < formatLength) {
+        unichar c = [dateFormat characterAtIndex:index];
+
+        if (c == '\'') {
+            if (index + 1 < formatLength && [dateFormat characterAtIndex:index + 1] == '\'') {
+                // '' is a literal quote, inside and outside of quoted text
+                [templateData appendBytes:"'" length:1];
+                index += 2;
+            } else {
+                quoted = !quoted;
+                index++;
+            }
+            continue;
+        }
+
+        if (!quoted && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+            NSUInteger count = 1;
+            while (index + count < formatLength && [dateFormat characterAtIndex:index + count] == c) {
+                count++;
+            }
+
+            TMPTimestampToken token;
+            if (!TMPTimestampFieldForLetter(c, count, &token.field, &token.length)) {
+                return NO;
+            }
+
+            if (token.field == TMPTimestampFieldMillisecond) {
+                if (_hasMilliseconds) {
+                    return NO;
+                }
+                _hasMilliseconds = YES;
+                _millisecondOffset = templateData.length;
+            }
+
+            token.offset = (uint8_t)templateData.length;
+            [tokenData appendBytes:&token length:sizeof(token)];
+            [templateData increaseLengthBy:token.length];
+            index += count;
+        } else {
+            // Literal character; copy it as UTF-8 (surrogate pairs are copied as a whole).
+            NSRange range = [dateFormat rangeOfComposedCharacterSequenceAtIndex:index];
+            NSData *literal = [[dateFormat substringWithRange:range] dataUsingEncoding:NSUTF8StringEncoding];
+            [templateData appendData:literal];
+            index = NSMaxRange(range);
+        }
+
+        if (templateData.length > TMP_TIMESTAMP_MAX_LENGTH) {
+            return NO;
+        }
+    }
+
+    if (quoted) {
+        return NO;
+    }
+
+    memcpy(_template, templateData.bytes, templateData.length);
+    _length = templateData.length;
+
+    _tokenData = [tokenData copy];
+    _tokens = _tokenData.bytes;
+    _tokenCount = _tokenData.length / sizeof(TMPTimestampToken);
+
+    return YES;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark Rendering
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static inline void TMPTimestampWriteDigits(char *bytes, int value, uint8_t count) {
+    for (int i = count - 1; i >= 0; i--) {
+        bytes[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+}
+
+static inline void TMPTimestampWriteOffset(char *bytes, long offset, BOOL colon) {
+    long minutes = (offset < 0 ? -offset : offset) / 60;
+
+    bytes[0] = offset < 0 ? '-' : '+';
+    TMPTimestampWriteDigits(bytes + 1, (int)(minutes / 60), 2);
+    if (colon) {
+        bytes[3] = ':';
+        TMPTimestampWriteDigits(bytes + 4, (int)(minutes % 60), 2);
+    } else {
+        TMPTimestampWriteDigits(bytes + 3, (int)(minutes % 60), 2);
+    }
+}
+
+/**
+ * Renders everything but the milliseconds of `second` into `text`.
+ * Called at most once per second (per renderer), so it is free to use NSTimeZone.
+ **/
+- (void)renderSecond:(int64_t)second intoText:(char *)text {
+    NSTimeZone *timeZone = _timeZone ?: [NSTimeZone defaultTimeZone];
+    NSInteger offset = [timeZone secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)second]];
+
+    time_t local = (time_t)(second + offset);
+    struct tm tm;
+    gmtime_r(&local, &tm);
+
+    memset(text, 0, TMP_TIMESTAMP_MAX_LENGTH);
+    memcpy(text, _template, _length);
+
+    for (NSUInteger i = 0; i < _tokenCount; i++) {
+        const TMPTimestampToken *token = &_tokens[i];
+        char *bytes = text + token->offset;
+
+        switch (token->field) {
+            case TMPTimestampFieldYear4:         TMPTimestampWriteDigits(bytes, tm.tm_year + 1900, 4); break;
+            case TMPTimestampFieldYear2:         TMPTimestampWriteDigits(bytes, tm.tm_year + 1900, 2); break;
+            case TMPTimestampFieldMonth:         TMPTimestampWriteDigits(bytes, tm.tm_mon + 1, 2);     break;
+            case TMPTimestampFieldDay:           TMPTimestampWriteDigits(bytes, tm.tm_mday, 2);        break;
+            case TMPTimestampFieldHour:          TMPTimestampWriteDigits(bytes, tm.tm_hour, 2);        break;
+            case TMPTimestampFieldMinute:        TMPTimestampWriteDigits(bytes, tm.tm_min, 2);         break;
+            case TMPTimestampFieldSecond:        TMPTimestampWriteDigits(bytes, tm.tm_sec, 2);         break;
+            case TMPTimestampFieldOffsetColon:   TMPTimestampWriteOffset(bytes, (long)offset, YES);    break;
+            case TMPTimestampFieldOffsetCompact: TMPTimestampWriteOffset(bytes, (long)offset, NO);     break;
+            case TMPTimestampFieldMillisecond:
+            case TMPTimestampFieldLiteral:
+                // Milliseconds are written for every message, literals are part of the template.
+                break;
+        }
+    }
+}
+
+/**
+ * Writes the timestamp for `date` into `bytes`, which must have room for `_length` bytes.
+ **/
+- (void)renderDate:(NSDate *)date intoBytes:(char *)bytes {
+    // Like NSDateFormatter, work from whole milliseconds, rounded down (also before 1970).
+    int64_t milliseconds = (int64_t)floor([date timeIntervalSince1970] * 1000.0);
+    int64_t millisecondOfSecond = (milliseconds % 1000 + 1000) % 1000;
+    int64_t second = (milliseconds - millisecondOfSecond) / 1000;
+    uint64_t generation = atomic_load_explicit(&TMPTimestampTimeZoneGeneration, memory_order_relaxed);
+
+    uint64_t text[TMP_TIMESTAMP_CACHE_WORDS];
+    BOOL cached = NO;
+
+    // Reader side of the sequence lock.
+    // The cache is only used if the sequence is even (no update in progress) and unchanged after the copy.
+    uint64_t sequence = atomic_load_explicit(&_sequence, memory_order_acquire);
+    if ((sequence & 1) == 0 &&
+        atomic_load_explicit(&_cachedSecond, memory_order_relaxed) == second &&
+        atomic_load_explicit(&_cachedGeneration, memory_order_relaxed) == generation) {
+        for (NSUInteger i = 0; i < TMP_TIMESTAMP_CACHE_WORDS; i++) {
+            text[i] = atomic_load_explicit(&_cachedText[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        cached = (atomic_load_explicit(&_sequence, memory_order_relaxed) == sequence);
+    }
+
+    if (!cached) {
+        [self renderSecond:second intoText:(char *)text];
+
+        // Writer side: whoever wins the race publishes, everybody else just uses what they rendered.
+        sequence = atomic_load_explicit(&_sequence, memory_order_relaxed);
+        if ((sequence & 1) == 0 &&
+            atomic_compare_exchange_strong_explicit(&_sequence, &sequence, sequence + 1,
+                                                    memory_order_relaxed, memory_order_relaxed)) {
+            atomic_thread_fence(memory_order_release);
+            atomic_store_explicit(&_cachedSecond, second, memory_order_relaxed);
+            atomic_store_explicit(&_cachedGeneration, generation, memory_order_relaxed);
+            for (NSUInteger i = 0; i < TMP_TIMESTAMP_CACHE_WORDS; i++) {
+                atomic_store_explicit(&_cachedText[i], text[i], memory_order_relaxed);
+            }
+            atomic_store_explicit(&_sequence, sequence + 2, memory_order_release);
+        }
+    }
+
+    memcpy(bytes, text, _length);
+
+    if (_hasMilliseconds) {
+        // Written for every message, without branches.
+        int value = (int)millisecondOfSecond;
+        char *digits = bytes + _millisecondOffset;
+        digits[0] = (char)('0' + value / 100);
+        digits[1] = (char)('0' + value / 10 % 10);
+        digits[2] = (char)('0' + value % 10);
+    }
+}
+
+- (void)appendDate:(NSDate *)date toBuffer:(NSMutableData *)buffer {
+    NSUInteger start = buffer.length;
+    [buffer increaseLengthBy:_length];
+    [self renderDate:date intoBytes:(char *)buffer.mutableBytes + start];
+}
+
+- (NSString *)stringFromDate:(NSDate *)date {
+    char bytes[TMP_TIMESTAMP_MAX_LENGTH];
+    [self renderDate:date intoBytes:bytes];
+    return [[NSString alloc] initWithBytes:bytes length:_length encoding:NSUTF8StringEncoding];
+}
+
+@end
@@ -22,5 +22,7 @@ FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameASL NS_SWIFT_NAME(TMPLoggerNa
 FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameTTY NS_SWIFT_NAME(TMPLoggerName.tty); // TMPTTYLogger
 FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameOS NS_SWIFT_NAME(TMPLoggerName.os); // TMPOSLogger
 FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameFile NS_SWIFT_NAME(TMPLoggerName.file); // TMPFileLogger
+FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameFlightRecorder NS_SWIFT_NAME(TMPLoggerName.flightRecorder); // TMPFlightRecorderLogger
+FOUNDATION_EXPORT TMPLoggerName const TMPLoggerNameMappedRing NS_SWIFT_NAME(TMPLoggerName.mappedRing); // TMPMappedRingLogger
 
 NS_ASSUME_NONNULL_END
@@ -19,3 +19,5 @@ TMPLoggerName const TMPLoggerNameASL    = @"cocoa.lumberjack.aslLogger";
 TMPLoggerName const TMPLoggerNameTTY    = @"cocoa.lumberjack.ttyLogger";
 TMPLoggerName const TMPLoggerNameOS     = @"cocoa.lumberjack.osLogger";
 TMPLoggerName const TMPLoggerNameFile   = @"cocoa.lumberjack.fileLogger";
+TMPLoggerName const TMPLoggerNameFlightRecorder = @"cocoa.lumberjack.flightRecorderLogger";
+TMPLoggerName const TMPLoggerNameMappedRing = @"cocoa.lumberjack.mappedRingLogger";
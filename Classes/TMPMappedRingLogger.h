@@ -0,0 +1,90 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <Foundation/Foundation.h>
+
+// Disable legacy macros
+#ifndef TMP_LEGACY_MACROS
+    #define TMP_LEGACY_MACROS 0
+#endif
+
+#import <CocoaLumberjack/TMPLog.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A logger that keeps the last N messages in a file mapped into memory, so they survive a crash of the process.
+ *
+ * The file is a ring of fixed size slots, shared with the file system: writing a message only stores to memory,
+ * without any system call, and the kernel writes the pages back to the file even if the process dies right after.
+ * Each slot holds a framed record (see `TMPLogRecordHeader`, the payload is the text of the message) along with
+ * the sequence number of the message and a checksum, published last with a release store,
+ * so messages being written when the process died are detected and dropped.
+ *
+ * Messages are written from any thread, without locking: a writer claims its slot with a compare-and-swap of the sequence.
+ * When writers lap each other (more concurrent writers than slots), a message whose slot is being written,
+ * or already holds a newer message, is dropped. Install the logger as `TMPLog.mappedRingLogger`
+ * to have it record messages on the threads logging them, before they are queued: it then also keeps the messages
+ * that were still waiting in the logging queue, or in a buffering logger, when the process crashed.
+ * It can be added with `addLogger:` like any other logger too.
+ *
+ * When the file is opened, the records left by the previous run are read first (`recoveredMessages`),
+ * and can be replayed into another logger, e.g. a `TMPFileLogger`.
+ **/
+@interface TMPMappedRingLogger : TMPAbstractLogger <TMPLogger>
+
+/**
+ * Unavailable, use `initWithPath:numberOfRecords:recordSize:error:`
+ */
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Opens (creating it if needed) the ring at `path`, keeping the last `numberOfRecords` messages.
+ * Messages longer than `recordSize` bytes (including the 48 byte record header) are truncated.
+ * Returns nil if the file can't be mapped.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path
+                      numberOfRecords:(NSUInteger)numberOfRecords
+                           recordSize:(NSUInteger)recordSize
+                                error:(NSError * __autoreleasing *)error NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Opens the ring at `path` with 1024 records of 512 bytes.
+ */
+- (nullable instancetype)initWithPath:(NSString *)path error:(NSError * __autoreleasing *)error;
+
+@property (nonatomic, readonly, copy) NSString *path;
+@property (nonatomic, readonly) NSUInteger numberOfRecords;
+@property (nonatomic, readonly) NSUInteger recordSize;
+
+/**
+ * The valid records left in the file by the previous run, oldest first.
+ * Only the text, flag, context and timestamp of the messages are restored.
+ **/
+@property (nonatomic, readonly) NSArray<TMPLogMessage *> *recoveredMessages;
+
+/**
+ * Logs the recovered messages to `logger`, on its `loggerQueue`, and forgets them.
+ **/
+- (void)replayRecoveredMessagesToLogger:(id <TMPLogger>)logger;
+
+/**
+ * Reads the valid records of a ring file without opening it for writing, oldest first.
+ **/
++ (nullable NSArray<TMPLogMessage *> *)messagesInRingAtPath:(NSString *)path error:(NSError * __autoreleasing *)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,309 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import "TMPMappedRingLogger.h"
+#import "TMPLogRecordFraming.h"
+
+#import <fcntl.h>
+#import <stdatomic.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+#if !__has_feature(objc_arc)
+#error This file must be compiled with ARC. Use -fobjc-arc flag (or convert project to ARC).
+#endif
+
+static const uint32_t kTMPMappedRingMagic = 0x314D4A4C; // "LJM1" in little endian
+
+static const NSUInteger kTMPMappedRingDefaultNumberOfRecords = 1024;
+static const NSUInteger kTMPMappedRingDefaultRecordSize = 512;
+
+// The file starts with this header, followed by the slots.
+// The ring is only ever read back on the same machine, so everything but the records is in the host byte order.
+typedef struct {
+    uint32_t magic;
+    uint32_t recordSize;
+    uint32_t numberOfRecords;
+    uint32_t reserved;
+    _Atomic(uint64_t) lastSequence;
+    uint8_t padding[40];
+} TMPMappedRingHeader;
+
+// The sequence of a slot being written. Slots that were never written have sequence 0.
+static const uint64_t kTMPMappedRingSlotWriting = UINT64_MAX;
+
+typedef struct {
+    _Atomic(uint64_t) sequence; // kTMPMappedRingSlotWriting while the slot is being written
+    uint32_t checksum;          // CRC32C of the sequence, continuing the checksum of the record
+    uint32_t reserved;
+    TMPLogRecordHeader record;  // Followed by the payload
+} TMPMappedRingSlot;
+
+_Static_assert(sizeof(TMPMappedRingHeader) == 64, "TMPMappedRingHeader must not contain padding");
+_Static_assert(sizeof(TMPMappedRingSlot) == 48, "TMPMappedRingSlot must not contain padding");
+
+static inline uint32_t TMPMappedRingSlotChecksum(const TMPMappedRingSlot *slot, uint64_t sequence) {
+    return TMPLogCRC32C(slot->record.checksum, &sequence, sizeof(sequence));
+}
+
+static NSArray<TMPLogMessage *> * TMPMappedRingReadMessages(const uint8_t *bytes, NSUInteger length) {
+    const TMPMappedRingHeader *header = (const TMPMappedRingHeader *)bytes;
+
+    if (length < sizeof(TMPMappedRingHeader) ||
+        header->magic != kTMPMappedRingMagic ||
+        header->recordSize < sizeof(TMPMappedRingSlot) ||
+        header->recordSize % 8 != 0 ||
+        (length - sizeof(TMPMappedRingHeader)) / header->recordSize < header->numberOfRecords) {
+        return @[];
+    }
+
+    // Valid slots, sorted by sequence
+    NSMutableArray<NSNumber *> *sequences = [NSMutableArray array];
+    NSMutableDictionary<NSNumber *, NSNumber *> *offsets = [NSMutableDictionary dictionary];
+
+    for (NSUInteger i = 0; i < header->numberOfRecords; i++) {
+        NSUInteger offset = sizeof(TMPMappedRingHeader) + i * header->recordSize;
+        const TMPMappedRingSlot *slot = (const TMPMappedRingSlot *)(bytes + offset);
+        uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+        if (sequence == 0 || sequence == kTMPMappedRingSlotWriting || slot->checksum != TMPMappedRingSlotChecksum(slot, sequence)) {
+            continue;
+        }
+
+        NSUInteger recordLength = kTMPLogRecordHeaderSize + CFSwapInt32LittleToHost(slot->record.length);
+        NSUInteger preambleLength = 0;
+
+        if (recordLength > header->recordSize - offsetof(TMPMappedRingSlot, record) ||
+            TMPLogRecordValidLength(&slot->record, recordLength, &preambleLength, NULL) != recordLength ||
+            preambleLength != 0) {
+            continue;
+        }
+
+        [sequences addObject:@(sequence)];
+        offsets[@(sequence)] = @(offset);
+    }
+
+    [sequences sortUsingSelector:@selector(compare:)];
+
+    NSMutableData *records = [NSMutableData data];
+
+    for (NSNumber *sequence in sequences) {
+        const TMPMappedRingSlot *slot = (const TMPMappedRingSlot *)(bytes + offsets[sequence].unsignedIntegerValue);
+        [records appendBytes:&slot->record length:kTMPLogRecordHeaderSize + CFSwapInt32LittleToHost(slot->record.length)];
+    }
+
+    return [[TMPLogRecordReader alloc] initWithData:records].logMessages;
+}
+
+static NSError * TMPMappedRingPOSIXError(NSString *path) {
+    return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSFilePathErrorKey: path }];
+}
+
+@interface TMPMappedRingLogger () {
+    NSString *_path;
+    NSUInteger _numberOfRecords;
+    NSUInteger _recordSize;
+
+    uint8_t *_mapping;
+    size_t _mappingLength;
+    TMPMappedRingHeader *_header;
+
+    NSArray<TMPLogMessage *> *_recoveredMessages;
+}
+
+@end
+
+@implementation TMPMappedRingLogger
+
+@synthesize path = _path;
+@synthesize numberOfRecords = _numberOfRecords;
+@synthesize recordSize = _recordSize;
+
+- (instancetype)initWithPath:(NSString *)path error:(NSError * __autoreleasing *)error {
+    return [self initWithPath:path
+              numberOfRecords:kTMPMappedRingDefaultNumberOfRecords
+                   recordSize:kTMPMappedRingDefaultRecordSize
+                        error:error];
+}
+
+- (instancetype)initWithPath:(NSString *)path
+             numberOfRecords:(NSUInteger)numberOfRecords
+                  recordSize:(NSUInteger)recordSize
+                       error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(path);
+
+    if ((self = [super init])) {
+        _path = [path copy];
+        _numberOfRecords = MAX(numberOfRecords, (NSUInteger)1);
+        _recordSize = (MAX(recordSize, sizeof(TMPMappedRingSlot) + 8) + 7) & ~(NSUInteger)7;
+        _mappingLength = sizeof(TMPMappedRingHeader) + _numberOfRecords * _recordSize;
+
+        int fd = open(path.fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0) {
+            if (error) {
+                *error = TMPMappedRingPOSIXError(path);
+            }
+
+            return nil;
+        }
+
+        // Read what the previous run left behind, before the file is reset for this one
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *previous = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+            if (previous != MAP_FAILED) {
+                _recoveredMessages = TMPMappedRingReadMessages(previous, (NSUInteger)st.st_size);
+                munmap(previous, (size_t)st.st_size);
+            }
+        }
+
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)_mappingLength) != 0) {
+            if (error) {
+                *error = TMPMappedRingPOSIXError(path);
+            }
+
+            close(fd);
+            return nil;
+        }
+
+        void *mapping = mmap(NULL, _mappingLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (mapping == MAP_FAILED) {
+            if (error) {
+                *error = TMPMappedRingPOSIXError(path);
+            }
+
+            close(fd);
+            return nil;
+        }
+
+        // The mapping stays valid once the descriptor is closed
+        close(fd);
+
+        _mapping = mapping;
+        _header = mapping;
+        _header->recordSize = (uint32_t)_recordSize;
+        _header->numberOfRecords = (uint32_t)_numberOfRecords;
+        atomic_store_explicit(&_header->lastSequence, 0, memory_order_relaxed);
+        _header->magic = kTMPMappedRingMagic;
+
+        if (_recoveredMessages == nil) {
+            _recoveredMessages = @[];
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if (_mapping) {
+        munmap(_mapping, _mappingLength);
+    }
+}
+
++ (NSArray<TMPLogMessage *> *)messagesInRingAtPath:(NSString *)path error:(NSError * __autoreleasing *)error {
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+
+    if (data == nil) {
+        return nil;
+    }
+
+    return TMPMappedRingReadMessages(data.bytes, data.length);
+}
+
+- (NSArray<TMPLogMessage *> *)recoveredMessages {
+    @synchronized (self) {
+        return _recoveredMessages;
+    }
+}
+
+- (void)replayRecoveredMessagesToLogger:(id <TMPLogger>)logger {
+    NSArray<TMPLogMessage *> *messages;
+
+    @synchronized (self) {
+        messages = _recoveredMessages;
+        _recoveredMessages = @[];
+    }
+
+    if (messages.count == 0) {
+        return;
+    }
+
+    dispatch_block_t block = ^{ @autoreleasepool {
+        for (TMPLogMessage *logMessage in messages) {
+            [logger logMessage:logMessage];
+        }
+    } };
+
+    dispatch_queue_t queue = [logger respondsToSelector:@selector(loggerQueue)] ? logger.loggerQueue : NULL;
+
+    if (queue) {
+        dispatch_async(queue, block);
+    } else {
+        block();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+#pragma mark TMPLogger
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    // May be invoked from any thread (see TMPLog.mappedRingLogger): concurrent writers share the sequence counter,
+    // and claim their slot before writing it.
+    uint64_t sequence = atomic_fetch_add_explicit(&_header->lastSequence, 1, memory_order_relaxed) + 1;
+    TMPMappedRingSlot *slot = (TMPMappedRingSlot *)(_mapping + sizeof(TMPMappedRingHeader) + (sequence % _numberOfRecords) * _recordSize);
+    uint8_t *payload = (uint8_t *)slot + sizeof(TMPMappedRingSlot);
+
+    // Writers lapping each other land on the same slot. Only one of them writes it at a time, and only over an older
+    // record: the message is dropped if the slot is being written or already holds a newer record.
+    uint64_t previous = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    BOOL claimed = NO;
+
+    while (previous < sequence && !claimed) {
+        claimed = atomic_compare_exchange_strong_explicit(&slot->sequence, &previous, kTMPMappedRingSlotWriting,
+                                                          memory_order_acquire, memory_order_relaxed);
+    }
+
+    if (!claimed) {
+        return;
+    }
+
+    // The text is encoded straight into the slot, truncated on a character boundary if needed
+    NSString *message = logMessage->_message ?: @"";
+    NSUInteger length = 0;
+    [message getBytes:payload
+            maxLength:_recordSize - sizeof(TMPMappedRingSlot)
+           usedLength:&length
+             encoding:NSUTF8StringEncoding
+              options:0
+                range:NSMakeRange(0, message.length)
+       remainingRange:NULL];
+
+    TMPLogRecordHeaderInit(&slot->record, logMessage, payload, (uint32_t)length);
+    slot->checksum = TMPMappedRingSlotChecksum(slot, sequence);
+
+    atomic_store_explicit(&slot->sequence, sequence, memory_order_release);
+}
+
+- (TMPLoggerName)loggerName {
+    return TMPLoggerNameMappedRing;
+}
+
+@end
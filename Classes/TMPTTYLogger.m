@@ -14,6 +14,7 @@
 //   prior written permission of Deusty, LLC.
 
 #import "TMPTTYLogger.h"
+#import "TMPLogMetrics.h"
 
 #import <sys/uio.h>
 
@@ -133,6 +134,8 @@ typedef struct {
     BOOL _colorsEnabled;
     NSMutableArray *_colorProfilesArray;
     NSMutableDictionary *_colorProfilesDict;
+
+    NSMutableData *_formattingBuffer;
 }
 
 @end
@@ -884,6 +887,8 @@ static TMPTTYLogger *sharedInstance;
         _colorProfilesDict = [[NSMutableDictionary alloc] initWithCapacity:8];
 
         _automaticallyAppendNewlineForCustomFormatters = YES;
+
+        _formattingBuffer = [[NSMutableData alloc] initWithCapacity:1024];
     }
 
     return self;
@@ -908,7 +913,7 @@ static TMPTTYLogger *sharedInstance;
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     __block BOOL result;
 
@@ -945,7 +950,7 @@ static TMPTTYLogger *sharedInstance;
     NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
     NSAssert(![self isOnInternalLoggerQueue], @"MUST access ivar directly, NOT via self.* syntax.");
 
-    dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+    dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
 
     dispatch_async(globalLoggingQueue, ^{
         dispatch_async(self.loggerQueue, block);
@@ -991,7 +996,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1023,7 +1028,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1061,7 +1066,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1085,7 +1090,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1107,7 +1112,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1129,7 +1134,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1152,7 +1157,7 @@ static TMPTTYLogger *sharedInstance;
     if ([self isOnInternalLoggerQueue]) {
         block();
     } else {
-        dispatch_queue_t globalLoggingQueue = [TMPLog loggingQueue];
+        dispatch_queue_t globalLoggingQueue = self.globalLoggingQueue;
         NSAssert(![self isOnGlobalLoggingQueue], @"Core architecture requirement failure");
 
         dispatch_async(globalLoggingQueue, ^{
@@ -1162,15 +1167,12 @@ static TMPTTYLogger *sharedInstance;
 }
 
 - (void)logMessage:(TMPLogMessage *)logMessage {
-    NSString *logMsg = logMessage->_message;
+    // The message is formatted (or, if there's no formatter, converted) to UTF-8 straight into our buffer.
+    // It's reused for every message since we're always running on our logger queue.
     BOOL isFormatted = NO;
+    _formattingBuffer.length = 0;
 
-    if (_logFormatter) {
-        logMsg = [_logFormatter formatLogMessage:logMessage];
-        isFormatted = logMsg != logMessage->_message;
-    }
-
-    if (logMsg) {
+    if (TMPLogFormatMessageToBuffer(_logFormatter, logMessage, _formattingBuffer, &isFormatted)) {
         // Search for a color profile associated with the log message
 
         TMPTTYLoggerColorProfile *colorProfile = nil;
@@ -1202,30 +1204,9 @@ static TMPTTYLogger *sharedInstance;
             }
         }
 
-        // Convert log message to C string.
-        //
-        // We use the stack instead of the heap for speed if possible.
-        // But we're extra cautious to avoid a stack overflow.
-
-        NSUInteger msgLen = [logMsg lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
-        const BOOL useStack = msgLen < (1024 * 4);
-
-        char msgStack[useStack ? (msgLen + 1) : 1]; // Analyzer doesn't like zero-size array, hence the 1
-        char *msg = useStack ? msgStack : (char *)calloc(msgLen + 1, sizeof(char));
-
-        if (msg == NULL) {
-            return;
-        }
-
-        BOOL logMsgEnc = [logMsg getCString:msg maxLength:(msgLen + 1) encoding:NSUTF8StringEncoding];
-
-        if (!logMsgEnc) {
-            if (!useStack && msg != NULL) {
-                free(msg);
-            }
-
-            return;
-        }
+        const char *msg = _formattingBuffer.bytes;
+        NSUInteger msgLen = _formattingBuffer.length;
+        BOOL hasNewline = msgLen > 0 && msg[msgLen - 1] == '\n';
 
         // Write the log message to STDERR
 
@@ -1259,10 +1240,13 @@ static TMPTTYLogger *sharedInstance;
 
             if (iovec_len == 5) {
                 v[3].iov_base = "\n";
-                v[3].iov_len = (msg[msgLen] == '\n') ? 0 : 1;
+                v[3].iov_len = hasNewline ? 0 : 1;
             }
 
-            writev(STDERR_FILENO, v, iovec_len);
+            ssize_t written = writev(STDERR_FILENO, v, iovec_len);
+            if (written > 0) {
+                TMPLogMetricsAddBytesWritten((NSUInteger)written);
+            }
         } else {
             // The log message is unformatted, so apply standard NSLog style formatting.
 
@@ -1355,13 +1339,12 @@ static TMPTTYLogger *sharedInstance;
             v[10].iov_len = msgLen;
 
             v[11].iov_base = "\n";
-            v[11].iov_len = (msg[msgLen] == '\n') ? 0 : 1;
+            v[11].iov_len = hasNewline ? 0 : 1;
 
-            writev(STDERR_FILENO, v, 13);
-        }
-
-        if (!useStack) {
-            free(msg);
+            ssize_t written = writev(STDERR_FILENO, v, 13);
+            if (written > 0) {
+                TMPLogMetricsAddBytesWritten((NSUInteger)written);
+            }
         }
     }
 }
@@ -1370,6 +1353,10 @@ static TMPTTYLogger *sharedInstance;
     return TMPLoggerNameTTY;
 }
 
+- (BOOL)reusesSharedFormattedOutput {
+    return YES;
+}
+
 @end
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,67 @@
+#!/bin/bash
+
+set -euo pipefail
+SCRIPT_NAME=$(basename $0)
+
+# Arg1: Mode (full, usage_only). Defaults to 'full'.
+print_usage() {
+	echo "Usage: ${SCRIPT_NAME} [-n COUNT] SOCKET_PATH"
+	if [[ "${1:-full}" == "full" ]]; then
+		echo ""
+		echo "Prints the call sites that logged the most bytes, read from the TMPLogMetricsServer listening on SOCKET_PATH."
+		echo "The app must have a TMPLogCallSiteProfiler installed (TMPLog.callSiteProfiler)."
+		echo ""
+		echo "Examples:"
+		echo "$ ${SCRIPT_NAME} /tmp/app-log.sock           # Prints the top 10 call sites."
+		echo "$ ${SCRIPT_NAME} -n 25 /tmp/app-log.sock     # Prints the top 25 call sites."
+	fi
+}
+
+COUNT=10
+while getopts ":n:h" OPTION; do
+	case "${OPTION}" in
+		n)
+			COUNT="${OPTARG}"
+			;;
+		h)
+			print_usage 'full'
+			exit 0
+			;;
+		*)
+			print_usage 'usage_only'
+			exit 1
+			;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [[ $# -ne 1 ]]; then
+	print_usage 'usage_only'
+	exit 1
+fi
+
+# Joins the bytes and messages samples of each call site: "bytes messages file:line function"
+nc -U "$1" < /dev/null | awk '
+	/^tmplog_call_site_(bytes|messages)\{/ {
+		match($0, /\{.*\}/)
+		labels = substr($0, RSTART + 1, RLENGTH - 2)
+		value = $NF
+
+		file = labels; sub(/^.*file="/, "", file); sub(/".*$/, "", file)
+		line = labels; sub(/^.*line="/, "", line); sub(/".*$/, "", line)
+		function_name = labels; sub(/^.*function="/, "", function_name); sub(/"$/, "", function_name)
+
+		site = file ":" line " " function_name
+		sites[site] = 1
+		if ($0 ~ /^tmplog_call_site_bytes/) {
+			bytes[site] = value
+		} else {
+			messages[site] = value
+		}
+	}
+	END {
+		for (site in sites) {
+			printf "%12d %10d  %s\n", bytes[site], messages[site], site
+		}
+	}
+' | sort -rn | head -n "${COUNT}" | { printf "%12s %10s  %s\n" "bytes" "messages" "site"; cat; }
@@ -0,0 +1,136 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+@interface DDDispatchQueueLogFormatterTests : XCTestCase
+
+@property (nonatomic) TMPDispatchQueueLogFormatter *formatter;
+
+@end
+
+@implementation DDDispatchQueueLogFormatterTests
+
+- (void)setUp {
+    [super setUp];
+    self.formatter = [[TMPDispatchQueueLogFormatter alloc] init];
+}
+
+- (TMPLogMessage *)messageWithQueueLabel:(NSString *)queueLabel threadName:(NSString *)threadName {
+    TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"message"
+                                                              level:TMPLogLevelAll
+                                                               flag:TMPLogFlagInfo
+                                                            context:0
+                                                               file:@(__FILE__)
+                                                           function:@(__func__)
+                                                               line:__LINE__
+                                                                tag:nil
+                                                            options:(TMPLogMessageOptions)0
+                                                          timestamp:nil];
+    message->_queueLabel = [queueLabel copy];
+    message->_threadName = [threadName copy];
+    return message;
+}
+
+- (void)testQueueLabelIsUsed {
+    TMPLogMessage *message = [self messageWithQueueLabel:@"com.example.network" threadName:@"worker"];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"com.example.network");
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"com.example.network");
+}
+
+- (void)testRootQueuesUseThreadNameOrID {
+    TMPLogMessage *named = [self messageWithQueueLabel:@"com.apple.root.default-priority" threadName:@"worker"];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:named], @"worker");
+
+    TMPLogMessage *unnamed = [self messageWithQueueLabel:@"com.apple.root.default-priority" threadName:nil];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:unnamed], unnamed.threadID);
+}
+
+- (void)testReplacementsAreAppliedAfterCaching {
+    TMPLogMessage *message = [self messageWithQueueLabel:@"com.example.disk-io" threadName:nil];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"com.example.disk-io");
+
+    [self.formatter setReplacementString:@"diskIO" forQueueLabel:@"com.example.disk-io"];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"diskIO");
+
+    [self.formatter setReplacementString:nil forQueueLabel:@"com.example.disk-io"];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"com.example.disk-io");
+
+    TMPLogMessage *main = [self messageWithQueueLabel:@"com.apple.main-thread" threadName:nil];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:main], @"main");
+}
+
+- (void)testLengthLimitsAreAppliedAfterCaching {
+    TMPLogMessage *message = [self messageWithQueueLabel:@"diskIO" threadName:nil];
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"diskIO");
+
+    self.formatter.minQueueLength = 8;
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"diskIO  ");
+
+    self.formatter.maxQueueLength = 4;
+    XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message], @"disk");
+    XCTAssertEqual(self.formatter.maxQueueLength, 4);
+}
+
+- (void)testLengthLimitsAreAppliedToThreadIDsInBuffers {
+    TMPLogMessage *message = [self messageWithQueueLabel:@"com.apple.root.default-priority" threadName:nil];
+    NSString *threadID = message.threadID;
+
+    self.formatter.minQueueLength = threadID.length + 40;
+    NSMutableData *buffer = [NSMutableData data];
+    XCTAssertTrue([self.formatter formatLogMessage:message toBuffer:buffer]);
+    NSString *padded = [threadID stringByPaddingToLength:threadID.length + 40 withString:@" " startingAtIndex:0];
+    XCTAssertTrue([[[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding] containsString:[NSString stringWithFormat:@" [%@] ", padded]]);
+
+    self.formatter.minQueueLength = 0;
+    self.formatter.maxQueueLength = 1;
+    buffer.length = 0;
+    XCTAssertTrue([self.formatter formatLogMessage:message toBuffer:buffer]);
+    NSString *truncated = [threadID substringToIndex:1];
+    XCTAssertTrue([[[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding] containsString:[NSString stringWithFormat:@" [%@] ", truncated]]);
+}
+
+- (void)testManyDistinctLabels {
+    self.formatter.minQueueLength = 3;
+
+    for (NSUInteger i = 0; i < 1000; i++) {
+        NSString *label = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        TMPLogMessage *message = [self messageWithQueueLabel:label threadName:nil];
+        XCTAssertEqualObjects([self.formatter queueThreadLabelForLogMessage:message],
+                              [label stringByPaddingToLength:MAX(label.length, 3) withString:@" " startingAtIndex:0]);
+    }
+}
+
+- (void)testConcurrentLookups {
+    NSMutableArray<TMPLogMessage *> *messages = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 32; i++) {
+        [messages addObject:[self messageWithQueueLabel:[NSString stringWithFormat:@"queue-%lu", (unsigned long)i] threadName:nil]];
+    }
+
+    TMPDispatchQueueLogFormatter *formatter = self.formatter;
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        for (NSUInteger i = 0; i < 2000; i++) {
+            TMPLogMessage *message = messages[(i + worker) % messages.count];
+            NSString *label = [formatter queueThreadLabelForLogMessage:message];
+            if (i % 500 == 0) {
+                [formatter setReplacementString:@"replaced" forQueueLabel:@"queue-0"];
+            }
+            XCTAssertTrue([label isEqualToString:message.queueLabel] || [label isEqualToString:@"replaced"]);
+        }
+    });
+}
+
+@end
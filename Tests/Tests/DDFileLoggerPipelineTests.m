@@ -0,0 +1,164 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+// Not shareable: may only be called on the logger queue
+@interface DDPipelineTestSerialFormatter : NSObject <TMPLogFormatter>
+
+@property (nonatomic, readonly) BOOL calledOutsideQueue;
+@property (nonatomic, weak) TMPFileLogger *fileLogger;
+
+@end
+
+@implementation DDPipelineTestSerialFormatter
+
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    if (!self.fileLogger.isOnInternalLoggerQueue) {
+        _calledOutsideQueue = YES;
+    }
+    return logMessage.message;
+}
+
+@end
+
+@interface DDFileLoggerPipelineTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+@property (nonatomic) TMPFileLogger *fileLogger;
+
+@end
+
+@implementation DDFileLoggerPipelineTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+
+    NSString *logsDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    self.fileLogger = [[TMPFileLogger alloc] initWithLogFileManager:[[TMPLogFileManagerDefault alloc] initWithLogsDirectory:logsDirectory]];
+    self.fileLogger.maximumFileSize = 0;
+    self.fileLogger.rollingFrequency = 0;
+    self.fileLogger.logFormatter = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldMessage];
+}
+
+- (void)tearDown {
+    [self.log removeAllLoggers];
+    [self.log flushLog];
+    [[NSFileManager defaultManager] removeItemAtPath:self.fileLogger.logFileManager.logsDirectory error:nil];
+    self.fileLogger = nil;
+    [super tearDown];
+}
+
+- (void)logMessages:(NSUInteger)count {
+    for (NSUInteger i = 0; i < count; i++) {
+        [self.log log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Message %lu", (unsigned long)i];
+    }
+    [self.log flushLog];
+}
+
+- (NSArray<NSString *> *)writtenLines {
+    NSString *contents = [NSString stringWithContentsOfFile:self.fileLogger.currentLogFileInfo.filePath encoding:NSUTF8StringEncoding error:nil];
+    NSMutableArray<NSString *> *lines = [[contents componentsSeparatedByString:@"\n"] mutableCopy];
+    [lines removeObject:@""];
+    return lines;
+}
+
+- (void)assertWrittenInOrder:(NSUInteger)count {
+    NSArray<NSString *> *lines = [self writtenLines];
+    XCTAssertEqual(lines.count, count);
+
+    for (NSUInteger i = 0; i < MIN(lines.count, count); i++) {
+        NSString *expected = [NSString stringWithFormat:@"\"message\":\"Message %lu\"", (unsigned long)i];
+        XCTAssertTrue([lines[i] containsString:expected], @"%@", lines[i]);
+    }
+}
+
+- (void)testWritesInOrderWithWorkers {
+    XCTAssertEqual(self.fileLogger.formattingWorkerCount, 0);
+    self.fileLogger.formattingWorkerCount = 4;
+    XCTAssertEqual(self.fileLogger.formattingWorkerCount, 4);
+    [self.log addLogger:self.fileLogger];
+
+    // More than the 256 messages in flight
+    [self logMessages:1000];
+
+    [self assertWrittenInOrder:1000];
+}
+
+- (void)testWritesInOrderThroughTheBuffer {
+    self.fileLogger.formattingWorkerCount = 3;
+    [self.log addLogger:[self.fileLogger wrapWithBuffer]];
+
+    [self logMessages:500];
+
+    [self assertWrittenInOrder:500];
+}
+
+- (void)testChangingTheWorkersKeepsTheOrder {
+    self.fileLogger.formattingWorkerCount = 2;
+    [self.log addLogger:self.fileLogger];
+
+    for (NSUInteger i = 0; i < 300; i++) {
+        if (i == 100) {
+            self.fileLogger.formattingWorkerCount = 0;
+        } else if (i == 200) {
+            self.fileLogger.formattingWorkerCount = 8;
+        }
+        [self.log log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Message %lu", (unsigned long)i];
+    }
+    [self.log flushLog];
+
+    [self assertWrittenInOrder:300];
+}
+
+- (void)testUnshareableFormatterFormatsOnTheLoggerQueue {
+    DDPipelineTestSerialFormatter *formatter = [DDPipelineTestSerialFormatter new];
+    formatter.fileLogger = self.fileLogger;
+    self.fileLogger.logFormatter = formatter;
+    self.fileLogger.formattingWorkerCount = 4;
+    [self.log addLogger:self.fileLogger];
+
+    [self logMessages:100];
+
+    XCTAssertFalse(formatter.calledOutsideQueue);
+    XCTAssertEqual([self writtenLines].count, 100);
+    XCTAssertEqualObjects([self writtenLines].lastObject, @"Message 99");
+}
+
+- (void)measureFormattingWithWorkers:(NSUInteger)workerCount {
+    self.fileLogger.logFormatter = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldAll];
+    self.fileLogger.formattingWorkerCount = workerCount;
+    [self.log addLogger:self.fileLogger];
+
+    [self measureBlock:^{
+        [self logMessages:5000];
+    }];
+}
+
+- (void)testPerformanceFormattingOnTheLoggerQueue {
+    [self measureFormattingWithWorkers:0];
+}
+
+- (void)testPerformanceFormattingWithTwoWorkers {
+    [self measureFormattingWithWorkers:2];
+}
+
+- (void)testPerformanceFormattingWithFourWorkers {
+    [self measureFormattingWithWorkers:4];
+}
+
+@end
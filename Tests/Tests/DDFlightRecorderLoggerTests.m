@@ -0,0 +1,183 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+static TMPLogLevel tmpLogLevel = TMPLogLevelVerbose;
+
+@interface DDFlightRecorderTestFormatter : NSObject <TMPLogFormatter>
+
+@property (nonatomic, copy) NSString *prefix;
+
+@end
+
+@implementation DDFlightRecorderTestFormatter
+
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    return [self.prefix stringByAppendingString:logMessage.message];
+}
+
+@end
+
+@interface DDFlightRecorderLoggerTests : XCTestCase
+
+@property (nonatomic) TMPFlightRecorderLogger *recorder;
+@property (nonatomic) DDTestLogger *downstream;
+
+@end
+
+@implementation DDFlightRecorderLoggerTests
+
+- (void)setUp {
+    [super setUp];
+    self.downstream = [DDTestLogger new];
+    self.recorder = [[TMPFlightRecorderLogger alloc] initWithCapacity:4096];
+    self.recorder.downstreamLogger = self.downstream;
+    [TMPLog addLogger:self.recorder withLevel:TMPLogLevelAll];
+}
+
+- (void)tearDown {
+    [TMPLog removeLogger:self.recorder];
+    [super tearDown];
+}
+
+- (NSArray<NSString *> *)dumpedMessages {
+    [TMPLog flushLog];
+    return [self.downstream.messages valueForKey:@"message"];
+}
+
+- (void)testNothingIsWrittenUntilAnError {
+    TMPLogVerbose(@"Connecting");
+    TMPLogDebug(@"Sending %d bytes", 42);
+    TMPLogWarn(@"Slow response");
+
+    XCTAssertEqualObjects([self dumpedMessages], @[]);
+    XCTAssertEqual(self.recorder.numberOfRecordedMessages, 3);
+
+    TMPLogError(@"Timed out");
+    XCTAssertEqualObjects([self dumpedMessages], (@[ @"Connecting", @"Sending 42 bytes", @"Slow response", @"Timed out" ]));
+    XCTAssertEqual(self.recorder.numberOfRecordedMessages, 0);
+
+    TMPLogMessage *error = self.downstream.messages.lastObject;
+    XCTAssertEqual(error.flag, TMPLogFlagError);
+    XCTAssertEqual(self.downstream.messages.firstObject.flag, TMPLogFlagVerbose);
+    XCTAssertLessThanOrEqual(self.downstream.messages.firstObject.timestamp.timeIntervalSinceNow, 0);
+    XCTAssertGreaterThan(self.downstream.messages.firstObject.timestamp.timeIntervalSinceNow, -60);
+
+    // The window starts over
+    TMPLogInfo(@"Retrying");
+    [self.recorder dump];
+    XCTAssertEqualObjects([[self dumpedMessages] lastObject], @"Retrying");
+    XCTAssertEqual(self.downstream.messages.count, 5);
+}
+
+- (void)testTriggerLevel {
+    self.recorder.triggerLevel = TMPLogLevelOff;
+    TMPLogError(@"Not a trigger");
+    XCTAssertEqualObjects([self dumpedMessages], @[]);
+
+    self.recorder.triggerLevel = TMPLogLevelWarning;
+    TMPLogWarn(@"Trigger");
+    XCTAssertEqualObjects([self dumpedMessages], (@[ @"Not a trigger", @"Trigger" ]));
+}
+
+- (void)testOldestMessagesAreDropped {
+    self.recorder.triggerLevel = TMPLogLevelOff;
+
+    // 32 byte headers plus 64 bytes of text and the metadata: the 4 KB ring holds less than 42 messages
+    for (NSUInteger i = 0; i < 1000; i++) {
+        TMPLogVerbose(@"%064lu", (unsigned long)i);
+    }
+    NSUInteger count = self.recorder.numberOfRecordedMessages;
+    XCTAssertGreaterThan(count, 5);
+    XCTAssertLessThan(count, 42);
+
+    [self.recorder dump];
+    NSArray<NSString *> *messages = [self dumpedMessages];
+    XCTAssertEqual(messages.count, count);
+    XCTAssertEqual(messages.firstObject.integerValue, 1000 - count);
+    XCTAssertEqual(messages.lastObject.integerValue, 999);
+
+    self.recorder.maximumNumberOfMessages = 5;
+    for (NSUInteger i = 0; i < 10; i++) {
+        TMPLogVerbose(@"%lu", (unsigned long)i);
+    }
+    [self.recorder dump];
+    XCTAssertEqualObjects([[self dumpedMessages] subarrayWithRange:NSMakeRange(count, 5)], (@[ @"5", @"6", @"7", @"8", @"9" ]));
+}
+
+- (void)testDumpedMessagesKeepTheirMetadata {
+    __block NSUInteger line;
+    __block NSString *function;
+    __block TMPLogMessage *logged; // Created on the same thread, for its thread ID
+
+    dispatch_queue_t queue = dispatch_queue_create("com.example.recorder", DISPATCH_QUEUE_SERIAL);
+    dispatch_sync(queue, ^{
+        logged = [[TMPLogMessage alloc] initWithMessage:@"" level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:@"" function:nil line:0 tag:nil options:(TMPLogMessageOptions)0 timestamp:nil];
+        function = @(__PRETTY_FUNCTION__);
+        line = __LINE__ + 1;
+        TMPLogError(@"Failed");
+    });
+
+    [self dumpedMessages];
+    TMPLogMessage *message = self.downstream.messages.lastObject;
+    XCTAssertEqualObjects(message.message, @"Failed");
+    XCTAssertEqual(message.level, tmpLogLevel);
+    XCTAssertEqualObjects(message.fileName, @"DDFlightRecorderLoggerTests");
+    XCTAssertEqualObjects(message.function, function);
+    XCTAssertEqual(message.line, line);
+    XCTAssertEqualObjects(message.threadID, logged.threadID);
+    XCTAssertEqualObjects(message.queueLabel, @"com.example.recorder");
+}
+
+- (void)testFormattedMessagesAreNotFormattedAgain {
+    DDFlightRecorderTestFormatter *recorderFormatter = [DDFlightRecorderTestFormatter new];
+    recorderFormatter.prefix = @"recorder ";
+    self.recorder.logFormatter = recorderFormatter;
+
+    DDFlightRecorderTestFormatter *downstreamFormatter = [DDFlightRecorderTestFormatter new];
+    downstreamFormatter.prefix = @"downstream ";
+    self.downstream.logFormatter = downstreamFormatter;
+
+    TMPLogError(@"Failed");
+    XCTAssertEqualObjects([self dumpedMessages], @[ @"recorder Failed" ]);
+    XCTAssertEqualObjects(self.downstream.outputs, @[ @"recorder Failed" ]);
+}
+
+- (void)testOversizedMessagesAreTruncated {
+    NSString *large = [@"" stringByPaddingToLength:10000 withString:@"é" startingAtIndex:0];
+    TMPLogError(@"%@", large);
+
+    NSString *message = [self dumpedMessages].firstObject;
+    XCTAssertGreaterThan(message.length, 1000);
+    XCTAssertLessThan(message.length, 4096);
+    XCTAssertTrue([large hasPrefix:message]);
+}
+
+- (void)testPerformanceRecording {
+    self.recorder.triggerLevel = TMPLogLevelOff;
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            TMPLogVerbose(@"Request %lu", (unsigned long)i);
+        }
+        [TMPLog flushLog];
+    }];
+}
+
+@end
@@ -0,0 +1,133 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+static const NSUInteger kDDFormatterIterations = 10000;
+
+@interface DDFormatterPerformanceTests : XCTestCase
+
+@property (nonatomic) TMPLogMessage *message;
+
+@end
+
+@implementation DDFormatterPerformanceTests
+
+- (void)setUp {
+    [super setUp];
+
+    _message = [[TMPLogMessage alloc] initWithMessage:@"Finished loading 42 items from https://example.com/api/v1/items"
+                                                level:TMPLogLevelAll
+                                                 flag:TMPLogFlagInfo
+                                              context:0
+                                                 file:@(__FILE__)
+                                             function:@(__func__)
+                                                 line:__LINE__
+                                                  tag:nil
+                                              options:(TMPLogMessageOptions)0
+                                            timestamp:nil];
+}
+
+- (void)measureStringsOfFormatter:(id <TMPLogFormatter>)formatter {
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kDDFormatterIterations; i++) {
+            @autoreleasepool {
+                NSString *string = [formatter formatLogMessage:self.message];
+                __unused NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+            }
+        }
+    }];
+}
+
+- (void)measureBufferOfFormatter:(id <TMPLogFormatter>)formatter {
+    NSMutableData *buffer = [NSMutableData dataWithCapacity:1024];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kDDFormatterIterations; i++) {
+            @autoreleasepool {
+                buffer.length = 0;
+                [formatter formatLogMessage:self.message toBuffer:buffer];
+            }
+        }
+    }];
+}
+
+- (void)testPerformanceFileFormatterString {
+    [self measureStringsOfFormatter:[TMPLogFileFormatterDefault new]];
+}
+
+- (void)testPerformanceFileFormatterBuffer {
+    [self measureBufferOfFormatter:[TMPLogFileFormatterDefault new]];
+}
+
+- (void)testPerformanceDispatchQueueFormatterString {
+    [self measureStringsOfFormatter:[TMPDispatchQueueLogFormatter new]];
+}
+
+- (void)testPerformanceDispatchQueueFormatterBuffer {
+    [self measureBufferOfFormatter:[TMPDispatchQueueLogFormatter new]];
+}
+
+- (void)testPerformancePatternFormatterString {
+    [self measureStringsOfFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%d [%t] %-5p %F:%L %m"]];
+}
+
+- (void)testPerformancePatternFormatterBuffer {
+    [self measureBufferOfFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%d [%t] %-5p %F:%L %m"]];
+}
+
+- (void)testPerformanceMultiFormatterString {
+    TMPMultiFormatter *formatter = [TMPMultiFormatter new];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%F:%L %m"]];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%-5p %m"]];
+    [formatter addFormatter:[TMPDispatchQueueLogFormatter new]];
+
+    [self measureStringsOfFormatter:formatter];
+}
+
+
+- (void)testPerformanceJSONFormatterBuffer {
+    [self measureBufferOfFormatter:[TMPJSONLogFormatter new]];
+}
+
+- (void)testPerformanceJSONSerializationReference {
+    // What a formatter building a dictionary for NSJSONSerialization costs, for comparison with the one above.
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    dateFormatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx";
+    TMPLogMessage *message = self.message;
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kDDFormatterIterations; i++) {
+            @autoreleasepool {
+                NSDictionary *object = @{
+                    @"timestamp": [dateFormatter stringFromDate:message.timestamp],
+                    @"level": @"INFO",
+                    @"context": @(message.context),
+                    @"file": message.fileName,
+                    @"function": message.function,
+                    @"line": @(message.line),
+                    @"thread": message.threadID,
+                    @"queue": message.queueLabel,
+                    @"message": message.message,
+                };
+                __unused NSData *data = [NSJSONSerialization dataWithJSONObject:object options:0 error:NULL];
+            }
+        }
+    }];
+}
+
+@end
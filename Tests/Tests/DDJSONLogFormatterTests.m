@@ -0,0 +1,182 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+@interface DDJSONLogFormatterTests : XCTestCase
+
+@end
+
+@implementation DDJSONLogFormatterTests
+
+- (TMPLogMessage *)messageWithText:(NSString *)text {
+    return [[TMPLogMessage alloc] initWithMessage:text
+                                            level:TMPLogLevelAll
+                                             flag:TMPLogFlagWarning
+                                          context:-3
+                                             file:@"/path/to/Sources/Networking.m"
+                                         function:@"-[Networking fetch]"
+                                             line:123
+                                              tag:@"network"
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.5]];
+}
+
+- (NSArray<NSString *> *)trickyStrings {
+    NSMutableString *controls = [NSMutableString string];
+    for (unichar c = 1; c < 0x20; c++) {
+        [controls appendFormat:@"%C", c];
+    }
+
+    NSMutableArray<NSString *> *strings = [NSMutableArray arrayWithArray:@[
+        @"",
+        @"plain ascii text",
+        @"\"quoted\" and \\backslashed\\",
+        @"line\nbreak\r\ntab\t/slash",
+        controls,
+        @"äöü € 日本語",
+        @"emoji 👍🏽 outside of the BMP",
+        @"separators \u2028 and \u2029",
+        @"\x7F delete",
+    ]];
+
+    // Special characters on either side of every 8 and 16 byte chunk boundary.
+    for (NSUInteger position = 0; position < 40; position++) {
+        for (NSString *special in @[ @"\"", @"\\", @"\n", @"\x01", @"é", @"𝄞" ]) {
+            NSMutableString *string = [[@"" stringByPaddingToLength:40 withString:@"abcdefgh" startingAtIndex:0] mutableCopy];
+            [string insertString:special atIndex:position];
+            [strings addObject:string];
+        }
+    }
+
+    return strings;
+}
+
+- (id)parse:(NSData *)data {
+    NSError *error = nil;
+    id object = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+    XCTAssertNil(error, @"%@", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]);
+    return object;
+}
+
+- (void)testEscapingRoundTripsThroughReferenceParser {
+    for (NSNumber *escapeNonASCII in @[ @NO, @YES ]) {
+        for (NSString *string in [self trickyStrings]) {
+            const char *utf8 = string.UTF8String;
+            NSMutableData *buffer = [NSMutableData dataWithBytes:"[" length:1];
+            TMPJSONAppendQuotedString(buffer, utf8, strlen(utf8), escapeNonASCII.boolValue);
+            [buffer appendBytes:"]" length:1];
+
+            XCTAssertEqualObjects([self parse:buffer], @[ string ]);
+
+            const uint8_t *bytes = buffer.bytes;
+            for (NSUInteger i = 0; i < buffer.length; i++) {
+                XCTAssertGreaterThanOrEqual(bytes[i], 0x20);
+                if (escapeNonASCII.boolValue) {
+                    XCTAssertLessThan(bytes[i], 0x80);
+                }
+            }
+        }
+    }
+}
+
+- (void)testEscapingMatchesReferenceSerializer {
+    // NSJSONSerialization also escapes `/`, and may use a different case for hex digits, but is otherwise identical.
+    for (NSString *string in [self trickyStrings]) {
+        if ([string rangeOfString:@"/"].location != NSNotFound) {
+            continue;
+        }
+
+        NSData *reference = [NSJSONSerialization dataWithJSONObject:@[ string ] options:0 error:NULL];
+        const char *utf8 = string.UTF8String;
+        NSMutableData *buffer = [NSMutableData dataWithBytes:"[" length:1];
+        TMPJSONAppendQuotedString(buffer, utf8, strlen(utf8), NO);
+        [buffer appendBytes:"]" length:1];
+
+        NSString *expected = [[NSString alloc] initWithData:reference encoding:NSUTF8StringEncoding];
+        NSString *actual = [[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding];
+        XCTAssertEqualObjects(actual.lowercaseString, expected.lowercaseString);
+    }
+}
+
+- (void)testInvalidUTF8IsReplaced {
+    NSMutableData *buffer = [NSMutableData data];
+    TMPJSONAppendQuotedString(buffer, "a\xFF" "b\xC3", 4, YES);
+    XCTAssertEqualObjects([[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding], @"\"a\\ufffdb\\ufffd\"");
+
+    buffer.length = 0;
+    TMPJSONAppendQuotedString(buffer, "\xED\xA0\x80", 3, YES); // Encoded surrogate
+    XCTAssertEqualObjects([[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding], @"\"\\ufffd\\ufffd\\ufffd\"");
+}
+
+- (void)testAllFields {
+    TMPLogMessage *message = [self messageWithText:@"Hello \"world\"\n"];
+    TMPJSONLogFormatter *formatter = [TMPJSONLogFormatter new];
+
+    NSString *string = [formatter formatLogMessage:message];
+    XCTAssertEqual([string rangeOfString:@"\n"].location, NSNotFound);
+
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    dateFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    dateFormatter.calendar = [[NSCalendar alloc] initWithCalendarIdentifier:NSCalendarIdentifierGregorian];
+    dateFormatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx";
+
+    NSMutableDictionary *expected = [@{
+        @"timestamp": [dateFormatter stringFromDate:message.timestamp],
+        @"level": @"WARN",
+        @"context": @(-3),
+        @"file": @"Networking",
+        @"function": @"-[Networking fetch]",
+        @"line": @123,
+        @"thread": message.threadID,
+        @"queue": message.queueLabel,
+        @"tag": @"network",
+        @"message": @"Hello \"world\"\n",
+    } mutableCopy];
+
+    if (message.threadName.length > 0) {
+        expected[@"threadName"] = message.threadName;
+    }
+
+    XCTAssertEqualObjects([self parse:[string dataUsingEncoding:NSUTF8StringEncoding]], expected);
+}
+
+- (void)testFieldSelection {
+    TMPLogMessage *message = [self messageWithText:@"ünïcode"];
+
+    TMPJSONLogFormatter *formatter = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldLevel | TMPJSONLogFieldLine | TMPJSONLogFieldMessage];
+    XCTAssertEqualObjects([formatter formatLogMessage:message], @"{\"level\":\"WARN\",\"line\":123,\"message\":\"ünïcode\"}");
+
+    formatter = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldMessage escapingNonASCII:YES];
+    XCTAssertEqualObjects([formatter formatLogMessage:message], @"{\"message\":\"\\u00fcn\\u00efcode\"}");
+
+    formatter = [[TMPJSONLogFormatter alloc] initWithFields:0];
+    XCTAssertEqualObjects([formatter formatLogMessage:message], @"{}");
+}
+
+- (void)testBufferMatchesString {
+    TMPLogMessage *message = [self messageWithText:@"\t✓"];
+    TMPJSONLogFormatter *formatter = [TMPJSONLogFormatter new];
+
+    NSMutableData *buffer = [NSMutableData dataWithBytes:"prefix" length:6];
+    XCTAssertTrue([formatter formatLogMessage:message toBuffer:buffer]);
+
+    NSString *fromBuffer = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(6, buffer.length - 6)]
+                                                 encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(fromBuffer, [formatter formatLogMessage:message]);
+}
+
+@end
@@ -0,0 +1,159 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+@interface DDLogCallSiteProfilerTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+
+@end
+
+@implementation DDLogCallSiteProfilerTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+}
+
+- (void)tearDown {
+    self.log.callSiteProfiler = nil;
+    [self.log removeAllLoggers];
+    [self.log flushLog];
+    [super tearDown];
+}
+
+- (void)logMessage:(NSString *)message line:(NSUInteger)line {
+    [self.log log:NO level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:line tag:nil format:@"%@", message];
+}
+
+- (void)testCountsMessagesAndBytesPerCallSite {
+    TMPLogCallSiteProfiler *profiler = [TMPLogCallSiteProfiler new];
+    self.log.callSiteProfiler = profiler;
+
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self logMessage:@"Short" line:1];
+    }
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self logMessage:@"A much longer message" line:2];
+    }
+    [self logMessage:@"Café" line:3];
+
+    NSArray<TMPLogCallSite *> *callSites = [profiler topCallSites:10];
+    XCTAssertEqual(callSites.count, 3);
+
+    XCTAssertEqual(callSites[0].line, 2);
+    XCTAssertEqual(callSites[0].messages, 3);
+    XCTAssertEqual(callSites[0].bytes, 63);
+    XCTAssertEqualObjects(callSites[0].fileName, @"DDLogCallSiteProfilerTests.m");
+    XCTAssertEqualObjects(callSites[0].function, @"-[DDLogCallSiteProfilerTests logMessage:line:]");
+
+    XCTAssertEqual(callSites[1].line, 1);
+    XCTAssertEqual(callSites[1].messages, 10);
+    XCTAssertEqual(callSites[1].bytes, 50);
+
+    XCTAssertEqual(callSites[2].line, 3);
+    XCTAssertEqual(callSites[2].bytes, 5);
+
+    XCTAssertEqual([profiler topCallSites:1].count, 1);
+
+    NSArray<NSString *> *lines = [[profiler reportWithCount:2] componentsSeparatedByString:@"\n"];
+    XCTAssertEqual(lines.count, 4);
+    XCTAssertTrue([lines[2] hasSuffix:@"DDLogCallSiteProfilerTests.m:2 -[DDLogCallSiteProfilerTests logMessage:line:]"], @"%@", lines[2]);
+}
+
+- (void)testCountsMessageObjects {
+    TMPLogCallSiteProfiler *profiler = [TMPLogCallSiteProfiler new];
+    self.log.callSiteProfiler = profiler;
+
+    for (NSUInteger i = 0; i < 4; i++) {
+        // A new file name string every time: message objects are told apart by its contents
+        TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"Object"
+                                                                  level:TMPLogLevelAll
+                                                                   flag:TMPLogFlagInfo
+                                                                context:0
+                                                                   file:[NSString stringWithFormat:@"%s", __FILE__]
+                                                               function:@"objectFunction"
+                                                                   line:1
+                                                                    tag:nil
+                                                                options:(TMPLogMessageOptions)0
+                                                              timestamp:nil];
+        [self.log log:NO message:message];
+    }
+
+    NSArray<TMPLogCallSite *> *callSites = [profiler topCallSites:10];
+    XCTAssertEqual(callSites.count, 1);
+    XCTAssertEqual(callSites[0].messages, 4);
+    XCTAssertEqual(callSites[0].bytes, 24);
+    XCTAssertEqualObjects(callSites[0].fileName, @"DDLogCallSiteProfilerTests.m");
+    XCTAssertEqualObjects(callSites[0].function, @"objectFunction");
+}
+
+- (void)testForgetsCallSitesOutsideTheWindow {
+    TMPLogCallSiteProfiler *profiler = [[TMPLogCallSiteProfiler alloc] initWithWindow:0.6];
+    self.log.callSiteProfiler = profiler;
+
+    [self logMessage:@"Message" line:1];
+    XCTAssertEqual([profiler topCallSites:10].count, 1);
+
+    [NSThread sleepForTimeInterval:1];
+    XCTAssertEqual([profiler topCallSites:10].count, 0);
+}
+
+- (void)testLogsReport {
+    TMPLogCallSiteProfiler *profiler = [TMPLogCallSiteProfiler new];
+    profiler.reportInterval = 0.1;
+    self.log.callSiteProfiler = profiler;
+
+    DDTestLogger *logger = [DDTestLogger new];
+    [self.log addLogger:logger];
+
+    [self logMessage:@"Message" line:1];
+    [NSThread sleepForTimeInterval:0.3];
+    [self.log flushLog];
+
+    XCTAssertGreaterThan(logger.messages.count, 1);
+    XCTAssertTrue([logger.messages[1].message hasPrefix:@"Top log call sites"], @"%@", logger.messages[1].message);
+
+    // Reports aren't counted
+    XCTAssertEqual([profiler topCallSites:10][0].messages, 1);
+}
+
+- (void)testMetricsExposeCallSites {
+    self.log.callSiteProfiler = [TMPLogCallSiteProfiler new];
+
+    [self logMessage:@"Message" line:7];
+
+    TMPLogMetrics *metrics = self.log.metrics;
+    XCTAssertEqual(metrics.callSites.count, 1);
+    XCTAssertTrue([metrics.textExposition containsString:@"tmplog_call_site_bytes{file=\"DDLogCallSiteProfilerTests.m\",line=\"7\""], @"%@", metrics.textExposition);
+}
+
+- (void)testPerformanceProfiledLogging {
+    self.log.callSiteProfiler = [TMPLogCallSiteProfiler new];
+    [self.log addLogger:[DDTestLogger new]];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [self.log log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Message %lu", (unsigned long)i];
+        }
+        [self.log flushLog];
+    }];
+}
+
+@end
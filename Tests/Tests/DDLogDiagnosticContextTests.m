@@ -0,0 +1,226 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+// The sampled scopes are tested through the macros
+#define TMP_LOG_SAMPLING_ENABLED 1
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+static TMPLogLevel tmpLogLevel = TMPLogLevelInfo;
+
+@interface DDLogDiagnosticContextTests : XCTestCase
+
+@end
+
+@implementation DDLogDiagnosticContextTests
+
+- (void)tearDown {
+    while (TMPLogDiagnosticContext.currentContext) {
+        [TMPLog popContext];
+    }
+    [super tearDown];
+}
+
+- (TMPLogMessage *)message {
+    return [[TMPLogMessage alloc] initWithMessage:@"Request finished"
+                                            level:TMPLogLevelAll
+                                             flag:TMPLogFlagInfo
+                                          context:0
+                                             file:@"/path/to/Networking.m"
+                                         function:@"-[Networking fetch]"
+                                             line:42
+                                              tag:nil
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.5]
+                                           fields:TMPLogFieldsMake(TMPLogFieldInt("status", 200))];
+}
+
+- (void)testScopes {
+    XCTAssertNil(TMPLogDiagnosticContext.currentContext);
+
+    [TMPLog pushContextFields:TMPLogFieldsMake(TMPLogFieldString("request", @"abc"), TMPLogFieldString("user", @"alice"))];
+    TMPLogDiagnosticContext *outer = TMPLogDiagnosticContext.currentContext;
+    XCTAssertEqual(outer.depth, 1);
+    XCTAssertNil(outer.parent);
+
+    [TMPLog performWithContextFields:TMPLogFieldsMake(TMPLogFieldString("user", @"bob"), TMPLogFieldInt("attempt", 2)) block:^{
+        TMPLogDiagnosticContext *inner = TMPLogDiagnosticContext.currentContext;
+        XCTAssertEqual(inner.depth, 2);
+        XCTAssertEqual(inner.parent, outer);
+        XCTAssertEqualObjects(inner.scopeFields.description, @"user=bob attempt=2");
+        XCTAssertEqualObjects(inner.fields.description, @"request=abc user=bob attempt=2");
+        XCTAssertEqual(inner.fields, inner.fields);
+    }];
+
+    XCTAssertEqual(TMPLogDiagnosticContext.currentContext, outer);
+    XCTAssertEqualObjects(outer.fields.description, @"request=abc user=alice");
+
+    [TMPLog popContext];
+    XCTAssertNil(TMPLogDiagnosticContext.currentContext);
+
+    // Unbalanced pops are ignored
+    [TMPLog popContext];
+    XCTAssertNil(TMPLogDiagnosticContext.currentContext);
+}
+
+- (void)testScopedMacro {
+    {
+        TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldString("request", @"abc")));
+        XCTAssertEqual(TMPLogDiagnosticContext.currentContext.depth, 1);
+        {
+            TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldInt("attempt", 1)));
+            XCTAssertEqual(TMPLogDiagnosticContext.currentContext.depth, 2);
+        }
+        XCTAssertEqual(TMPLogDiagnosticContext.currentContext.depth, 1);
+    }
+    XCTAssertNil(TMPLogDiagnosticContext.currentContext);
+}
+
+- (void)testMessagesShareTheContext {
+    XCTAssertNil([self message].diagnosticContext);
+
+    TMPLogMessage *first;
+    TMPLogMessage *second;
+    {
+        TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldString("request", @"abc")));
+        first = [self message];
+        second = [self message];
+    }
+
+    // Captured by reference, and still alive after the scope ended
+    XCTAssertNotNil(first.diagnosticContext);
+    XCTAssertEqual(first.diagnosticContext, second.diagnosticContext);
+    XCTAssertEqual(((TMPLogMessage *)[first copy]).diagnosticContext, first.diagnosticContext);
+    XCTAssertEqualObjects(first.diagnosticContext.fields[@"request"], @"abc");
+    XCTAssertNil([self message].diagnosticContext);
+}
+
+- (void)testContextIsPerThread {
+    TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldString("request", @"abc")));
+
+    __block TMPLogDiagnosticContext *otherThreadContext = TMPLogDiagnosticContext.currentContext;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"other thread"];
+
+    [NSThread detachNewThreadWithBlock:^{
+        otherThreadContext = TMPLogDiagnosticContext.currentContext;
+        [TMPLog pushContextFields:TMPLogFieldsMake(TMPLogFieldString("request", @"def"))];
+        // Left on the stack, released when the thread exits
+        [expectation fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertNil(otherThreadContext);
+    XCTAssertEqualObjects(TMPLogDiagnosticContext.currentContext.fields[@"request"], @"abc");
+}
+
+- (void)testFormattersAndFilter {
+    TMPLogMessage *message;
+    {
+        TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldString("request", @"abc 123")));
+        message = [self message];
+    }
+
+    TMPPatternLogFormatter *pattern = [[TMPPatternLogFormatter alloc] initWithPattern:@"%m [%X] %X{request}/%X{status}"];
+    XCTAssertEqualObjects([pattern formatLogMessage:message], @"Request finished [request=\"abc 123\" status=200] abc 123/200");
+
+    TMPJSONLogFormatter *json = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldMessage | TMPJSONLogFieldFields | TMPJSONLogFieldDiagnosticContext];
+    XCTAssertEqualObjects([json formatLogMessage:message],
+                          @"{\"message\":\"Request finished\",\"fields\":{\"status\":200},\"mdc\":{\"request\":\"abc 123\"}}");
+
+    NSString *text = [[TMPLogFileFormatterDefault new] formatLogMessage:message];
+    XCTAssertTrue([text hasSuffix:@"  Request finished request=\"abc 123\" status=200"], @"%@", text);
+
+    XCTAssertTrue([[[TMPLogFieldFilter alloc] initWithKey:@"request" value:@"abc 123"] shouldLogMessage:message]);
+    XCTAssertFalse([[[TMPLogFieldFilter alloc] initWithKey:@"request" value:nil] shouldLogMessage:[self message]]);
+}
+
+- (void)testSampledScopesRaiseTheLevel {
+    DDTestLogger *logger = [DDTestLogger new];
+    [TMPLog addLogger:logger];
+
+    TMPLogVerbose(@"Dropped");
+    XCTAssertEqual(TMPLogDiagnosticContext.sampledLevel, TMPLogLevelOff);
+
+    [TMPLog pushContextFields:TMPLogFieldsMake(TMPLogFieldString("request", @"abc")) sampled:YES];
+    XCTAssertEqual(TMPLogDiagnosticContext.sampledLevel, TMPLogLevelVerbose);
+    TMPLogVerbose(@"Sampled");
+    {
+        // Nested scopes inherit sampling
+        TMPLogContextScoped(TMPLogFieldsMake(TMPLogFieldInt("attempt", 1)));
+        XCTAssertTrue(TMPLogDiagnosticContext.currentContext.isSampled);
+        TMPLogDebugWithFields(TMPLogFieldsMake(TMPLogFieldInt("step", 2)), @"Sampled too");
+    }
+
+    // dispatch_sync may run the block on this thread, use a thread of its own
+    __block TMPLogLevel otherThreadLevel = TMPLogLevelAll;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"other thread"];
+    [NSThread detachNewThreadWithBlock:^{
+        otherThreadLevel = TMPLogDiagnosticContext.sampledLevel;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(otherThreadLevel, TMPLogLevelOff);
+
+    [TMPLog popContext];
+    XCTAssertEqual(TMPLogDiagnosticContext.sampledLevel, TMPLogLevelOff);
+    TMPLogVerbose(@"Dropped again");
+
+    [TMPLog flushLog];
+    [TMPLog removeLogger:logger];
+
+    XCTAssertEqualObjects([logger.messages valueForKey:@"message"], (@[ @"Sampled", @"Sampled too" ]));
+    XCTAssertEqualObjects(logger.messages.firstObject.diagnosticContext.fields[@"request"], @"abc");
+}
+
+- (void)testTraceSampling {
+    XCTAssertTrue(TMPLogTraceIsSampled("abc", 3, 1.0));
+    XCTAssertFalse(TMPLogTraceIsSampled("abc", 3, 0.0));
+    XCTAssertFalse(TMPLogTraceIsSampled("abc", 3, NAN));
+
+    NSUInteger sampled = 0;
+    for (NSUInteger i = 0; i < 10000; i++) {
+        char traceID[32];
+        int length = snprintf(traceID, sizeof(traceID), "trace-%lu", (unsigned long)i);
+        BOOL isSampled = TMPLogTraceIsSampled(traceID, (NSUInteger)length, 0.1);
+
+        // Deterministic, and monotonic in the rate
+        XCTAssertEqual(isSampled, TMPLogTraceIsSampled(traceID, (NSUInteger)length, 0.1));
+        if (isSampled) {
+            XCTAssertTrue(TMPLogTraceIsSampled(traceID, (NSUInteger)length, 0.2));
+            sampled++;
+        }
+    }
+    XCTAssertGreaterThan(sampled, 800);
+    XCTAssertLessThan(sampled, 1200);
+
+    [TMPLog pushContextFields:TMPLogFieldsMake(TMPLogFieldString("trace", @"trace-1")) traceID:@"trace-1" sampleRate:1.0];
+    XCTAssertTrue(TMPLogDiagnosticContext.currentContext.isSampled);
+    [TMPLog popContext];
+}
+
+- (void)testPerformancePushPop {
+    TMPLogFields *fields = TMPLogFieldsMake(TMPLogFieldString("request", @"abc"));
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100000; i++) {
+            TMPLogContextScoped(fields);
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,130 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import <fcntl.h>
+#import <unistd.h>
+
+static void DDCountingDrain(void *context) {
+    (*(NSUInteger *)context)++;
+}
+
+@interface DDLogEmergencyTests : XCTestCase
+
+@property (nonatomic, copy) NSString *directory;
+
+@end
+
+@implementation DDLogEmergencyTests
+
+- (void)setUp {
+    [super setUp];
+    self.directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+    [TMPLog removeAllLoggers];
+    [TMPLog flushLog];
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:nil];
+    [super tearDown];
+}
+
+- (void)testWritesToRegisteredDescriptors {
+    int fds[2];
+    XCTAssertEqual(pipe(fds), 0);
+    XCTAssertTrue(TMPLogEmergencyAddFileDescriptor(fds[1], NO));
+
+    TMPLogEmergencyWrite(TMPLogFlagError, "Out of memory", 13);
+    TMPLogEmergencyWrite(TMPLogFlagError, "Giving up\n", 10);
+
+    TMPLogEmergencyRemoveFileDescriptor(fds[1]);
+    TMPLogEmergencyWrite(TMPLogFlagError, "Not written", 11);
+    close(fds[1]);
+
+    char buffer[64] = { 0 };
+    ssize_t length = read(fds[0], buffer, sizeof(buffer) - 1);
+    close(fds[0]);
+
+    XCTAssertEqual(length, 24);
+    XCTAssertEqualObjects(@(buffer), @"Out of memory\nGiving up\n");
+}
+
+- (void)testWritesRecordsToFramedDescriptors {
+    NSString *path = [self.directory stringByAppendingPathComponent:@"framed.log"];
+    int fd = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT, 0644);
+    XCTAssertTrue(TMPLogEmergencyAddFileDescriptor(fd, YES));
+
+    TMPLogEmergencyWrite(TMPLogFlagError, "Fatal signal", 12);
+    TMPLogEmergencyWriteRecord(1234567890000000, 3, TMPLogFlagInfo, "Earlier", 7);
+
+    TMPLogEmergencyRemoveFileDescriptor(fd);
+    close(fd);
+
+    NSArray<TMPLogMessage *> *messages = [[TMPLogRecordReader alloc] initWithContentsOfFile:path error:NULL].logMessages;
+    XCTAssertEqualObjects([messages valueForKey:@"message"], (@[ @"Fatal signal", @"Earlier" ]));
+    XCTAssertEqual(messages[0].flag, TMPLogFlagError);
+    XCTAssertLessThan(fabs(messages[0].timestamp.timeIntervalSinceNow), 60);
+    XCTAssertEqual(messages[1].context, 3);
+    XCTAssertEqual(messages[1].timestamp.timeIntervalSince1970, 1234567890);
+}
+
+- (void)testDrains {
+    NSUInteger count = 0;
+    XCTAssertTrue(TMPLogEmergencyAddDrain(DDCountingDrain, &count));
+
+    TMPLogEmergencyDrain();
+    XCTAssertEqual(count, 1);
+
+    TMPLogEmergencyRemoveDrain(DDCountingDrain, &count);
+    TMPLogEmergencyDrain();
+    XCTAssertEqual(count, 1);
+}
+
+- (void)testBufferedFileLoggerIsDrained {
+    TMPFileLogger *fileLogger = [[TMPFileLogger alloc] initWithLogFileManager:[[TMPLogFileManagerDefault alloc] initWithLogsDirectory:self.directory]];
+    fileLogger.logFormatter = nil;
+    [TMPLog addLogger:[fileLogger wrapWithBuffer]];
+
+    [TMPLog log:NO message:[[TMPLogMessage alloc] initWithMessage:@"Still buffered"
+                                                            level:TMPLogLevelAll
+                                                             flag:TMPLogFlagInfo
+                                                          context:0
+                                                             file:@"File.m"
+                                                         function:nil
+                                                             line:1
+                                                              tag:nil
+                                                          options:(TMPLogMessageOptions)0
+                                                        timestamp:nil]];
+
+    dispatch_sync([TMPLog loggingQueue], ^{
+        dispatch_sync(fileLogger.loggerQueue, ^{});
+    });
+
+    NSString *path = fileLogger.currentLogFileInfo.filePath;
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL], @"");
+
+    TMPLogEmergencyDrain();
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL], @"Still buffered\n");
+}
+
+- (void)testInstallCrashHandler {
+    XCTAssertTrue(TMPLogInstallCrashHandler());
+    XCTAssertTrue(TMPLogInstallCrashHandler());
+}
+
+@end
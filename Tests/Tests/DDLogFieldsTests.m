@@ -0,0 +1,171 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+static TMPLogLevel tmpLogLevel = TMPLogLevelInfo;
+
+@interface DDLogFieldsTests : XCTestCase
+
+@property (nonatomic) DDTestLogger *logger;
+
+@end
+
+@implementation DDLogFieldsTests
+
+- (void)setUp {
+    [super setUp];
+    self.logger = [DDTestLogger new];
+    [TMPLog addLogger:self.logger];
+}
+
+- (void)tearDown {
+    [TMPLog removeLogger:self.logger];
+    [super tearDown];
+}
+
+- (TMPLogMessage *)messageWithFields:(TMPLogFields *)fields {
+    return [[TMPLogMessage alloc] initWithMessage:@"Request finished"
+                                            level:TMPLogLevelAll
+                                             flag:TMPLogFlagInfo
+                                          context:0
+                                             file:@"/path/to/Networking.m"
+                                         function:@"-[Networking fetch]"
+                                             line:42
+                                              tag:nil
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.5]
+                                           fields:fields];
+}
+
+- (void)testFieldsAreCopied {
+    char requestID[] = "abc123";
+    uint8_t digest[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+
+    TMPLogFields *fields = TMPLogFieldsMake(TMPLogFieldCString("request", requestID),
+                                            TMPLogFieldBytes("digest", digest, sizeof(digest)),
+                                            TMPLogFieldInt("status", -404),
+                                            TMPLogFieldDouble("duration", 0.25),
+                                            TMPLogFieldBool("cached", YES));
+    requestID[0] = 'X';
+    digest[0] = 0;
+
+    XCTAssertEqual(fields.count, 5);
+    XCTAssertEqualObjects(fields[@"request"], @"abc123");
+    XCTAssertEqualObjects(fields[@"digest"], [NSData dataWithBytes:"\xDE\xAD\xBE\xEF" length:4]);
+    XCTAssertEqualObjects(fields[@"status"], @(-404));
+    XCTAssertEqualObjects(fields[@"duration"], @0.25);
+    XCTAssertEqualObjects(fields[@"cached"], @YES);
+    XCTAssertNil(fields[@"missing"]);
+
+    TMPLogField field;
+    XCTAssertTrue([fields getField:&field forKey:"request"]);
+    XCTAssertEqual(field.type, TMPLogFieldTypeString);
+    XCTAssertEqual(strcmp(field.value.data.bytes, "abc123"), 0);
+    XCTAssertFalse([fields getField:&field forKey:"missing"]);
+}
+
+- (void)testDictionaryConversion {
+    NSDictionary *dictionary = @{
+        @"b": @YES,
+        @"i": @7,
+        @"d": @1.5,
+        @"s": @"text",
+        @"x": [NSData dataWithBytes:"\x01\x02" length:2],
+        @"u": [NSURL URLWithString:@"https://example.com"],
+    };
+    TMPLogFields *fields = [TMPLogFields fieldsWithDictionary:dictionary];
+
+    XCTAssertEqual([fields fieldAtIndex:0].type, TMPLogFieldTypeBool);   // b
+    XCTAssertEqual([fields fieldAtIndex:1].type, TMPLogFieldTypeDouble); // d
+    XCTAssertEqual([fields fieldAtIndex:2].type, TMPLogFieldTypeInt);    // i
+    XCTAssertEqual([fields fieldAtIndex:3].type, TMPLogFieldTypeString); // s
+    XCTAssertEqual([fields fieldAtIndex:4].type, TMPLogFieldTypeString); // u
+    XCTAssertEqual([fields fieldAtIndex:5].type, TMPLogFieldTypeBytes);  // x
+
+    NSMutableDictionary *expected = [dictionary mutableCopy];
+    expected[@"u"] = @"https://example.com";
+    XCTAssertEqualObjects(fields.dictionaryRepresentation, expected);
+}
+
+- (void)testLogfmt {
+    TMPLogFields *fields = TMPLogFieldsMake(TMPLogFieldString("request", @"abc123"),
+                                            TMPLogFieldString("note", @"two words \"quoted\"\n"),
+                                            TMPLogFieldString("empty", @""),
+                                            TMPLogFieldInt("status", 200),
+                                            TMPLogFieldDouble("ratio", 0.1),
+                                            TMPLogFieldBool("ok", NO),
+                                            TMPLogFieldBytes("raw", "\x0F\xA0", 2));
+
+    XCTAssertEqualObjects(fields.description,
+                          @"request=abc123 note=\"two words \\\"quoted\\\"\\n\" empty=\"\" status=200 ratio=0.1 ok=false raw=0fa0");
+}
+
+- (void)testFormatters {
+    TMPLogFields *fields = TMPLogFieldsMake(TMPLogFieldString("request", @"abc 123"), TMPLogFieldInt("status", 200));
+    TMPLogMessage *message = [self messageWithFields:fields];
+
+    TMPPatternLogFormatter *pattern = [[TMPPatternLogFormatter alloc] initWithPattern:@"%m [%X] %X{status}/%X{request}/%X{missing}"];
+    XCTAssertEqualObjects([pattern formatLogMessage:message], @"Request finished [request=\"abc 123\" status=200] 200/abc 123/");
+
+    TMPJSONLogFormatter *json = [[TMPJSONLogFormatter alloc] initWithFields:TMPJSONLogFieldMessage | TMPJSONLogFieldFields];
+    XCTAssertEqualObjects([json formatLogMessage:message],
+                          @"{\"message\":\"Request finished\",\"fields\":{\"request\":\"abc 123\",\"status\":200}}");
+
+    NSString *text = [[TMPLogFileFormatterDefault new] formatLogMessage:message];
+    XCTAssertTrue([text hasSuffix:@"  Request finished request=\"abc 123\" status=200"], @"%@", text);
+
+    TMPLogMessage *plain = [self messageWithFields:nil];
+    XCTAssertEqualObjects([json formatLogMessage:plain], @"{\"message\":\"Request finished\"}");
+    XCTAssertEqualObjects([pattern formatLogMessage:plain], @"Request finished [] //");
+}
+
+- (void)testFieldFilter {
+    TMPLogMessage *message = [self messageWithFields:TMPLogFieldsMake(TMPLogFieldString("user", @"alice"),
+                                                                      TMPLogFieldInt("status", 200))];
+
+    XCTAssertTrue([[[TMPLogFieldFilter alloc] initWithKey:@"user" value:@"alice"] shouldLogMessage:message]);
+    XCTAssertFalse([[[TMPLogFieldFilter alloc] initWithKey:@"user" value:@"bob"] shouldLogMessage:message]);
+    XCTAssertTrue([[[TMPLogFieldFilter alloc] initWithKey:@"status" value:@200.0] shouldLogMessage:message]);
+    XCTAssertFalse([[[TMPLogFieldFilter alloc] initWithKey:@"status" value:@"200"] shouldLogMessage:message]);
+    XCTAssertTrue([[[TMPLogFieldFilter alloc] initWithKey:@"status" value:nil] shouldLogMessage:message]);
+    XCTAssertFalse([[[TMPLogFieldFilter alloc] initWithKey:@"missing" value:nil] shouldLogMessage:message]);
+    XCTAssertFalse([[[TMPLogFieldFilter alloc] initWithKey:@"user" value:nil] shouldLogMessage:[self messageWithFields:nil]]);
+}
+
+- (void)testMacrosAttachFieldsLazily {
+    __block NSUInteger evaluations = 0;
+    TMPLogFields * (^makeFields)(void) = ^{
+        evaluations++;
+        return TMPLogFieldsMake(TMPLogFieldString("request", @"abc123"), TMPLogFieldInt("attempt", 2));
+    };
+
+    TMPLogInfoWithFields(makeFields(), @"Request %@", @"finished");
+    TMPLogDebugWithFields(makeFields(), @"Not logged at the info level");
+    [TMPLog flushLog];
+
+    XCTAssertEqual(evaluations, 1);
+    XCTAssertEqual(self.logger.messages.count, 1);
+
+    TMPLogMessage *message = self.logger.messages.firstObject;
+    XCTAssertEqualObjects(message.message, @"Request finished");
+    XCTAssertEqualObjects(message.fields.dictionaryRepresentation, (@{ @"request": @"abc123", @"attempt": @2 }));
+    XCTAssertEqual(((TMPLogMessage *)[message copy]).fields, message.fields);
+}
+
+@end
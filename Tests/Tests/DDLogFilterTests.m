@@ -0,0 +1,125 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+@interface DDLogFilterTests : XCTestCase
+
+@end
+
+@implementation DDLogFilterTests
+
+- (void)logContexts:(NSArray<NSNumber *> *)contexts toLog:(TMPLog *)log {
+    for (NSNumber *context in contexts) {
+        TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"message"
+                                                                  level:TMPLogLevelAll
+                                                                   flag:TMPLogFlagInfo
+                                                                context:context.integerValue
+                                                                   file:@(__FILE__)
+                                                               function:@(__func__)
+                                                                   line:__LINE__
+                                                                    tag:nil
+                                                                options:(TMPLogMessageOptions)0
+                                                              timestamp:nil];
+        [log log:NO message:message];
+    }
+    [log flushLog];
+}
+
+- (void)testWhitelistFilterIsAppliedBeforeDispatch {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDTestLogger *filtered = [DDTestLogger new];
+    DDTestLogger *unfiltered = [DDTestLogger new];
+
+    TMPContextWhitelistFilterLogFormatter *whitelist = [TMPContextWhitelistFilterLogFormatter new];
+    [whitelist addToWhitelist:1];
+    [whitelist addToWhitelist:-5];
+    [whitelist addToWhitelist:100000];
+
+    [log addLogger:filtered withLevel:TMPLogLevelAll filter:whitelist];
+    [log addLogger:unfiltered withLevel:TMPLogLevelAll];
+
+    [self logContexts:@[ @0, @1, @2, @-5, @100000, @100001 ] toLog:log];
+
+    XCTAssertEqualObjects([filtered.messages valueForKey:@"context"], (@[ @1, @-5, @100000 ]));
+    XCTAssertEqual(unfiltered.messages.count, 6);
+}
+
+- (void)testBlacklistFilter {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDTestLogger *logger = [DDTestLogger new];
+
+    TMPContextBlacklistFilterLogFormatter *blacklist = [TMPContextBlacklistFilterLogFormatter new];
+    [blacklist addToBlacklist:255];
+    [blacklist addToBlacklist:256];
+
+    [log addLogger:logger withLevel:TMPLogLevelAll filter:blacklist];
+
+    [self logContexts:@[ @254, @255, @256, @257 ] toLog:log];
+
+    XCTAssertEqualObjects([logger.messages valueForKey:@"context"], (@[ @254, @257 ]));
+}
+
+- (void)testContextSetMembership {
+    TMPContextWhitelistFilterLogFormatter *whitelist = [TMPContextWhitelistFilterLogFormatter new];
+    NSArray<NSNumber *> *contexts = @[ @0, @63, @64, @255, @256, @-1, @(NSIntegerMax), @(NSIntegerMin) ];
+
+    for (NSNumber *context in contexts) {
+        XCTAssertFalse([whitelist isOnWhitelist:context.integerValue]);
+        [whitelist addToWhitelist:context.integerValue];
+    }
+
+    for (NSNumber *context in contexts) {
+        XCTAssertTrue([whitelist isOnWhitelist:context.integerValue], @"%@", context);
+    }
+    XCTAssertEqual(whitelist.whitelist.count, contexts.count);
+
+    // Enough large contexts to grow the hash table a couple of times.
+    for (NSInteger context = 1000; context < 1100; context++) {
+        [whitelist addToWhitelist:context];
+    }
+    for (NSInteger context = 1000; context < 1100; context++) {
+        XCTAssertTrue([whitelist isOnWhitelist:context]);
+    }
+    XCTAssertFalse([whitelist isOnWhitelist:1100]);
+
+    for (NSNumber *context in contexts) {
+        [whitelist removeFromWhitelist:context.integerValue];
+        XCTAssertFalse([whitelist isOnWhitelist:context.integerValue], @"%@", context);
+    }
+}
+
+- (void)testFormatterStillFilters {
+    TMPContextWhitelistFilterLogFormatter *whitelist = [TMPContextWhitelistFilterLogFormatter new];
+    [whitelist addToWhitelist:7];
+
+    TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"message"
+                                                              level:TMPLogLevelAll
+                                                               flag:TMPLogFlagInfo
+                                                            context:8
+                                                               file:@(__FILE__)
+                                                           function:@(__func__)
+                                                               line:__LINE__
+                                                                tag:nil
+                                                            options:(TMPLogMessageOptions)0
+                                                          timestamp:nil];
+    XCTAssertNil([whitelist formatLogMessage:message]);
+    XCTAssertFalse([whitelist shouldLogMessage:message]);
+}
+
+@end
@@ -0,0 +1,133 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+@interface DDLogIsolationTests : XCTestCase
+
+@end
+
+@implementation DDLogIsolationTests
+
+- (void)logMessages:(NSUInteger)count to:(TMPLog *)log asynchronously:(BOOL)asynchronous {
+    for (NSUInteger i = 0; i < count; i++) {
+        [log log:asynchronous level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"%lu", (unsigned long)i];
+    }
+}
+
+- (void)testInstancesHaveTheirOwnQueue {
+    TMPLog *log = [[TMPLog alloc] init];
+    TMPLog *otherLog = [[TMPLog alloc] initWithMaximumQueueSize:0 qualityOfService:QOS_CLASS_UTILITY];
+
+    XCTAssertEqual(TMPLog.loggingQueue, TMPLog.sharedInstance.loggingQueue);
+    XCTAssertNotEqual(log.loggingQueue, TMPLog.loggingQueue);
+    XCTAssertNotEqual(log.loggingQueue, otherLog.loggingQueue);
+
+    XCTAssertEqual(TMPLog.sharedInstance.maximumQueueSize, 1000);
+    XCTAssertEqual(log.maximumQueueSize, 1000);
+    XCTAssertEqual(otherLog.maximumQueueSize, 1);
+    XCTAssertEqual(dispatch_queue_get_qos_class(otherLog.loggingQueue, NULL), QOS_CLASS_UTILITY);
+}
+
+- (void)testStalledInstanceDoesNotDelayAnother {
+    TMPLog *stalledLog = [[TMPLog alloc] initWithMaximumQueueSize:2 qualityOfService:QOS_CLASS_UNSPECIFIED];
+    DDTestLogger *stalledLogger = [DDTestLogger new];
+    stalledLogger.gate = dispatch_semaphore_create(0);
+    [stalledLog addLogger:stalledLogger];
+
+    TMPLog *log = [[TMPLog alloc] init];
+    DDTestLogger *logger = [DDTestLogger new];
+    [log addLogger:logger];
+
+    // Stalls the logging queue of the first instance, and fills its backlog:
+    // one message being delivered, one queued.
+    [self logMessages:2 to:stalledLog asynchronously:YES];
+
+    // So the third producer blocks, even though it logs asynchronously
+    dispatch_semaphore_t thirdLogged = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [stalledLog log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"2"];
+        dispatch_semaphore_signal(thirdLogged);
+    });
+
+    XCTestExpectation *logged = [self expectationWithDescription:@"Logged to the other instance"];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self logMessages:100 to:log asynchronously:NO];
+        [log flushLog];
+        [logged fulfill];
+    });
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(logger.messages.count, 100);
+    XCTAssertEqual(stalledLogger.messages.count, 0);
+    XCTAssertNotEqual(dispatch_semaphore_wait(thirdLogged, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(100 * NSEC_PER_MSEC))), 0);
+
+    dispatch_semaphore_signal(stalledLogger.gate);
+    XCTAssertEqual(dispatch_semaphore_wait(thirdLogged, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC))), 0);
+    [stalledLog flushLog];
+
+    XCTAssertEqual(stalledLogger.messages.count, 3);
+    XCTAssertEqualObjects(stalledLogger.messages.lastObject.message, @"2");
+}
+
+- (void)testLoggingFromTheLoggingQueueDoesNotTakeASlot {
+    TMPLog *log = [[TMPLog alloc] initWithMaximumQueueSize:1 qualityOfService:QOS_CLASS_UNSPECIFIED];
+    DDTestLogger *logger = [DDTestLogger new];
+    [log addLogger:logger];
+
+    // Would deadlock if it waited for the slot the queue holds
+    dispatch_sync(log.loggingQueue, ^{
+        [self logMessages:3 to:log asynchronously:YES];
+    });
+    [self logMessages:3 to:log asynchronously:NO];
+    [log flushLog];
+
+    XCTAssertEqual(logger.messages.count, 6);
+}
+
+- (void)testLoggerAccessorsGoThroughTheirInstance {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDTestLogger *logger = [DDTestLogger new];
+    XCTAssertEqual(logger.globalLoggingQueue, TMPLog.loggingQueue);
+
+    [log addLogger:logger];
+    XCTAssertEqual(logger.globalLoggingQueue, log.loggingQueue);
+
+    // The accessors don't wait for the stalled shared instance
+    dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+    dispatch_async(TMPLog.loggingQueue, ^{
+        dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+    });
+
+    TMPDispatchQueueLogFormatter *formatter = [TMPDispatchQueueLogFormatter new];
+    XCTestExpectation *accessed = [self expectationWithDescription:@"Accessed the formatter"];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        logger.logFormatter = formatter;
+        XCTAssertEqual(logger.logFormatter, formatter);
+        [accessed fulfill];
+    });
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    dispatch_semaphore_signal(gate);
+
+    [log removeLogger:logger];
+    [log flushLog];
+    XCTAssertEqual(logger.globalLoggingQueue, TMPLog.loggingQueue);
+}
+
+@end
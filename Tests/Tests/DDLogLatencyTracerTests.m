@@ -0,0 +1,142 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+@interface DDLatencyTracerTestLogger : TMPAbstractLogger
+
+@property (nonatomic, readonly) NSUInteger count;
+
+@end
+
+@implementation DDLatencyTracerTestLogger
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    _count++;
+}
+
+@end
+
+@interface DDLogLatencyTracerTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+@property (nonatomic, copy) NSString *directory;
+
+@end
+
+@implementation DDLogLatencyTracerTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+    self.directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown {
+    self.log.latencyTracer = nil;
+    [self.log removeAllLoggers];
+    [self.log flushLog];
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:nil];
+    [super tearDown];
+}
+
+- (void)logMessages:(NSUInteger)count asynchronously:(BOOL)asynchronous {
+    for (NSUInteger i = 0; i < count; i++) {
+        [self.log log:asynchronous level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Message %lu", (unsigned long)i];
+    }
+}
+
+- (void)testTracesMessages {
+    TMPLogLatencyTracer *tracer = [[TMPLogLatencyTracer alloc] initWithSampleRate:1];
+    self.log.latencyTracer = tracer;
+    [self.log addLogger:[DDLatencyTracerTestLogger new]];
+
+    [self logMessages:5 asynchronously:NO];
+
+    NSArray<TMPLoggerLatencyTrace *> *loggers = tracer.loggers;
+    XCTAssertEqual(loggers.count, 1);
+    XCTAssertEqualObjects(loggers[0].name, @"DDLatencyTracerTestLogger");
+    XCTAssertEqual(loggers[0].queueing.count, 5);
+    XCTAssertEqual(loggers[0].dispatching.count, 5);
+    XCTAssertEqual(loggers[0].writing.count, 5);
+    XCTAssertEqual(loggers[0].total.count, 5);
+    XCTAssertGreaterThanOrEqual(loggers[0].total.maximum, loggers[0].writing.maximum);
+
+    NSArray<NSString *> *lines = [tracer.samplesCSV componentsSeparatedByString:@"\n"];
+    XCTAssertEqual(lines.count, 7); // Header, 5 samples, and the empty string after the last newline
+    XCTAssertEqualObjects(lines[0], @"logger,timestamp,created,dequeued,handed,written");
+    XCTAssertTrue([lines[1] hasPrefix:@"DDLatencyTracerTestLogger,"], @"%@", lines[1]);
+
+    NSArray<NSString *> *columns = [lines[1] componentsSeparatedByString:@","];
+    XCTAssertLessThanOrEqual(columns[2].doubleValue, columns[3].doubleValue);
+    XCTAssertLessThanOrEqual(columns[3].doubleValue, columns[4].doubleValue);
+    XCTAssertLessThanOrEqual(columns[4].doubleValue, columns[5].doubleValue);
+
+    tracer.maximumNumberOfSamples = 2;
+    [self logMessages:3 asynchronously:NO];
+    XCTAssertEqual([tracer.samplesCSV componentsSeparatedByString:@"\n"].count, 4);
+
+    [tracer reset];
+    XCTAssertEqual(tracer.loggers.count, 0);
+}
+
+- (void)testSamples {
+    TMPLogLatencyTracer *tracer = [[TMPLogLatencyTracer alloc] initWithSampleRate:1000000];
+    self.log.latencyTracer = tracer;
+    [self.log addLogger:[DDLatencyTracerTestLogger new]];
+
+    [self logMessages:100 asynchronously:NO];
+
+    XCTAssertEqual(tracer.loggers.count, 0);
+}
+
+- (void)testBufferedFileLoggerIsWrittenWhenFlushed {
+    TMPLogLatencyTracer *tracer = [[TMPLogLatencyTracer alloc] initWithSampleRate:1];
+    self.log.latencyTracer = tracer;
+
+    TMPFileLogger *fileLogger = [[TMPFileLogger alloc] initWithLogFileManager:[[TMPLogFileManagerDefault alloc] initWithLogsDirectory:self.directory]];
+    TMPFileLogger *bufferedLogger = [fileLogger wrapWithBuffer];
+    [self.log addLogger:bufferedLogger];
+
+    [self logMessages:3 asynchronously:NO];
+
+    // Still in the buffer
+    XCTAssertEqual(tracer.loggers.count, 0);
+
+    [bufferedLogger flush];
+
+    NSArray<TMPLoggerLatencyTrace *> *loggers = tracer.loggers;
+    XCTAssertEqual(loggers.count, 1);
+    XCTAssertEqualObjects(loggers[0].name, TMPLoggerNameFile);
+    XCTAssertEqual(loggers[0].total.count, 3);
+
+    NSString *path = [self.directory stringByAppendingPathComponent:@"samples.csv"];
+    NSError *error = nil;
+    XCTAssertTrue([tracer writeSamplesToFile:path error:&error], @"%@", error);
+    XCTAssertEqualObjects([NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL], tracer.samplesCSV);
+}
+
+- (void)testPerformanceSampledLogging {
+    self.log.latencyTracer = [TMPLogLatencyTracer new];
+    [self.log addLogger:[DDLatencyTracerTestLogger new]];
+
+    [self measureBlock:^{
+        [self logMessages:10000 asynchronously:YES];
+        [self.log flushLog];
+    }];
+}
+
+@end
@@ -0,0 +1,210 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import <mach/mach_time.h>
+#import <sys/socket.h>
+#import <sys/un.h>
+#import <unistd.h>
+
+@interface DDMetricsTestLogger : TMPAbstractLogger
+
+@property (nonatomic, readonly) NSUInteger count;
+
+@end
+
+@implementation DDMetricsTestLogger
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    _count++;
+}
+
+@end
+
+@interface DDLogMetricsTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+@property (nonatomic) DDMetricsTestLogger *logger;
+
+@end
+
+@implementation DDLogMetricsTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+    self.logger = [DDMetricsTestLogger new];
+    [self.log addLogger:self.logger];
+}
+
+- (void)tearDown {
+    self.log.rateLimiter = nil;
+    [self.log removeAllLoggers];
+    [super tearDown];
+}
+
+- (void)logFromSite:(NSString *)message asynchronously:(BOOL)asynchronous {
+    [self.log log:asynchronous level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"%@", message];
+}
+
+- (void)testHistogram {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double secondsPerTick = (double)timebase.numer / timebase.denom / NSEC_PER_SEC;
+
+    TMPLogHistogram *histogram = calloc(1, sizeof(TMPLogHistogram));
+    for (uint64_t value = 1; value <= 10000; value++) {
+        TMPLogHistogramRecord(histogram, value);
+    }
+
+    TMPLogLatency *latency = [[TMPLogLatency alloc] initWithHistogram:histogram];
+    free(histogram);
+
+    XCTAssertEqual(latency.count, 10000);
+    XCTAssertEqualWithAccuracy(latency.maximum, 10000 * secondsPerTick, secondsPerTick / 2);
+    XCTAssertEqualWithAccuracy(latency.mean, 5000.5 * secondsPerTick, secondsPerTick / 2);
+    XCTAssertEqualWithAccuracy([latency latencyAtPercentile:50], 5000 * secondsPerTick, 5000 * secondsPerTick / 16);
+    XCTAssertEqualWithAccuracy([latency latencyAtPercentile:99], 9900 * secondsPerTick, 9900 * secondsPerTick / 16);
+    XCTAssertEqualWithAccuracy([latency latencyAtPercentile:100], latency.maximum, secondsPerTick / 2);
+}
+
+- (void)testCountsMessages {
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self logFromSite:@"Sync" asynchronously:NO];
+        [self logFromSite:@"Async" asynchronously:YES];
+    }
+    [self.log flushLog];
+
+    TMPLogMetrics *metrics = self.log.metrics;
+    XCTAssertEqual(metrics.messagesEnqueued, 10);
+    XCTAssertEqual(metrics.messagesDelivered, 10);
+    XCTAssertEqual(metrics.messagesDropped, 0);
+    XCTAssertEqual(metrics.queueDepth, 0);
+    XCTAssertGreaterThanOrEqual(metrics.maximumQueueDepth, 1);
+    XCTAssertEqual(metrics.queueLatency.count, 10);
+    XCTAssertEqual(metrics.blockedTime.count, 0);
+
+    XCTAssertEqual(metrics.loggers.count, 1);
+    XCTAssertEqual(metrics.loggers[0].logger, self.logger);
+    XCTAssertEqualObjects(metrics.loggers[0].name, @"DDMetricsTestLogger");
+    XCTAssertEqual(metrics.loggers[0].latency.count, 10);
+}
+
+- (void)testTimesTheWaitsForAFullBacklog {
+    TMPLog *log = [[TMPLog alloc] initWithMaximumQueueSize:1 qualityOfService:QOS_CLASS_UNSPECIFIED];
+    dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+    dispatch_async(log.loggingQueue, ^{
+        dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+    });
+
+    XCTestExpectation *logged = [self expectationWithDescription:@"Logged"];
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        // The first message takes the only slot, the second waits for it
+        for (NSUInteger i = 0; i < 2; i++) {
+            [log log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Blocked"];
+        }
+        [logged fulfill];
+    });
+
+    [NSThread sleepForTimeInterval:0.1];
+    dispatch_semaphore_signal(gate);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [log flushLog];
+
+    TMPLogMetrics *metrics = log.metrics;
+    XCTAssertEqual(metrics.blockedTime.count, 1);
+    XCTAssertGreaterThan(metrics.blockedTime.maximum, 0.05);
+}
+
+- (void)testCountsDroppedMessages {
+    self.log.rateLimiter = [[TMPLogRateLimiter alloc] initWithMessagesPerSecond:1.0 / 60 burst:2];
+
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self logFromSite:@"Limited" asynchronously:NO];
+    }
+
+    TMPLogMetrics *metrics = self.log.metrics;
+    XCTAssertEqual(metrics.messagesEnqueued, 2);
+    XCTAssertEqual(metrics.messagesDropped, 3);
+    XCTAssertEqual(self.logger.count, 2);
+}
+
+- (void)testTextExposition {
+    [self logFromSite:@"Sync" asynchronously:NO];
+
+    NSString *text = self.log.metrics.textExposition;
+    XCTAssertTrue([text containsString:@"\ntmplog_messages_delivered_total 1\n"], @"%@", text);
+    XCTAssertTrue([text containsString:@"\ntmplog_queue_latency_seconds_count 1\n"], @"%@", text);
+    XCTAssertTrue([text containsString:@"\ntmplog_logger_latency_seconds{logger=\"DDMetricsTestLogger\",position=\"0\",quantile=\"0.99\"} "], @"%@", text);
+    XCTAssertTrue([text containsString:@"\ntmplog_logger_latency_seconds_count{logger=\"DDMetricsTestLogger\",position=\"0\"} 1\n"], @"%@", text);
+}
+
+- (void)testServer {
+    // Socket paths are limited to about a hundred bytes
+    NSString *path = [NSString stringWithFormat:@"/tmp/tmplog-%@.sock", [[NSUUID UUID].UUIDString substringToIndex:8]];
+    TMPLogMetricsServer *server = [[TMPLogMetricsServer alloc] initWithLog:self.log socketPath:path];
+
+    NSError *error = nil;
+    XCTAssertTrue([server start:&error], @"%@", error);
+
+    [self logFromSite:@"Sync" asynchronously:NO];
+
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+    strlcpy(address.sun_path, path.fileSystemRepresentation, sizeof(address.sun_path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    XCTAssertEqual(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+
+    NSMutableData *data = [NSMutableData data];
+    uint8_t buffer[1024];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        [data appendBytes:buffer length:(NSUInteger)length];
+    }
+    close(fd);
+
+    NSString *text = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    XCTAssertTrue([text containsString:@"tmplog_messages_enqueued_total 1\n"], @"%@", text);
+
+    [server stop];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path]);
+}
+
+- (void)testServerDoesNotReplaceOtherFiles {
+    NSString *path = [NSString stringWithFormat:@"/tmp/tmplog-%@.sock", [[NSUUID UUID].UUIDString substringToIndex:8]];
+    XCTAssertTrue([[NSData data] writeToFile:path atomically:NO]);
+    TMPLogMetricsServer *server = [[TMPLogMetricsServer alloc] initWithLog:self.log socketPath:path];
+
+    NSError *error = nil;
+    XCTAssertFalse([server start:&error]);
+    XCTAssertEqual(error.code, EADDRINUSE);
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:path]);
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+- (void)testPerformanceInstrumentedLogging {
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [self logFromSite:@"Measured" asynchronously:YES];
+        }
+        [self.log flushLog];
+    }];
+}
+
+@end
@@ -0,0 +1,187 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+@interface DDLogRateLimiterTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+@property (nonatomic) TMPLogRateLimiter *limiter;
+@property (nonatomic) DDTestLogger *logger;
+
+@end
+
+@implementation DDLogRateLimiterTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+    self.logger = [DDTestLogger new];
+    [self.log addLogger:self.logger];
+
+    // One message per minute: nothing refills during a test
+    self.limiter = [[TMPLogRateLimiter alloc] initWithMessagesPerSecond:1.0 / 60 burst:3];
+    self.log.rateLimiter = self.limiter;
+}
+
+- (void)tearDown {
+    self.log.rateLimiter = nil;
+    [self.log removeAllLoggers];
+    [super tearDown];
+}
+
+- (void)logFromSiteA:(NSString *)message context:(NSInteger)context {
+    [self.log log:NO level:TMPLogLevelAll flag:TMPLogFlagError context:context file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"%@", message];
+}
+
+- (void)logFromSiteB:(NSString *)message {
+    [self.log log:NO level:TMPLogLevelAll flag:TMPLogFlagError context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"%@", message];
+}
+
+- (NSArray<NSString *> *)loggedMessages {
+    [self.log flushLog];
+    return [self.logger.messages valueForKey:@"message"];
+}
+
+- (void)testBurstThenSuppressed {
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self logFromSiteA:[NSString stringWithFormat:@"A%lu", (unsigned long)i] context:0];
+    }
+    [self logFromSiteB:@"B"];
+
+    [self.limiter reportSuppressedMessages];
+    [self.limiter reportSuppressedMessages]; // Nothing left to report
+
+    NSArray<NSString *> *messages = [self loggedMessages];
+    XCTAssertEqual(messages.count, 5);
+    XCTAssertEqualObjects([messages subarrayWithRange:NSMakeRange(0, 4)], (@[ @"A0", @"A1", @"A2", @"B" ]));
+    XCTAssertTrue([messages[4] hasPrefix:@"Suppressed 7 messages from DDLogRateLimiterTests.m:"], @"%@", messages[4]);
+
+    TMPLogMessage *report = self.logger.messages.lastObject;
+    XCTAssertEqual(report.flag, TMPLogFlagWarning);
+    XCTAssertEqual(report.line, self.logger.messages.firstObject.line);
+}
+
+- (TMPLogMessage *)messageObject:(NSString *)message line:(NSUInteger)line {
+    // A new file name string every time: message objects are told apart by its contents
+    return [[TMPLogMessage alloc] initWithMessage:message
+                                            level:TMPLogLevelAll
+                                             flag:TMPLogFlagError
+                                          context:0
+                                             file:[NSString stringWithFormat:@"%s", __FILE__]
+                                         function:@(__PRETTY_FUNCTION__)
+                                             line:line
+                                              tag:nil
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:nil];
+}
+
+- (void)testLimitsMessageObjects {
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self.log log:NO message:[self messageObject:@"Object" line:1]];
+        [self.log log:NO message:[self messageObject:@"Pointers" line:2] file:__FILE__ function:__PRETTY_FUNCTION__];
+    }
+    [self.log log:NO message:[self messageObject:@"Other line" line:3]];
+
+    NSArray<NSString *> *messages = [self loggedMessages];
+    XCTAssertEqualObjects(messages, (@[ @"Object", @"Pointers", @"Object", @"Pointers", @"Object", @"Pointers", @"Other line" ]));
+    XCTAssertEqual(self.log.metrics.messagesDropped, 4);
+}
+
+- (void)testContextLimits {
+    [self.limiter setMessagesPerSecond:0 burst:0 forContext:1];
+    [self.limiter setMessagesPerSecond:1.0 / 60 burst:1 forContext:2];
+
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self logFromSiteA:@"Unlimited" context:1];
+        [self logFromSiteA:@"Limited" context:2];
+    }
+
+    NSArray<NSString *> *messages = [self loggedMessages];
+    XCTAssertEqual([messages indexesOfObjectsPassingTest:^BOOL(NSString *message, NSUInteger idx, BOOL *stop) {
+        return [message isEqualToString:@"Unlimited"];
+    }].count, 5);
+    XCTAssertEqual([messages indexesOfObjectsPassingTest:^BOOL(NSString *message, NSUInteger idx, BOOL *stop) {
+        return [message isEqualToString:@"Limited"];
+    }].count, 1);
+
+    // Back to the default burst of 3
+    [self.limiter removeLimitForContext:1];
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self logFromSiteA:@"Default" context:1];
+    }
+    XCTAssertEqual([[self loggedMessages] indexesOfObjectsPassingTest:^BOOL(NSString *message, NSUInteger idx, BOOL *stop) {
+        return [message isEqualToString:@"Default"];
+    }].count, 3);
+}
+
+- (void)testCollapsesRepeatedMessages {
+    self.log.rateLimiter = [[TMPLogRateLimiter alloc] initWithMessagesPerSecond:0 burst:0];
+    self.log.rateLimiter.collapsesRepeatedMessages = YES;
+
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self logFromSiteB:@"Same"];
+    }
+    [self logFromSiteB:@"Different"];
+    [self logFromSiteB:@"Same"];
+    [self logFromSiteB:@"Same"];
+    [self.log.rateLimiter reportSuppressedMessages];
+
+    XCTAssertEqualObjects([self loggedMessages], (@[ @"Same",
+                                                     @"Last message repeated 4 times",
+                                                     @"Different",
+                                                     @"Same",
+                                                     @"Last message repeated 1 times" ]));
+}
+
+- (void)testReleasesReplacedLimiters {
+    __weak TMPLogRateLimiter *replacedLimiter;
+    dispatch_group_t group = dispatch_group_create();
+
+    // Replaced while other threads are logging
+    for (NSUInteger i = 0; i < 4; i++) {
+        dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+            for (NSUInteger j = 0; j < 1000; j++) {
+                [self logFromSiteA:@"Concurrent" context:0];
+            }
+        });
+    }
+
+    @autoreleasepool {
+        TMPLogRateLimiter *limiter = [[TMPLogRateLimiter alloc] initWithMessagesPerSecond:1.0 / 60 burst:3];
+        replacedLimiter = limiter;
+        self.log.rateLimiter = limiter;
+        limiter = nil;
+        self.log.rateLimiter = self.limiter;
+    }
+
+    XCTAssertNil(replacedLimiter);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+}
+
+- (void)testPerformanceSuppressedCheck {
+    [self.limiter setMessagesPerSecond:1.0 / 60 burst:1 forContext:3];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100000; i++) {
+            [self logFromSiteA:@"Suppressed" context:3];
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,180 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+static TMPLogMessage *DDRecordTestMessage(NSString *message, TMPLogFlag flag, NSInteger context) {
+    return [[TMPLogMessage alloc] initWithMessage:message
+                                            level:TMPLogLevelAll
+                                             flag:flag
+                                          context:context
+                                             file:@(__FILE__)
+                                         function:@(__func__)
+                                             line:__LINE__
+                                              tag:nil
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.123456]];
+}
+
+static void DDRecordTestAppend(NSMutableData *data, NSString *message, TMPLogFlag flag, NSInteger context) {
+    NSData *payload = [message dataUsingEncoding:NSUTF8StringEncoding];
+    TMPLogRecordAppend(data, DDRecordTestMessage(message, flag, context), payload.bytes, payload.length);
+}
+
+@interface DDLogRecordFramingTests : XCTestCase
+
+@end
+
+@implementation DDLogRecordFramingTests
+
+- (void)testCRC32CCheckValue {
+    const char *check = "123456789";
+    XCTAssertEqual(TMPLogCRC32C(0, check, strlen(check)), 0xE3069283);
+}
+
+- (void)testCRC32CIsIncremental {
+    uint8_t bytes[1021];
+    for (NSUInteger i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(i * 31);
+    }
+
+    uint32_t oneShot = TMPLogCRC32C(0, bytes, sizeof(bytes));
+    uint32_t incremental = TMPLogCRC32C(TMPLogCRC32C(0, bytes, 13), bytes + 13, sizeof(bytes) - 13);
+    XCTAssertEqual(oneShot, incremental);
+}
+
+- (void)testRoundTrip {
+    NSMutableData *data = [NSMutableData data];
+    DDRecordTestAppend(data, @"First", TMPLogFlagError, 1);
+    DDRecordTestAppend(data, @"Zweite Nachricht – ünïcödé", TMPLogFlagInfo, -7);
+    DDRecordTestAppend(data, @"", TMPLogFlagVerbose, 0);
+
+    TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithData:data];
+    XCTAssertEqual(reader.recordCount, 3);
+    XCTAssertEqual(reader.preambleLength, 0);
+    XCTAssertEqual(reader.validLength, data.length);
+    XCTAssertFalse(reader.hasCorruptTail);
+
+    NSArray<TMPLogMessage *> *messages = reader.logMessages;
+    XCTAssertEqualObjects(messages[0].message, @"First");
+    XCTAssertEqual(messages[0].flag, TMPLogFlagError);
+    XCTAssertEqual(messages[0].context, 1);
+    XCTAssertEqualWithAccuracy(messages[0].timestamp.timeIntervalSince1970, 1234567890.123456, 0.000001);
+    XCTAssertEqualObjects(messages[1].message, @"Zweite Nachricht – ünïcödé");
+    XCTAssertEqual(messages[1].flag, TMPLogFlagInfo);
+    XCTAssertEqual(messages[1].context, -7);
+    XCTAssertEqualObjects(messages[2].message, @"");
+}
+
+- (void)testPreambleIsSkipped {
+    NSMutableData *data = [[@"header\n" dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+    DDRecordTestAppend(data, @"Message", TMPLogFlagWarning, 0);
+
+    TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithData:data];
+    XCTAssertEqual(reader.preambleLength, 7);
+    XCTAssertEqual(reader.recordCount, 1);
+    XCTAssertFalse(reader.hasCorruptTail);
+}
+
+- (void)testTornTailIsDetected {
+    NSMutableData *data = [NSMutableData data];
+    DDRecordTestAppend(data, @"Complete", TMPLogFlagError, 0);
+    NSUInteger intactLength = data.length;
+    DDRecordTestAppend(data, @"Torn in the middle of the payload", TMPLogFlagError, 0);
+
+    for (NSUInteger length = intactLength + 1; length < data.length; length++) {
+        TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithData:[data subdataWithRange:NSMakeRange(0, length)]];
+        XCTAssertEqual(reader.recordCount, 1);
+        XCTAssertEqual(reader.validLength, intactLength);
+        XCTAssertTrue(reader.hasCorruptTail);
+    }
+}
+
+- (void)testCorruptPayloadIsDetected {
+    NSMutableData *data = [NSMutableData data];
+    DDRecordTestAppend(data, @"Complete", TMPLogFlagError, 0);
+    NSUInteger intactLength = data.length;
+    DDRecordTestAppend(data, @"Bit flip", TMPLogFlagError, 0);
+
+    ((uint8_t *)data.mutableBytes)[data.length - 1] ^= 0x01;
+
+    TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithData:data];
+    XCTAssertEqual(reader.recordCount, 1);
+    XCTAssertEqual(reader.validLength, intactLength);
+}
+
+- (void)testTruncatesFromTheFirstCorruptRecord {
+    NSMutableData *data = [NSMutableData data];
+    DDRecordTestAppend(data, @"Before", TMPLogFlagError, 0);
+    NSUInteger intactLength = data.length;
+    DDRecordTestAppend(data, @"Corrupt", TMPLogFlagError, 0);
+    NSUInteger corruptEnd = data.length;
+    DDRecordTestAppend(data, @"After", TMPLogFlagError, 0);
+
+    ((uint8_t *)data.mutableBytes)[corruptEnd - 1] ^= 0x01;
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [data writeToFile:path atomically:NO];
+
+    NSError *error = nil;
+    XCTAssertEqual([TMPLogRecordReader truncateCorruptTailOfFileAtPath:path error:&error], data.length - intactLength);
+    XCTAssertNil(error);
+
+    // The valid record after the corrupt one goes too
+    TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithContentsOfFile:path error:nil];
+    XCTAssertEqual(reader.recordCount, 1);
+    XCTAssertFalse(reader.hasCorruptTail);
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testTruncatingAMissingFileReportsTheError {
+    NSError *error = nil;
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+
+    XCTAssertEqual([TMPLogRecordReader truncateCorruptTailOfFileAtPath:path error:&error], 0);
+    XCTAssertNotNil(error.domain);
+}
+
+- (void)testTornTailIsTruncatedWhenResuming {
+    NSString *logsDirectory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    TMPLogFileManagerDefault *fileManager = [[TMPLogFileManagerDefault alloc] initWithLogsDirectory:logsDirectory];
+
+    TMPFileLogger *logger = [[TMPFileLogger alloc] initWithLogFileManager:fileManager];
+    logger.usesRecordFraming = YES;
+    NSString *path = logger.currentLogFileInfo.filePath;
+
+    NSMutableData *data = [NSMutableData data];
+    DDRecordTestAppend(data, @"Survivor", TMPLogFlagError, 0);
+    NSUInteger intactLength = data.length;
+    DDRecordTestAppend(data, @"Casualty", TMPLogFlagError, 0);
+    [[data subdataWithRange:NSMakeRange(0, data.length - 3)] writeToFile:path atomically:NO];
+    logger = nil;
+
+    TMPFileLogger *resumed = [[TMPFileLogger alloc] initWithLogFileManager:fileManager];
+    resumed.usesRecordFraming = YES;
+    XCTAssertEqualObjects(resumed.currentLogFileInfo.filePath, path);
+
+    TMPLogRecordReader *reader = [[TMPLogRecordReader alloc] initWithContentsOfFile:path error:nil];
+    XCTAssertEqual(reader.validLength, intactLength);
+    XCTAssertFalse(reader.hasCorruptTail);
+    XCTAssertEqualObjects(reader.logMessages.firstObject.message, @"Survivor");
+
+    resumed = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:logsDirectory error:nil];
+}
+
+@end
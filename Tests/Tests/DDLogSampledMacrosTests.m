@@ -0,0 +1,121 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+static TMPLogLevel tmpLogLevel = TMPLogLevelDebug;
+
+@interface DDLogSampledMacrosTests : XCTestCase
+
+@property (nonatomic) DDTestLogger *logger;
+
+@end
+
+@implementation DDLogSampledMacrosTests
+
+- (void)setUp {
+    [super setUp];
+    self.logger = [DDTestLogger new];
+    [TMPLog addLogger:self.logger];
+}
+
+- (void)tearDown {
+    [TMPLog removeLogger:self.logger];
+    [super tearDown];
+}
+
+- (void)testSampleOneIn {
+    for (NSUInteger i = 0; i < 100; i++) {
+        XCTAssertTrue(TMPLogSampleOneIn(0));
+        XCTAssertTrue(TMPLogSampleOneIn(1));
+    }
+
+    NSUInteger sampled = 0;
+    for (NSUInteger i = 0; i < 100000; i++) {
+        sampled += TMPLogSampleOneIn(10) ? 1 : 0;
+    }
+    XCTAssertGreaterThan(sampled, 9000);
+    XCTAssertLessThan(sampled, 11000);
+}
+
+- (void)testMacrosDecideBeforeFormatting {
+    __block NSUInteger evaluations = 0;
+    NSString * (^argument)(void) = ^{
+        evaluations++;
+        return @"packet";
+    };
+
+    for (NSUInteger i = 0; i < 10000; i++) {
+        TMPLogDebugSampled(100, @"Received %@", argument());
+    }
+    TMPLogVerboseSampled(1, @"Below the level");
+    TMPLogInfoSampled(1, @"Every time");
+    [TMPLog flushLog];
+
+    XCTAssertEqual(evaluations, self.logger.messages.count - 1);
+    XCTAssertGreaterThan(evaluations, 50);
+    XCTAssertLessThan(evaluations, 200);
+
+    TMPLogMessage *first = self.logger.messages.firstObject;
+    XCTAssertEqualObjects(first.message, @"Received packet");
+    XCTAssertEqual(first.sampleRate, 100);
+    XCTAssertEqualObjects(first.fields[@TMPLogFieldSampleRateKey], @100);
+
+    TMPLogMessage *last = self.logger.messages.lastObject;
+    XCTAssertEqualObjects(last.message, @"Every time");
+    XCTAssertEqual(last.sampleRate, 1);
+}
+
+- (void)testRateExpressionsCanUseAnyName {
+    // Named like the macro's former local, which shadowed it
+    NSUInteger tmpSampleRate = 1;
+    TMPLogInfoSampled(tmpSampleRate, @"Every time");
+    [TMPLog flushLog];
+
+    XCTAssertEqual(self.logger.messages.count, 1);
+    XCTAssertEqual(self.logger.messages.firstObject.sampleRate, 1);
+}
+
+- (void)testThreadsHaveTheirOwnGenerator {
+    __block uint64_t otherState = 0;
+    TMPLogSampleOneIn(2);
+    uint64_t ownState = tmpLogSampleState;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"other thread"];
+    [NSThread detachNewThreadWithBlock:^{
+        XCTAssertEqual(tmpLogSampleState, 0);
+        TMPLogSampleOneIn(2);
+        otherState = tmpLogSampleState;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertNotEqual(otherState, 0);
+    XCTAssertNotEqual(otherState, ownState);
+    XCTAssertEqual(tmpLogSampleState, ownState);
+}
+
+- (void)testPerformanceUnsampled {
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000000; i++) {
+            TMPLogDebugSampled(1000000000, @"Never %lu", (unsigned long)i);
+        }
+    }];
+}
+
+@end
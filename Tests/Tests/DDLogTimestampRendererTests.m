@@ -0,0 +1,173 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+static NSDateFormatter *DDTimestampTestDateFormatter(NSString *format, NSTimeZone *timeZone) {
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.dateFormat = format;
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.calendar = [[NSCalendar alloc] initWithCalendarIdentifier:NSCalendarIdentifierGregorian];
+    formatter.timeZone = timeZone;
+    return formatter;
+}
+
+@interface DDLogTimestampRendererTests : XCTestCase
+
+@end
+
+@implementation DDLogTimestampRendererTests
+
+- (void)testMatchesDateFormatter {
+    NSArray<NSString *> *formats = @[
+        @"yyyy/MM/dd HH:mm:ss:SSS",
+        @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx",
+        @"yy.MM.dd HH:mm:ss Z",
+        @"HH:mm:ss.SSS",
+        @"'Day' dd 'o''clock' HH",
+    ];
+    NSArray<NSTimeZone *> *timeZones = @[
+        [NSTimeZone timeZoneForSecondsFromGMT:0],
+        [NSTimeZone timeZoneWithName:@"America/New_York"],
+        [NSTimeZone timeZoneWithName:@"Asia/Kolkata"],
+    ];
+
+    for (NSString *format in formats) {
+        for (NSTimeZone *timeZone in timeZones) {
+            TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:format timeZone:timeZone];
+            NSDateFormatter *formatter = DDTimestampTestDateFormatter(format, timeZone);
+            XCTAssertNotNil(renderer, @"%@", format);
+
+            // Walks across seconds, a DST change in New York and a new year, hitting and missing the cache.
+            NSTimeInterval start = 1552201190.0; // 2019-03-10 06:59:50 UTC
+            for (NSTimeInterval offset = 0; offset < 30; offset += 0.125) {
+                NSDate *date = [NSDate dateWithTimeIntervalSince1970:start + offset];
+                XCTAssertEqualObjects([renderer stringFromDate:date], [formatter stringFromDate:date]);
+            }
+
+            NSDate *newYear = [NSDate dateWithTimeIntervalSince1970:1546300799.999]; // 2018-12-31 23:59:59.999 UTC
+            XCTAssertEqualObjects([renderer stringFromDate:newYear], [formatter stringFromDate:newYear]);
+        }
+    }
+}
+
+- (void)testMillisecondsAreTruncated {
+    NSTimeZone *utc = [NSTimeZone timeZoneForSecondsFromGMT:0];
+    TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:@"ss.SSS" timeZone:utc];
+
+    XCTAssertEqualObjects([renderer stringFromDate:[NSDate dateWithTimeIntervalSince1970:1.0]], @"01.000");
+    XCTAssertEqualObjects([renderer stringFromDate:[NSDate dateWithTimeIntervalSince1970:1.0999]], @"01.099");
+    XCTAssertEqualObjects([renderer stringFromDate:[NSDate dateWithTimeIntervalSince1970:1.9999999]], @"01.999");
+}
+
+- (void)testAppendsToBuffer {
+    NSTimeZone *utc = [NSTimeZone timeZoneForSecondsFromGMT:0];
+    TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:@"yyyy-MM-dd" timeZone:utc];
+    NSMutableData *buffer = [[@"> " dataUsingEncoding:NSUTF8StringEncoding] mutableCopy];
+
+    [renderer appendDate:[NSDate dateWithTimeIntervalSince1970:0] toBuffer:buffer];
+
+    XCTAssertEqual(renderer.length, 10);
+    XCTAssertEqualObjects([[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding], @"> 1970-01-01");
+}
+
+- (void)testUnsupportedFormats {
+    XCTAssertNil([[TMPLogTimestampRenderer alloc] initWithDateFormat:@"MMM dd"]);
+    XCTAssertNil([[TMPLogTimestampRenderer alloc] initWithDateFormat:@"h:mm a"]);
+    XCTAssertNil([[TMPLogTimestampRenderer alloc] initWithDateFormat:@"HH:mm 'unterminated"]);
+    XCTAssertNil([[TMPLogTimestampRenderer alloc] initWithDateFormat:@"ss.SSS.SSS"]);
+    XCTAssertNotNil([[TMPLogTimestampRenderer alloc] initWithDateFormat:@"yyyy/MM/dd HH:mm:ss:SSS"]);
+}
+
+- (void)testConcurrentRendering {
+    NSTimeZone *utc = [NSTimeZone timeZoneForSecondsFromGMT:0];
+    NSString *format = @"yyyy-MM-dd HH:mm:ss.SSS";
+    TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:format timeZone:utc];
+    NSDateFormatter *formatter = DDTimestampTestDateFormatter(format, utc);
+
+    NSMutableArray<NSDate *> *dates = [NSMutableArray array];
+    NSMutableArray<NSString *> *expected = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 64; i++) {
+        NSDate *date = [NSDate dateWithTimeIntervalSince1970:1500000000.0 + i * 0.7];
+        [dates addObject:date];
+        [expected addObject:[formatter stringFromDate:date]];
+    }
+
+    __block NSUInteger mismatches = 0;
+    NSObject *lock = [NSObject new];
+
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+        NSUInteger local = 0;
+        for (NSUInteger i = 0; i < 10000; i++) {
+            NSUInteger index = (i * 7 + worker) % dates.count;
+            if (![[renderer stringFromDate:dates[index]] isEqualToString:expected[index]]) {
+                local++;
+            }
+        }
+        @synchronized (lock) {
+            mismatches += local;
+        }
+    });
+
+    XCTAssertEqual(mismatches, 0);
+}
+
+- (void)testFileFormatterUsesRenderer {
+    TMPLogFileFormatterDefault *formatter = [[TMPLogFileFormatterDefault alloc] init];
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:1500000000.25];
+    TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"Hello"
+                                                              level:TMPLogLevelAll
+                                                               flag:TMPLogFlagInfo
+                                                            context:0
+                                                               file:@(__FILE__)
+                                                           function:@(__func__)
+                                                               line:__LINE__
+                                                                tag:nil
+                                                            options:(TMPLogMessageOptions)0
+                                                          timestamp:date];
+
+    NSDateFormatter *dateFormatter = DDTimestampTestDateFormatter(@"yyyy/MM/dd HH:mm:ss:SSS", [NSTimeZone defaultTimeZone]);
+    NSString *expected = [NSString stringWithFormat:@"%@  Hello", [dateFormatter stringFromDate:date]];
+    XCTAssertEqualObjects([formatter formatLogMessage:message], expected);
+}
+
+- (void)testRendererPerformance {
+    TMPLogTimestampRenderer *renderer = [[TMPLogTimestampRenderer alloc] initWithDateFormat:@"yyyy/MM/dd HH:mm:ss:SSS"];
+    NSMutableData *buffer = [NSMutableData dataWithCapacity:64];
+    NSDate *date = [NSDate date];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            buffer.length = 0;
+            [renderer appendDate:date toBuffer:buffer];
+        }
+    }];
+}
+
+- (void)testDateFormatterPerformance {
+    NSDateFormatter *formatter = DDTimestampTestDateFormatter(@"yyyy/MM/dd HH:mm:ss:SSS", [NSTimeZone defaultTimeZone]);
+    NSMutableData *buffer = [NSMutableData dataWithCapacity:64];
+    NSDate *date = [NSDate date];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10000; i++) {
+            buffer.length = 0;
+            TMPLogBufferAppendString(buffer, [formatter stringFromDate:date]);
+        }
+    }];
+}
+
+@end
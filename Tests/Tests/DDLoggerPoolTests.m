@@ -0,0 +1,230 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+#import <objc/runtime.h>
+#import <stdatomic.h>
+
+// Loggers currently in logMessage:, and the most seen at once
+static _Atomic(NSInteger) runningLoggers;
+static _Atomic(NSInteger) maximumRunningLoggers;
+
+@interface DDLoggerPoolTestLogger : TMPAbstractLogger
+
+@property (nonatomic, readonly) NSMutableArray<NSString *> *messages;
+@property (nonatomic, readonly) BOOL loggedOutsideQueue;
+@property (nonatomic, assign) BOOL logsInline;
+@property (nonatomic, assign) NSTimeInterval duration;
+
+@end
+
+@implementation DDLoggerPoolTestLogger
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _messages = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    NSInteger running = atomic_fetch_add(&runningLoggers, 1) + 1;
+    NSInteger maximum = atomic_load(&maximumRunningLoggers);
+    while (running > maximum && !atomic_compare_exchange_weak(&maximumRunningLoggers, &maximum, running)) {}
+
+    if (!self.isOnInternalLoggerQueue) {
+        _loggedOutsideQueue = YES;
+    }
+
+    [_messages addObject:logMessage.message];
+
+    if (_duration > 0) {
+        [NSThread sleepForTimeInterval:_duration];
+    }
+
+    atomic_fetch_sub(&runningLoggers, 1);
+}
+
+@end
+
+// No ivars of its own, so that a DDLoggerPoolTestLogger can become one
+static NSUInteger uppercaseLoggerFlushCount;
+
+@interface DDLoggerPoolTestUppercaseLogger : DDLoggerPoolTestLogger
+
+@end
+
+@implementation DDLoggerPoolTestUppercaseLogger
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    [self.messages addObject:logMessage.message.uppercaseString];
+}
+
+- (void)flush {
+    uppercaseLoggerFlushCount++;
+}
+
+@end
+
+@interface DDLoggerPoolTests : XCTestCase
+
+@property (nonatomic) TMPLog *log;
+
+@end
+
+@implementation DDLoggerPoolTests
+
+- (void)setUp {
+    [super setUp];
+    self.log = [[TMPLog alloc] init];
+    atomic_store(&runningLoggers, 0);
+    atomic_store(&maximumRunningLoggers, 0);
+}
+
+- (void)tearDown {
+    [self.log removeAllLoggers];
+    [self.log flushLog];
+    [super tearDown];
+}
+
+- (NSArray<DDLoggerPoolTestLogger *> *)addLoggers:(NSUInteger)count {
+    NSMutableArray<DDLoggerPoolTestLogger *> *loggers = [NSMutableArray array];
+
+    for (NSUInteger i = 0; i < count; i++) {
+        DDLoggerPoolTestLogger *logger = [DDLoggerPoolTestLogger new];
+        logger.duration = 0.002;
+        [self.log addLogger:logger];
+        [loggers addObject:logger];
+    }
+
+    return loggers;
+}
+
+- (void)logMessages:(NSUInteger)count {
+    for (NSUInteger i = 0; i < count; i++) {
+        [self.log log:YES level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"%lu", (unsigned long)i];
+    }
+    [self.log flushLog];
+}
+
+- (void)testDeliversInOrderOnLoggerQueues {
+    self.log.loggerPoolWidth = 3;
+    NSArray<DDLoggerPoolTestLogger *> *loggers = [self addLoggers:8];
+
+    [self logMessages:20];
+
+    for (DDLoggerPoolTestLogger *logger in loggers) {
+        XCTAssertEqual(logger.messages.count, 20);
+        XCTAssertEqualObjects(logger.messages.firstObject, @"0");
+        XCTAssertEqualObjects(logger.messages.lastObject, @"19");
+        XCTAssertFalse(logger.loggedOutsideQueue);
+    }
+}
+
+- (void)testWidthBoundsConcurrentLoggers {
+    self.log.loggerPoolWidth = 2;
+    [self addLoggers:8];
+
+    [self logMessages:10];
+
+    XCTAssertGreaterThanOrEqual(atomic_load(&maximumRunningLoggers), 1);
+    XCTAssertLessThanOrEqual(atomic_load(&maximumRunningLoggers), 2);
+}
+
+- (void)testWidthOfOneIsSerial {
+    self.log.loggerPoolWidth = 0;
+    XCTAssertEqual(self.log.loggerPoolWidth, 1);
+
+    [self addLoggers:4];
+    [self logMessages:10];
+
+    XCTAssertEqual(atomic_load(&maximumRunningLoggers), 1);
+}
+
+- (void)testInlineLoggersRunOnTheLoggingThread {
+    self.log.loggerPoolWidth = 4;
+
+    DDLoggerPoolTestLogger *inlineLogger = [DDLoggerPoolTestLogger new];
+    inlineLogger.logsInline = YES;
+    [self.log addLogger:inlineLogger];
+    [self addLoggers:2];
+
+    [self logMessages:10];
+
+    XCTAssertEqual(inlineLogger.messages.count, 10);
+    XCTAssertFalse(inlineLogger.loggedOutsideQueue);
+
+    XCTAssertTrue([TMPFlightRecorderLogger new].logsInline);
+}
+
+- (void)testCheapLoggersAreRunInline {
+    DDLoggerPoolTestLogger *cheapLogger = [DDLoggerPoolTestLogger new];
+    [self.log addLogger:cheapLogger];
+
+    DDLoggerPoolTestLogger *expensiveLogger = [DDLoggerPoolTestLogger new];
+    expensiveLogger.duration = 0.0001;
+    [self.log addLogger:expensiveLogger];
+
+    XCTAssertEqualWithAccuracy(self.log.inlineLoggerThreshold, 0.000005, 0.0000001);
+    self.log.inlineLoggerThreshold = 0.00005;
+
+    // Evaluated every 256 messages
+    [self logMessages:300];
+
+    NSArray<TMPLoggerMetrics *> *loggers = self.log.metrics.loggers;
+    XCTAssertGreaterThan(loggers[0].averageCost, 0);
+    XCTAssertTrue(loggers[0].runsInline);
+    XCTAssertGreaterThanOrEqual(loggers[1].averageCost, 0.0001);
+    XCTAssertFalse(loggers[1].runsInline);
+    XCTAssertTrue([self.log.metrics.textExposition containsString:@"tmplog_logger_inline{logger=\"DDLoggerPoolTestLogger\",position=\"0\"} 1"]);
+
+    XCTAssertEqual(cheapLogger.messages.count, 300);
+    XCTAssertFalse(cheapLogger.loggedOutsideQueue);
+
+    // Back to the pool
+    self.log.inlineLoggerThreshold = 0;
+    [self logMessages:256];
+    XCTAssertFalse(self.log.metrics.loggers[0].runsInline);
+}
+
+- (void)testDeliversToTheCurrentClassOfTheLogger {
+    DDLoggerPoolTestLogger *logger = [DDLoggerPoolTestLogger new];
+    [self.log addLogger:logger];
+    uppercaseLoggerFlushCount = 0;
+
+    [self.log log:NO level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"a"];
+
+    // As KVO would
+    object_setClass(logger, [DDLoggerPoolTestUppercaseLogger class]);
+
+    [self.log log:NO level:TMPLogLevelAll flag:TMPLogFlagInfo context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"b"];
+    [self.log flushLog];
+
+    XCTAssertEqualObjects(logger.messages, (@[ @"a", @"B" ]));
+    XCTAssertEqual(uppercaseLoggerFlushCount, 1);
+}
+
+- (void)testPerformanceManyLoggers {
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self.log addLogger:[DDLoggerPoolTestLogger new]];
+    }
+
+    [self measureBlock:^{
+        [self logMessages:2000];
+    }];
+}
+
+@end
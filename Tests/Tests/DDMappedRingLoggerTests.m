@@ -0,0 +1,154 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+#import "DDTestLogger.h"
+
+@interface DDMappedRingLoggerTests : XCTestCase
+
+@property (nonatomic, copy) NSString *path;
+
+@end
+
+@implementation DDMappedRingLoggerTests
+
+- (void)setUp {
+    [super setUp];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:nil];
+    [super tearDown];
+}
+
+- (TMPLogMessage *)messageWithText:(NSString *)text flag:(TMPLogFlag)flag {
+    return [[TMPLogMessage alloc] initWithMessage:text
+                                            level:TMPLogLevelAll
+                                             flag:flag
+                                          context:7
+                                             file:@"File.m"
+                                         function:nil
+                                             line:1
+                                              tag:nil
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.5]];
+}
+
+- (TMPMappedRingLogger *)openRingWithNumberOfRecords:(NSUInteger)numberOfRecords recordSize:(NSUInteger)recordSize {
+    NSError *error = nil;
+    TMPMappedRingLogger *ring = [[TMPMappedRingLogger alloc] initWithPath:self.path numberOfRecords:numberOfRecords recordSize:recordSize error:&error];
+    XCTAssertNotNil(ring, @"%@", error);
+    return ring;
+}
+
+- (void)testRecoversTheLastRecords {
+    TMPMappedRingLogger *ring = [self openRingWithNumberOfRecords:8 recordSize:128];
+    XCTAssertEqualObjects(ring.recoveredMessages, @[]);
+
+    for (NSUInteger i = 0; i < 20; i++) {
+        [ring logMessage:[self messageWithText:[NSString stringWithFormat:@"Message %lu", (unsigned long)i] flag:TMPLogFlagInfo]];
+    }
+    [ring logMessage:[self messageWithText:@"Crashing" flag:TMPLogFlagError]];
+
+    // What the next launch finds, without the ring being closed
+    NSArray<TMPLogMessage *> *messages = [TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL];
+    XCTAssertEqual(messages.count, 8);
+    XCTAssertEqualObjects(messages.firstObject.message, @"Message 13");
+    XCTAssertEqualObjects(messages.lastObject.message, @"Crashing");
+    XCTAssertEqual(messages.lastObject.flag, TMPLogFlagError);
+    XCTAssertEqual(messages.lastObject.context, 7);
+    XCTAssertEqualWithAccuracy(messages.lastObject.timestamp.timeIntervalSince1970, 1234567890.5, 0.000001);
+
+    TMPMappedRingLogger *nextRun = [self openRingWithNumberOfRecords:4 recordSize:128];
+    XCTAssertEqualObjects([nextRun.recoveredMessages valueForKey:@"message"], [messages valueForKey:@"message"]);
+    XCTAssertEqualObjects([TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL], @[]);
+
+    DDTestLogger *logger = [DDTestLogger new];
+    [nextRun replayRecoveredMessagesToLogger:logger];
+    dispatch_sync(logger.loggerQueue, ^{});
+    XCTAssertEqual(logger.messages.count, 8);
+    XCTAssertEqualObjects(nextRun.recoveredMessages, @[]);
+}
+
+- (void)testTruncatesAndDropsTornRecords {
+    TMPMappedRingLogger *ring = [self openRingWithNumberOfRecords:4 recordSize:64];
+    NSString *large = [@"" stringByPaddingToLength:100 withString:@"é" startingAtIndex:0];
+    [ring logMessage:[self messageWithText:large flag:TMPLogFlagInfo]];
+    [ring logMessage:[self messageWithText:@"Torn" flag:TMPLogFlagInfo]];
+
+    NSArray<TMPLogMessage *> *messages = [TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL];
+    XCTAssertEqualObjects(messages.firstObject.message, [large substringToIndex:8]);
+
+    // Damage the payload of the second record, as if the process died while writing it
+    NSMutableData *data = [NSMutableData dataWithContentsOfFile:self.path];
+    ((uint8_t *)data.mutableBytes)[64 + 2 * 64 + 48] ^= 0xFF;
+    [data writeToFile:self.path atomically:NO];
+
+    messages = [TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL];
+    XCTAssertEqualObjects([messages valueForKey:@"message"], @[ [large substringToIndex:8] ]);
+}
+
+- (void)testRecordsBeforeQueueing {
+    TMPLog *log = [[TMPLog alloc] init];
+    log.mappedRingLogger = [self openRingWithNumberOfRecords:16 recordSize:128];
+
+    [log log:YES level:TMPLogLevelAll flag:TMPLogFlagWarning context:0 file:__FILE__ function:__PRETTY_FUNCTION__ line:__LINE__ tag:nil format:@"Queued %d", 1];
+
+    // Already in the file, even though there's no logger and the message may still be queued
+    NSArray<TMPLogMessage *> *messages = [TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL];
+    XCTAssertEqualObjects([messages valueForKey:@"message"], @[ @"Queued 1" ]);
+
+    log.mappedRingLogger = nil;
+    [log flushLog];
+}
+
+- (void)testConcurrentWritersLappingEachOther {
+    // Many more writers than slots, so they keep landing on the same slots
+    TMPMappedRingLogger *ring = [self openRingWithNumberOfRecords:4 recordSize:128];
+
+    dispatch_apply(16, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t writer) {
+        for (NSUInteger i = 0; i < 2000; i++) {
+            NSString *text = [NSString stringWithFormat:@"Writer %02zu message %04lu", writer, (unsigned long)i];
+            [ring logMessage:[self messageWithText:text flag:TMPLogFlagInfo]];
+        }
+    });
+
+    // Every record left is whole, and there is at most one per slot
+    NSArray<TMPLogMessage *> *messages = [TMPMappedRingLogger messagesInRingAtPath:self.path error:NULL];
+    XCTAssertGreaterThan(messages.count, 0);
+    XCTAssertLessThanOrEqual(messages.count, 4);
+
+    NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:@"^Writer [0-9]{2} message [0-9]{4}$" options:0 error:NULL];
+    for (TMPLogMessage *message in messages) {
+        XCTAssertEqual([expression numberOfMatchesInString:message.message options:0 range:NSMakeRange(0, message.message.length)], 1, @"%@", message.message);
+        XCTAssertEqual(message.context, 7);
+    }
+}
+
+- (void)testPerformanceWriting {
+    TMPMappedRingLogger *ring = [self openRingWithNumberOfRecords:1024 recordSize:256];
+    TMPLogMessage *message = [self messageWithText:@"Request finished in 42 ms" flag:TMPLogFlagVerbose];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100000; i++) {
+            [ring logMessage:message];
+        }
+    }];
+}
+
+@end
@@ -0,0 +1,88 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+@interface DDMultiFormatterTests : XCTestCase
+
+@property (nonatomic) TMPLogMessage *message;
+
+@end
+
+@implementation DDMultiFormatterTests
+
+- (void)setUp {
+    [super setUp];
+
+    _message = [[TMPLogMessage alloc] initWithMessage:@"message"
+                                                level:TMPLogLevelAll
+                                                 flag:TMPLogFlagWarning
+                                              context:3
+                                                 file:@"/path/to/File.m"
+                                             function:@(__func__)
+                                                 line:42
+                                                  tag:nil
+                                              options:(TMPLogMessageOptions)0
+                                            timestamp:nil];
+}
+
+- (void)testEmptyChainReturnsMessage {
+    TMPMultiFormatter *formatter = [TMPMultiFormatter new];
+    XCTAssertEqualObjects([formatter formatLogMessage:self.message], @"message");
+}
+
+- (void)testStagesAreAppliedInOrder {
+    TMPMultiFormatter *formatter = [TMPMultiFormatter new];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%F:%L %m"]];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%p %m"]];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"[%c] %m"]];
+
+    XCTAssertEqualObjects([formatter formatLogMessage:self.message], @"[3] WARN File:42 message");
+    XCTAssertEqualObjects(self.message.message, @"message");
+}
+
+- (void)testFilteringStopsTheChain {
+    TMPContextWhitelistFilterLogFormatter *filter = [TMPContextWhitelistFilterLogFormatter new];
+    [filter addToWhitelist:1];
+
+    TMPMultiFormatter *formatter = [TMPMultiFormatter new];
+    [formatter addFormatter:[[TMPPatternLogFormatter alloc] initWithPattern:@"%p %m"]];
+    [formatter addFormatter:filter];
+
+    XCTAssertNil([formatter formatLogMessage:self.message]);
+}
+
+- (void)testAddingAndRemovingFormatters {
+    TMPMultiFormatter *formatter = [TMPMultiFormatter new];
+    TMPPatternLogFormatter *level = [[TMPPatternLogFormatter alloc] initWithPattern:@"%p %m"];
+    TMPPatternLogFormatter *line = [[TMPPatternLogFormatter alloc] initWithPattern:@"%L %m"];
+
+    [formatter addFormatter:level];
+    [formatter addFormatter:line];
+    XCTAssertTrue([formatter isFormattingWithFormatter:level]);
+    XCTAssertEqualObjects(formatter.formatters, (@[ level, line ]));
+
+    NSArray *snapshot = formatter.formatters;
+    [formatter removeFormatter:level];
+    XCTAssertFalse([formatter isFormattingWithFormatter:level]);
+    XCTAssertEqualObjects([formatter formatLogMessage:self.message], @"42 message");
+    XCTAssertEqual(snapshot.count, 2);
+
+    [formatter removeAllFormatters];
+    XCTAssertEqual(formatter.formatters.count, 0);
+}
+
+@end
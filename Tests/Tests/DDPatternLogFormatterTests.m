@@ -0,0 +1,109 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+@interface DDPatternLogFormatterTests : XCTestCase
+
+@end
+
+@implementation DDPatternLogFormatterTests
+
+- (TMPLogMessage *)messageWithText:(NSString *)text flag:(TMPLogFlag)flag {
+    return [[TMPLogMessage alloc] initWithMessage:text
+                                            level:TMPLogLevelAll
+                                             flag:flag
+                                          context:7
+                                             file:@"/path/to/Sources/Networking.m"
+                                         function:@"-[Networking fetch]"
+                                             line:123
+                                              tag:@"network"
+                                          options:(TMPLogMessageOptions)0
+                                        timestamp:[NSDate dateWithTimeIntervalSince1970:1234567890.5]];
+}
+
+- (NSString *)format:(TMPLogMessage *)message withPattern:(NSString *)pattern {
+    TMPPatternLogFormatter *formatter = [[TMPPatternLogFormatter alloc] initWithPattern:pattern];
+
+    NSMutableData *buffer = [NSMutableData dataWithBytes:"prefix" length:6];
+    XCTAssertTrue([formatter formatLogMessage:message toBuffer:buffer]);
+    NSString *fromBuffer = [[NSString alloc] initWithData:[buffer subdataWithRange:NSMakeRange(6, buffer.length - 6)]
+                                                 encoding:NSUTF8StringEncoding];
+
+    NSString *fromString = [formatter formatLogMessage:message];
+    XCTAssertEqualObjects(fromBuffer, fromString);
+
+    return fromString;
+}
+
+- (void)testMessageFields {
+    TMPLogMessage *message = [self messageWithText:@"Hello" flag:TMPLogFlagError];
+    XCTAssertEqualObjects([self format:message withPattern:@"%p|%c|%F:%L|%M|%g|%m"],
+                          @"ERROR|7|Networking:123|-[Networking fetch]|network|Hello");
+}
+
+- (void)testLevels {
+    XCTAssertEqualObjects([self format:[self messageWithText:@"" flag:TMPLogFlagWarning] withPattern:@"%p"], @"WARN");
+    XCTAssertEqualObjects([self format:[self messageWithText:@"" flag:TMPLogFlagInfo] withPattern:@"%p"], @"INFO");
+    XCTAssertEqualObjects([self format:[self messageWithText:@"" flag:TMPLogFlagDebug] withPattern:@"%p"], @"DEBUG");
+    XCTAssertEqualObjects([self format:[self messageWithText:@"" flag:TMPLogFlagVerbose] withPattern:@"%p"], @"VERBOSE");
+}
+
+- (void)testThread {
+    TMPLogMessage *message = [self messageWithText:@"" flag:TMPLogFlagInfo];
+    XCTAssertEqualObjects([self format:message withPattern:@"%T"], message.threadID);
+    XCTAssertEqualObjects([self format:message withPattern:@"%Q"], message.queueLabel);
+}
+
+- (void)testPaddingAndTruncation {
+    TMPLogMessage *message = [self messageWithText:@"abcdef" flag:TMPLogFlagInfo];
+    XCTAssertEqualObjects([self format:message withPattern:@"[%-7p][%7p][%.3m][%-8.3m][%2m]"],
+                          @"[INFO   ][   INFO][abc][abc     ][abcdef]");
+}
+
+- (void)testTruncationKeepsCharactersIntact {
+    TMPLogMessage *message = [self messageWithText:@"äöü€" flag:TMPLogFlagInfo];
+    XCTAssertEqualObjects([self format:message withPattern:@"%.2m|%6m"], @"äö|  äöü€");
+}
+
+- (void)testLiteralsAndUnknownConversions {
+    TMPLogMessage *message = [self messageWithText:@"x" flag:TMPLogFlagInfo];
+    XCTAssertEqualObjects([self format:message withPattern:@"%z 100%% %m%n%"], @"%z 100% x\n%");
+}
+
+- (void)testDates {
+    TMPLogMessage *message = [self messageWithText:@"" flag:TMPLogFlagInfo];
+    XCTAssertEqualObjects([self format:message withPattern:@"%d{UNIX_MILLIS}"], @"1234567890500");
+
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    dateFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    dateFormatter.calendar = [[NSCalendar alloc] initWithCalendarIdentifier:NSCalendarIdentifierGregorian];
+
+    dateFormatter.dateFormat = @"yyyy-MM-dd HH:mm:ss.SSS";
+    XCTAssertEqualObjects([self format:message withPattern:@"%d"], [dateFormatter stringFromDate:message.timestamp]);
+
+    dateFormatter.dateFormat = @"HH:mm:ss.SSS";
+    XCTAssertEqualObjects([self format:message withPattern:@"%d{ABSOLUTE}"], [dateFormatter stringFromDate:message.timestamp]);
+
+    dateFormatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSSxxx";
+    XCTAssertEqualObjects([self format:message withPattern:@"%d{ISO8601}"], [dateFormatter stringFromDate:message.timestamp]);
+
+    dateFormatter.dateFormat = @"dd/MM HH:mm";
+    XCTAssertEqualObjects([self format:message withPattern:@"%d{dd/MM HH:mm}"], [dateFormatter stringFromDate:message.timestamp]);
+    XCTAssertEqualObjects([self format:message withPattern:@"%d{MMMM}"], @"%d{MMMM}");
+}
+
+@end
@@ -0,0 +1,171 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+#import <XCTest/XCTest.h>
+#import <CocoaLumberjack/CocoaLumberjack.h>
+#import <stdatomic.h>
+
+@interface DDCountingFormatter : NSObject <TMPLogFormatter> {
+    @public
+    _Atomic(NSUInteger) _count;
+}
+
+@property (nonatomic, getter=isShareable) BOOL shareable;
+
+@end
+
+@implementation DDCountingFormatter
+
+- (NSString *)formatLogMessage:(TMPLogMessage *)logMessage {
+    atomic_fetch_add(&_count, 1);
+    return logMessage.context == 0 ? [@"formatted " stringByAppendingString:logMessage.message] : nil;
+}
+
+@end
+
+@interface DDBufferLogger : TMPAbstractLogger
+
+@property (nonatomic, readonly) NSMutableArray<NSString *> *lines;
+
+@end
+
+@implementation DDBufferLogger
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _lines = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (BOOL)reusesSharedFormattedOutput {
+    return YES;
+}
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    NSMutableData *buffer = [NSMutableData data];
+    if (TMPLogFormatMessageToBuffer(_logFormatter, logMessage, buffer, NULL)) {
+        [_lines addObject:[[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding]];
+    }
+}
+
+@end
+
+@interface DDSharedFormattingTests : XCTestCase
+
+@end
+
+@implementation DDSharedFormattingTests
+
+- (void)logToLog:(TMPLog *)log context:(NSInteger)context {
+    TMPLogMessage *message = [[TMPLogMessage alloc] initWithMessage:@"message"
+                                                              level:TMPLogLevelAll
+                                                               flag:TMPLogFlagInfo
+                                                            context:context
+                                                               file:@(__FILE__)
+                                                           function:@(__func__)
+                                                               line:__LINE__
+                                                                tag:nil
+                                                            options:(TMPLogMessageOptions)0
+                                                          timestamp:nil];
+    [log log:NO message:message];
+}
+
+- (NSArray<DDBufferLogger *> *)addLoggers:(NSUInteger)count withFormatter:(id <TMPLogFormatter>)formatter toLog:(TMPLog *)log {
+    NSMutableArray *loggers = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count; i++) {
+        DDBufferLogger *logger = [DDBufferLogger new];
+        logger.logFormatter = formatter;
+        [log addLogger:logger];
+        [loggers addObject:logger];
+    }
+    return loggers;
+}
+
+- (void)testShareableFormatterFormatsOnce {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDCountingFormatter *formatter = [DDCountingFormatter new];
+    formatter.shareable = YES;
+
+    NSArray<DDBufferLogger *> *loggers = [self addLoggers:3 withFormatter:formatter toLog:log];
+
+    [self logToLog:log context:0];
+    [self logToLog:log context:0];
+    [log flushLog];
+
+    XCTAssertEqual(atomic_load(&formatter->_count), 2);
+    for (DDBufferLogger *logger in loggers) {
+        XCTAssertEqualObjects(logger.lines, (@[ @"formatted message", @"formatted message" ]));
+    }
+}
+
+- (void)testSharedFilteringIsRespected {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDCountingFormatter *formatter = [DDCountingFormatter new];
+    formatter.shareable = YES;
+
+    NSArray<DDBufferLogger *> *loggers = [self addLoggers:2 withFormatter:formatter toLog:log];
+
+    [self logToLog:log context:1];
+    [log flushLog];
+
+    XCTAssertEqual(atomic_load(&formatter->_count), 1);
+    XCTAssertEqual(loggers[0].lines.count, 0);
+    XCTAssertEqual(loggers[1].lines.count, 0);
+}
+
+- (void)testUnshareableFormatterFormatsPerLogger {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDCountingFormatter *formatter = [DDCountingFormatter new];
+
+    [self addLoggers:3 withFormatter:formatter toLog:log];
+
+    [self logToLog:log context:0];
+    [log flushLog];
+
+    XCTAssertEqual(atomic_load(&formatter->_count), 3);
+}
+
+- (void)testSharingFollowsFormatterChanges {
+    TMPLog *log = [[TMPLog alloc] init];
+    DDCountingFormatter *first = [DDCountingFormatter new];
+    first.shareable = YES;
+    DDCountingFormatter *second = [DDCountingFormatter new];
+    second.shareable = YES;
+
+    NSArray<DDBufferLogger *> *loggers = [self addLoggers:2 withFormatter:first toLog:log];
+    [self logToLog:log context:0];
+
+    loggers[1].logFormatter = second;
+    [self logToLog:log context:0];
+    [log flushLog];
+
+    // The second message went through two different formatters, neither of them shared.
+    XCTAssertEqual(atomic_load(&first->_count), 2);
+    XCTAssertEqual(atomic_load(&second->_count), 1);
+    XCTAssertEqual(loggers[0].lines.count, 2);
+    XCTAssertEqual(loggers[1].lines.count, 2);
+}
+
+- (void)testBufferAppendStringKeepsEmbeddedNULs {
+    NSString *string = [[NSString alloc] initWithBytes:"a\0b" length:3 encoding:NSASCIIStringEncoding];
+    NSMutableData *buffer = [NSMutableData data];
+
+    TMPLogBufferAppendString(buffer, string);
+
+    XCTAssertEqualObjects(buffer, [NSData dataWithBytes:"a\0b" length:3]);
+}
+
+@end
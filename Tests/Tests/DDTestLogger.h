@@ -0,0 +1,34 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+
+#import <CocoaLumberjack/CocoaLumberjack.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * A logger collecting the messages it's given, and their output formatted with its log formatter.
+ **/
+@interface DDTestLogger : TMPAbstractLogger
+
+@property (nonatomic, readonly) NSMutableArray<TMPLogMessage *> *messages;
+@property (nonatomic, readonly) NSMutableArray<NSString *> *outputs;
+
+// Set to stall logMessage: until it's signaled
+@property (nonatomic, nullable) dispatch_semaphore_t gate;
+
+@end
+
+NS_ASSUME_NONNULL_END
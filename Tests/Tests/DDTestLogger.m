@@ -0,0 +1,42 @@
+// Software License Agreement (BSD License)
+//
+// Copyright (c) 2010-2019, Deusty, LLC
+// All rights reserved.
+//
+// Redistribution and use of this software in source and binary forms,
+// with or without modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+//
+// * Neither the name of Deusty nor the names of its contributors may be used
+//   to endorse or promote products derived from this software without specific
+//   prior written permission of Deusty, LLC.
+
+
+#import "DDTestLogger.h"
+
+@implementation DDTestLogger
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _messages = [NSMutableArray array];
+        _outputs = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)logMessage:(TMPLogMessage *)logMessage {
+    if (_gate) {
+        dispatch_semaphore_wait(_gate, DISPATCH_TIME_FOREVER);
+        dispatch_semaphore_signal(_gate);
+    }
+
+    [_messages addObject:logMessage];
+
+    NSMutableData *buffer = [NSMutableData data];
+    TMPLogFormatMessageToBuffer(_logFormatter, logMessage, buffer, NULL);
+    [_outputs addObject:[[NSString alloc] initWithData:buffer encoding:NSUTF8StringEncoding]];
+}
+
+@end